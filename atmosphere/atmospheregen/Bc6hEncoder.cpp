@@ -0,0 +1,356 @@
+#include "Bc6hEncoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Half.h"
+
+namespace
+{
+	// Largest finite half float.
+	const int kMaxHalf = 0x7bff;
+
+	// Interpolation weights of the 4 bit indices, in 64ths.
+	const int kWeights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Number of least squares refinements of the endpoints, in quality mode.
+	const int kRefinementCount = 2;
+
+	// The single region modes: mode bits, bits per endpoint component, and bits per delta (equal to the endpoint
+	// bits when the second endpoint is not delta encoded).
+	struct Mode
+	{
+		int modeBits;
+		int endpointBits;
+		int deltaBits;
+	};
+	const Mode kModes[4] = { { 0x03, 10, 10 }, { 0x07, 11, 9 }, { 0x0b, 12, 8 }, { 0x0f, 16, 4 } };
+
+	// A candidate encoding of a block.
+	struct Encoding
+	{
+		const Mode* mode;
+		int endpoints[2][3];
+		int indices[16];
+		int64_t error;
+	};
+
+	class BlockWriter
+	{
+	public:
+		explicit BlockWriter(unsigned char* block) : block_(block), position_(0)
+		{
+			memset(block_, 0, kBc6hBlockSize);
+		}
+
+		// Writes bits [first, first + count) of 'value', least significant bit first.
+		void Write(int value, int first, int count)
+		{
+			for (int i = first; i < first + count; i++, position_++)
+				block_[position_ / 8] |= ((value >> i) & 1) << (position_ % 8);
+		}
+
+		// Writes bits [first, last] of 'value', most significant bit first.
+		void WriteReversed(int value, int last, int first)
+		{
+			for (int i = last; i >= first; i--)
+				Write(value, i, 1);
+		}
+
+	private:
+		unsigned char* block_;
+		int position_;
+	};
+
+	// The BC6H decoder maps the quantized endpoints to 16 bit values, interpolates them, and scales the result by
+	// 31/64 to get the half float bits. The encoder works with the same 16 bit values.
+	int Unquantize(int value, int bits)
+	{
+		if (bits >= 15 || value == 0)
+			return value;
+		if (value == (1 << bits) - 1)
+			return 0xffff;
+		return ((value << 16) + 0x8000) >> bits;
+	}
+
+	int Quantize(float value, int bits)
+	{
+		const int quantized = static_cast<int>(value) >> (16 - bits);
+		return std::min(std::max(quantized, 0), (1 << bits) - 1);
+	}
+
+	// Encodes 'pixels' (16 half floats bits, times 3 channels) with the given mode and endpoints (in the 16 bit
+	// space of the decoder), choosing the best index for each pixel.
+	bool EncodeEndpoints(const int pixels[16][3], const Mode& mode, const float endpoints[2][3], Encoding* encoding)
+	{
+		encoding->mode = &mode;
+		const int deltaMin = -(1 << (mode.deltaBits - 1));
+		const int deltaMax = (1 << (mode.deltaBits - 1)) - 1;
+		for (int c = 0; c < 3; c++)
+		{
+			encoding->endpoints[0][c] = Quantize(endpoints[0][c], mode.endpointBits);
+			encoding->endpoints[1][c] = Quantize(endpoints[1][c], mode.endpointBits);
+			if (mode.deltaBits != mode.endpointBits)
+			{
+				const int delta = encoding->endpoints[1][c] - encoding->endpoints[0][c];
+				encoding->endpoints[1][c] = encoding->endpoints[0][c] + std::min(std::max(delta, deltaMin), deltaMax);
+			}
+		}
+
+		int palette[16][3];
+		for (int c = 0; c < 3; c++)
+		{
+			const int e0 = Unquantize(encoding->endpoints[0][c], mode.endpointBits);
+			const int e1 = Unquantize(encoding->endpoints[1][c], mode.endpointBits);
+			for (int i = 0; i < 16; i++)
+				palette[i][c] = ((((64 - kWeights[i]) * e0 + kWeights[i] * e1 + 32) >> 6) * 31) >> 6;
+		}
+
+		encoding->error = 0;
+		for (int p = 0; p < 16; p++)
+		{
+			int64_t bestError = INT64_MAX;
+			for (int i = 0; i < 16; i++)
+			{
+				int64_t error = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					const int64_t difference = palette[i][c] - pixels[p][c];
+					error += difference * difference;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					encoding->indices[p] = i;
+				}
+			}
+			encoding->error += bestError;
+		}
+
+		// The most significant bit of the first index is implicitly 0. Swap the endpoints if needed, which is only
+		// possible in delta modes if the opposite delta fits.
+		if (encoding->indices[0] >= 8)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				if (mode.deltaBits != mode.endpointBits &&
+					encoding->endpoints[0][c] - encoding->endpoints[1][c] > deltaMax)
+					return false;
+			}
+			for (int c = 0; c < 3; c++)
+				std::swap(encoding->endpoints[0][c], encoding->endpoints[1][c]);
+			for (int p = 0; p < 16; p++)
+				encoding->indices[p] = 15 - encoding->indices[p];
+		}
+		return true;
+	}
+
+	void WriteBlock(const Encoding& encoding, unsigned char* block)
+	{
+		const Mode& mode = *encoding.mode;
+		const int(&e)[2][3] = encoding.endpoints;
+		BlockWriter writer(block);
+		writer.Write(mode.modeBits, 0, 5);
+		for (int c = 0; c < 3; c++)
+			writer.Write(e[0][c], 0, 10);
+
+		const int mask = (1 << mode.deltaBits) - 1;
+		for (int c = 0; c < 3; c++)
+		{
+			const int second = mode.deltaBits == mode.endpointBits ? e[1][c] : (e[1][c] - e[0][c]) & mask;
+			writer.Write(second, 0, mode.deltaBits);
+			// The high bits of the first endpoint follow the second one, in reverse order for the 12 and 16 bit modes.
+			if (mode.endpointBits == 11)
+				writer.Write(e[0][c], 10, 1);
+			else if (mode.endpointBits > 11)
+				writer.WriteReversed(e[0][c], mode.endpointBits - 1, 10);
+		}
+
+		writer.Write(encoding.indices[0], 0, 3);
+		for (int p = 1; p < 16; p++)
+			writer.Write(encoding.indices[p], 0, 4);
+	}
+
+	// Least squares endpoints for the given indices, in the 16 bit space of the decoder.
+	bool FitEndpoints(const float targets[16][3], const int indices[16], float endpoints[2][3])
+	{
+		float a = 0.0f, b = 0.0f, c = 0.0f;
+		float x[3] = {}, y[3] = {};
+		for (int p = 0; p < 16; p++)
+		{
+			const float t = kWeights[indices[p]] / 64.0f;
+			a += (1.0f - t) * (1.0f - t);
+			b += (1.0f - t) * t;
+			c += t * t;
+			for (int k = 0; k < 3; k++)
+			{
+				x[k] += (1.0f - t) * targets[p][k];
+				y[k] += t * targets[p][k];
+			}
+		}
+		const float determinant = a * c - b * b;
+		if (std::abs(determinant) < 1e-6f)
+			return false;
+		for (int k = 0; k < 3; k++)
+		{
+			endpoints[0][k] = std::min(std::max((c * x[k] - b * y[k]) / determinant, 0.0f), 65535.0f);
+			endpoints[1][k] = std::min(std::max((a * y[k] - b * x[k]) / determinant, 0.0f), 65535.0f);
+		}
+		return true;
+	}
+
+	void EncodeBlock(const int pixels[16][3], bool quality, unsigned char* block)
+	{
+		// Pixel values in the 16 bit space of the decoder.
+		float targets[16][3];
+		float mean[3] = {};
+		float minimum[3] = { 65535.0f, 65535.0f, 65535.0f };
+		float maximum[3] = {};
+		for (int p = 0; p < 16; p++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				targets[p][c] = pixels[p][c] * 64.0f / 31.0f;
+				mean[c] += targets[p][c] / 16.0f;
+				minimum[c] = std::min(minimum[c], targets[p][c]);
+				maximum[c] = std::max(maximum[c], targets[p][c]);
+			}
+		}
+
+		float endpoints[2][3];
+		if (!quality)
+		{
+			// Diagonal of the bounding box, oriented with the covariances of each channel with the widest one.
+			int widest = 0;
+			for (int c = 1; c < 3; c++)
+			{
+				if (maximum[c] - minimum[c] > maximum[widest] - minimum[widest])
+					widest = c;
+			}
+			for (int c = 0; c < 3; c++)
+			{
+				float covariance = 0.0f;
+				for (int p = 0; p < 16; p++)
+					covariance += (targets[p][c] - mean[c]) * (targets[p][widest] - mean[widest]);
+				endpoints[0][c] = covariance >= 0.0f ? minimum[c] : maximum[c];
+				endpoints[1][c] = covariance >= 0.0f ? maximum[c] : minimum[c];
+			}
+		}
+		else
+		{
+			// Principal axis, by power iteration on the covariance matrix, and extent of the projections on it.
+			float covariance[3][3] = {};
+			for (int p = 0; p < 16; p++)
+			{
+				for (int i = 0; i < 3; i++)
+				{
+					for (int j = 0; j < 3; j++)
+						covariance[i][j] += (targets[p][i] - mean[i]) * (targets[p][j] - mean[j]);
+				}
+			}
+			float axis[3] = { 1.0f, 1.0f, 1.0f };
+			for (int iteration = 0; iteration < 8; iteration++)
+			{
+				float next[3];
+				float length = 0.0f;
+				for (int i = 0; i < 3; i++)
+				{
+					next[i] = covariance[i][0] * axis[0] + covariance[i][1] * axis[1] + covariance[i][2] * axis[2];
+					length = std::max(length, std::abs(next[i]));
+				}
+				if (length == 0.0f)
+					break;
+				for (int i = 0; i < 3; i++)
+					axis[i] = next[i] / length;
+			}
+			const float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+			float minProjection = 0.0f;
+			float maxProjection = 0.0f;
+			for (int p = 0; p < 16; p++)
+			{
+				float projection = 0.0f;
+				for (int c = 0; c < 3; c++)
+					projection += (targets[p][c] - mean[c]) * axis[c] / axisLength;
+				minProjection = std::min(minProjection, projection);
+				maxProjection = std::max(maxProjection, projection);
+			}
+			for (int c = 0; c < 3; c++)
+			{
+				endpoints[0][c] = std::min(std::max(mean[c] + minProjection * axis[c] / axisLength, 0.0f), 65535.0f);
+				endpoints[1][c] = std::min(std::max(mean[c] + maxProjection * axis[c] / axisLength, 0.0f), 65535.0f);
+			}
+		}
+
+		Encoding best;
+		best.error = INT64_MAX;
+		const int modeCount = quality ? 4 : 1;
+		for (int iteration = 0; iteration <= (quality ? kRefinementCount : 0); iteration++)
+		{
+			Encoding candidate;
+			for (int m = 0; m < modeCount; m++)
+			{
+				if (EncodeEndpoints(pixels, kModes[m], endpoints, &candidate) && candidate.error < best.error)
+					best = candidate;
+			}
+			if (best.error == 0 || !FitEndpoints(targets, best.indices, endpoints))
+				break;
+		}
+		if (best.error == INT64_MAX)
+		{
+			// Only possible if no delta mode fits, which can't happen with the raw 10 bit mode.
+			EncodeEndpoints(pixels, kModes[0], endpoints, &best);
+		}
+		WriteBlock(best, block);
+	}
+}
+
+int GetBc6hImageSize(int width, int height)
+{
+	return ((width + 3) / 4) * ((height + 3) / 4) * kBc6hBlockSize;
+}
+
+void EncodeBc6h(const float* pixels, int width, int height, int channelCount, bool quality,
+	unsigned char* blocks, int threadCount /*= 0*/)
+{
+	const int blocksX = (width + 3) / 4;
+	const int blocksY = (height + 3) / 4;
+
+	if (threadCount <= 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, blocksY);
+	std::atomic<int> nextRow(0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < threadCount; i++)
+	{
+		threads.emplace_back([&]()
+		{
+			for (int by = nextRow++; by < blocksY; by = nextRow++)
+			{
+				for (int bx = 0; bx < blocksX; bx++)
+				{
+					int blockPixels[16][3];
+					for (int p = 0; p < 16; p++)
+					{
+						const int x = std::min(4 * bx + p % 4, width - 1);
+						const int y = std::min(4 * by + p / 4, height - 1);
+						const float* pixel = pixels + (static_cast<size_t>(y) * width + x) * channelCount;
+						for (int c = 0; c < 3; c++)
+						{
+							// NaNs fail the comparison and are clamped to 0 too.
+							const float value = pixel[c] > 0.0f ? pixel[c] : 0.0f;
+							blockPixels[p][c] = std::min(static_cast<int>(FloatToHalf(value)), kMaxHalf);
+						}
+					}
+					EncodeBlock(blockPixels, quality, blocks + (static_cast<size_t>(by) * blocksX + bx) * kBc6hBlockSize);
+				}
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+}
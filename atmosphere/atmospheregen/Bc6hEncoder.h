@@ -0,0 +1,18 @@
+#pragma once
+
+// Size of a BC6H block, which encodes 4x4 pixels.
+const int kBc6hBlockSize = 16;
+
+// Returns the size in bytes of a width x height image compressed to BC6H.
+extern int GetBc6hImageSize(int width, int height);
+
+// Compresses a width x height image to BC6H_UF16 (unsigned half floats), row by row. 'pixels' contains 'channelCount'
+// interleaved floats per pixel, of which only the first 3 (RGB) are encoded; negative values are clamped to 0. Images
+// whose size is not a multiple of 4 are padded by repeating their last row and column.
+//
+// The fast mode only uses the single region mode with 10 bit endpoints, taken at the corners of the bounding box of
+// each block. The quality mode fits the endpoints along the principal axis of each block, refines them by least
+// squares, and also tries the single region modes with delta encoded endpoints of 11, 12 and 16 bits, which are more
+// precise for the smooth gradients of skies. The blocks are encoded on 'threadCount' threads (0 means one per core).
+extern void EncodeBc6h(const float* pixels, int width, int height, int channelCount, bool quality,
+	unsigned char* blocks, int threadCount = 0);
@@ -0,0 +1,545 @@
+#include "ExrWriter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Half.h"
+
+namespace
+{
+	// Number of scanlines per block, for the ZIP compression.
+	const int kLinesPerBlock = 16;
+
+	// Maximum number of previous positions tried for each LZ77 match.
+	const int kMaxMatchChain = 32;
+	const int kWindowSize = 32768;
+	const int kHashBits = 15;
+	const int kMinMatch = 3;
+	const int kMaxMatch = 258;
+
+	// Deflate length and distance codes (RFC 1951, section 3.2.5).
+	const int kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99,
+		115, 131, 163, 195, 227, 258 };
+	const int kLengthExtraBits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5,
+		5, 0 };
+	const int kDistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025,
+		1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const int kDistanceExtraBits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11,
+		11, 12, 12, 13, 13 };
+	// Order in which the code length code lengths are stored (RFC 1951, section 3.2.7).
+	const int kCodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	const int kEndOfBlock = 256;
+	const int kLiteralLengthCodes = 286;
+	const int kDistanceCodes = 30;
+	const int kCodeLengthCodes = 19;
+
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(std::vector<unsigned char>& output) : output_(output), bits_(0), count_(0) {}
+
+		// Writes the 'length' low bits of 'value', least significant bit first.
+		void Write(uint32_t value, int length)
+		{
+			bits_ |= static_cast<uint64_t>(value) << count_;
+			count_ += length;
+			while (count_ >= 8)
+			{
+				output_.push_back(static_cast<unsigned char>(bits_));
+				bits_ >>= 8;
+				count_ -= 8;
+			}
+		}
+
+		// Writes a Huffman code, which is packed most significant bit first.
+		void WriteCode(uint32_t code, int length)
+		{
+			uint32_t reversed = 0;
+			for (int i = 0; i < length; i++)
+				reversed |= ((code >> i) & 1) << (length - 1 - i);
+			Write(reversed, length);
+		}
+
+		void Flush()
+		{
+			if (count_ > 0)
+				output_.push_back(static_cast<unsigned char>(bits_));
+			bits_ = 0;
+			count_ = 0;
+		}
+
+	private:
+		std::vector<unsigned char>& output_;
+		uint64_t bits_;
+		int count_;
+	};
+
+	// A literal byte (distance 0) or a match of 'value' bytes at 'distance' bytes back.
+	struct Symbol
+	{
+		uint16_t value;
+		uint16_t distance;
+	};
+
+	int GetLengthCode(int length)
+	{
+		int code = 28;
+		while (kLengthBase[code] > length)
+			code--;
+		return code;
+	}
+
+	int GetDistanceCode(int distance)
+	{
+		int code = 29;
+		while (kDistanceBase[code] > distance)
+			code--;
+		return code;
+	}
+
+	// Greedy LZ77 parsing, with hash chains.
+	void FindMatches(const unsigned char* data, int size, std::vector<Symbol>& symbols)
+	{
+		std::vector<int> head(1 << kHashBits, -1);
+		std::vector<int> previous(size, -1);
+		auto hash = [data](int i)
+		{
+			return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << kHashBits) - 1);
+		};
+		auto insert = [&](int i)
+		{
+			if (i + kMinMatch <= size)
+			{
+				const int h = hash(i);
+				previous[i] = head[h];
+				head[h] = i;
+			}
+		};
+
+		int i = 0;
+		while (i < size)
+		{
+			int bestLength = 0;
+			int bestDistance = 0;
+			if (i + kMinMatch <= size)
+			{
+				const int maxLength = std::min(kMaxMatch, size - i);
+				int candidate = head[hash(i)];
+				for (int chain = 0; candidate >= 0 && i - candidate <= kWindowSize && chain < kMaxMatchChain; chain++)
+				{
+					int length = 0;
+					while (length < maxLength && data[candidate + length] == data[i + length])
+						length++;
+					if (length > bestLength)
+					{
+						bestLength = length;
+						bestDistance = i - candidate;
+						if (length == maxLength)
+							break;
+					}
+					candidate = previous[candidate];
+				}
+			}
+
+			if (bestLength >= kMinMatch)
+			{
+				symbols.push_back({ static_cast<uint16_t>(bestLength), static_cast<uint16_t>(bestDistance) });
+				for (int j = 0; j < bestLength; j++)
+					insert(i + j);
+				i += bestLength;
+			}
+			else
+			{
+				symbols.push_back({ data[i], 0 });
+				insert(i);
+				i++;
+			}
+		}
+	}
+
+	// Computes Huffman code lengths of at most 'maxLength' bits for the given symbol frequencies. At least two symbols
+	// get a code, so that the code is always complete. Frequencies are halved until the longest code fits.
+	std::vector<int> GetCodeLengths(std::vector<uint32_t> frequencies, int maxLength)
+	{
+		const int count = static_cast<int>(frequencies.size());
+		int used = 0;
+		for (int i = 0; i < count; i++)
+			used += frequencies[i] > 0 ? 1 : 0;
+		for (int i = 0; used < 2 && i < count; i++)
+		{
+			if (frequencies[i] == 0)
+			{
+				frequencies[i] = 1;
+				used++;
+			}
+		}
+
+		std::vector<int> lengths(count, 0);
+		while (true)
+		{
+			typedef std::pair<uint64_t, int> Node;
+			std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+			std::vector<int> parent(2 * count, -1);
+			for (int i = 0; i < count; i++)
+			{
+				if (frequencies[i] > 0)
+					queue.push(Node(frequencies[i], i));
+			}
+			int next = count;
+			while (queue.size() > 1)
+			{
+				Node a = queue.top();
+				queue.pop();
+				Node b = queue.top();
+				queue.pop();
+				parent[a.second] = next;
+				parent[b.second] = next;
+				queue.push(Node(a.first + b.first, next++));
+			}
+
+			int longest = 0;
+			for (int i = 0; i < count; i++)
+			{
+				lengths[i] = 0;
+				if (frequencies[i] == 0)
+					continue;
+				for (int node = i; parent[node] >= 0; node = parent[node])
+					lengths[i]++;
+				longest = std::max(longest, lengths[i]);
+			}
+			if (longest <= maxLength)
+				return lengths;
+
+			for (int i = 0; i < count; i++)
+			{
+				if (frequencies[i] > 0)
+					frequencies[i] = (frequencies[i] >> 1) | 1;
+			}
+		}
+	}
+
+	// Canonical Huffman codes for the given code lengths (RFC 1951, section 3.2.2).
+	std::vector<uint32_t> GetCodes(const std::vector<int>& lengths)
+	{
+		int lengthCounts[16] = {};
+		for (int length : lengths)
+			lengthCounts[length]++;
+		lengthCounts[0] = 0;
+
+		uint32_t nextCode[16] = {};
+		uint32_t code = 0;
+		for (int bits = 1; bits < 16; bits++)
+		{
+			code = (code + lengthCounts[bits - 1]) << 1;
+			nextCode[bits] = code;
+		}
+
+		std::vector<uint32_t> codes(lengths.size(), 0);
+		for (size_t i = 0; i < lengths.size(); i++)
+		{
+			if (lengths[i] != 0)
+				codes[i] = nextCode[lengths[i]]++;
+		}
+		return codes;
+	}
+
+	// Compresses 'data' to a zlib stream, made of a single deflate block with dynamic Huffman codes.
+	void Compress(const unsigned char* data, int size, std::vector<unsigned char>& output)
+	{
+		std::vector<Symbol> symbols;
+		FindMatches(data, size, symbols);
+
+		std::vector<uint32_t> literalFrequencies(kLiteralLengthCodes, 0);
+		std::vector<uint32_t> distanceFrequencies(kDistanceCodes, 0);
+		for (const Symbol& symbol : symbols)
+		{
+			if (symbol.distance == 0)
+			{
+				literalFrequencies[symbol.value]++;
+			}
+			else
+			{
+				literalFrequencies[257 + GetLengthCode(symbol.value)]++;
+				distanceFrequencies[GetDistanceCode(symbol.distance)]++;
+			}
+		}
+		literalFrequencies[kEndOfBlock]++;
+
+		const std::vector<int> literalLengths = GetCodeLengths(literalFrequencies, 15);
+		const std::vector<int> distanceLengths = GetCodeLengths(distanceFrequencies, 15);
+		const std::vector<uint32_t> literalCodes = GetCodes(literalLengths);
+		const std::vector<uint32_t> distanceCodes = GetCodes(distanceLengths);
+
+		int literalCount = kLiteralLengthCodes;
+		while (literalCount > 257 && literalLengths[literalCount - 1] == 0)
+			literalCount--;
+		int distanceCount = kDistanceCodes;
+		while (distanceCount > 1 && distanceLengths[distanceCount - 1] == 0)
+			distanceCount--;
+
+		// Run length encoding of the code lengths, with the 16 (repeat the previous length 3-6 times), 17 (repeat
+		// zero 3-10 times) and 18 (repeat zero 11-138 times) codes. Each entry is a code and its extra bits value.
+		std::vector<int> allLengths(literalLengths.begin(), literalLengths.begin() + literalCount);
+		allLengths.insert(allLengths.end(), distanceLengths.begin(), distanceLengths.begin() + distanceCount);
+		std::vector<std::pair<int, int>> lengthSymbols;
+		for (size_t i = 0; i < allLengths.size();)
+		{
+			const int length = allLengths[i];
+			int run = 1;
+			while (i + run < allLengths.size() && allLengths[i + run] == length)
+				run++;
+			i += run;
+
+			if (length == 0)
+			{
+				while (run >= 11)
+				{
+					const int repeat = std::min(run, 138);
+					lengthSymbols.push_back(std::make_pair(18, repeat - 11));
+					run -= repeat;
+				}
+				if (run >= 3)
+				{
+					lengthSymbols.push_back(std::make_pair(17, run - 3));
+					run = 0;
+				}
+			}
+			else
+			{
+				lengthSymbols.push_back(std::make_pair(length, 0));
+				run--;
+				while (run >= 3)
+				{
+					const int repeat = std::min(run, 6);
+					lengthSymbols.push_back(std::make_pair(16, repeat - 3));
+					run -= repeat;
+				}
+			}
+			for (; run > 0; run--)
+				lengthSymbols.push_back(std::make_pair(length, 0));
+		}
+
+		std::vector<uint32_t> codeLengthFrequencies(kCodeLengthCodes, 0);
+		for (const std::pair<int, int>& symbol : lengthSymbols)
+			codeLengthFrequencies[symbol.first]++;
+		const std::vector<int> codeLengthLengths = GetCodeLengths(codeLengthFrequencies, 7);
+		const std::vector<uint32_t> codeLengthCodes = GetCodes(codeLengthLengths);
+		int codeLengthCount = kCodeLengthCodes;
+		while (codeLengthCount > 4 && codeLengthLengths[kCodeLengthOrder[codeLengthCount - 1]] == 0)
+			codeLengthCount--;
+
+		// zlib header: deflate with a 32K window, default compression level.
+		output.push_back(0x78);
+		output.push_back(0x9C);
+
+		BitWriter writer(output);
+		writer.Write(1, 1); // Final block
+		writer.Write(2, 2); // Dynamic Huffman codes
+		writer.Write(literalCount - 257, 5);
+		writer.Write(distanceCount - 1, 5);
+		writer.Write(codeLengthCount - 4, 4);
+		for (int i = 0; i < codeLengthCount; i++)
+			writer.Write(codeLengthLengths[kCodeLengthOrder[i]], 3);
+		for (const std::pair<int, int>& symbol : lengthSymbols)
+		{
+			writer.WriteCode(codeLengthCodes[symbol.first], codeLengthLengths[symbol.first]);
+			if (symbol.first == 16)
+				writer.Write(symbol.second, 2);
+			else if (symbol.first == 17)
+				writer.Write(symbol.second, 3);
+			else if (symbol.first == 18)
+				writer.Write(symbol.second, 7);
+		}
+
+		for (const Symbol& symbol : symbols)
+		{
+			if (symbol.distance == 0)
+			{
+				writer.WriteCode(literalCodes[symbol.value], literalLengths[symbol.value]);
+				continue;
+			}
+			const int lengthCode = GetLengthCode(symbol.value);
+			writer.WriteCode(literalCodes[257 + lengthCode], literalLengths[257 + lengthCode]);
+			writer.Write(symbol.value - kLengthBase[lengthCode], kLengthExtraBits[lengthCode]);
+			const int distanceCode = GetDistanceCode(symbol.distance);
+			writer.WriteCode(distanceCodes[distanceCode], distanceLengths[distanceCode]);
+			writer.Write(symbol.distance - kDistanceBase[distanceCode], kDistanceExtraBits[distanceCode]);
+		}
+		writer.WriteCode(literalCodes[kEndOfBlock], literalLengths[kEndOfBlock]);
+		writer.Flush();
+
+		// Adler-32 checksum of the uncompressed data, most significant byte first.
+		uint32_t a = 1;
+		uint32_t b = 0;
+		for (int i = 0; i < size; i++)
+		{
+			a = (a + data[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		const uint32_t adler = (b << 16) | a;
+		for (int shift = 24; shift >= 0; shift -= 8)
+			output.push_back(static_cast<unsigned char>(adler >> shift));
+	}
+
+	// Encodes the given scanlines in the EXR layout (for each line, each channel in alphabetical order), and compresses
+	// them like the OpenEXR ZIP compressor: the bytes are split in two halves (even and odd bytes), delta encoded, and
+	// deflated. Blocks which don't compress are stored as is, as expected by the readers.
+	void EncodeBlock(int firstLine, int lineCount, int width, int channelCount, bool halfPrecision,
+		const std::function<void(int, float*)>& getRow, std::vector<unsigned char>& output)
+	{
+		// Channels are sorted by name: A, B, G, R.
+		const int kRgbaOrder[4] = { 3, 2, 1, 0 };
+		const int kRgbOrder[3] = { 2, 1, 0 };
+		const int* channelOrder = channelCount == 4 ? kRgbaOrder : kRgbOrder;
+		const int sampleSize = halfPrecision ? 2 : 4;
+
+		std::vector<float> row(width * channelCount);
+		std::vector<unsigned char> raw(lineCount * width * channelCount * sampleSize);
+		unsigned char* out = raw.data();
+		for (int line = 0; line < lineCount; line++)
+		{
+			getRow(firstLine + line, row.data());
+			for (int c = 0; c < channelCount; c++)
+			{
+				const int channel = channelOrder[c];
+				for (int x = 0; x < width; x++)
+				{
+					const float value = row[x * channelCount + channel];
+					if (halfPrecision)
+					{
+						const uint16_t half = FloatToHalf(value);
+						memcpy(out, &half, sizeof(half));
+					}
+					else
+					{
+						memcpy(out, &value, sizeof(value));
+					}
+					out += sampleSize;
+				}
+			}
+		}
+
+		const int size = static_cast<int>(raw.size());
+		std::vector<unsigned char> split(size);
+		for (int i = 0, t1 = 0, t2 = (size + 1) / 2; i < size; i++)
+		{
+			if (i % 2 == 0)
+				split[t1++] = raw[i];
+			else
+				split[t2++] = raw[i];
+		}
+		for (int i = size - 1; i > 0; i--)
+			split[i] = static_cast<unsigned char>(split[i] - split[i - 1] + 128);
+
+		Compress(split.data(), size, output);
+		if (static_cast<int>(output.size()) >= size)
+			output = raw;
+	}
+
+	void WriteInt(std::ofstream& file, int32_t value)
+	{
+		file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	void WriteAttribute(std::ofstream& file, const char* name, const char* type, int size)
+	{
+		file.write(name, strlen(name) + 1);
+		file.write(type, strlen(type) + 1);
+		WriteInt(file, size);
+	}
+}
+
+bool WriteExr(const char* path, int width, int height, int channelCount, bool halfPrecision,
+	const std::function<void(int, float*)>& getRow, int threadCount /*= 0*/)
+{
+	const int blockCount = (height + kLinesPerBlock - 1) / kLinesPerBlock;
+	std::vector<std::vector<unsigned char>> blocks(blockCount);
+
+	if (threadCount <= 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, blockCount);
+	std::atomic<int> nextBlock(0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < threadCount; i++)
+	{
+		threads.emplace_back([&]()
+		{
+			for (int block = nextBlock++; block < blockCount; block = nextBlock++)
+			{
+				const int firstLine = block * kLinesPerBlock;
+				EncodeBlock(firstLine, std::min(kLinesPerBlock, height - firstLine), width, channelCount, halfPrecision,
+					getRow, blocks[block]);
+			}
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	// Magic number and version 2 (single part scanline file).
+	const unsigned char kHeader[8] = { 0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0 };
+	file.write(reinterpret_cast<const char*>(kHeader), sizeof(kHeader));
+
+	const char* channelNames = channelCount == 4 ? "ABGR" : "BGR";
+	WriteAttribute(file, "channels", "chlist", channelCount * 18 + 1);
+	for (int i = 0; i < channelCount; i++)
+	{
+		const char name[2] = { channelNames[i], 0 };
+		file.write(name, 2);
+		WriteInt(file, halfPrecision ? 1 : 2); // Pixel type: HALF or FLOAT
+		const char kLinearAndReserved[4] = { 0, 0, 0, 0 };
+		file.write(kLinearAndReserved, 4);
+		WriteInt(file, 1); // x sampling
+		WriteInt(file, 1); // y sampling
+	}
+	file.put(0);
+
+	WriteAttribute(file, "compression", "compression", 1);
+	file.put(3); // ZIP_COMPRESSION
+	for (const char* window : { "dataWindow", "displayWindow" })
+	{
+		WriteAttribute(file, window, "box2i", 16);
+		WriteInt(file, 0);
+		WriteInt(file, 0);
+		WriteInt(file, width - 1);
+		WriteInt(file, height - 1);
+	}
+	WriteAttribute(file, "lineOrder", "lineOrder", 1);
+	file.put(0); // INCREASING_Y
+	const float kOne = 1.0f;
+	const float kZero = 0.0f;
+	WriteAttribute(file, "pixelAspectRatio", "float", 4);
+	file.write(reinterpret_cast<const char*>(&kOne), 4);
+	WriteAttribute(file, "screenWindowCenter", "v2f", 8);
+	file.write(reinterpret_cast<const char*>(&kZero), 4);
+	file.write(reinterpret_cast<const char*>(&kZero), 4);
+	WriteAttribute(file, "screenWindowWidth", "float", 4);
+	file.write(reinterpret_cast<const char*>(&kOne), 4);
+	file.put(0); // End of header
+
+	// Offset table, followed by the blocks (line number, data size, data).
+	uint64_t offset = static_cast<uint64_t>(file.tellp()) + blockCount * sizeof(uint64_t);
+	for (int i = 0; i < blockCount; i++)
+	{
+		file.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+		offset += 8 + blocks[i].size();
+	}
+	for (int i = 0; i < blockCount; i++)
+	{
+		WriteInt(file, i * kLinesPerBlock);
+		WriteInt(file, static_cast<int32_t>(blocks[i].size()));
+		file.write(reinterpret_cast<const char*>(blocks[i].data()), blocks[i].size());
+	}
+	return static_cast<bool>(file);
+}
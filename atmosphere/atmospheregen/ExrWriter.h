@@ -0,0 +1,13 @@
+#pragma once
+
+#include <functional>
+
+// Writes a single part, scanline OpenEXR file with ZIP compression (blocks of 16 scanlines, each deflate compressed
+// independently). The deflate encoder is built in, so this does not depend on zlib or on the OpenEXR libraries.
+//
+// getRow(y, pixels) must write row y of the image (top row first) to 'pixels', as 'channelCount' (3 for RGB, 4 for
+// RGBA) interleaved 32 bit floats per pixel. The blocks are gathered and compressed in parallel, on 'threadCount'
+// threads (0 means one per core), so getRow is called from several threads at once. With halfPrecision, the pixels are
+// stored as 16 bit floats. Returns false if the file could not be written.
+extern bool WriteExr(const char* path, int width, int height, int channelCount, bool halfPrecision,
+	const std::function<void(int, float*)>& getRow, int threadCount = 0);
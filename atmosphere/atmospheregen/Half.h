@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Rounds to the nearest 16 bit float, with ties to even.
+inline uint16_t FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const int floatExponent = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (floatExponent == 0xff)
+		return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0)); // Infinity or NaN
+	const int exponent = floatExponent - 127 + 15;
+	if (exponent >= 31)
+		return static_cast<uint16_t>(sign | 0x7c00); // Overflow
+	if (exponent <= 0)
+	{
+		// Denormal (or zero) half.
+		if (exponent < -10)
+			return static_cast<uint16_t>(sign);
+		mantissa |= 0x800000;
+		const int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1)))
+			half++;
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	// A carry out of the mantissa correctly increments the exponent (up to infinity).
+	uint32_t half = (exponent << 10) | (mantissa >> 13);
+	const uint32_t remainder = mantissa & 0x1fff;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+		half++;
+	return static_cast<uint16_t>(sign | half);
+}
@@ -0,0 +1,110 @@
+#include "SphericalHarmonics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	constexpr double kPi = 3.14159265358979323846;
+
+	// Sums of the projected radiance, and of the solid angles, over a range of cubemap rows.
+	struct PartialSum
+	{
+		double coefficients[kSH9CoefficientCount][3];
+		double solidAngle;
+	};
+
+	void AccumulateRows(const float* pixels, int resolution, const float faceToWorld[6][9], int firstRow, int endRow,
+		PartialSum* sum)
+	{
+		std::fill(&sum->coefficients[0][0], &sum->coefficients[0][0] + kSH9CoefficientCount * 3, 0.0);
+		sum->solidAngle = 0.0;
+
+		const double texelSize = 2.0 / resolution;
+		// Rows are numbered across the 6 faces, so that threads get the same amount of work.
+		for (int row = firstRow; row < endRow; row++)
+		{
+			const int face = row / resolution;
+			const float* m = faceToWorld[face];
+			const double v = (row % resolution + 0.5) * texelSize - 1.0;
+			const float* pixel = pixels + static_cast<size_t>(row) * resolution * 3;
+
+			// Kept branch free, so that the compiler can vectorize it.
+			for (int s = 0; s < resolution; s++)
+			{
+				const double u = (s + 0.5) * texelSize - 1.0;
+				const double lengthSquared = u * u + v * v + 1.0;
+				const double invLength = 1.0 / std::sqrt(lengthSquared);
+				const double solidAngle = texelSize * texelSize * invLength / lengthSquared;
+				const double x = (m[0] * u + m[1] * v - m[2]) * invLength;
+				const double y = (m[3] * u + m[4] * v - m[5]) * invLength;
+				const double z = (m[6] * u + m[7] * v - m[8]) * invLength;
+
+				const double basis[kSH9CoefficientCount] = {
+					0.282095,
+					0.488603 * y,
+					0.488603 * z,
+					0.488603 * x,
+					1.092548 * x * y,
+					1.092548 * y * z,
+					0.315392 * (3.0 * z * z - 1.0),
+					1.092548 * x * z,
+					0.546274 * (x * x - y * y)
+				};
+				for (int i = 0; i < kSH9CoefficientCount; i++)
+				{
+					const double weight = basis[i] * solidAngle;
+					sum->coefficients[i][0] += pixel[3 * s] * weight;
+					sum->coefficients[i][1] += pixel[3 * s + 1] * weight;
+					sum->coefficients[i][2] += pixel[3 * s + 2] * weight;
+				}
+				sum->solidAngle += solidAngle;
+			}
+		}
+	}
+}
+
+void ComputeIrradianceSH9(const float* pixels, int resolution, const float faceToWorld[6][9],
+	float coefficients[kSH9CoefficientCount][3], int threadCount /*= 0*/)
+{
+	const int rowCount = 6 * resolution;
+	if (threadCount <= 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, rowCount);
+
+	std::vector<PartialSum> sums(threadCount);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < threadCount; i++)
+	{
+		const int firstRow = rowCount * i / threadCount;
+		const int endRow = rowCount * (i + 1) / threadCount;
+		threads.emplace_back(AccumulateRows, pixels, resolution, faceToWorld, firstRow, endRow, &sums[i]);
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	// The partial sums are added in a fixed order, and the sum of the texel solid angles (which is only approximately
+	// 4 pi) is normalized to 4 pi.
+	PartialSum total = {};
+	for (const PartialSum& sum : sums)
+	{
+		for (int i = 0; i < kSH9CoefficientCount; i++)
+		{
+			for (int c = 0; c < 3; c++)
+				total.coefficients[i][c] += sum.coefficients[i][c];
+		}
+		total.solidAngle += sum.solidAngle;
+	}
+
+	// Clamped cosine convolution factors, for bands 0, 1 and 2.
+	const double kBandFactors[3] = { kPi, 2.0 * kPi / 3.0, kPi / 4.0 };
+	const int kBands[kSH9CoefficientCount] = { 0, 1, 1, 1, 2, 2, 2, 2, 2 };
+	const double normalization = 4.0 * kPi / total.solidAngle;
+	for (int i = 0; i < kSH9CoefficientCount; i++)
+	{
+		for (int c = 0; c < 3; c++)
+			coefficients[i][c] = static_cast<float>(total.coefficients[i][c] * normalization * kBandFactors[kBands[i]]);
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// Number of coefficients of an order 2 (3 bands) spherical harmonics expansion.
+const int kSH9CoefficientCount = 9;
+
+// Projects the radiance of a cubemap on the first 9 real spherical harmonics, and convolves the result with a clamped
+// cosine lobe (Ramamoorthi and Hanrahan, "An Efficient Representation for Irradiance Environment Maps"). The
+// irradiance for a surface normal n is then sum_i coefficients[i] * Y_i(n), with Y_i in the usual order: Y00, Y1-1
+// (y), Y10 (z), Y11 (x), Y2-2 (xy), Y2-1 (yz), Y20 (3z^2-1), Y21 (xz), Y22 (x^2-y^2).
+//
+// 'pixels' contains the 6 faces of the cubemap as RGB floats, in GL face order, each with 'resolution' rows of
+// 'resolution' pixels (i.e. the layout produced by ReadTexture). The direction of pixel (s, t) of face i is
+// faceToWorld[i] * (u, v, -1), where u and v are the coordinates of the pixel center in [-1, 1] and faceToWorld[i] is
+// a row major 3x3 matrix. The rows of the faces are split between 'threadCount' threads (0 means one per core).
+extern void ComputeIrradianceSH9(const float* pixels, int resolution, const float faceToWorld[6][9],
+	float coefficients[kSH9CoefficientCount][3], int threadCount = 0);
@@ -4,78 +4,117 @@
 #include <GL/glut.h>
 #include "tiffio.h"
 
+#include "Bc6hEncoder.h"
+#include "ExrWriter.h"
 #include "TextureSaver.h"
 
-//#include "ImfHeader.h"
-//#include "ImfOutputFile.h"
-//#include "ImfFrameBuffer.h"
-//#include "ImfChannelList.h"
-//#include "ImfPixelType.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
 
 namespace SaveFormat
 {
 	enum Type
 	{
 		TIF,
-		EXR
+		EXR_HALF,
+		EXR_FLOAT
 	};
 }
 
-void SaveTexture(const char* path, unsigned int texture, int textureType, bool alpha, int width, int height, int depth, SaveFormat::Type format)
-{
-	const bool halfPrecision = false; // Hard coded switch between half and full precision floats.
+// Textures are always read back as 32 bit floats. The precision of EXR files is chosen when they are written.
+const int channelSize = sizeof(float);
 
+int GetTextureBufferSize(int textureType, bool alpha, int width, int height, int depth)
+{
 	if (textureType != GL_TEXTURE_3D)
 		depth = 1;
 
 	int sampleperpixel = alpha ? 4 : 3; // RGBA
-	int channelSize = halfPrecision ? 2 : 4; // 16 or 32 bit floating point
-	int pixelSize = channelSize * sampleperpixel;
-	int panelSize = height * width * pixelSize;
-	int bufferSize = panelSize * depth;
+	int bufferSize = height * width * channelSize * sampleperpixel * depth;
 
 	if (textureType == GL_TEXTURE_CUBE_MAP)
 		bufferSize *= 6;
 
-	byte* pixelbuffer = new byte[bufferSize];
-	byte* tempbuffer = new byte[bufferSize];
+	return bufferSize;
+}
+
+void ReadTexture(unsigned int texture, int textureType, bool alpha, int width, int height, int depth, void* pixels, int level /*= 0*/)
+{
+	byte* pixelbuffer = (byte*)pixels;
+	int panelSize = GetTextureBufferSize(GL_TEXTURE_2D, alpha, width, height);
 
 	glBindTexture(textureType, texture);
 
 	GLenum glFormat = alpha ? GL_RGBA : GL_RGB;
-	GLenum glPixelDepth = halfPrecision ? GL_HALF_FLOAT : GL_FLOAT;
+	GLenum glPixelDepth = GL_FLOAT;
 
 	if (textureType == GL_TEXTURE_CUBE_MAP)
 	{
 		for (int i = 0; i < 6; i++)
-			glGetTexImage(GL_TEXTURE_BINDING_CUBE_MAP + 1 + i, 0, glFormat, glPixelDepth, pixelbuffer + panelSize * i);
+			glGetTexImage(GL_TEXTURE_BINDING_CUBE_MAP + 1 + i, level, glFormat, glPixelDepth, pixelbuffer + panelSize * i);
 	}
 	else
 	{
-		glGetTexImage(textureType, 0, glFormat, glPixelDepth, pixelbuffer);
+		glGetTexImage(textureType, level, glFormat, glPixelDepth, pixelbuffer);
 	}
+}
 
-	// Reorder buffer to save out 3d texture to tif (from tiling vertically, to tiling horizontally)
-	if (textureType == GL_TEXTURE_3D)
-	{
-		memcpy(tempbuffer, pixelbuffer, bufferSize);
+// Target size of the TIFF strips. Rows are gathered from the read back buffer into one strip at a time, so this
+// bounds the memory used for writing, whatever the size of the texture.
+const int kStripBytes = 256 * 1024;
 
-		int srcLineSize = width * pixelSize;
-		int destLineSize = width * depth * pixelSize;
-		int panelWidth = width * pixelSize;
+// Layout of the cube faces in the cross written to files, as 4 bands of 3 faces. -1 is a blank face.
+const int kCubeCrossFaces[4][3] =
+{
+	{ -1, GL_TEXTURE_CUBE_MAP_POSITIVE_Y - GL_TEXTURE_CUBE_MAP_POSITIVE_X, -1 },
+	{ GL_TEXTURE_CUBE_MAP_NEGATIVE_X - GL_TEXTURE_CUBE_MAP_POSITIVE_X, GL_TEXTURE_CUBE_MAP_POSITIVE_Z - GL_TEXTURE_CUBE_MAP_POSITIVE_X, GL_TEXTURE_CUBE_MAP_POSITIVE_X - GL_TEXTURE_CUBE_MAP_POSITIVE_X },
+	{ -1, GL_TEXTURE_CUBE_MAP_NEGATIVE_Y - GL_TEXTURE_CUBE_MAP_POSITIVE_X, -1 },
+	{ -1, GL_TEXTURE_CUBE_MAP_NEGATIVE_Z - GL_TEXTURE_CUBE_MAP_POSITIVE_X, -1 },
+};
 
-		for (int z = 0; z < depth; z++)
-		{
-			for (int y = 0; y < height; y++)
-			{
-				int srcLineStart = (z * panelSize) + (y * srcLineSize);
-				int destLineStart = (z * panelWidth) + (y * destLineSize);
+// Copies row 'row' of the image written to files into 'dest', directly from the read back buffer: cube faces are laid
+// out in a cross (see kCubeCrossFaces), and the slices of 3D textures side by side (the read back buffer has them one
+// below the other).
+void GatherRow(const byte* pixelbuffer, int textureType, int width, int height, int depth, int pixelSize, int row, byte* dest)
+{
+	const int panelSize = height * width * pixelSize;
+	const int lineSize = width * pixelSize;
 
-				memcpy(pixelbuffer + destLineStart, tempbuffer + srcLineStart, srcLineSize);
-			}
+	if (textureType == GL_TEXTURE_CUBE_MAP)
+	{
+		const int* faces = kCubeCrossFaces[row / height];
+		const int faceRow = row % height;
+		for (int i = 0; i < 3; i++)
+		{
+			if (faces[i] < 0)
+				memset(dest + i * lineSize, 0, lineSize);
+			else
+				memcpy(dest + i * lineSize, pixelbuffer + faces[i] * panelSize + faceRow * lineSize, lineSize);
 		}
 	}
+	else if (textureType == GL_TEXTURE_3D)
+	{
+		for (int z = 0; z < depth; z++)
+			memcpy(dest + z * lineSize, pixelbuffer + z * panelSize + row * lineSize, lineSize);
+	}
+	else
+	{
+		memcpy(dest, pixelbuffer + row * lineSize, lineSize);
+	}
+}
 
+void SavePixels(const char* path, const void* pixels, int textureType, bool alpha, int width, int height, int depth, SaveFormat::Type format)
+{
+	if (textureType != GL_TEXTURE_3D)
+		depth = 1;
+
+	int sampleperpixel = alpha ? 4 : 3; // RGBA
+	int pixelSize = channelSize * sampleperpixel;
+
+	const byte* pixelbuffer = (const byte*)pixels;
+
+	// 3d textures are written with their slices tiled horizontally.
 	int outputWidth = width * depth;
 	int outputHeight = height;
 
@@ -89,6 +128,12 @@ void SaveTexture(const char* path, unsigned int texture, int textureType, bool a
 	if (format == SaveFormat::TIF)
 	{
 		TIFF *out = TIFFOpen(path, "w");
+		if (!out)
+			return;
+
+		tsize_t linebytes = pixelSize * outputWidth; // length in memory of one row of pixel in the image.
+		uint32 rowsPerStrip = std::max(1, std::min(outputHeight, static_cast<int>(kStripBytes / linebytes)));
+
 		TIFFSetField(out, TIFFTAG_IMAGEWIDTH, outputWidth);  // set the width of the image
 		TIFFSetField(out, TIFFTAG_IMAGELENGTH, outputHeight);    // set the height of the image
 		TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, sampleperpixel);   // set number of channels per pixel
@@ -98,107 +143,113 @@ void SaveTexture(const char* path, unsigned int texture, int textureType, bool a
 		TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
 		TIFFSetField(out, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP); // Floating point
 		TIFFSetField(out, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+		TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, rowsPerStrip);
 
-		tsize_t linebytes = pixelSize * outputWidth; // length in memory of one row of pixel in the image.
-		byte* buf = NULL; // buffer used to store the row of pixel information for writing to file
-
-		// Allocating memory to store the pixels of current row
-		if (TIFFScanlineSize(out) < linebytes)
-			buf = (byte*)_TIFFmalloc(linebytes);
-		else
-			buf = (byte*)_TIFFmalloc(TIFFScanlineSize(out));
+		// Now writing image to the file one strip at a time, each strip being gathered from the read back buffer.
+		byte* strip = new byte[rowsPerStrip * linebytes];
+		for (uint32 firstRow = 0, stripIndex = 0; firstRow < static_cast<uint32>(outputHeight); firstRow += rowsPerStrip, stripIndex++)
+		{
+			uint32 stripRows = std::min(rowsPerStrip, outputHeight - firstRow);
+			for (uint32 row = 0; row < stripRows; row++)
+				GatherRow(pixelbuffer, textureType, width, height, depth, pixelSize, firstRow + row, strip + row * linebytes);
 
-		// We set the strip size of the file to be size of one row of pixels
-		TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(out, width * sampleperpixel));
+			if (TIFFWriteEncodedStrip(out, stripIndex, strip, stripRows * linebytes) < 0)
+				break;
+		}
+		delete[] strip;
 
-		//Now writing image to the file one strip at a time
-		if (textureType == GL_TEXTURE_CUBE_MAP)
+		(void)TIFFClose(out);
+	}
+	else
+	{
+		WriteExr(path, outputWidth, outputHeight, sampleperpixel, format == SaveFormat::EXR_HALF,
+			[=](int row, float* dest)
 		{
-			tsize_t thirdBytes = linebytes / 3;
-			byte* zerobuf = (byte*)_TIFFmalloc(thirdBytes);
-			for (int i = 0; i < thirdBytes; i++)
-			{
-				//zerobuf[i] = 0;
-			}
-			void* dest1 = buf;
-			void* dest2 = buf + thirdBytes;
-			void* dest3 = buf + (thirdBytes * 2);
+			GatherRow(pixelbuffer, textureType, width, height, depth, pixelSize, row, reinterpret_cast<byte*>(dest));
+		});
+	}
+}
 
-			// Lay out the cube faces in a cross pattern as we write
-			for (uint32 row = 0; row < outputHeight; row++)
-			{
-				int faceRow = row % height;
-
-				// TODO: Do 4 seperate loops, instead of branching on each iteration of one loop.
-				switch (row / height)
-				{
-				case 0: // Blank, +Y, Blank
-					memcpy(dest1, zerobuf, thirdBytes);
-					memcpy(dest2, &pixelbuffer[((GL_TEXTURE_CUBE_MAP_POSITIVE_Y - GL_TEXTURE_BINDING_CUBE_MAP - 1) * panelSize) + (faceRow * thirdBytes)], thirdBytes);
-					memcpy(dest3, zerobuf, thirdBytes);
-					break;
-				case 1: // -X, +Z, +X
-					memcpy(dest1, &pixelbuffer[((GL_TEXTURE_CUBE_MAP_NEGATIVE_X - GL_TEXTURE_BINDING_CUBE_MAP - 1) * panelSize) + (faceRow * thirdBytes)], thirdBytes);
-					memcpy(dest2, &pixelbuffer[((GL_TEXTURE_CUBE_MAP_POSITIVE_Z - GL_TEXTURE_BINDING_CUBE_MAP - 1) * panelSize) + (faceRow * thirdBytes)], thirdBytes);
-					memcpy(dest3, &pixelbuffer[((GL_TEXTURE_CUBE_MAP_POSITIVE_X - GL_TEXTURE_BINDING_CUBE_MAP - 1) * panelSize) + (faceRow * thirdBytes)], thirdBytes);
-					break;
-				case 2: // Blank, -Y, Blank
-					memcpy(dest1, zerobuf, thirdBytes);
-					memcpy(dest2, &pixelbuffer[((GL_TEXTURE_CUBE_MAP_NEGATIVE_Y - GL_TEXTURE_BINDING_CUBE_MAP - 1) * panelSize) + (faceRow * thirdBytes)], thirdBytes);
-					memcpy(dest3, zerobuf, thirdBytes);
-					break;
-				case 3: // Blank, -Z, Blank
-				default:
-					memcpy(dest1, zerobuf, thirdBytes);
-					memcpy(dest2, &pixelbuffer[((GL_TEXTURE_CUBE_MAP_NEGATIVE_Z - GL_TEXTURE_BINDING_CUBE_MAP - 1) * panelSize) + (faceRow * thirdBytes)], thirdBytes);
-					memcpy(dest3, zerobuf, thirdBytes);
-					break;
-				}
-
-				if (TIFFWriteScanline(out, buf, row, 0) < 0)
-					break;
-			}
-		}
-		else
+void SavePixelsToDds(const char* path, const std::vector<const void*>& levels, int textureType, bool alpha, int width, int height, int depth /*= 1*/, bool quality /*= false*/)
+{
+	if (textureType != GL_TEXTURE_3D)
+		depth = 1;
+
+	const int sampleperpixel = alpha ? 4 : 3;
+	const int pixelSize = channelSize * sampleperpixel;
+	const int faceCount = textureType == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+	const int mipCount = static_cast<int>(levels.size());
+
+	// Compress each face (or slice) of each level. Cube faces are written with all their mips one after the other,
+	// and volume textures with all the slices of each mip one after the other.
+	std::vector<std::vector<unsigned char>> faces(faceCount);
+	for (int face = 0; face < faceCount; face++)
+	{
+		for (int level = 0; level < mipCount; level++)
 		{
-			// Standard write
-			for (uint32 row = 0; row < outputHeight; row++)
+			const int levelWidth = std::max(width >> level, 1);
+			const int levelHeight = std::max(height >> level, 1);
+			const int levelDepth = std::max(depth >> level, 1);
+			const int panelSize = levelWidth * levelHeight * pixelSize;
+			const int imageSize = GetBc6hImageSize(levelWidth, levelHeight);
+			for (int z = 0; z < levelDepth; z++)
 			{
-				memcpy(buf, &pixelbuffer[row * linebytes], linebytes);
-				if (TIFFWriteScanline(out, buf, row, 0) < 0)
-					break;
+				const byte* panel = (const byte*)levels[level] + (face + z) * panelSize;
+				const size_t offset = faces[face].size();
+				faces[face].resize(offset + imageSize);
+				EncodeBc6h(reinterpret_cast<const float*>(panel), levelWidth, levelHeight, sampleperpixel, quality,
+					faces[face].data() + offset);
 			}
 		}
-
-		(void)TIFFClose(out);
-		if (buf)
-			_TIFFfree(buf);
 	}
-	else if (format == SaveFormat::EXR)
+
+	// DDS_HEADER, followed by a DDS_HEADER_DXT10.
+	uint32_t header[31] = {};
+	header[0] = sizeof(header);
+	header[1] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // Caps, height, width, pixel format, mip count, linear size
+	header[2] = height;
+	header[3] = width;
+	header[4] = GetBc6hImageSize(width, height);
+	header[5] = depth;
+	header[6] = mipCount;
+	header[18] = 32; // Pixel format size
+	header[19] = 0x4; // FourCC
+	header[20] = 0x30315844; // "DX10"
+	header[26] = 0x1000; // Texture
+	if (mipCount > 1 || faceCount > 1 || depth > 1)
+		header[26] |= 0x8; // Complex
+	if (mipCount > 1)
+		header[26] |= 0x400000; // Mipmap
+	if (faceCount > 1)
+		header[27] = 0x200 | 0xfc00; // Cubemap with all faces
+	if (textureType == GL_TEXTURE_3D)
 	{
-		// WIP
-		//Imf::Header header(width, height);
-		//header.channels().insert("G", Imf::Channel(Imf::HALF));
-		//header.channels().insert("Z", Imf::Channel(Imf::FLOAT));
-
-		//Imf::OutputFile file(path, header);
-		//Imf::FrameBuffer frameBuffer;
-		//frameBuffer.insert("G", // name
-		//	Imf::Slice(Imf::HALF, // type
-		//	(char*)&pixelbuffer, // base
-		//	sizeof(pixelbuffer) * 1, // xStride
-		//	sizeof(pixelbuffer) * width)); // yStride
-		//frameBuffer.insert("Z", // name
-		//	Imf::Slice(Imf::FLOAT, // type
-		//	(char*)&pixelbuffer, // base
-		//	sizeof(pixelbuffer) * 1, // xStride
-		//	sizeof(pixelbuffer) * width)); // yStride
-		//file.setFrameBuffer(frameBuffer); //
-		//file.writePixels(height);
+		header[1] |= 0x800000; // Depth
+		header[27] = 0x200000; // Volume
 	}
+	const uint32_t kBc6hUnsignedFormat = 95; // DXGI_FORMAT_BC6H_UF16
+	const uint32_t dx10Header[5] = {
+		kBc6hUnsignedFormat,
+		textureType == GL_TEXTURE_3D ? 4u : 3u, // Texture 3D or 2D
+		faceCount > 1 ? 0x4u : 0u, // Texture cube
+		1, // Array size
+		0
+	};
+
+	std::ofstream file(path, std::ios::binary);
+	file.write("DDS ", 4);
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(dx10Header), sizeof(dx10Header));
+	for (const std::vector<unsigned char>& face : faces)
+		file.write(reinterpret_cast<const char*>(face.data()), face.size());
+}
 
-	delete pixelbuffer;
-	delete tempbuffer;
+void SaveTexture(const char* path, unsigned int texture, int textureType, bool alpha, int width, int height, int depth, SaveFormat::Type format)
+{
+	byte* pixelbuffer = new byte[GetTextureBufferSize(textureType, alpha, width, height, depth)];
+	ReadTexture(texture, textureType, alpha, width, height, depth, pixelbuffer);
+	SavePixels(path, pixelbuffer, textureType, alpha, width, height, depth, format);
+	delete[] pixelbuffer;
 }
 
 void SaveTextureToTiff(const char* path, unsigned int texture, int textureType, bool alpha, int width, int height, int depth /*= 1*/)
@@ -206,7 +257,17 @@ void SaveTextureToTiff(const char* path, unsigned int texture, int textureType,
 	SaveTexture(path, texture, textureType, alpha, width, height, depth, SaveFormat::TIF);
 }
 
-//void SaveTextureToEXR(const char* path, unsigned int texture, int textureType, int width, int height, int depth /*= 1*/)
-//{
-//	SaveTexture(path, texture, textureType, width, height, depth, SaveFormat::EXR);
-//}
\ No newline at end of file
+void SavePixelsToTiff(const char* path, const void* pixels, int textureType, bool alpha, int width, int height, int depth /*= 1*/)
+{
+	SavePixels(path, pixels, textureType, alpha, width, height, depth, SaveFormat::TIF);
+}
+
+void SaveTextureToExr(const char* path, unsigned int texture, int textureType, bool alpha, int width, int height, int depth /*= 1*/, bool halfPrecision /*= true*/)
+{
+	SaveTexture(path, texture, textureType, alpha, width, height, depth, halfPrecision ? SaveFormat::EXR_HALF : SaveFormat::EXR_FLOAT);
+}
+
+void SavePixelsToExr(const char* path, const void* pixels, int textureType, bool alpha, int width, int height, int depth /*= 1*/, bool halfPrecision /*= true*/)
+{
+	SavePixels(path, pixels, textureType, alpha, width, height, depth, halfPrecision ? SaveFormat::EXR_HALF : SaveFormat::EXR_FLOAT);
+}
@@ -1,4 +1,18 @@
 #pragma once
 
+#include <vector>
+
 extern void SaveTextureToTiff(const char* path, unsigned int texture, int textureType, bool alpha, int width, int height, int depth = 1);
-//extern void SaveTextureToEXR(const char* path, unsigned int texture, int textureType, int width, int height, int depth = 1);
\ No newline at end of file
+// Writes a ZIP compressed OpenEXR file, with 16 bit floats if halfPrecision is true, 32 bit floats otherwise.
+extern void SaveTextureToExr(const char* path, unsigned int texture, int textureType, bool alpha, int width, int height, int depth = 1, bool halfPrecision = true);
+
+// Split versions of SaveTextureToTiff, so that the (GL) read back and the (CPU only) file write can happen on different threads.
+// 'pixels' must hold GetTextureBufferSize bytes. For mip levels other than 0, width, height and depth are the size of
+// this level.
+extern int GetTextureBufferSize(int textureType, bool alpha, int width, int height, int depth = 1);
+extern void ReadTexture(unsigned int texture, int textureType, bool alpha, int width, int height, int depth, void* pixels, int level = 0);
+extern void SavePixelsToTiff(const char* path, const void* pixels, int textureType, bool alpha, int width, int height, int depth = 1);
+extern void SavePixelsToExr(const char* path, const void* pixels, int textureType, bool alpha, int width, int height, int depth = 1, bool halfPrecision = true);
+// Writes a BC6H compressed DDS file (see EncodeBc6h for the quality switch). 'levels' holds the read back pixels of each
+// mip level, level 0 first. Cubemaps are written as cube textures, and 3D textures as volume textures.
+extern void SavePixelsToDds(const char* path, const std::vector<const void*>& levels, int textureType, bool alpha, int width, int height, int depth = 1, bool quality = false);
\ No newline at end of file
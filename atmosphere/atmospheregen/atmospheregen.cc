@@ -5,14 +5,18 @@
 
 #include <algorithm>
 #include <cmath>
+#include <fstream>
 #include <map>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "vec3.h"
 #include "mat4.h"
+#include "SphericalHarmonics.h"
 #include "TextureSaver.h"
+#include "atmosphere/trace.h"
 
 namespace atmosphere
 {
@@ -47,10 +51,157 @@ namespace atmosphere
 		gl_Position = vertex;
 	})";
 
+		// Samples a sky panorama rendered with the sun at azimuth 0 (see RenderPanorama), rotated about the zenith so
+		// that the sun ends up at the given azimuth.
+		const char kResampleShader[] = R"(
+	#version 330
+	uniform sampler2D panorama;
+	uniform float azimuth;
+	in vec3 view_ray;
+	layout(location = 0) out vec3 color;
+	const float PI = 3.14159265;
+	void main()
+	{
+		vec3 view_direction = normalize(view_ray);
+		float longitude = atan(view_direction.y, view_direction.x) - azimuth;
+		float latitude = asin(clamp(view_direction.z, -1.0, 1.0));
+		color = texture(panorama, vec2(longitude / (2.0 * PI) + 0.5, latitude / PI + 0.5)).rgb;
+	})";
+
+		// Renders one face of one mip level of a cubemap prefiltered with a GGX lobe (see FilterCubemap). Directions
+		// are computed with the GL cubemap face conventions, both for the rendered texel and for the source lookups,
+		// so that the result does not depend on the orientation of the faces in world space. The samples are
+		// importance sampled with a Hammersley sequence, and read from the mip level of the source whose texel solid
+		// angle matches the solid angle of the sample ("filtered importance sampling"), which avoids the aliasing of
+		// bright features such as the sun with a small number of samples.
+		const char kPrefilterShader[] = R"(
+	#version 330
+	uniform samplerCube source;
+	uniform float source_size;
+	uniform float face_size;
+	uniform int face;
+	uniform float roughness;
+	layout(location = 0) out vec3 color;
+	const float PI = 3.14159265;
+	const uint SAMPLE_COUNT = 256u;
+	vec3 GetCubemapDirection(vec2 frag_coord)
+	{
+		vec2 st = 2.0 * frag_coord / face_size - 1.0;
+		if (face == 0) return vec3(1.0, -st.y, -st.x);
+		if (face == 1) return vec3(-1.0, -st.y, st.x);
+		if (face == 2) return vec3(st.x, 1.0, st.y);
+		if (face == 3) return vec3(st.x, -1.0, -st.y);
+		if (face == 4) return vec3(st.x, -st.y, 1.0);
+		return vec3(-st.x, -st.y, -1.0);
+	}
+	float RadicalInverse(uint bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return float(bits) * 2.3283064365386963e-10;
+	}
+	void main()
+	{
+		vec3 n = normalize(GetCubemapDirection(gl_FragCoord.xy));
+		if (roughness == 0.0)
+		{
+			color = textureLod(source, n, 0.0).rgb;
+			return;
+		}
+		float alpha2 = roughness * roughness * roughness * roughness;
+		vec3 up = abs(n.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+		vec3 tangent_x = normalize(cross(up, n));
+		vec3 tangent_y = cross(n, tangent_x);
+		float texel_solid_angle = 4.0 * PI / (6.0 * source_size * source_size);
+		vec3 sum = vec3(0.0);
+		float weight = 0.0;
+		for (uint i = 0u; i < SAMPLE_COUNT; ++i)
+		{
+			vec2 xi = vec2(float(i) / float(SAMPLE_COUNT), RadicalInverse(i));
+			float phi = 2.0 * PI * xi.x;
+			float cos_theta = sqrt((1.0 - xi.y) / (1.0 + (alpha2 - 1.0) * xi.y));
+			float sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+			vec3 h = sin_theta * cos(phi) * tangent_x + sin_theta * sin(phi) * tangent_y + cos_theta * n;
+			vec3 l = 2.0 * dot(n, h) * h - n;
+			float n_dot_l = dot(n, l);
+			if (n_dot_l > 0.0)
+			{
+				// With the usual n = v = r assumption, the pdf of l is D(h) / 4.
+				float d = cos_theta * cos_theta * (alpha2 - 1.0) + 1.0;
+				float pdf = alpha2 / (4.0 * PI * d * d);
+				float sample_solid_angle = 1.0 / (float(SAMPLE_COUNT) * pdf);
+				float lod = max(0.5 * log2(sample_solid_angle / texel_solid_angle) + 1.0, 0.0);
+				sum += textureLod(source, l, lod).rgb * n_dot_l;
+				weight += n_dot_l;
+			}
+		}
+		color = sum / weight;
+	})";
+
+		// Sun directions whose elevation differ by less than this share the same panorama.
+		constexpr float kSunElevationEpsilon = 1e-5f;
+		// The model textures use units 0 to 3 (see InitModel).
+		constexpr int kPanoramaTextureUnit = 4;
+		constexpr int kPrefilterTextureUnit = 5;
+
 #include "atmosphere/atmospheregen/atmospheregen.glsl.inc"
 
 		static std::map<int, AtmosphereGen*> INSTANCES;
 
+		// Rotation of the camera rendering the given cubemap face (0 to 5, in GL face order).
+		mat4d GetCubemapFaceRotation(int face)
+		{
+			switch (face + GL_TEXTURE_CUBE_MAP_POSITIVE_X)
+			{
+			case GL_TEXTURE_CUBE_MAP_NEGATIVE_Y:
+				return mat4d::rotate(vec3d(270, 180, 0));
+			case GL_TEXTURE_CUBE_MAP_POSITIVE_Y:
+				return mat4d::rotate(vec3d(-270, 180, 0));
+			case GL_TEXTURE_CUBE_MAP_NEGATIVE_X:
+				return mat4d::rotate(vec3d(0, 90, 0));
+			case GL_TEXTURE_CUBE_MAP_POSITIVE_X:
+				return mat4d::rotate(vec3d(0, -90, 0));
+			case GL_TEXTURE_CUBE_MAP_NEGATIVE_Z:
+				return mat4d::rotate(vec3d(0, 0, 180));
+			case GL_TEXTURE_CUBE_MAP_POSITIVE_Z:
+			default:
+				return mat4d::rotate(vec3d(0, 180, 0));
+			}
+		}
+
+		// Writes the irradiance spherical harmonics of a cubemap, and a description of its mip levels, as a JSON file.
+		void WriteProbeSidecar(const std::string& path, const AtmosphereGen::Job& job, unsigned int resolution,
+			int mipLevels, AtmosphereGen::Options::MipFilter mipFilter, const float coefficients[kSH9CoefficientCount][3])
+		{
+			std::ofstream file(path);
+			file << "{\n";
+			file << "  \"altitude\": " << job.altitude << ",\n";
+			file << "  \"sun_direction\": [" << job.sunDirection[0] << ", " << job.sunDirection[1] << ", "
+				<< job.sunDirection[2] << "],\n";
+			file << "  \"mie_scale\": " << job.mieScale << ",\n";
+			file << "  \"resolution\": " << resolution << ",\n";
+			file << "  \"mip_filter\": \"" << (mipFilter == AtmosphereGen::Options::GGX ? "ggx" : "box") << "\",\n";
+			file << "  \"mip_roughness\": [";
+			for (int level = 0; level < mipLevels; level++)
+			{
+				const float roughness = mipFilter == AtmosphereGen::Options::GGX && mipLevels > 1 ?
+					static_cast<float>(level) / static_cast<float>(mipLevels - 1) : 0.0f;
+				file << (level == 0 ? "" : ", ") << roughness;
+			}
+			file << "],\n";
+			file << "  \"irradiance_sh9\": [\n";
+			for (int i = 0; i < kSH9CoefficientCount; i++)
+			{
+				file << "    [" << coefficients[i][0] << ", " << coefficients[i][1] << ", " << coefficients[i][2] << "]"
+					<< (i + 1 < kSH9CoefficientCount ? ",\n" : "\n");
+			}
+			file << "  ]\n";
+			file << "}\n";
+		}
+
 	}
 
 	AtmosphereGen::AtmosphereGen(Options options) :
@@ -63,6 +214,10 @@ namespace atmosphere
 		do_white_balance_(false),
 		show_help_(true),
 		program_(0),
+		panorama_program_(0),
+		resample_program_(0),
+		prefilter_program_(0),
+		fbo_(0),
 		view_distance_meters_(9000.0),
 		view_zenith_angle_radians_(1.47),
 		view_azimuth_angle_radians_(-0.1),
@@ -70,7 +225,6 @@ namespace atmosphere
 		sun_azimuth_angle_radians_(2.9),
 		exposure_(10.0) 
 	{
-		InitModel();
 	}
 
 	/*
@@ -79,6 +233,9 @@ namespace atmosphere
 
 	AtmosphereGen::~AtmosphereGen() {
 		glDeleteProgram(program_);
+		glDeleteProgram(panorama_program_);
+		glDeleteProgram(resample_program_);
+		glDeleteProgram(prefilter_program_);
 	}
 
 	/*
@@ -90,6 +247,7 @@ namespace atmosphere
 
 	void AtmosphereGen::InitModel()
 	{
+		trace::Span span("atmospheregen", "InitModel");
 		// Values from "Reference Solar Spectral Irradiance: ASTM G-173", ETR column
 		// (see http://rredc.nrel.gov/solar/spectra/am1.5/ASTMG173/ASTMG173.html),
 		// summed and averaged in each bin (e.g. the value for 360nm is the average
@@ -186,34 +344,57 @@ namespace atmosphere
 		to get the final scene rendering program:
 		*/
 
-		GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-		const char* const vertex_shader_source = kVertexShader;
-		glShaderSource(vertex_shader, 1, &vertex_shader_source, NULL);
-		glCompileShader(vertex_shader);
-
-		const std::string fragment_shader_str =
-			"#version 330\n" +
-			std::string(use_luminance_ != NONE ? "#define USE_LUMINANCE\n" : "") +
-			atmospheregen_glsl;
-		const char* fragment_shader_source = fragment_shader_str.c_str();
-		GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment_shader, 1, &fragment_shader_source, NULL);
-		glCompileShader(fragment_shader);
+		auto createProgram = [this](const char* vertex_shader_source, const std::string& fragment_shader_str, bool link_model)
+		{
+			GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+			glShaderSource(vertex_shader, 1, &vertex_shader_source, NULL);
+			glCompileShader(vertex_shader);
+
+			const char* fragment_shader_source = fragment_shader_str.c_str();
+			GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+			glShaderSource(fragment_shader, 1, &fragment_shader_source, NULL);
+			glCompileShader(fragment_shader);
+
+			GLuint program = glCreateProgram();
+			glAttachShader(program, vertex_shader);
+			glAttachShader(program, fragment_shader);
+			if (link_model)
+				glAttachShader(program, model_->GetShader());
+			glLinkProgram(program);
+			glDetachShader(program, vertex_shader);
+			glDetachShader(program, fragment_shader);
+			if (link_model)
+				glDetachShader(program, model_->GetShader());
+			glDeleteShader(vertex_shader);
+			glDeleteShader(fragment_shader);
+			return program;
+		};
 
+		const std::string luminance_define = use_luminance_ != NONE ? "#define USE_LUMINANCE\n" : "";
 		if (program_ != 0)
 		{
 			glDeleteProgram(program_);
 		}
-		program_ = glCreateProgram();
-		glAttachShader(program_, vertex_shader);
-		glAttachShader(program_, fragment_shader);
-		glAttachShader(program_, model_->GetShader());
-		glLinkProgram(program_);
-		glDetachShader(program_, vertex_shader);
-		glDetachShader(program_, fragment_shader);
-		glDetachShader(program_, model_->GetShader());
-		glDeleteShader(vertex_shader);
-		glDeleteShader(fragment_shader);
+		program_ = createProgram(kVertexShader, "#version 330\n" + luminance_define + atmospheregen_glsl, true);
+
+		// The same shader, rendering an equirectangular panorama instead of a cubemap face (see RenderPanorama).
+		if (panorama_program_ != 0)
+		{
+			glDeleteProgram(panorama_program_);
+		}
+		panorama_program_ = createProgram(kVertexShader,
+			"#version 330\n#define PANORAMA\n" + luminance_define + atmospheregen_glsl, true);
+
+		// The programs resampling a rotated panorama into a cubemap face, and prefiltering the cubemap mip levels, do
+		// not depend on the model.
+		if (resample_program_ == 0)
+		{
+			resample_program_ = createProgram(kVertexShader, kResampleShader, false);
+		}
+		if (prefilter_program_ == 0)
+		{
+			prefilter_program_ = createProgram(kVertexShader, kPrefilterShader, false);
+		}
 
 		/*
 		<p>Finally, it sets the uniforms of this program that can be set once and for
@@ -221,8 +402,6 @@ namespace atmosphere
 		because our demo app does not have any texture of its own):
 		*/
 
-		glUseProgram(program_);
-		model_->SetProgramUniforms(program_, 0, 1, 2, 3);
 		double white_point_r = 1.0;
 		double white_point_g = 1.0;
 		double white_point_b = 1.0;
@@ -234,48 +413,371 @@ namespace atmosphere
 			white_point_g /= white_point;
 			white_point_b /= white_point;
 		}
-		glUniform3f(glGetUniformLocation(program_, "white_point"),
-			white_point_r, white_point_g, white_point_b);
-		glUniform3f(glGetUniformLocation(program_, "earth_center"),
-			0.0, 0.0, -kBottomRadius / kLengthUnitInMeters);
-		glUniform2f(glGetUniformLocation(program_, "sun_size"),
-			tan(kSunAngularRadius),
-			cos(kSunAngularRadius));
+		for (GLuint program : { panorama_program_, program_ })
+		{
+			glUseProgram(program);
+			model_->SetProgramUniforms(program, 0, 1, 2, 3);
+			glUniform3f(glGetUniformLocation(program, "white_point"),
+				white_point_r, white_point_g, white_point_b);
+			glUniform3f(glGetUniformLocation(program, "earth_center"),
+				0.0, 0.0, -kBottomRadius / kLengthUnitInMeters);
+			glUniform2f(glGetUniformLocation(program, "sun_size"),
+				tan(kSunAngularRadius),
+				cos(kSunAngularRadius));
+		}
 	}
 
 	void AtmosphereGen::RenderAtmosphere()
 	{
-		std::cout << "rendering cubemap... " << std::endl;
-
-		const unsigned int cubemap_resolution = 1024;
+		trace::Span span("atmospheregen", "RenderAtmosphere");
+		Job job;
+		job.outputName = options.outputName;
+		job.altitude = options.altitude;
+		job.sunDirection[0] = options.sunDirection[0];
+		job.sunDirection[1] = options.sunDirection[1];
+		job.sunDirection[2] = options.sunDirection[2];
+		job.mieScale = options.mieScale;
+		RenderJobs({ job });
+	}
 
-		GLuint fbo;
-		glGenFramebuffersEXT(1, &fbo);
-		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
+	void AtmosphereGen::RenderJobs(std::vector<Job> jobs)
+	{
+		trace::Span span("atmospheregen", "RenderJobs", "jobs", static_cast<int>(jobs.size()));
+		// Group the jobs by atmosphere parameters, so that the model is precomputed once per group. The sort is
+		// stable to keep the requested order inside each group. With reuseAzimuth, jobs are further grouped by
+		// altitude and sun elevation, so that they can share the same panorama.
+		const bool reuseAzimuth = options.reuseAzimuth;
+		std::stable_sort(jobs.begin(), jobs.end(), [reuseAzimuth](const Job& a, const Job& b)
+		{
+			if (a.mieScale != b.mieScale || !reuseAzimuth)
+				return a.mieScale < b.mieScale;
+			if (a.altitude != b.altitude)
+				return a.altitude < b.altitude;
+			return GetSunElevation(a.sunDirection) < GetSunElevation(b.sunDirection);
+		});
+
+		const unsigned int cubemap_resolution = options.cubemapResolution;
+		const int mipLevels = GetMipLevelCount(cubemap_resolution, options.cubemapMipLevels);
+		// With the GGX filter, the sky is rendered into a separate box filtered cubemap, which is then convolved
+		// into the output cubemap. The box filtered levels of the source are needed for the filtered importance
+		// sampling (see kPrefilterShader).
+		const bool prefilter = mipLevels > 1 && options.mipFilter == Options::GGX;
+
+		glGenFramebuffersEXT(1, &fbo_);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_);
 		glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
 		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
 
-		// Allocate cubemap
-		GLuint cubeTexture;
-		glGenTextures(1, &cubeTexture);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture);
+		// Allocate cubemaps
+		GLuint cubeTexture = NewCubemapTexture(cubemap_resolution, mipLevels);
+		GLuint sourceTexture = prefilter ?
+			NewCubemapTexture(cubemap_resolution, GetMipLevelCount(cubemap_resolution, 0)) : cubeTexture;
+
+		// Two read back buffers: one is written to disk by the writer thread, while the other receives the next
+		// rendered cubemap. Each buffer holds all the mip levels, one after the other.
+		std::vector<int> levelOffsets;
+		int bufferSize = 0;
+		for (int level = 0; level < mipLevels; level++)
+		{
+			const int levelResolution = std::max(cubemap_resolution >> level, 1u);
+			levelOffsets.push_back(bufferSize);
+			bufferSize += GetTextureBufferSize(GL_TEXTURE_CUBE_MAP, false, levelResolution, levelResolution);
+		}
+		std::vector<unsigned char> pixelBuffers[2];
+		pixelBuffers[0].resize(bufferSize);
+		pixelBuffers[1].resize(bufferSize);
+		std::thread writer;
+
+		// The view directions of the rendered faces, in world space, for the spherical harmonics projection.
+		float faceToWorld[6][9];
+		for (int face = 0; face < 6; face++)
+		{
+			const mat4d worldFromFace = GetCubemapFaceRotation(face).inverse();
+			for (int row = 0; row < 3; row++)
+			{
+				for (int column = 0; column < 3; column++)
+					faceToWorld[face][3 * row + column] = static_cast<float>(worldFromFace[row][column]);
+			}
+		}
+
+		GLuint panoramaTexture = 0;
+		bool panoramaValid = false;
+		float panoramaAltitude = 0.0f;
+		float panoramaSunElevation = 0.0f;
+		int panoramaCount = 0;
+
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			trace::Span jobSpan("atmospheregen", "Job", "job", static_cast<int>(i));
+			const Job& job = jobs[i];
+			// The model is precomputed lazily, at the first job of each group, so that the command line mie scale
+			// does not cost a precomputation when no job uses it.
+			if (!model_ || job.mieScale != options.mieScale)
+			{
+				options.mieScale = job.mieScale;
+				InitModel();
+				panoramaValid = false;
+			}
+
+			// The lookup textures only depend on the atmosphere parameters, so they are written once per group, named
+			// after its first job.
+			if (options.outputLookupTextures && (i == 0 || job.mieScale != jobs[i - 1].mieScale))
+			{
+				const std::string path = std::string(options.outputDirectory) + "\\" + job.outputName + "_lut.bin";
+				std::cout << "writing " << path << "..." << std::endl;
+				if (!model_->SaveTextures(path))
+					std::cerr << "Error writing " << path << "\n";
+			}
+
+			std::cout << "rendering cubemap " << job.outputName << " (" << (i + 1) << "/" << jobs.size() << ")..." << std::endl;
+			if (reuseAzimuth)
+			{
+				// For a camera at the pole, changing the sun azimuth simply rotates the sky about the zenith. So a
+				// single panorama, rendered with the sun at azimuth 0, gives the cubemaps for all the azimuths.
+				const float sunElevation = GetSunElevation(job.sunDirection);
+				if (!panoramaValid || job.altitude != panoramaAltitude ||
+					std::abs(sunElevation - panoramaSunElevation) > kSunElevationEpsilon)
+				{
+					if (panoramaTexture == 0)
+						panoramaTexture = NewPanoramaTexture(2 * cubemap_resolution);
+					RenderPanorama(panoramaTexture, 2 * cubemap_resolution, job.altitude, sunElevation);
+					panoramaValid = true;
+					panoramaAltitude = job.altitude;
+					panoramaSunElevation = sunElevation;
+					panoramaCount++;
+				}
+				const float sunAzimuth = std::atan2(job.sunDirection[1], job.sunDirection[0]);
+				glUseProgram(resample_program_);
+				glActiveTexture(GL_TEXTURE0 + kPanoramaTextureUnit);
+				glBindTexture(GL_TEXTURE_2D, panoramaTexture);
+				glUniform1i(glGetUniformLocation(resample_program_, "panorama"), kPanoramaTextureUnit);
+				glUniform1f(glGetUniformLocation(resample_program_, "azimuth"), sunAzimuth);
+				RenderCubemap(resample_program_, sourceTexture, cubemap_resolution, job.altitude, job.sunDirection);
+			}
+			else
+			{
+				RenderCubemap(program_, sourceTexture, cubemap_resolution, job.altitude, job.sunDirection);
+			}
+
+			if (mipLevels > 1)
+			{
+				glActiveTexture(GL_TEXTURE0 + kPrefilterTextureUnit);
+				glBindTexture(GL_TEXTURE_CUBE_MAP, sourceTexture);
+				glGenerateMipmapEXT(GL_TEXTURE_CUBE_MAP);
+			}
+			if (prefilter)
+			{
+				FilterCubemap(sourceTexture, cubeTexture, cubemap_resolution, mipLevels);
+			}
+
+			// Blocks until the GPU has finished rendering this cubemap.
+			std::vector<unsigned char>& pixels = pixelBuffers[i % 2];
+			for (int level = 0; level < mipLevels; level++)
+			{
+				trace::Span readSpan("atmospheregen", "ReadTexture", "level", level);
+				const int levelResolution = std::max(cubemap_resolution >> level, 1u);
+				ReadTexture(cubeTexture, GL_TEXTURE_CUBE_MAP, false, levelResolution, levelResolution, 1,
+					pixels.data() + levelOffsets[level], level);
+			}
+
+			// Wait for the previous cubemap (stored in the other buffer) to be written before starting this one.
+			if (writer.joinable())
+			{
+				trace::Span waitSpan("atmospheregen", "WaitWriter");
+				writer.join();
+			}
+
+			const std::string basePath = std::string(options.outputDirectory) + "\\" + job.outputName;
+			const Options::MipFilter mipFilter = options.mipFilter;
+			const Options::OutputFormat outputFormat = options.outputFormat;
+			const bool outputIrradianceSH = options.outputIrradianceSH;
+			const int jobIndex = static_cast<int>(i);
+			writer = std::thread([basePath, job, jobIndex, &pixels, &levelOffsets, &faceToWorld, mipLevels, mipFilter,
+				outputFormat, outputIrradianceSH, cubemap_resolution]()
+			{
+				trace::Span writeSpan("atmospheregen", "WriteCubemap", "job", jobIndex);
+				if (outputIrradianceSH)
+				{
+					float coefficients[kSH9CoefficientCount][3];
+					ComputeIrradianceSH9(reinterpret_cast<const float*>(pixels.data()), cubemap_resolution, faceToWorld,
+						coefficients);
+					const std::string path = basePath + "_sh.json";
+					std::cout << "writing " << path << "..." << std::endl;
+					WriteProbeSidecar(path, job, cubemap_resolution, mipLevels, mipFilter, coefficients);
+				}
+				if (outputFormat == Options::DDS_BC6H || outputFormat == Options::DDS_BC6H_QUALITY)
+				{
+					std::vector<const void*> levels;
+					for (int level = 0; level < mipLevels; level++)
+						levels.push_back(pixels.data() + levelOffsets[level]);
+					const std::string path = basePath + ".dds";
+					std::cout << "writing " << path << "..." << std::endl;
+					SavePixelsToDds(path.c_str(), levels, GL_TEXTURE_CUBE_MAP, false, cubemap_resolution,
+						cubemap_resolution, 1, outputFormat == Options::DDS_BC6H_QUALITY);
+					return;
+				}
+				for (int level = 0; level < mipLevels; level++)
+				{
+					const int levelResolution = std::max(cubemap_resolution >> level, 1u);
+					const std::string extension = outputFormat == Options::TIFF ? ".tif" : ".exr";
+					const std::string path = level == 0 ?
+						basePath + extension : basePath + "_mip" + std::to_string(level) + extension;
+					std::cout << "writing " << path << "..." << std::endl;
+					if (outputFormat == Options::TIFF)
+					{
+						SavePixelsToTiff(path.c_str(), pixels.data() + levelOffsets[level], GL_TEXTURE_CUBE_MAP, false,
+							levelResolution, levelResolution);
+					}
+					else
+					{
+						SavePixelsToExr(path.c_str(), pixels.data() + levelOffsets[level], GL_TEXTURE_CUBE_MAP, false,
+							levelResolution, levelResolution, 1, outputFormat == Options::EXR_HALF);
+					}
+				}
+			});
+		}
+
+		if (writer.joinable())
+			writer.join();
+
+		if (reuseAzimuth)
+		{
+			std::cout << "rendered " << panoramaCount << " panoramas for " << jobs.size() << " cubemaps" << std::endl;
+			glDeleteTextures(1, &panoramaTexture);
+		}
+
+		if (prefilter)
+			glDeleteTextures(1, &sourceTexture);
+		glDeleteTextures(1, &cubeTexture);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+		glDeleteFramebuffersEXT(1, &fbo_);
+		fbo_ = 0;
+	}
+
+	float AtmosphereGen::GetSunElevation(const float sunDirection[3])
+	{
+		const float length = std::sqrt(sunDirection[0] * sunDirection[0] + sunDirection[1] * sunDirection[1] +
+			sunDirection[2] * sunDirection[2]);
+		return std::asin(sunDirection[2] / length);
+	}
+
+	int AtmosphereGen::GetMipLevelCount(unsigned int resolution, int requestedLevels)
+	{
+		int fullChain = 1;
+		while ((resolution >> fullChain) > 0)
+			fullChain++;
+		return requestedLevels <= 0 ? fullChain : std::min(requestedLevels, fullChain);
+	}
+
+	unsigned int AtmosphereGen::NewCubemapTexture(unsigned int resolution, int mipLevels)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glActiveTexture(GL_TEXTURE0 + kPrefilterTextureUnit);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mipLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGB32F_ARB, cubemap_resolution, cubemap_resolution, 0, GL_RGB, GL_FLOAT, NULL);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_RGB32F_ARB, cubemap_resolution, cubemap_resolution, 0, GL_RGB, GL_FLOAT, NULL);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_RGB32F_ARB, cubemap_resolution, cubemap_resolution, 0, GL_RGB, GL_FLOAT, NULL);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_RGB32F_ARB, cubemap_resolution, cubemap_resolution, 0, GL_RGB, GL_FLOAT, NULL);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGB32F_ARB, cubemap_resolution, cubemap_resolution, 0, GL_RGB, GL_FLOAT, NULL);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGB32F_ARB, cubemap_resolution, cubemap_resolution, 0, GL_RGB, GL_FLOAT, NULL);
+		for (int level = 0; level < mipLevels; level++)
+		{
+			const unsigned int levelResolution = std::max(resolution >> level, 1u);
+			for (int i = 0; i < 6; i++)
+			{
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, GL_RGB32F_ARB, levelResolution, levelResolution,
+					0, GL_RGB, GL_FLOAT, NULL);
+			}
+		}
+		return texture;
+	}
+
+	void AtmosphereGen::FilterCubemap(unsigned int sourceTexture, unsigned int cubeTexture, unsigned int resolution, int mipLevels)
+	{
+		trace::Span span("atmospheregen", "FilterCubemap");
+		// Filter across the face edges when reading the source (the GGX lobes of the low levels span several faces).
+		glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+		glUseProgram(prefilter_program_);
+		glActiveTexture(GL_TEXTURE0 + kPrefilterTextureUnit);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, sourceTexture);
+		glUniform1i(glGetUniformLocation(prefilter_program_, "source"), kPrefilterTextureUnit);
+		glUniform1f(glGetUniformLocation(prefilter_program_, "source_size"), resolution);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_);
+
+		for (int level = 0; level < mipLevels; level++)
+		{
+			const unsigned int levelResolution = std::max(resolution >> level, 1u);
+			glViewport(0, 0, levelResolution, levelResolution);
+			glUniform1f(glGetUniformLocation(prefilter_program_, "face_size"), levelResolution);
+			glUniform1f(glGetUniformLocation(prefilter_program_, "roughness"),
+				static_cast<float>(level) / static_cast<float>(mipLevels - 1));
+			for (int i = 0; i < 6; i++)
+			{
+				glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+					cubeTexture, level);
+				glUniform1i(glGetUniformLocation(prefilter_program_, "face"), i);
+
+				glBegin(GL_TRIANGLE_STRIP);
+				glVertex4f(-1.0, -1.0, 0.0, 1.0);
+				glVertex4f(+1.0, -1.0, 0.0, 1.0);
+				glVertex4f(-1.0, +1.0, 0.0, 1.0);
+				glVertex4f(+1.0, +1.0, 0.0, 1.0);
+				glEnd();
+			}
+		}
+
+		glFinish();
+	}
 
-		// Set program
-		glViewport(0, 0, cubemap_resolution, cubemap_resolution);
+	unsigned int AtmosphereGen::NewPanoramaTexture(unsigned int height)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glActiveTexture(GL_TEXTURE0 + kPanoramaTextureUnit);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		// Longitudes wrap around, latitudes don't.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F_ARB, 2 * height, height, 0, GL_RGB, GL_FLOAT, NULL);
+		return texture;
+	}
+
+	void AtmosphereGen::RenderPanorama(unsigned int panoramaTexture, unsigned int height, float altitude, float sunElevation)
+	{
+		trace::Span span("atmospheregen", "RenderPanorama");
+		const unsigned int width = 2 * height;
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_);
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, panoramaTexture, 0);
+		glViewport(0, 0, width, height);
+
+		glUseProgram(panorama_program_);
+		glUniform2f(glGetUniformLocation(panorama_program_, "panorama_size"), width, height);
+		glUniform1f(glGetUniformLocation(panorama_program_, "exposure"), use_luminance_ != NONE ? exposure_ * 1e-5 : exposure_);
+		glUniform3f(glGetUniformLocation(panorama_program_, "sun_direction"), std::cos(sunElevation), 0.0f, std::sin(sunElevation));
+		glUniform3f(glGetUniformLocation(panorama_program_, "camera"), 0.0f, 0.0f, altitude);
+
+		glBegin(GL_TRIANGLE_STRIP);
+		glVertex4f(-1.0, -1.0, 0.0, 1.0);
+		glVertex4f(+1.0, -1.0, 0.0, 1.0);
+		glVertex4f(-1.0, +1.0, 0.0, 1.0);
+		glVertex4f(+1.0, +1.0, 0.0, 1.0);
+		glEnd();
+	}
+
+	void AtmosphereGen::RenderCubemap(unsigned int program, unsigned int cubeTexture, unsigned int resolution, float altitude, const float sunDirection[3])
+	{
+		trace::Span span("atmospheregen", "RenderCubemap");
+		glUseProgram(program);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_);
+		glViewport(0, 0, resolution, resolution);
 
 		// Unit vectors of the camera frame, expressed in world space.
 		float cos_z = cos(view_zenith_angle_radians_);
@@ -308,13 +810,13 @@ namespace atmosphere
 			0.0, 0.0, 0.0, -1.0,
 			0.0, 0.0, 1.0, 1.0
 		};
-		glUniformMatrix4fv(glGetUniformLocation(program_, "view_from_clip"), 1, true, view_from_clip);
+		glUniformMatrix4fv(glGetUniformLocation(program, "view_from_clip"), 1, true, view_from_clip);
 
-		glUniform1f(glGetUniformLocation(program_, "exposure"), use_luminance_ != NONE ? exposure_ * 1e-5 : exposure_);
-		glUniform3f(glGetUniformLocation(program_, "sun_direction"), options.sunDirection[0], options.sunDirection[1], options.sunDirection[2]);
+		glUniform1f(glGetUniformLocation(program, "exposure"), use_luminance_ != NONE ? exposure_ * 1e-5 : exposure_);
+		glUniform3f(glGetUniformLocation(program, "sun_direction"), sunDirection[0], sunDirection[1], sunDirection[2]);
 		
-		vec3d position = vec3d(0, 0, options.altitude);
-		glUniform3f(glGetUniformLocation(program_, "camera"), position.x, position.y, position.z);
+		vec3d position = vec3d(0, 0, altitude);
+		glUniform3f(glGetUniformLocation(program, "camera"), position.x, position.y, position.z);
 
 		float h = position.length() - kBottomRadius;
 		mat4f proj = mat4f::perspectiveProjection(90, 1, 10, 1e5 * h);
@@ -323,46 +825,21 @@ namespace atmosphere
 		// Render each face of the cubemap
 		for (int i = 0; i < 6; i++)
 		{
+			trace::Span drawSpan("atmospheregen", "DrawFace", "face", i);
 			const GLenum face = GL_TEXTURE_BINDING_CUBE_MAP + 1 + i;
 			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, face, cubeTexture, 0);
 
 			glClearColor(0.0, 1.0, 1.0, 1.0);
 			glClear(GL_COLOR_BUFFER_BIT);
 
-			mat4d view = mat4d();
-			switch (i + GL_TEXTURE_BINDING_CUBE_MAP + 1)
-			{
-			case GL_TEXTURE_CUBE_MAP_NEGATIVE_Y:
-				view = mat4d::rotate(vec3d(270, 180, 0));
-				break;
-			case GL_TEXTURE_CUBE_MAP_POSITIVE_Y:
-				view = mat4d::rotate(vec3d(-270, 180, 0));
-				break;
-			case GL_TEXTURE_CUBE_MAP_NEGATIVE_X:
-				view = mat4d::rotate(vec3d(0, 90, 0));
-				break;
-			case GL_TEXTURE_CUBE_MAP_POSITIVE_X:
-				view = mat4d::rotate(vec3d(0, -90, 0));
-				break;
-			case GL_TEXTURE_CUBE_MAP_NEGATIVE_Z:
-				view = mat4d::rotate(vec3d(0, 0, 180));
-				break;
-			case GL_TEXTURE_CUBE_MAP_POSITIVE_Z:
-				view = mat4d::rotate(vec3d(0, 180, 0));
-				break;
-			default:
-				continue;
-				break;
-			}
-
-			view = view * mat4d::translate(position);
+			mat4d view = GetCubemapFaceRotation(i) * mat4d::translate(position);
 			mat4d iview = view.inverse();
 			mat4f iviewf = mat4f(iview[0][0], iview[0][1], iview[0][2], iview[0][3],
 				iview[1][0], iview[1][1], iview[1][2], iview[1][3],
 				iview[2][0], iview[2][1], iview[2][2], iview[2][3],
 				iview[3][0], iview[3][1], iview[3][2], iview[3][3]);
 
-			glUniformMatrix4fv(glGetUniformLocation(program_, "model_from_view"), 1, true, iviewf.coefficients());
+			glUniformMatrix4fv(glGetUniformLocation(program, "model_from_view"), 1, true, iviewf.coefficients());
 
 			// Draw quad
 			glBegin(GL_TRIANGLE_STRIP);
@@ -373,11 +850,10 @@ namespace atmosphere
 			glEnd();
 		}
 
-		std::cout << "writing cubemap..." << std::endl;
-
-		glFinish();
-		SaveTextureToTiff((std::string(options.outputDirectory) + "\\" + options.outputName + ".tif").c_str(), cubeTexture, GL_TEXTURE_CUBE_MAP, false, cubemap_resolution, cubemap_resolution);
-
-		glDeleteTextures(1, &cubeTexture);
+		{
+			// The draw calls above are asynchronous, so this is where most of their GPU time is spent.
+			trace::Span finishSpan("atmospheregen", "Finish");
+			glFinish();
+		}
 	}
 }
\ No newline at end of file
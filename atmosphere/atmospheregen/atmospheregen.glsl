@@ -33,7 +33,11 @@ uniform vec3 white_point;
 uniform vec3 earth_center;
 uniform vec3 sun_direction;
 uniform vec2 sun_size;
+#ifdef PANORAMA
+uniform vec2 panorama_size;
+#else
 in vec3 view_ray;
+#endif
 layout(location = 0) out vec3 color;
 
 const float PI = 3.14159265;
@@ -53,7 +57,16 @@ vec3 GetSunAndSkyIrradiance(vec3 p, vec3 normal, vec3 sun_direction, out vec3 sk
 
 void main()
 {
+#ifdef PANORAMA
+	// Equirectangular panorama around the z axis: longitude from -PI to PI along x, latitude from -PI/2 to PI/2
+	// along y.
+	vec2 uv = gl_FragCoord.xy / panorama_size;
+	float longitude = (uv.x - 0.5) * 2.0 * PI;
+	float latitude = (uv.y - 0.5) * PI;
+	vec3 view_direction = vec3(cos(latitude) * cos(longitude), cos(latitude) * sin(longitude), sin(latitude));
+#else
 	vec3 view_direction = normalize(view_ray);
+#endif
 	vec3 sun_direction_normalized = normalize(sun_direction);
 
 	vec3 p = camera - earth_center;
@@ -2,6 +2,8 @@
 
 #include <memory>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "atmosphere/model.h"
 
@@ -13,29 +15,69 @@ namespace atmosphere
 
 		struct Options
 		{
+			enum MipFilter
+			{
+				// Each mip level is the 2x2 average of the previous one.
+				BOX,
+				// Each mip level is the cubemap convolved with a GGX lobe, whose roughness increases linearly from 0
+				// at level 0 to 1 at the last level (as in the split sum approximation of image based lighting).
+				GGX
+			};
+
+			enum OutputFormat
+			{
+				// LZW compressed TIFF, with 32 bit floats.
+				TIFF,
+				// ZIP compressed OpenEXR, with 16 bit floats.
+				EXR_HALF,
+				// ZIP compressed OpenEXR, with 32 bit floats.
+				EXR_FLOAT,
+				// BC6H compressed DDS cubemap, including all the mip levels, with the fast encoder.
+				DDS_BC6H,
+				// BC6H compressed DDS cubemap, including all the mip levels, with the quality encoder.
+				DDS_BC6H_QUALITY
+			};
+
 			// Output options
 			const char* outputDirectory;
 			const char* outputName;
+			OutputFormat outputFormat;
+			// Also write the precomputed textures of the atmosphere model (see Model::SaveTextures), once per mie scale.
 			bool outputLookupTextures;
 			bool outputCubemap;
 			int cubemapResolution;
+			// Number of mip levels to write, including the full resolution one. 0 means the full mip chain, down to
+			// 1x1 faces.
+			int cubemapMipLevels;
+			MipFilter mipFilter;
+			// Also write the irradiance spherical harmonics of each cubemap, and the roughness of its mip levels, to
+			// "<outputName>_sh.json".
+			bool outputIrradianceSH;
 
 			// Render options
 			float altitude;
 			float sunDirection[3];
 			float polarizationFilter;
 			float mieScale;
+			// Resample the cubemaps of jobs which only differ by their sun azimuth from a single panorama (see
+			// RenderJobs), instead of rendering each of them.
+			bool reuseAzimuth;
 
 			Options()
 				: outputDirectory("")
 				, outputName("")
+				, outputFormat(TIFF)
 				, outputLookupTextures(false)
 				, outputCubemap(false)
 				, cubemapResolution(1024)
+				, cubemapMipLevels(1)
+				, mipFilter(BOX)
+				, outputIrradianceSH(false)
 				, altitude(0.1f)
 				, sunDirection{ 1.0, 0.0f, 0.0f }
 				, polarizationFilter(0.0f)
 				, mieScale(1.0f)
+				, reuseAzimuth(false)
 			{
 			}
 
@@ -43,21 +85,47 @@ namespace atmosphere
 			{
 				std::cout << "outputDirectory: " << outputDirectory << "\n";
 				std::cout << "outputName: " << outputName << "\n";
+				const char* kOutputFormatNames[] = { "tif", "exr", "exr32", "dds", "dds_hq" };
+				std::cout << "outputFormat: " << kOutputFormatNames[outputFormat] << "\n";
 				std::cout << "outputLookupTextures: " << outputLookupTextures << "\n";
 				std::cout << "outputCubemap: " << outputCubemap << "\n";
 				std::cout << "cubemapResolution: " << cubemapResolution << "\n";
+				std::cout << "cubemapMipLevels: " << cubemapMipLevels << "\n";
+				std::cout << "mipFilter: " << (mipFilter == GGX ? "ggx" : "box") << "\n";
+				std::cout << "outputIrradianceSH: " << outputIrradianceSH << "\n";
 				std::cout << "altitude: " << altitude << "\n";
 				std::cout << "sunDirection: " << sunDirection[0] << "," << sunDirection[1] << "," << sunDirection[2] << "\n";
 				std::cout << "polarizationFilter: " << polarizationFilter << "\n";
 				std::cout << "mieScale: " << mieScale << "\n";
+				std::cout << "reuseAzimuth: " << reuseAzimuth << "\n";
 			}
 		};
 
+		// One cubemap to bake, as listed in a job list file.
+		struct Job
+		{
+			std::string outputName;
+			float altitude;
+			float sunDirection[3];
+			float mieScale;
+		};
+
 		AtmosphereGen(Options options);
 		~AtmosphereGen();
 
+		// Renders and writes the cubemap described by the options.
 		void RenderAtmosphere();
 
+		// Renders and writes all the given cubemaps, in the output directory of the options. The model is
+		// precomputed once per group of jobs with the same atmosphere parameters, and each cubemap is written
+		// to disk on a background thread while the next one is rendered. With reuseAzimuth, only one panorama is
+		// rendered per altitude and sun elevation, and each cubemap is resampled from it with a rotation about the
+		// zenith (which is exact for the camera at the pole used here, up to the resampling filter). Level 0 of each
+		// cubemap is written to "<outputName>.tif" (or .exr, depending on outputFormat), and the other mip levels to
+		// "<outputName>_mip<level>.tif". DDS files contain all the mip levels. With
+		// outputIrradianceSH, the spherical harmonics projection of each cubemap is computed on the writer thread too.
+		void RenderJobs(std::vector<Job> jobs);
+
 	private:
 		enum Luminance
 		{
@@ -76,6 +144,13 @@ namespace atmosphere
 		};
 
 		void InitModel();
+		void RenderCubemap(unsigned int program, unsigned int cubeTexture, unsigned int resolution, float altitude, const float sunDirection[3]);
+		void RenderPanorama(unsigned int panoramaTexture, unsigned int height, float altitude, float sunElevation);
+		void FilterCubemap(unsigned int sourceTexture, unsigned int cubeTexture, unsigned int resolution, int mipLevels);
+		static unsigned int NewPanoramaTexture(unsigned int height);
+		static unsigned int NewCubemapTexture(unsigned int resolution, int mipLevels);
+		static int GetMipLevelCount(unsigned int resolution, int requestedLevels);
+		static float GetSunElevation(const float sunDirection[3]);
 
 		Options options;
 
@@ -89,6 +164,10 @@ namespace atmosphere
 
 		std::unique_ptr<Model> model_;
 		unsigned int program_;
+		unsigned int panorama_program_;
+		unsigned int resample_program_;
+		unsigned int prefilter_program_;
+		unsigned int fbo_;
 
 		double view_distance_meters_;
 		double view_zenith_angle_radians_;
@@ -4,9 +4,12 @@
 #include <GL/freeglut.h>
 
 #include "optionparser.h"
+#include "atmosphere/trace.h"
 
+#include <fstream>
 #include <memory>
 #include <sstream>
+#include <vector>
 
 namespace commandlineOptionIndex
 {
@@ -21,6 +24,15 @@ namespace commandlineOptionIndex
 		polarization_filter,
 		mie_asymmetry,
 		mie_scale,
+		job_list,
+		reuse_azimuth,
+		cubemap_resolution,
+		mip_levels,
+		mip_filter,
+		irradiance_sh,
+		output_format,
+		lookup_textures,
+		trace,
 	};
 }
 const option::Descriptor usage[] =
@@ -58,6 +70,16 @@ const option::Descriptor usage[] =
 		option::Arg::Optional,
 		"--output_name -n \tSpecify output filename."
 	},
+	{
+		commandlineOptionIndex::output_format,
+		0,
+		"o",
+		"output_format",
+		option::Arg::Optional,
+		"--output_format -o \tFile format of the cubemaps: tif (32 bit float TIFF, the default), exr (16 bit float "
+		"OpenEXR), exr32 (32 bit float OpenEXR), dds (BC6H compressed DDS, with all the mip levels in one file) or "
+		"dds_hq (the same, with a slower and more accurate encoder)."
+	},
 	{
 		commandlineOptionIndex::altitude,
 		0,
@@ -98,6 +120,80 @@ const option::Descriptor usage[] =
 		option::Arg::Optional,
 		"--mie_asymmetry -y \tScale asymmetry of mie scattering."
 	},
+	{
+		commandlineOptionIndex::job_list,
+		0,
+		"j",
+		"job_list",
+		option::Arg::Optional,
+		"--job_list -j \tA file listing several cubemaps to bake with a single precomputation of the model. "
+		"Each line is \"output_name altitude sun_x,sun_y,sun_z [mie_scale]\". "
+		"Empty lines and lines starting with # are ignored. Replaces output_name, altitude and sun_direction."
+	},
+	{
+		commandlineOptionIndex::reuse_azimuth,
+		0,
+		"z",
+		"reuse_azimuth",
+		option::Arg::None,
+		"--reuse_azimuth -z \tWith job_list, render one panorama per altitude and sun elevation, and resample the "
+		"cubemaps for the other sun azimuths from it by rotation, instead of rendering them."
+	},
+	{
+		commandlineOptionIndex::cubemap_resolution,
+		0,
+		"c",
+		"cubemap_resolution",
+		option::Arg::Optional,
+		"--cubemap_resolution -c \tWidth and height of each cubemap face, in pixels. Defaults to 1024."
+	},
+	{
+		commandlineOptionIndex::mip_levels,
+		0,
+		"l",
+		"mip_levels",
+		option::Arg::Optional,
+		"--mip_levels -l \tNumber of mip levels to write, including the full resolution one. 0 writes the full mip chain. "
+		"Level n is written to output_name_mipn.tif. Defaults to 1."
+	},
+	{
+		commandlineOptionIndex::mip_filter,
+		0,
+		"f",
+		"mip_filter",
+		option::Arg::Optional,
+		"--mip_filter -f \tHow the mip levels are computed: box (2x2 average, the default) or ggx (prefiltered for "
+		"specular image based lighting, with a roughness from 0 at level 0 to 1 at the last level)."
+	},
+	{
+		commandlineOptionIndex::irradiance_sh,
+		0,
+		"i",
+		"irradiance_sh",
+		option::Arg::None,
+		"--irradiance_sh -i \tAlso write the order 2 (9 coefficients) spherical harmonics of the irradiance of each "
+		"cubemap, and the roughness of its mip levels, to output_name_sh.json."
+	},
+	{
+		commandlineOptionIndex::lookup_textures,
+		0,
+		"t",
+		"lookup_textures",
+		option::Arg::None,
+		"--lookup_textures -t \tAlso write the precomputed transmittance, scattering and irradiance textures of the "
+		"atmosphere model to output_name_lut.bin (see Model::SaveTextures for the format). With a job list, one file is "
+		"written per mie scale, named after the first job using it."
+	},
+	{
+		commandlineOptionIndex::trace,
+		0,
+		"r",
+		"trace",
+		option::Arg::Optional,
+		"--trace -r \tRecord the timeline of the precomputations and of the rendering work (per thread, with the GPU "
+		"time of each precomputation step if timer queries are supported) to the given file, in the Chrome trace JSON "
+		"format (which can be viewed with chrome://tracing or https://ui.perfetto.dev)."
+	},
 	{
 		commandlineOptionIndex::unknown,
 		0,
@@ -107,10 +203,87 @@ const option::Descriptor usage[] =
 	"\nExamples:\n"
 	"  PrecomputedAtmosphericScattering.exe -dC:\\test\n"
 	"  PrecomputedAtmosphericScattering.exe --output_directory=C:\\test\n"
+	"  PrecomputedAtmosphericScattering.exe -dC:\\test -jC:\\test\\jobs.txt\n"
+	"  PrecomputedAtmosphericScattering.exe -dC:\\test -jC:\\test\\sweep.txt --reuse_azimuth\n"
+	"  PrecomputedAtmosphericScattering.exe -dC:\\test -nsky -c256 -l0 -fggx --irradiance_sh -oexr\n"
+	"  PrecomputedAtmosphericScattering.exe -dC:\\test -nsky --lookup_textures\n"
+	"  PrecomputedAtmosphericScattering.exe -dC:\\test -nsky --trace=C:\\test\\trace.json\n"
 	},
 	{ 0,0,0,0,0,0 } // Null to end array
 };
 
+// Parses a job list file (see the job_list option). Returns false, after printing the reason, if the file can't be read
+// or contains an invalid line.
+bool ParseJobList(const char* path, float defaultMieScale, std::vector<atmosphere::AtmosphereGen::Job>& jobs)
+{
+	std::ifstream file(path);
+	if (!file.good())
+	{
+		std::cerr << "job_list specified does not exist!\n";
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		std::stringstream lineStream(line);
+		std::string outputName;
+		if (!(lineStream >> outputName) || outputName[0] == '#')
+			continue;
+
+		atmosphere::AtmosphereGen::Job job;
+		job.outputName = outputName;
+		job.mieScale = defaultMieScale;
+
+		std::string sunDirection;
+		bool valid = static_cast<bool>(lineStream >> job.altitude >> sunDirection);
+		if (valid)
+		{
+			std::stringstream sunStream(sunDirection);
+			std::string segment;
+			for (int i = 0; i < 3; i++)
+			{
+				if (!std::getline(sunStream, segment, ','))
+				{
+					valid = false;
+					break;
+				}
+				try
+				{
+					job.sunDirection[i] = std::stof(segment);
+				}
+				catch (...)
+				{
+					valid = false;
+					break;
+				}
+			}
+		}
+		// The mie scale is optional, but must be a number if present.
+		float mieScale;
+		if (valid && lineStream >> mieScale)
+			job.mieScale = mieScale;
+		else if (valid)
+			valid = lineStream.eof();
+
+		if (!valid)
+		{
+			std::cerr << "Error parsing job_list line " << lineNumber << ": " << line << "\n";
+			return false;
+		}
+		jobs.push_back(job);
+	}
+
+	if (jobs.empty())
+	{
+		std::cerr << "job_list is empty!\n";
+		return false;
+	}
+	return true;
+}
+
 int main(int argc, char** argv) 
 {
 	bool error = false;
@@ -153,18 +326,44 @@ int main(int argc, char** argv)
 		error = true;
 	}
 
+	// Job list
+	option::Option jobListOption = commandlineOptions[commandlineOptionIndex::job_list];
+	const bool useJobList = jobListOption.count() && jobListOption.arg;
+
 	// Output name
 	option::Option outputNameOption = commandlineOptions[commandlineOptionIndex::output_name];
 	if (outputNameOption.count() && outputNameOption.arg)
 	{
 		options.outputName = outputNameOption.arg;
 	}
-	else
+	else if (!useJobList)
 	{
 		std::cerr << "output_name must be specified!\n";
 		error = true;
 	}
 
+	// Output format
+	option::Option outputFormatOption = commandlineOptions[commandlineOptionIndex::output_format];
+	if (outputFormatOption.count() && outputFormatOption.arg)
+	{
+		const std::string outputFormat = outputFormatOption.arg;
+		if (outputFormat == "tif")
+			options.outputFormat = atmosphere::AtmosphereGen::Options::TIFF;
+		else if (outputFormat == "exr")
+			options.outputFormat = atmosphere::AtmosphereGen::Options::EXR_HALF;
+		else if (outputFormat == "exr32")
+			options.outputFormat = atmosphere::AtmosphereGen::Options::EXR_FLOAT;
+		else if (outputFormat == "dds")
+			options.outputFormat = atmosphere::AtmosphereGen::Options::DDS_BC6H;
+		else if (outputFormat == "dds_hq")
+			options.outputFormat = atmosphere::AtmosphereGen::Options::DDS_BC6H_QUALITY;
+		else
+		{
+			std::cerr << "Error parsing argument: " << outputFormatOption.name << "\n";
+			error = true;
+		}
+	}
+
 	// Altitude
 	option::Option altitudeOption = commandlineOptions[commandlineOptionIndex::altitude];
 	if (altitudeOption.count() && altitudeOption.arg)
@@ -225,10 +424,91 @@ int main(int argc, char** argv)
 		}
 	}
 
+	// Reuse azimuth
+	if (commandlineOptions[commandlineOptionIndex::reuse_azimuth])
+	{
+		options.reuseAzimuth = true;
+	}
+
+	// Cubemap resolution
+	option::Option cubemapResolutionOption = commandlineOptions[commandlineOptionIndex::cubemap_resolution];
+	if (cubemapResolutionOption.count() && cubemapResolutionOption.arg)
+	{
+		try
+		{
+			options.cubemapResolution = std::stoi(cubemapResolutionOption.arg);
+		}
+		catch (...)
+		{
+			options.cubemapResolution = 0;
+		}
+		if (options.cubemapResolution <= 0)
+		{
+			std::cerr << "Error parsing argument: " << cubemapResolutionOption.name << "\n";
+			error = true;
+		}
+	}
+
+	// Mip levels
+	option::Option mipLevelsOption = commandlineOptions[commandlineOptionIndex::mip_levels];
+	if (mipLevelsOption.count() && mipLevelsOption.arg)
+	{
+		try
+		{
+			options.cubemapMipLevels = std::stoi(mipLevelsOption.arg);
+		}
+		catch (...)
+		{
+			options.cubemapMipLevels = -1;
+		}
+		if (options.cubemapMipLevels < 0)
+		{
+			std::cerr << "Error parsing argument: " << mipLevelsOption.name << "\n";
+			error = true;
+		}
+	}
+
+	// Mip filter
+	option::Option mipFilterOption = commandlineOptions[commandlineOptionIndex::mip_filter];
+	if (mipFilterOption.count() && mipFilterOption.arg)
+	{
+		const std::string mipFilter = mipFilterOption.arg;
+		if (mipFilter == "box")
+			options.mipFilter = atmosphere::AtmosphereGen::Options::BOX;
+		else if (mipFilter == "ggx")
+			options.mipFilter = atmosphere::AtmosphereGen::Options::GGX;
+		else
+		{
+			std::cerr << "Error parsing argument: " << mipFilterOption.name << "\n";
+			error = true;
+		}
+	}
+
+	// Irradiance spherical harmonics
+	if (commandlineOptions[commandlineOptionIndex::irradiance_sh])
+	{
+		options.outputIrradianceSH = true;
+	}
+
+	// Lookup textures
+	if (commandlineOptions[commandlineOptionIndex::lookup_textures])
+	{
+		options.outputLookupTextures = true;
+	}
+
+	// The job list is parsed last, so that its rows default to the mie scale given on the command line.
+	std::vector<atmosphere::AtmosphereGen::Job> jobs;
+	if (useJobList && !ParseJobList(jobListOption.arg, options.mieScale, jobs))
+	{
+		error = true;
+	}
+
 	if (error)
 		return 1;
 
 	options.Print();
+	if (useJobList)
+		std::cout << "jobs: " << jobs.size() << "\n";
 
 	// Initialize OpenGL
 	char* fakeArgv[] = { "" };
@@ -240,11 +520,26 @@ int main(int argc, char** argv)
 	glutCreateWindow("");
 	glewInit();
 
+	// Start tracing before the rendering, which precomputes the model.
+	option::Option traceOption = commandlineOptions[commandlineOptionIndex::trace];
+	const bool useTrace = traceOption.count() && traceOption.arg;
+	if (useTrace)
+		atmosphere::trace::Start();
+
 	// Create and configure atmosphere gen
 	atmosphere::AtmosphereGen atmosphereGen(options);
 
 	// Render
-	atmosphereGen.RenderAtmosphere();
+	if (useJobList)
+		atmosphereGen.RenderJobs(jobs);
+	else
+		atmosphereGen.RenderAtmosphere();
 
+	if (useTrace)
+	{
+		std::cout << "writing " << traceOption.arg << "..." << std::endl;
+		if (!atmosphere::trace::Stop(traceOption.arg))
+			std::cerr << "Error writing " << traceOption.arg << "\n";
+	}
 	return 0;
 }
@@ -37,6 +37,13 @@ model. It also provides tabulated values of the <a href=
 <a href="https://en.wikipedia.org/wiki/SRGB">sRGB</a> color spaces (which are
 needed to convert the spectral radiance samples computed by our algorithm to
 sRGB luminance values).
+
+<p>The size of the precomputed textures, and the number of samples used to
+compute the integrals of the precomputations, can be changed at compile time
+by defining a macro with the same name, prefixed with <code>ATMOSPHERE_</code>
+(e.g. <code>-DATMOSPHERE_SCATTERING_TEXTURE_MU_SIZE=64</code>). This is used by
+<a href="reference/model_sweep.cc.html">model_sweep.cc</a> to measure the
+precision and the cost of different values.
 */
 
 #ifndef ATMOSPHERE_CONSTANTS_H_
@@ -44,21 +51,94 @@ sRGB luminance values).
 
 namespace atmosphere {
 
-constexpr int TRANSMITTANCE_TEXTURE_WIDTH = 256;
-constexpr int TRANSMITTANCE_TEXTURE_HEIGHT = 64;
+#ifndef ATMOSPHERE_TRANSMITTANCE_TEXTURE_WIDTH
+#define ATMOSPHERE_TRANSMITTANCE_TEXTURE_WIDTH 256
+#endif
+#ifndef ATMOSPHERE_TRANSMITTANCE_TEXTURE_HEIGHT
+#define ATMOSPHERE_TRANSMITTANCE_TEXTURE_HEIGHT 64
+#endif
+
+#ifndef ATMOSPHERE_SCATTERING_TEXTURE_R_SIZE
+#define ATMOSPHERE_SCATTERING_TEXTURE_R_SIZE 32
+#endif
+#ifndef ATMOSPHERE_SCATTERING_TEXTURE_MU_SIZE
+#define ATMOSPHERE_SCATTERING_TEXTURE_MU_SIZE 128
+#endif
+#ifndef ATMOSPHERE_SCATTERING_TEXTURE_MU_S_SIZE
+#define ATMOSPHERE_SCATTERING_TEXTURE_MU_S_SIZE 32
+#endif
+#ifndef ATMOSPHERE_SCATTERING_TEXTURE_NU_SIZE
+#define ATMOSPHERE_SCATTERING_TEXTURE_NU_SIZE 8
+#endif
+
+#ifndef ATMOSPHERE_IRRADIANCE_TEXTURE_WIDTH
+#define ATMOSPHERE_IRRADIANCE_TEXTURE_WIDTH 64
+#endif
+#ifndef ATMOSPHERE_IRRADIANCE_TEXTURE_HEIGHT
+#define ATMOSPHERE_IRRADIANCE_TEXTURE_HEIGHT 16
+#endif
+
+#ifndef ATMOSPHERE_TRANSMITTANCE_SAMPLE_COUNT
+#define ATMOSPHERE_TRANSMITTANCE_SAMPLE_COUNT 500
+#endif
+#ifndef ATMOSPHERE_SINGLE_SCATTERING_SAMPLE_COUNT
+#define ATMOSPHERE_SINGLE_SCATTERING_SAMPLE_COUNT 50
+#endif
+#ifndef ATMOSPHERE_SCATTERING_DENSITY_SAMPLE_COUNT
+#define ATMOSPHERE_SCATTERING_DENSITY_SAMPLE_COUNT 16
+#endif
+#ifndef ATMOSPHERE_INDIRECT_IRRADIANCE_SAMPLE_COUNT
+#define ATMOSPHERE_INDIRECT_IRRADIANCE_SAMPLE_COUNT 32
+#endif
+#ifndef ATMOSPHERE_MULTIPLE_SCATTERING_SAMPLE_COUNT
+#define ATMOSPHERE_MULTIPLE_SCATTERING_SAMPLE_COUNT 50
+#endif
+
+constexpr int TRANSMITTANCE_TEXTURE_WIDTH =
+    ATMOSPHERE_TRANSMITTANCE_TEXTURE_WIDTH;
+constexpr int TRANSMITTANCE_TEXTURE_HEIGHT =
+    ATMOSPHERE_TRANSMITTANCE_TEXTURE_HEIGHT;
 
-constexpr int SCATTERING_TEXTURE_R_SIZE = 32;
-constexpr int SCATTERING_TEXTURE_MU_SIZE = 128;
-constexpr int SCATTERING_TEXTURE_MU_S_SIZE = 32;
-constexpr int SCATTERING_TEXTURE_NU_SIZE = 8;
+constexpr int SCATTERING_TEXTURE_R_SIZE = ATMOSPHERE_SCATTERING_TEXTURE_R_SIZE;
+constexpr int SCATTERING_TEXTURE_MU_SIZE =
+    ATMOSPHERE_SCATTERING_TEXTURE_MU_SIZE;
+constexpr int SCATTERING_TEXTURE_MU_S_SIZE =
+    ATMOSPHERE_SCATTERING_TEXTURE_MU_S_SIZE;
+constexpr int SCATTERING_TEXTURE_NU_SIZE =
+    ATMOSPHERE_SCATTERING_TEXTURE_NU_SIZE;
 
 constexpr int SCATTERING_TEXTURE_WIDTH =
     SCATTERING_TEXTURE_NU_SIZE * SCATTERING_TEXTURE_MU_S_SIZE;
 constexpr int SCATTERING_TEXTURE_HEIGHT = SCATTERING_TEXTURE_MU_SIZE;
 constexpr int SCATTERING_TEXTURE_DEPTH = SCATTERING_TEXTURE_R_SIZE;
 
-constexpr int IRRADIANCE_TEXTURE_WIDTH = 64;
-constexpr int IRRADIANCE_TEXTURE_HEIGHT = 16;
+constexpr int IRRADIANCE_TEXTURE_WIDTH = ATMOSPHERE_IRRADIANCE_TEXTURE_WIDTH;
+constexpr int IRRADIANCE_TEXTURE_HEIGHT = ATMOSPHERE_IRRADIANCE_TEXTURE_HEIGHT;
+
+// The number of samples used to compute the integrals of the precomputations
+// (see functions.glsl). For the scattering density and the indirect irradiance,
+// this is the number of samples per half circle of each spherical coordinate.
+constexpr int TRANSMITTANCE_SAMPLE_COUNT =
+    ATMOSPHERE_TRANSMITTANCE_SAMPLE_COUNT;
+constexpr int SINGLE_SCATTERING_SAMPLE_COUNT =
+    ATMOSPHERE_SINGLE_SCATTERING_SAMPLE_COUNT;
+constexpr int SCATTERING_DENSITY_SAMPLE_COUNT =
+    ATMOSPHERE_SCATTERING_DENSITY_SAMPLE_COUNT;
+constexpr int INDIRECT_IRRADIANCE_SAMPLE_COUNT =
+    ATMOSPHERE_INDIRECT_IRRADIANCE_SAMPLE_COUNT;
+constexpr int MULTIPLE_SCATTERING_SAMPLE_COUNT =
+    ATMOSPHERE_MULTIPLE_SCATTERING_SAMPLE_COUNT;
+
+// The textures used by the fast precomputation mode (see fast_functions.glsl).
+constexpr int MULTI_SCATTERING_TEXTURE_WIDTH = 32;
+constexpr int MULTI_SCATTERING_TEXTURE_HEIGHT = 32;
+
+constexpr int SKY_VIEW_TEXTURE_WIDTH = 192;
+constexpr int SKY_VIEW_TEXTURE_HEIGHT = 108;
+
+constexpr int AERIAL_PERSPECTIVE_TEXTURE_WIDTH = 32;
+constexpr int AERIAL_PERSPECTIVE_TEXTURE_HEIGHT = 32;
+constexpr int AERIAL_PERSPECTIVE_TEXTURE_DEPTH = 32;
 
 // The conversion factor between watts and lumens.
 constexpr double MAX_LUMINOUS_EFFICACY = 683.0;
@@ -131,6 +131,10 @@ macros. The full definitions are given in the
 #define ScatteringTexture sampler3D
 #define ScatteringDensityTexture sampler3D
 #define IrradianceTexture sampler2D
+#define MultiScatteringTexture sampler2D
+#define SkyViewTexture sampler2D
+#define AerialPerspectiveScatteringTexture sampler3D
+#define AerialPerspectiveTransmittanceTexture sampler3D
 
 /*
 <h3>Physical units</h3>
@@ -69,6 +69,10 @@ constexpr double kPi = 3.1415926;
 constexpr double kSunAngularRadius = 0.00935 / 2.0;
 constexpr double kSunSolidAngle = kPi * kSunAngularRadius * kSunAngularRadius;
 constexpr double kLengthUnitInMeters = 1000.0;
+// The directory where the precomputed textures are cached, so that they are
+// only precomputed the first time the demo is launched (or the first time an
+// option changing them is toggled).
+constexpr char kCacheDirectory[] = "output/";
 
 const char kVertexShader[] = R"(
     #version 330
@@ -250,7 +254,7 @@ void Demo::InitModel() {
       {mie_layer}, mie_scattering, mie_extinction, kMiePhaseFunctionG,
       ozone_density, absorption_extinction, ground_albedo, max_sun_zenith_angle,
       kLengthUnitInMeters, use_luminance_ == PRECOMPUTED ? 15 : 3,
-      use_combined_textures_, use_half_precision_));
+      use_combined_textures_, use_half_precision_, kCacheDirectory));
   model_->Init();
 
 /*
@@ -0,0 +1,684 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/fast_functions.glsl</h2>
+
+<p>This GLSL file contains the functions of an alternative, "fast"
+precomputation mode for our atmosphere model, based on the method described in
+<a href="https://sebh.github.io/publications/egsr2020.pdf">A Scalable and
+Production Ready Sky and Atmosphere Rendering Technique</a> (Sébastien Hillaire,
+EGSR 2020). Instead of the 4D scattering texture described in
+<a href="functions.glsl.html">functions.glsl</a>, which takes seconds to compute
+and must be recomputed each time the atmosphere parameters change, this mode
+uses the following textures, all small enough to be recomputed at each frame:
+<ul>
+<li>the transmittance texture, computed exactly as in the default mode,</li>
+<li>a multiple scattering texture, which depends only on $r$ and $\mu_s$, and
+which is computed with an approximation assuming that the light scattered at
+orders 2 and more is isotropic,</li>
+<li>a sky view texture, which contains the sky radiance as seen from a given
+viewer, and which is recomputed when the viewer or the Sun move,</li>
+<li>an aerial perspective texture, which contains the in-scattered radiance and
+the transmittance between the viewer and the points of a 3D grid aligned with
+the view frustum (a "froxel" volume), also recomputed for each view.</li>
+</ul>
+
+<p>This file reuses the atmosphere parameters, the physical types and the
+transmittance functions from <a href="functions.glsl.html">functions.glsl</a>,
+which must be included before it. Like this file, it can be compiled either
+with a GLSL compiler or with a C++ compiler.
+
+<p>The functions provided in this file are organized as follows:
+<ul>
+<li><a href="#medium">Participating medium</a></li>
+<li><a href="#multi_scattering">Multiple scattering</a>
+<ul>
+<li><a href="#multi_scattering_computation">Computation</a></li>
+<li><a href="#multi_scattering_precomputation">Precomputation</a></li>
+<li><a href="#multi_scattering_lookup">Lookup</a></li>
+</ul>
+</li>
+<li><a href="#sky_view">Sky view</a>
+<ul>
+<li><a href="#sky_view_computation">Computation</a></li>
+<li><a href="#sky_view_precomputation">Precomputation</a></li>
+<li><a href="#sky_view_lookup">Lookup</a></li>
+</ul>
+</li>
+<li><a href="#aerial_perspective">Aerial perspective</a>
+<ul>
+<li><a href="#aerial_perspective_precomputation">Precomputation</a></li>
+<li><a href="#aerial_perspective_lookup">Lookup</a></li>
+</ul>
+</li>
+<li><a href="#fast_rendering">Rendering</a></li>
+</ul>
+
+<h3 id="medium">Participating medium</h3>
+
+<p>Unlike the default mode, which precomputes the Rayleigh and Mie single
+scattering separately, this mode integrates all the scattering terms along each
+ray in a single loop. At each step it needs the Rayleigh and Mie scattering
+coefficients, and the total extinction coefficient (including the absorption by
+ozone) at the current point, which are given by the following function:
+*/
+
+void ComputeMediumCoefficients(IN(AtmosphereParameters) atmosphere,
+    Length r, OUT(ScatteringSpectrum) rayleigh_scattering,
+    OUT(ScatteringSpectrum) mie_scattering,
+    OUT(ScatteringSpectrum) extinction) {
+  Length altitude = r - atmosphere.bottom_radius;
+  Number rayleigh_density =
+      GetProfileDensity(atmosphere.rayleigh_density, altitude);
+  Number mie_density = GetProfileDensity(atmosphere.mie_density, altitude);
+  Number absorption_density =
+      GetProfileDensity(atmosphere.absorption_density, altitude);
+  rayleigh_scattering = atmosphere.rayleigh_scattering * rayleigh_density;
+  mie_scattering = atmosphere.mie_scattering * mie_density;
+  extinction = rayleigh_scattering +
+      atmosphere.mie_extinction * mie_density +
+      atmosphere.absorption_extinction * absorption_density;
+}
+
+/*
+<h3 id="multi_scattering">Multiple scattering</h3>
+
+<p>The multiple scattering texture contains, for each point at radius $r$ and
+each Sun zenith angle cosine $\mu_s$, an approximation of the radiance arriving
+at this point after 2 or more bounces, averaged over all directions. This
+approximation relies on two assumptions: the light scattered at orders 2 and
+more is isotropic, and it is the same at all the points in the neighborhood of
+the considered point. With these assumptions, each scattering order is
+proportional to the previous one, with a constant "transfer" factor $f_{ms}$,
+and the sum of all the orders $n\ge 2$ is a geometric series.
+
+<h4 id="multi_scattering_computation">Computation</h4>
+
+<p>The following function computes, for a ray starting at radius $r$ with
+direction $(\mu,\nu)$, the two integrals needed for this approximation: the
+radiance arriving at the ray origin after exactly one bounce (in the atmosphere,
+with an isotropic phase function, or on the ground, with the average ground
+albedo), and the fraction of some uniform isotropic radiance arriving at the ray
+origin after one bounce in the atmosphere (noted $f_{ms}$ in Hillaire's paper):
+*/
+
+void ComputeIsotropicScatteringIntegrals(
+    IN(AtmosphereParameters) atmosphere,
+    IN(TransmittanceTexture) transmittance_texture,
+    Length r, Number mu, Number mu_s, Number nu,
+    OUT(RadianceSpectrum) radiance, OUT(DimensionlessSpectrum) transfer) {
+  const int SAMPLE_COUNT = 20;
+  const InverseSolidAngle isotropic_phase = 1.0 / (4.0 * PI * sr);
+  bool ray_r_mu_intersects_ground = RayIntersectsGround(atmosphere, r, mu);
+  Length d = DistanceToNearestAtmosphereBoundary(
+      atmosphere, r, mu, ray_r_mu_intersects_ground);
+  Length dx = d / Number(SAMPLE_COUNT);
+  DimensionlessSpectrum optical_depth = DimensionlessSpectrum(0.0);
+  radiance = RadianceSpectrum(0.0 * watt_per_square_meter_per_sr_per_nm);
+  transfer = DimensionlessSpectrum(0.0);
+  for (int i = 0; i < SAMPLE_COUNT; ++i) {
+    Length d_i = (Number(i) + 0.5) * dx;
+    Length r_i =
+        ClampRadius(atmosphere, sqrt(d_i * d_i + 2.0 * r * mu * d_i + r * r));
+    Number mu_s_i = ClampCosine((r * mu_s + d_i * nu) / r_i);
+    ScatteringSpectrum rayleigh_scattering;
+    ScatteringSpectrum mie_scattering;
+    ScatteringSpectrum extinction;
+    ComputeMediumCoefficients(atmosphere, r_i, rayleigh_scattering,
+        mie_scattering, extinction);
+    DimensionlessSpectrum transmittance_i =
+        exp(-(optical_depth + extinction * (0.5 * dx)));
+    ScatteringSpectrum scattering = rayleigh_scattering + mie_scattering;
+    radiance += transmittance_i * scattering * dx * isotropic_phase *
+        atmosphere.solar_irradiance *
+        GetTransmittanceToSun(atmosphere, transmittance_texture, r_i, mu_s_i);
+    transfer += transmittance_i * scattering * dx;
+    optical_depth += extinction * dx;
+  }
+  // Light reflected by the ground (assumed to be a Lambertian reflector).
+  if (ray_r_mu_intersects_ground) {
+    Number mu_s_ground =
+        ClampCosine((r * mu_s + d * nu) / atmosphere.bottom_radius);
+    radiance += exp(-optical_depth) * atmosphere.ground_albedo *
+        (1.0 / (PI * sr)) * atmosphere.solar_irradiance *
+        GetTransmittanceToSun(atmosphere, transmittance_texture,
+            atmosphere.bottom_radius, mu_s_ground) *
+        max(mu_s_ground, 0.0);
+  }
+}
+
+/*
+<p>The multiple scattering approximation is then obtained by integrating these
+two terms over all directions, with an isotropic phase function, which gives the
+second order scattering $L_{2nd order}$ and the transfer factor $f_{ms}$, and by
+summing the geometric series $L_{2nd order}(1+f_{ms}+f_{ms}^2+...)$. Since the
+integrands are symmetric with respect to the plane containing the zenith and the
+Sun direction, we only need to integrate over half of the sphere (and double the
+result):
+*/
+
+RadianceSpectrum ComputeMultiScattering(
+    IN(AtmosphereParameters) atmosphere,
+    IN(TransmittanceTexture) transmittance_texture,
+    Length r, Number mu_s) {
+  const int SAMPLE_COUNT = 8;
+  const Angle dphi = pi / Number(SAMPLE_COUNT);
+  const Angle dtheta = pi / Number(SAMPLE_COUNT);
+  const InverseSolidAngle isotropic_phase = 1.0 / (4.0 * PI * sr);
+  Number sin_theta_s = sqrt(max(1.0 - mu_s * mu_s, 0.0));
+  RadianceSpectrum second_order =
+      RadianceSpectrum(0.0 * watt_per_square_meter_per_sr_per_nm);
+  DimensionlessSpectrum transfer = DimensionlessSpectrum(0.0);
+  for (int l = 0; l < SAMPLE_COUNT; ++l) {
+    Angle theta = (Number(l) + 0.5) * dtheta;
+    Number mu = cos(theta);
+    for (int m = 0; m < SAMPLE_COUNT; ++m) {
+      Angle phi = (Number(m) + 0.5) * dphi;
+      Number nu = mu * mu_s + sin(theta) * sin_theta_s * cos(phi);
+      SolidAngle domega = 2.0 * (dtheta / rad) * (dphi / rad) * sin(theta) * sr;
+      RadianceSpectrum radiance_i;
+      DimensionlessSpectrum transfer_i;
+      ComputeIsotropicScatteringIntegrals(atmosphere, transmittance_texture,
+          r, mu, mu_s, nu, radiance_i, transfer_i);
+      second_order += radiance_i * isotropic_phase * domega;
+      transfer += transfer_i * isotropic_phase * domega;
+    }
+  }
+  return second_order / (DimensionlessSpectrum(1.0) - transfer);
+}
+
+/*
+<h4 id="multi_scattering_precomputation">Precomputation</h4>
+
+<p>The multiple scattering function is very smooth, so we store it in a small
+texture with the same affine mapping as for the ground irradiance texture:
+*/
+
+vec2 GetMultiScatteringTextureUvFromRMuS(IN(AtmosphereParameters) atmosphere,
+    Length r, Number mu_s) {
+  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
+  assert(mu_s >= -1.0 && mu_s <= 1.0);
+  Number x_r = (r - atmosphere.bottom_radius) /
+      (atmosphere.top_radius - atmosphere.bottom_radius);
+  Number x_mu_s = mu_s * 0.5 + 0.5;
+  return vec2(
+      GetTextureCoordFromUnitRange(x_mu_s, MULTI_SCATTERING_TEXTURE_WIDTH),
+      GetTextureCoordFromUnitRange(x_r, MULTI_SCATTERING_TEXTURE_HEIGHT));
+}
+
+void GetRMuSFromMultiScatteringTextureUv(IN(AtmosphereParameters) atmosphere,
+    IN(vec2) uv, OUT(Length) r, OUT(Number) mu_s) {
+  assert(uv.x >= 0.0 && uv.x <= 1.0);
+  assert(uv.y >= 0.0 && uv.y <= 1.0);
+  Number x_mu_s =
+      GetUnitRangeFromTextureCoord(uv.x, MULTI_SCATTERING_TEXTURE_WIDTH);
+  Number x_r =
+      GetUnitRangeFromTextureCoord(uv.y, MULTI_SCATTERING_TEXTURE_HEIGHT);
+  r = atmosphere.bottom_radius +
+      x_r * (atmosphere.top_radius - atmosphere.bottom_radius);
+  mu_s = ClampCosine(2.0 * x_mu_s - 1.0);
+}
+
+const vec2 MULTI_SCATTERING_TEXTURE_SIZE =
+    vec2(MULTI_SCATTERING_TEXTURE_WIDTH, MULTI_SCATTERING_TEXTURE_HEIGHT);
+
+RadianceSpectrum ComputeMultiScatteringTexture(
+    IN(AtmosphereParameters) atmosphere,
+    IN(TransmittanceTexture) transmittance_texture,
+    IN(vec2) gl_frag_coord) {
+  Length r;
+  Number mu_s;
+  GetRMuSFromMultiScatteringTextureUv(
+      atmosphere, gl_frag_coord / MULTI_SCATTERING_TEXTURE_SIZE, r, mu_s);
+  return ComputeMultiScattering(atmosphere, transmittance_texture, r, mu_s);
+}
+
+/*
+<h4 id="multi_scattering_lookup">Lookup</h4>
+*/
+
+RadianceSpectrum GetMultiScattering(
+    IN(AtmosphereParameters) atmosphere,
+    IN(MultiScatteringTexture) multi_scattering_texture,
+    Length r, Number mu_s) {
+  vec2 uv = GetMultiScatteringTextureUvFromRMuS(atmosphere, r, mu_s);
+  return RadianceSpectrum(texture(multi_scattering_texture, uv));
+}
+
+/*
+<h3 id="sky_view">Sky view</h3>
+
+<p>The sky view texture contains the sky radiance for all the view directions
+of a given viewer, and for a given Sun direction. It is recomputed when the
+viewer or the Sun move, and is then used to render the sky with a single lookup
+per pixel.
+
+<h4 id="sky_view_computation">Computation</h4>
+
+<p>The sky radiance is computed by integrating, along the view ray, the single
+scattering (with the Rayleigh and Mie phase functions) and the multiple
+scattering from the multiple scattering texture. We use a quadratic distribution
+of the samples along the ray, in order to get more samples near the viewer,
+where the scattering is the strongest. This function also returns the
+transmittance along the ray segment, and is also used for the aerial perspective
+(with a ray length $d$ smaller than the distance to the nearest atmosphere
+boundary):
+*/
+
+RadianceSpectrum ComputeScatteredRadiance(
+    IN(AtmosphereParameters) atmosphere,
+    IN(TransmittanceTexture) transmittance_texture,
+    IN(MultiScatteringTexture) multi_scattering_texture,
+    Length r, Number mu, Number mu_s, Number nu, Length d, int sample_count,
+    OUT(DimensionlessSpectrum) transmittance) {
+  InverseSolidAngle rayleigh_phase = RayleighPhaseFunction(nu);
+  InverseSolidAngle mie_phase =
+      MiePhaseFunction(atmosphere.mie_phase_function_g, nu);
+  DimensionlessSpectrum optical_depth = DimensionlessSpectrum(0.0);
+  RadianceSpectrum radiance =
+      RadianceSpectrum(0.0 * watt_per_square_meter_per_sr_per_nm);
+  for (int i = 0; i < sample_count; ++i) {
+    Number t_0 = Number(i) / Number(sample_count);
+    Number t_1 = Number(i + 1) / Number(sample_count);
+    Length dx = (t_1 * t_1 - t_0 * t_0) * d;
+    Length d_i = 0.5 * (t_0 * t_0 + t_1 * t_1) * d;
+    Length r_i =
+        ClampRadius(atmosphere, sqrt(d_i * d_i + 2.0 * r * mu * d_i + r * r));
+    Number mu_s_i = ClampCosine((r * mu_s + d_i * nu) / r_i);
+    ScatteringSpectrum rayleigh_scattering;
+    ScatteringSpectrum mie_scattering;
+    ScatteringSpectrum extinction;
+    ComputeMediumCoefficients(atmosphere, r_i, rayleigh_scattering,
+        mie_scattering, extinction);
+    DimensionlessSpectrum transmittance_i =
+        exp(-(optical_depth + extinction * (0.5 * dx)));
+    RadianceDensitySpectrum single_scattering = atmosphere.solar_irradiance *
+        GetTransmittanceToSun(atmosphere, transmittance_texture, r_i, mu_s_i) *
+        (rayleigh_scattering * rayleigh_phase + mie_scattering * mie_phase);
+    RadianceDensitySpectrum multiple_scattering =
+        (rayleigh_scattering + mie_scattering) * GetMultiScattering(
+            atmosphere, multi_scattering_texture, r_i, mu_s_i);
+    radiance +=
+        transmittance_i * (single_scattering + multiple_scattering) * dx;
+    optical_depth += extinction * dx;
+  }
+  transmittance = exp(-optical_depth);
+  return radiance;
+}
+
+/*
+<h4 id="sky_view_precomputation">Precomputation</h4>
+
+<p>The sky view texture is parameterized with the view zenith angle, and with
+the azimuth angle $\phi$ between the view direction and the Sun direction (for
+a given viewer and Sun direction, these two angles are sufficient to describe
+all the view directions). Following Hillaire, we use a non-linear mapping for
+the zenith angle, with more precision near the horizon, where the sky radiance
+varies the most. The horizon itself is mapped to $v=0.5$, with the directions
+above the horizon in the first half of the texture and those intersecting the
+ground in the second half. For the azimuth we use $u=\sqrt{(1-\cos\phi)/2}$,
+which gives more precision near the Sun:
+*/
+
+vec2 GetSkyViewTextureUvFromRMuMuSNu(IN(AtmosphereParameters) atmosphere,
+    Length r, Number mu, Number mu_s, Number nu,
+    bool ray_r_mu_intersects_ground) {
+  assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
+  assert(mu >= -1.0 && mu <= 1.0);
+  assert(mu_s >= -1.0 && mu_s <= 1.0);
+  assert(nu >= -1.0 && nu <= 1.0);
+  // Distance to the horizon.
+  Length rho = SafeSqrt(r * r -
+      atmosphere.bottom_radius * atmosphere.bottom_radius);
+  // Angle between the nadir and the horizon, and between the zenith and the
+  // horizon.
+  Angle beta = acos(rho / r);
+  Angle zenith_horizon_angle = pi - beta;
+  Angle theta = acos(ClampCosine(mu));
+  Number x_mu;
+  if (!ray_r_mu_intersects_ground) {
+    Number coord = 1.0 - theta / zenith_horizon_angle;
+    x_mu = 0.5 - 0.5 * sqrt(max(coord, 0.0));
+  } else {
+    Number coord = (theta - zenith_horizon_angle) / beta;
+    x_mu = 0.5 + 0.5 * sqrt(max(coord, 0.0));
+  }
+  // Cosine of the azimuth angle between the view and Sun directions.
+  Number sin_theta_sin_theta_s =
+      sqrt(max((1.0 - mu * mu) * (1.0 - mu_s * mu_s), 0.0));
+  Number cos_phi = ClampCosine(
+      (nu - mu * mu_s) / max(sin_theta_sin_theta_s, 1e-6));
+  Number x_nu = sqrt(0.5 - 0.5 * cos_phi);
+  return vec2(GetTextureCoordFromUnitRange(x_nu, SKY_VIEW_TEXTURE_WIDTH),
+              GetTextureCoordFromUnitRange(x_mu, SKY_VIEW_TEXTURE_HEIGHT));
+}
+
+/*
+<p>The inverse mapping follows immediately:
+*/
+
+void GetMuNuFromSkyViewTextureUv(IN(AtmosphereParameters) atmosphere,
+    IN(vec2) uv, Length r, Number mu_s, OUT(Number) mu, OUT(Number) nu,
+    OUT(bool) ray_r_mu_intersects_ground) {
+  assert(uv.x >= 0.0 && uv.x <= 1.0);
+  assert(uv.y >= 0.0 && uv.y <= 1.0);
+  Number x_nu = GetUnitRangeFromTextureCoord(uv.x, SKY_VIEW_TEXTURE_WIDTH);
+  Number x_mu = GetUnitRangeFromTextureCoord(uv.y, SKY_VIEW_TEXTURE_HEIGHT);
+  Length rho = SafeSqrt(r * r -
+      atmosphere.bottom_radius * atmosphere.bottom_radius);
+  Angle beta = acos(rho / r);
+  Angle zenith_horizon_angle = pi - beta;
+  if (x_mu < 0.5) {
+    Number coord = 1.0 - 2.0 * x_mu;
+    mu = cos((1.0 - coord * coord) * zenith_horizon_angle);
+    ray_r_mu_intersects_ground = false;
+  } else {
+    Number coord = 2.0 * x_mu - 1.0;
+    mu = cos(zenith_horizon_angle + coord * coord * beta);
+    ray_r_mu_intersects_ground = true;
+  }
+  Number cos_phi = 1.0 - 2.0 * x_nu * x_nu;
+  nu = ClampCosine(mu * mu_s +
+      sqrt(max((1.0 - mu * mu) * (1.0 - mu_s * mu_s), 0.0)) * cos_phi);
+}
+
+/*
+<p>Using this mapping, we can write a function to compute a texel of the sky
+view texture, for a viewer at radius $r$ and a Sun zenith angle cosine $\mu_s$
+(which must be the same for all the texels):
+*/
+
+const vec2 SKY_VIEW_TEXTURE_SIZE =
+    vec2(SKY_VIEW_TEXTURE_WIDTH, SKY_VIEW_TEXTURE_HEIGHT);
+
+const int SKY_VIEW_SAMPLE_COUNT = 30;
+
+RadianceSpectrum ComputeSkyViewTexture(
+    IN(AtmosphereParameters) atmosphere,
+    IN(TransmittanceTexture) transmittance_texture,
+    IN(MultiScatteringTexture) multi_scattering_texture,
+    IN(vec2) gl_frag_coord, Length r, Number mu_s) {
+  Number mu;
+  Number nu;
+  bool ray_r_mu_intersects_ground;
+  GetMuNuFromSkyViewTextureUv(atmosphere, gl_frag_coord / SKY_VIEW_TEXTURE_SIZE,
+      r, mu_s, mu, nu, ray_r_mu_intersects_ground);
+  Length d = DistanceToNearestAtmosphereBoundary(
+      atmosphere, r, mu, ray_r_mu_intersects_ground);
+  DimensionlessSpectrum transmittance;
+  return ComputeScatteredRadiance(atmosphere, transmittance_texture,
+      multi_scattering_texture, r, mu, mu_s, nu, d, SKY_VIEW_SAMPLE_COUNT,
+      transmittance);
+}
+
+/*
+<h4 id="sky_view_lookup">Lookup</h4>
+
+<p>The sky radiance for a viewer at radius $r$ can then be obtained with a
+single texture lookup, provided the sky view texture was computed for this
+radius and for the Sun zenith angle cosine $\mu_s$:
+*/
+
+RadianceSpectrum GetSkyView(
+    IN(AtmosphereParameters) atmosphere,
+    IN(SkyViewTexture) sky_view_texture,
+    Length r, Number mu, Number mu_s, Number nu,
+    bool ray_r_mu_intersects_ground) {
+  vec2 uv = GetSkyViewTextureUvFromRMuMuSNu(
+      atmosphere, r, mu, mu_s, nu, ray_r_mu_intersects_ground);
+  return RadianceSpectrum(texture(sky_view_texture, uv));
+}
+
+/*
+<h3 id="aerial_perspective">Aerial perspective</h3>
+
+<p>The aerial perspective textures contain the in-scattered radiance and the
+transmittance between a viewer and the points of a 3D grid aligned with the view
+frustum. The first two texture coordinates are the normalized screen
+coordinates, and the third one corresponds to the distance to the viewer, with a
+quadratic distribution in order to get more precision near the viewer. The grid
+covers the distances from 0 to some maximum distance $d_{max}$:
+*/
+
+Length GetAerialPerspectiveDistanceFromTextureCoord(Number w,
+    Length max_distance) {
+  return w * w * max_distance;
+}
+
+Number GetAerialPerspectiveTextureCoordFromDistance(Length d,
+    Length max_distance) {
+  return sqrt(max(d / max_distance, 0.0));
+}
+
+/*
+<h4 id="aerial_perspective_precomputation">Precomputation</h4>
+
+<p>The texel values are computed with the same function as for the sky view
+texture, from the viewer to the texel distance $d$ along the texel's view ray
+(clamped to the nearest atmosphere boundary). We handle viewers in space by
+moving them to the top atmosphere boundary first, as in the default mode:
+*/
+
+RadianceSpectrum ComputeAerialPerspective(
+    IN(AtmosphereParameters) atmosphere,
+    IN(TransmittanceTexture) transmittance_texture,
+    IN(MultiScatteringTexture) multi_scattering_texture,
+    Position camera, IN(Direction) view_ray, Length d,
+    IN(Direction) sun_direction, int sample_count,
+    OUT(DimensionlessSpectrum) transmittance) {
+  Length r = length(camera);
+  Length rmu = dot(camera, view_ray);
+  Length distance_to_top_atmosphere_boundary = -rmu -
+      sqrt(rmu * rmu - r * r + atmosphere.top_radius * atmosphere.top_radius);
+  if (distance_to_top_atmosphere_boundary > 0.0 * m) {
+    camera = camera + view_ray * distance_to_top_atmosphere_boundary;
+    r = atmosphere.top_radius;
+    rmu += distance_to_top_atmosphere_boundary;
+    d = d - distance_to_top_atmosphere_boundary;
+  } else if (r > atmosphere.top_radius) {
+    transmittance = DimensionlessSpectrum(1.0);
+    return RadianceSpectrum(0.0 * watt_per_square_meter_per_sr_per_nm);
+  }
+  Number mu = ClampCosine(rmu / r);
+  Number mu_s = ClampCosine(dot(camera, sun_direction) / r);
+  Number nu = ClampCosine(dot(view_ray, sun_direction));
+  bool ray_r_mu_intersects_ground = RayIntersectsGround(atmosphere, r, mu);
+  d = ClampDistance(min(d, DistanceToNearestAtmosphereBoundary(
+      atmosphere, r, mu, ray_r_mu_intersects_ground)));
+  return ComputeScatteredRadiance(atmosphere, transmittance_texture,
+      multi_scattering_texture, r, mu, mu_s, nu, d, sample_count,
+      transmittance);
+}
+
+/*
+<p>The texel values of a slice of the aerial perspective textures are then
+computed at the distance corresponding to the center of the slice, for the view
+ray of the texel (which depends on the projection used by the caller). Since
+the ray segments are shorter for the first slices, we use fewer samples for
+them:
+*/
+
+RadianceSpectrum ComputeAerialPerspectiveTexture(
+    IN(AtmosphereParameters) atmosphere,
+    IN(TransmittanceTexture) transmittance_texture,
+    IN(MultiScatteringTexture) multi_scattering_texture,
+    IN(Position) camera, IN(Direction) view_ray, IN(Direction) sun_direction,
+    int slice, Length max_distance,
+    OUT(DimensionlessSpectrum) transmittance) {
+  Number w = (Number(slice) + 0.5) / Number(AERIAL_PERSPECTIVE_TEXTURE_DEPTH);
+  Length d = GetAerialPerspectiveDistanceFromTextureCoord(w, max_distance);
+  return ComputeAerialPerspective(atmosphere, transmittance_texture,
+      multi_scattering_texture, camera, view_ray, d, sun_direction,
+      max(slice + 1, 4), transmittance);
+}
+
+/*
+<p>The same mapping can be used to store the aerial perspective of the default
+mode, computed with <code>GetSkyRadianceToPoint</code> from the precomputed
+scattering textures, in an <i>aerial perspective volume</i>. The texel
+distances are clamped to the top atmosphere boundary, beyond which the aerial
+perspective no longer changes. Note that we do not clamp them to the ground:
+near the horizon, the values computed for the texels behind the ground give
+better interpolated values for the ground points than the values at the ground
+(the view rays of two adjacent texels can hit the ground at very different
+distances there):
+*/
+
+RadianceSpectrum ComputeAerialPerspectiveVolumeTexture(
+    IN(AtmosphereParameters) atmosphere,
+    IN(TransmittanceTexture) transmittance_texture,
+    IN(ReducedScatteringTexture) scattering_texture,
+    IN(ReducedScatteringTexture) single_mie_scattering_texture,
+    IN(Position) camera, IN(Direction) view_ray, IN(Direction) sun_direction,
+    int slice, Length max_distance,
+    OUT(DimensionlessSpectrum) transmittance) {
+  Number w = (Number(slice) + 0.5) / Number(AERIAL_PERSPECTIVE_TEXTURE_DEPTH);
+  Length d = GetAerialPerspectiveDistanceFromTextureCoord(w, max_distance);
+  Length r = length(camera);
+  Length rmu = dot(camera, view_ray);
+  Area discriminant = rmu * rmu - r * r +
+      atmosphere.top_radius * atmosphere.top_radius;
+  d = min(d, ClampDistance(-rmu + SafeSqrt(discriminant)));
+  return GetSkyRadianceToPoint(atmosphere, transmittance_texture,
+      scattering_texture, single_mie_scattering_texture, camera,
+      camera + view_ray * d, 0.0 * m, sun_direction, transmittance);
+}
+
+/*
+<h4 id="aerial_perspective_lookup">Lookup</h4>
+
+<p>The in-scattered radiance and the transmittance for a point at distance $d$
+from the viewer, at the normalized screen coordinates $uv$, can then be obtained
+with a single trilinear lookup in each texture. Between the viewer and the
+first slice of the grid we interpolate linearly towards the exact values at
+$d=0$, i.e. no in-scattering and a unit transmittance:
+*/
+
+RadianceSpectrum GetAerialPerspective(
+    IN(AerialPerspectiveScatteringTexture)
+        aerial_perspective_scattering_texture,
+    IN(AerialPerspectiveTransmittanceTexture)
+        aerial_perspective_transmittance_texture,
+    IN(vec2) uv, Length d, Length max_distance,
+    OUT(DimensionlessSpectrum) transmittance) {
+  const Number w_0 = 0.5 / Number(AERIAL_PERSPECTIVE_TEXTURE_DEPTH);
+  Number w = GetAerialPerspectiveTextureCoordFromDistance(d, max_distance);
+  Number weight = min(w / w_0, Number(1.0));
+  vec3 uvw = vec3(uv.x, uv.y, max(w, w_0));
+  transmittance = DimensionlessSpectrum(1.0 - weight) + DimensionlessSpectrum(
+      texture(aerial_perspective_transmittance_texture, uvw)) * weight;
+  return RadianceSpectrum(
+      texture(aerial_perspective_scattering_texture, uvw)) * weight;
+}
+
+/*
+<h3 id="fast_rendering">Rendering</h3>
+
+<p>With these textures, the sky radiance can be rendered with a single lookup in
+the sky view texture, provided it was computed for the current viewer and Sun
+directions. For viewers in space, for which this texture is not valid, we fall
+back to a direct integration from the top atmosphere boundary. As in the default
+mode, this function also returns the transmittance to the top atmosphere
+boundary:
+*/
+
+RadianceSpectrum GetFastSkyRadiance(
+    IN(AtmosphereParameters) atmosphere,
+    IN(TransmittanceTexture) transmittance_texture,
+    IN(MultiScatteringTexture) multi_scattering_texture,
+    IN(SkyViewTexture) sky_view_texture,
+    Position camera, IN(Direction) view_ray, IN(Direction) sun_direction,
+    OUT(DimensionlessSpectrum) transmittance) {
+  Length r = length(camera);
+  Length rmu = dot(camera, view_ray);
+  Length distance_to_top_atmosphere_boundary = -rmu -
+      sqrt(rmu * rmu - r * r + atmosphere.top_radius * atmosphere.top_radius);
+  bool camera_in_space = false;
+  if (distance_to_top_atmosphere_boundary > 0.0 * m) {
+    camera = camera + view_ray * distance_to_top_atmosphere_boundary;
+    r = atmosphere.top_radius;
+    rmu += distance_to_top_atmosphere_boundary;
+    camera_in_space = true;
+  } else if (r > atmosphere.top_radius) {
+    transmittance = DimensionlessSpectrum(1.0);
+    return RadianceSpectrum(0.0 * watt_per_square_meter_per_sr_per_nm);
+  }
+  r = ClampRadius(atmosphere, r);
+  Number mu = ClampCosine(rmu / r);
+  Number mu_s = ClampCosine(dot(camera, sun_direction) / r);
+  Number nu = ClampCosine(dot(view_ray, sun_direction));
+  bool ray_r_mu_intersects_ground = RayIntersectsGround(atmosphere, r, mu);
+
+  transmittance = ray_r_mu_intersects_ground ? DimensionlessSpectrum(0.0) :
+      GetTransmittanceToTopAtmosphereBoundary(
+          atmosphere, transmittance_texture, r, mu);
+  if (camera_in_space) {
+    DimensionlessSpectrum ignored;
+    return ComputeScatteredRadiance(atmosphere, transmittance_texture,
+        multi_scattering_texture, r, mu, mu_s, nu,
+        DistanceToNearestAtmosphereBoundary(
+            atmosphere, r, mu, ray_r_mu_intersects_ground),
+        SKY_VIEW_SAMPLE_COUNT, ignored);
+  }
+  return GetSkyView(atmosphere, sky_view_texture, r, mu, mu_s, nu,
+      ray_r_mu_intersects_ground);
+}
+
+/*
+<p>The aerial perspective is given by the above
+<code>GetAerialPerspective</code> function, where the screen coordinates of the
+point must be computed by the caller, using the same projection as for the
+aerial perspective textures. Finally, the ground irradiance is computed as in
+the default mode for the direct part. For the sky irradiance we do not have an
+irradiance texture, but the multiple scattering texture contains the average
+incident radiance over all directions, which gives a reasonable approximation
+(a uniform sky of this radiance gives an irradiance of $\pi$ times this value
+on a horizontal surface):
+*/
+
+IrradianceSpectrum GetFastSunAndSkyIrradiance(
+    IN(AtmosphereParameters) atmosphere,
+    IN(TransmittanceTexture) transmittance_texture,
+    IN(MultiScatteringTexture) multi_scattering_texture,
+    IN(Position) point, IN(Direction) normal, IN(Direction) sun_direction,
+    OUT(IrradianceSpectrum) sky_irradiance) {
+  Length r = ClampRadius(atmosphere, length(point));
+  Number mu_s = ClampCosine(dot(point, sun_direction) / length(point));
+
+  // Indirect irradiance (approximated if the surface is not horizontal).
+  sky_irradiance =
+      GetMultiScattering(atmosphere, multi_scattering_texture, r, mu_s) *
+      (PI * sr) * (1.0 + dot(normal, point) / length(point)) * 0.5;
+
+  // Direct irradiance.
+  return atmosphere.solar_irradiance *
+      GetTransmittanceToSun(
+          atmosphere, transmittance_texture, r, mu_s) *
+      max(dot(normal, sun_direction), 0.0);
+}
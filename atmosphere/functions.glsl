@@ -126,6 +126,13 @@ Length SafeSqrt(Area a) {
   return sqrt(max(a, 0.0 * m2));
 }
 
+/*
+<p>Some of the following functions also use <code>COUNT</code> and
+<code>COUNT_IF</code> macros. They do nothing in GLSL. In C++ they count the
+integrand evaluations and the branch outcomes, in an instrumented build (see
+<a href="reference/counters.h.html">counters.h</a>).
+*/
+
 /*
 <h3 id="transmittance">Transmittance</h3>
 
@@ -241,8 +248,8 @@ bool RayIntersectsGround(IN(AtmosphereParameters) atmosphere,
     Length r, Number mu) {
   assert(r >= atmosphere.bottom_radius);
   assert(mu >= -1.0 && mu <= 1.0);
-  return mu < 0.0 && r * r * (mu * mu - 1.0) +
-      atmosphere.bottom_radius * atmosphere.bottom_radius >= 0.0 * m2;
+  return COUNT_IF(kRayIntersectsGround, mu < 0.0 && r * r * (mu * mu - 1.0) +
+      atmosphere.bottom_radius * atmosphere.bottom_radius >= 0.0 * m2);
 }
 
 /*
@@ -278,13 +285,14 @@ Length ComputeOpticalLengthToTopAtmosphereBoundary(
   assert(r >= atmosphere.bottom_radius && r <= atmosphere.top_radius);
   assert(mu >= -1.0 && mu <= 1.0);
   // Number of intervals for the numerical integration.
-  const int SAMPLE_COUNT = 500;
+  const int SAMPLE_COUNT = TRANSMITTANCE_SAMPLE_COUNT;
   // The integration step, i.e. the length of each integration interval.
   Length dx =
       DistanceToTopAtmosphereBoundary(atmosphere, r, mu) / Number(SAMPLE_COUNT);
   // Integration loop.
   Length result = 0.0 * m;
   for (int i = 0; i <= SAMPLE_COUNT; ++i) {
+    COUNT(kOpticalLengthSamples);
     Length d_i = Number(i) * dx;
     // Distance between the current sample point and the planet center.
     Length r_i = sqrt(d_i * d_i + 2.0 * r * mu * d_i + r * r);
@@ -704,7 +712,7 @@ void ComputeSingleScattering(
   assert(nu >= -1.0 && nu <= 1.0);
 
   // Number of intervals for the numerical integration.
-  const int SAMPLE_COUNT = 50;
+  const int SAMPLE_COUNT = SINGLE_SCATTERING_SAMPLE_COUNT;
   // The integration step, i.e. the length of each integration interval.
   Length dx =
       DistanceToNearestAtmosphereBoundary(atmosphere, r, mu,
@@ -713,6 +721,7 @@ void ComputeSingleScattering(
   DimensionlessSpectrum rayleigh_sum = DimensionlessSpectrum(0.0);
   DimensionlessSpectrum mie_sum = DimensionlessSpectrum(0.0);
   for (int i = 0; i <= SAMPLE_COUNT; ++i) {
+    COUNT(kSingleScatteringSamples);
     Length d_i = Number(i) * dx;
     // The Rayleigh and Mie single scattering at the current sample point.
     DimensionlessSpectrum rayleigh_i;
@@ -1178,7 +1187,7 @@ RadianceDensitySpectrum ComputeScatteringDensity(
   Number sun_dir_y = sqrt(max(1.0 - sun_dir_x * sun_dir_x - mu_s * mu_s, 0.0));
   vec3 omega_s = vec3(sun_dir_x, sun_dir_y, mu_s);
 
-  const int SAMPLE_COUNT = 16;
+  const int SAMPLE_COUNT = SCATTERING_DENSITY_SAMPLE_COUNT;
   const Angle dphi = pi / Number(SAMPLE_COUNT);
   const Angle dtheta = pi / Number(SAMPLE_COUNT);
   RadianceDensitySpectrum rayleigh_mie =
@@ -1207,6 +1216,7 @@ RadianceDensitySpectrum ComputeScatteringDensity(
     }
 
     for (int m = 0; m < 2 * SAMPLE_COUNT; ++m) {
+      COUNT(kScatteringDensitySamples);
       Angle phi = (Number(m) + 0.5) * dphi;
       vec3 omega_i =
           vec3(cos(phi) * sin_theta, sin(phi) * sin_theta, cos_theta);
@@ -1288,7 +1298,7 @@ RadianceSpectrum ComputeMultipleScattering(
   assert(nu >= -1.0 && nu <= 1.0);
 
   // Number of intervals for the numerical integration.
-  const int SAMPLE_COUNT = 50;
+  const int SAMPLE_COUNT = MULTIPLE_SCATTERING_SAMPLE_COUNT;
   // The integration step, i.e. the length of each integration interval.
   Length dx =
       DistanceToNearestAtmosphereBoundary(
@@ -1298,6 +1308,7 @@ RadianceSpectrum ComputeMultipleScattering(
   RadianceSpectrum rayleigh_mie_sum =
       RadianceSpectrum(0.0 * watt_per_square_meter_per_sr_per_nm);
   for (int i = 0; i <= SAMPLE_COUNT; ++i) {
+    COUNT(kMultipleScatteringSamples);
     Length d_i = Number(i) * dx;
 
     // The r, mu and mu_s parameters at the current integration point (see the
@@ -1478,7 +1489,7 @@ IrradianceSpectrum ComputeIndirectIrradiance(
   assert(mu_s >= -1.0 && mu_s <= 1.0);
   assert(scattering_order >= 1);
 
-  const int SAMPLE_COUNT = 32;
+  const int SAMPLE_COUNT = INDIRECT_IRRADIANCE_SAMPLE_COUNT;
   const Angle dphi = pi / Number(SAMPLE_COUNT);
   const Angle dtheta = pi / Number(SAMPLE_COUNT);
 
@@ -1488,6 +1499,7 @@ IrradianceSpectrum ComputeIndirectIrradiance(
   for (int j = 0; j < SAMPLE_COUNT / 2; ++j) {
     Angle theta = (Number(j) + 0.5) * dtheta;
     for (int i = 0; i < 2 * SAMPLE_COUNT; ++i) {
+      COUNT(kIndirectIrradianceSamples);
       Angle phi = (Number(i) + 0.5) * dphi;
       vec3 omega =
           vec3(cos(phi) * sin(theta), sin(phi) * sin(theta), cos(theta));
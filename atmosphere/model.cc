@@ -45,12 +45,21 @@ of the following C++ code.
 
 #include <GL/glew.h>
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <utility>
 
 #include "atmosphere/constants.h"
+#include "atmosphere/trace.h"
 
 /*
 <p>The rest of this file is organized in 3 parts:
@@ -112,8 +121,11 @@ shaders (with a <code>main</code> function and a proper declaration of the
 shader inputs and outputs). Note that these strings must be concatenated with
 <code>definitions.glsl</code> and <code>functions.glsl</code> (provided as C++
 string literals by the generated <code>.glsl.inc</code> files), as well as with
-a definition of the <code>ATMOSPHERE</code> constant - containing the atmosphere
-parameters, to really get a complete shader. Note also the
+a definition of <code>ATMOSPHERE</code> - containing the atmosphere parameters,
+to really get a complete shader. In these shaders the wavelength dependent
+parameters are taken from uniforms, so that the same programs can be used for
+all the precomputed wavelengths (see the <code>Model</code> constructor). Note
+also the
 <code>luminance_from_radiance</code> uniforms: these are used in precomputed
 illuminance mode to convert the radiance values computed by the
 <code>functions.glsl</code> functions to luminance values (see the
@@ -122,6 +134,19 @@ illuminance mode to convert the radiance values computed by the
 
 #include "atmosphere/definitions.glsl.inc"
 #include "atmosphere/functions.glsl.inc"
+#include "atmosphere/fast_functions.glsl.inc"
+
+// The names of the uniforms containing the wavelength dependent atmosphere
+// parameters, in the precomputation shaders.
+const char* const kSpectrumUniformNames[] = {
+  "atmosphere_solar_irradiance",
+  "atmosphere_rayleigh_scattering",
+  "atmosphere_mie_scattering",
+  "atmosphere_mie_extinction",
+  "atmosphere_absorption_extinction",
+  "atmosphere_ground_albedo"
+};
+constexpr int kNumSpectrumUniforms = 6;
 
 const char kComputeTransmittanceShader[] = R"(
     layout(location = 0) out vec3 transmittance;
@@ -208,6 +233,151 @@ const char kComputeMultipleScatteringShader[] = R"(
           0.0);
     })";
 
+/*
+<p>If OpenGL 4.3 is available, the same precomputations can also be done with
+compute shaders, each processing a whole texture in a single dispatch, instead
+of rendering one quad per layer of the 3D textures. The results are then
+accumulated directly in the shaders, with image load and store operations,
+instead of with blending. This also allows us to fuse some precomputation
+passes: the direct irradiance only depends on the transmittance, like the
+single scattering, and can thus be computed in the same dispatch. Likewise, the
+indirect irradiance for scattering order n-1 uses the same inputs as the
+scattering density for order n, and can be computed at the same time (provided
+it is written in another texture than the irradiance read by the scattering
+density). These compute shaders must be concatenated with the same code as the
+above fragment shaders, and with a definition of
+<code>SCATTERING_IMAGE_FORMAT</code> (the image format of the 3D textures,
+which depends on <code>half_precision</code>). The invocations of the 2D
+textures use the first layer of the 3D dispatches:
+*/
+
+const char kTransmittanceComputeShader[] = R"(
+    layout(local_size_x = 8, local_size_y = 8) in;
+    layout(rgba32f) uniform writeonly image2D transmittance_image;
+    void main() {
+      ivec2 xy = ivec2(gl_GlobalInvocationID.xy);
+      if (any(greaterThanEqual(xy, imageSize(transmittance_image)))) {
+        return;
+      }
+      vec3 transmittance = ComputeTransmittanceToTopAtmosphereBoundaryTexture(
+          ATMOSPHERE, vec2(xy) + vec2(0.5));
+      imageStore(transmittance_image, xy, vec4(transmittance, 1.0));
+    })";
+
+const char kSingleScatteringComputeShader[] = R"(
+    layout(local_size_x = 8, local_size_y = 8) in;
+    layout(SCATTERING_IMAGE_FORMAT) uniform writeonly image3D
+        delta_rayleigh_image;
+    layout(SCATTERING_IMAGE_FORMAT) uniform writeonly image3D delta_mie_image;
+    layout(SCATTERING_IMAGE_FORMAT) uniform image3D scattering_image;
+    #ifndef COMBINED_SCATTERING_TEXTURES
+    layout(SCATTERING_IMAGE_FORMAT) uniform image3D single_mie_scattering_image;
+    #endif
+    layout(rgba32f) uniform writeonly image2D delta_irradiance_image;
+    layout(rgba32f) uniform writeonly image2D irradiance_image;
+    uniform mat3 luminance_from_radiance;
+    uniform sampler2D transmittance_texture;
+    uniform bool blend;
+    void main() {
+      ivec3 xyz = ivec3(gl_GlobalInvocationID);
+      if (any(greaterThanEqual(xyz, imageSize(scattering_image)))) {
+        return;
+      }
+      vec3 delta_rayleigh;
+      vec3 delta_mie;
+      ComputeSingleScatteringTexture(
+          ATMOSPHERE, transmittance_texture, vec3(xyz) + vec3(0.5),
+          delta_rayleigh, delta_mie);
+      imageStore(delta_rayleigh_image, xyz, vec4(delta_rayleigh, 0.0));
+      imageStore(delta_mie_image, xyz, vec4(delta_mie, 0.0));
+      vec4 scattering = vec4(luminance_from_radiance * delta_rayleigh,
+          (luminance_from_radiance * delta_mie).r);
+      if (blend) {
+        scattering += imageLoad(scattering_image, xyz);
+      }
+      imageStore(scattering_image, xyz, scattering);
+    #ifndef COMBINED_SCATTERING_TEXTURES
+      vec3 single_mie_scattering = luminance_from_radiance * delta_mie;
+      if (blend) {
+        single_mie_scattering +=
+            imageLoad(single_mie_scattering_image, xyz).rgb;
+      }
+      imageStore(single_mie_scattering_image, xyz,
+          vec4(single_mie_scattering, 0.0));
+    #endif
+
+      if (xyz.z == 0 &&
+          all(lessThan(xyz.xy, imageSize(delta_irradiance_image)))) {
+        vec3 delta_irradiance = ComputeDirectIrradianceTexture(
+            ATMOSPHERE, transmittance_texture, vec2(xyz.xy) + vec2(0.5));
+        imageStore(delta_irradiance_image, xyz.xy, vec4(delta_irradiance, 0.0));
+        if (!blend) {
+          imageStore(irradiance_image, xyz.xy, vec4(0.0));
+        }
+      }
+    })";
+
+const char kScatteringDensityComputeShader[] = R"(
+    layout(local_size_x = 8, local_size_y = 8) in;
+    layout(SCATTERING_IMAGE_FORMAT) uniform writeonly image3D
+        scattering_density_image;
+    layout(rgba32f) uniform writeonly image2D delta_irradiance_image;
+    layout(rgba32f) uniform image2D irradiance_image;
+    uniform mat3 luminance_from_radiance;
+    uniform sampler2D transmittance_texture;
+    uniform sampler3D single_rayleigh_scattering_texture;
+    uniform sampler3D single_mie_scattering_texture;
+    uniform sampler3D multiple_scattering_texture;
+    uniform sampler2D irradiance_texture;
+    uniform int scattering_order;
+    void main() {
+      ivec3 xyz = ivec3(gl_GlobalInvocationID);
+      if (any(greaterThanEqual(xyz, imageSize(scattering_density_image)))) {
+        return;
+      }
+      vec3 scattering_density = ComputeScatteringDensityTexture(
+          ATMOSPHERE, transmittance_texture, single_rayleigh_scattering_texture,
+          single_mie_scattering_texture, multiple_scattering_texture,
+          irradiance_texture, vec3(xyz) + vec3(0.5), scattering_order);
+      imageStore(scattering_density_image, xyz, vec4(scattering_density, 0.0));
+
+      if (xyz.z == 0 &&
+          all(lessThan(xyz.xy, imageSize(delta_irradiance_image)))) {
+        vec3 delta_irradiance = ComputeIndirectIrradianceTexture(
+            ATMOSPHERE, single_rayleigh_scattering_texture,
+            single_mie_scattering_texture, multiple_scattering_texture,
+            vec2(xyz.xy) + vec2(0.5), scattering_order - 1);
+        imageStore(delta_irradiance_image, xyz.xy, vec4(delta_irradiance, 0.0));
+        imageStore(irradiance_image, xyz.xy,
+            imageLoad(irradiance_image, xyz.xy) +
+                vec4(luminance_from_radiance * delta_irradiance, 0.0));
+      }
+    })";
+
+const char kMultipleScatteringComputeShader[] = R"(
+    layout(local_size_x = 8, local_size_y = 8) in;
+    layout(SCATTERING_IMAGE_FORMAT) uniform writeonly image3D
+        delta_multiple_scattering_image;
+    layout(SCATTERING_IMAGE_FORMAT) uniform image3D scattering_image;
+    uniform mat3 luminance_from_radiance;
+    uniform sampler2D transmittance_texture;
+    uniform sampler3D scattering_density_texture;
+    void main() {
+      ivec3 xyz = ivec3(gl_GlobalInvocationID);
+      if (any(greaterThanEqual(xyz, imageSize(scattering_image)))) {
+        return;
+      }
+      float nu;
+      vec3 delta_multiple_scattering = ComputeMultipleScatteringTexture(
+          ATMOSPHERE, transmittance_texture, scattering_density_texture,
+          vec3(xyz) + vec3(0.5), nu);
+      imageStore(delta_multiple_scattering_image, xyz,
+          vec4(delta_multiple_scattering, 0.0));
+      imageStore(scattering_image, xyz, imageLoad(scattering_image, xyz) +
+          vec4(luminance_from_radiance *
+              delta_multiple_scattering / RayleighPhaseFunction(nu), 0.0));
+    })";
+
 /*
 <p>We finally need a shader implementing the GLSL functions exposed in our API,
 which can be done by calling the corresponding functions in
@@ -279,12 +449,205 @@ const char kAtmosphereShader[] = R"(
           sun_direction, sky_irradiance);
       sky_irradiance *= SKY_SPECTRAL_RADIANCE_TO_LUMINANCE;
       return sun_irradiance * SUN_SPECTRAL_RADIANCE_TO_LUMINANCE;
+    }
+    uniform sampler3D aerial_perspective_scattering_texture;
+    uniform sampler3D aerial_perspective_transmittance_texture;
+    uniform mat3 aerial_perspective_clip_from_view_ray;
+    uniform float aerial_perspective_max_distance;
+    RadianceSpectrum GetSkyRadianceToPointFromVolumeOrDirectly(
+        Position camera, Position point, Direction sun_direction,
+        out DimensionlessSpectrum transmittance) {
+      vec3 clip = aerial_perspective_clip_from_view_ray * (point - camera);
+      vec2 uv = clip.xy / clip.z * 0.5 + vec2(0.5);
+      Length d = length(point - camera);
+      if (clip.z > 0.0 && all(greaterThanEqual(uv, vec2(0.0))) &&
+          all(lessThanEqual(uv, vec2(1.0))) &&
+          d <= aerial_perspective_max_distance) {
+        return GetAerialPerspective(aerial_perspective_scattering_texture,
+            aerial_perspective_transmittance_texture, uv, d,
+            aerial_perspective_max_distance, transmittance);
+      }
+      return GetSkyRadianceToPoint(ATMOSPHERE, transmittance_texture,
+          scattering_texture, single_mie_scattering_texture,
+          camera, point, 0.0, sun_direction, transmittance);
+    }
+    #ifdef RADIANCE_API_ENABLED
+    RadianceSpectrum GetSkyRadianceToPointFromVolume(
+        Position camera, Position point, Direction sun_direction,
+        out DimensionlessSpectrum transmittance) {
+      return GetSkyRadianceToPointFromVolumeOrDirectly(
+          camera, point, sun_direction, transmittance);
+    }
+    #endif
+    Luminance3 GetSkyLuminanceToPointFromVolume(
+        Position camera, Position point, Direction sun_direction,
+        out DimensionlessSpectrum transmittance) {
+      return GetSkyRadianceToPointFromVolumeOrDirectly(
+          camera, point, sun_direction, transmittance) *
+          SKY_SPECTRAL_RADIANCE_TO_LUMINANCE;
+    })";
+
+/*
+<p>The aerial perspective volume used by the last functions above is computed
+with the following shader, which renders one layer of the volume. The texels
+are mapped to view rays and distances as in the aerial perspective textures of
+the <code>FastModel</code>, and their values are computed with
+<code>GetSkyRadianceToPoint</code> (see
+<a href="fast_functions.glsl.html#aerial_perspective">fast_functions.glsl</a>):
+*/
+
+const char kComputeAerialPerspectiveVolumeShader[] = R"(
+    layout(location = 0) out vec3 scattering;
+    layout(location = 1) out vec3 transmittance;
+    uniform sampler2D transmittance_texture;
+    uniform sampler3D scattering_texture;
+    uniform sampler3D single_mie_scattering_texture;
+    uniform vec3 camera;
+    uniform vec3 sun_direction;
+    uniform mat3 view_ray_from_clip;
+    uniform float max_distance;
+    uniform int layer;
+    void main() {
+      vec2 uv = gl_FragCoord.xy / vec2(AERIAL_PERSPECTIVE_TEXTURE_WIDTH,
+          AERIAL_PERSPECTIVE_TEXTURE_HEIGHT);
+      vec3 view_ray =
+          normalize(view_ray_from_clip * vec3(2.0 * uv - vec2(1.0), 1.0));
+      scattering = ComputeAerialPerspectiveVolumeTexture(ATMOSPHERE,
+          transmittance_texture, scattering_texture,
+          single_mie_scattering_texture, camera, view_ray, sun_direction,
+          layer, max_distance, transmittance);
+    })";
+
+/*
+<p>The <code>FastModel</code> class uses similar shaders, which wrap the
+functions from <a href="fast_functions.glsl.html">fast_functions.glsl</a>
+(the transmittance is computed with the above
+<code>kComputeTransmittanceShader</code>). In these shaders
+<code>ATMOSPHERE</code> is a uniform, so that the atmosphere parameters can
+change without recompiling the shaders (see the <code>FastModel</code>
+constructor):
+*/
+
+const char kComputeMultiScatteringShader[] = R"(
+    layout(location = 0) out vec3 multi_scattering;
+    uniform sampler2D transmittance_texture;
+    void main() {
+      multi_scattering = ComputeMultiScatteringTexture(
+          ATMOSPHERE, transmittance_texture, gl_FragCoord.xy);
+    })";
+
+const char kComputeSkyViewShader[] = R"(
+    layout(location = 0) out vec3 sky_view;
+    uniform sampler2D transmittance_texture;
+    uniform sampler2D multi_scattering_texture;
+    uniform float r;
+    uniform float mu_s;
+    void main() {
+      sky_view = ComputeSkyViewTexture(ATMOSPHERE, transmittance_texture,
+          multi_scattering_texture, gl_FragCoord.xy, r, mu_s);
+    })";
+
+const char kComputeAerialPerspectiveShader[] = R"(
+    layout(location = 0) out vec3 scattering;
+    layout(location = 1) out vec3 transmittance;
+    uniform sampler2D transmittance_texture;
+    uniform sampler2D multi_scattering_texture;
+    uniform vec3 camera;
+    uniform vec3 sun_direction;
+    uniform mat3 view_ray_from_clip;
+    uniform float max_distance;
+    uniform int layer;
+    void main() {
+      vec2 uv = gl_FragCoord.xy / vec2(AERIAL_PERSPECTIVE_TEXTURE_WIDTH,
+          AERIAL_PERSPECTIVE_TEXTURE_HEIGHT);
+      vec3 view_ray =
+          normalize(view_ray_from_clip * vec3(2.0 * uv - vec2(1.0), 1.0));
+      scattering = ComputeAerialPerspectiveTexture(ATMOSPHERE,
+          transmittance_texture, multi_scattering_texture, camera, view_ray,
+          sun_direction, layer, max_distance, transmittance);
+    })";
+
+/*
+<p>The shader exposed by the <code>FastModel</code> API provides the same
+functions as <code>kAtmosphereShader</code>. The aerial perspective is looked up
+in the aerial perspective textures for the points inside the view frustum used
+to compute them, and computed directly otherwise:
+*/
+
+const char kFastAtmosphereShader[] = R"(
+    uniform sampler2D transmittance_texture;
+    uniform sampler2D multi_scattering_texture;
+    uniform sampler2D sky_view_texture;
+    uniform sampler3D aerial_perspective_scattering_texture;
+    uniform sampler3D aerial_perspective_transmittance_texture;
+    uniform mat3 aerial_perspective_clip_from_view_ray;
+    uniform float aerial_perspective_max_distance;
+    RadianceSpectrum GetSolarRadiance() {
+      return ATMOSPHERE.solar_irradiance /
+          (PI * ATMOSPHERE.sun_angular_radius * ATMOSPHERE.sun_angular_radius);
+    }
+    RadianceSpectrum GetSkyRadiance(
+        Position camera, Direction view_ray, Length shadow_length,
+        Direction sun_direction, out DimensionlessSpectrum transmittance) {
+      return GetFastSkyRadiance(ATMOSPHERE, transmittance_texture,
+          multi_scattering_texture, sky_view_texture, camera, view_ray,
+          sun_direction, transmittance);
+    }
+    RadianceSpectrum GetSkyRadianceToPoint(
+        Position camera, Position point, Length shadow_length,
+        Direction sun_direction, out DimensionlessSpectrum transmittance) {
+      vec3 clip = aerial_perspective_clip_from_view_ray * (point - camera);
+      vec2 uv = clip.xy / clip.z * 0.5 + vec2(0.5);
+      Length d = length(point - camera);
+      if (clip.z > 0.0 && all(greaterThanEqual(uv, vec2(0.0))) &&
+          all(lessThanEqual(uv, vec2(1.0))) &&
+          d <= aerial_perspective_max_distance) {
+        return GetAerialPerspective(aerial_perspective_scattering_texture,
+            aerial_perspective_transmittance_texture, uv, d,
+            aerial_perspective_max_distance, transmittance);
+      }
+      return ComputeAerialPerspective(ATMOSPHERE, transmittance_texture,
+          multi_scattering_texture, camera, normalize(point - camera), d,
+          sun_direction, AERIAL_PERSPECTIVE_TEXTURE_DEPTH, transmittance);
+    }
+    IrradianceSpectrum GetSunAndSkyIrradiance(
+       Position p, Direction normal, Direction sun_direction,
+       out IrradianceSpectrum sky_irradiance) {
+      return GetFastSunAndSkyIrradiance(ATMOSPHERE, transmittance_texture,
+          multi_scattering_texture, p, normal, sun_direction, sky_irradiance);
+    }
+    Luminance3 GetSolarLuminance() {
+      return GetSolarRadiance() * SUN_SPECTRAL_RADIANCE_TO_LUMINANCE;
+    }
+    Luminance3 GetSkyLuminance(
+        Position camera, Direction view_ray, Length shadow_length,
+        Direction sun_direction, out DimensionlessSpectrum transmittance) {
+      return GetSkyRadiance(camera, view_ray, shadow_length, sun_direction,
+          transmittance) * SKY_SPECTRAL_RADIANCE_TO_LUMINANCE;
+    }
+    Luminance3 GetSkyLuminanceToPoint(
+        Position camera, Position point, Length shadow_length,
+        Direction sun_direction, out DimensionlessSpectrum transmittance) {
+      return GetSkyRadianceToPoint(camera, point, shadow_length,
+          sun_direction, transmittance) * SKY_SPECTRAL_RADIANCE_TO_LUMINANCE;
+    }
+    Illuminance3 GetSunAndSkyIlluminance(
+       Position p, Direction normal, Direction sun_direction,
+       out IrradianceSpectrum sky_irradiance) {
+      IrradianceSpectrum sun_irradiance =
+          GetSunAndSkyIrradiance(p, normal, sun_direction, sky_irradiance);
+      sky_irradiance *= SKY_SPECTRAL_RADIANCE_TO_LUMINANCE;
+      return sun_irradiance * SUN_SPECTRAL_RADIANCE_TO_LUMINANCE;
     })";
 
 /*<h3 id="utilities">Utility classes and functions</h3>
 
 <p>To compile and link these shaders into programs, and to set their uniforms,
-we use the following utility class:
+we use the following utility class. Compiling the precomputation programs can
+take a significant time, so this class can also save the linked program binary
+in a file, and load it from this file instead of compiling the shaders the next
+time (if the driver supports it, and if the file name identifies the shader
+sources and the driver - see <code>GetProgramBinaryFilename</code> below):
 */
 
 class Program {
@@ -298,51 +661,44 @@ class Program {
   Program(
       const std::string& vertex_shader_source,
       const std::string& geometry_shader_source,
-      const std::string& fragment_shader_source) {
+      const std::string& fragment_shader_source,
+      const std::string& binary_filename = "") {
     program_ = glCreateProgram();
-
-    const char* source;
-    source = vertex_shader_source.c_str();
-    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex_shader, 1, &source, NULL);
-    glCompileShader(vertex_shader);
-    CheckShader(vertex_shader);
-    glAttachShader(program_, vertex_shader);
-
-    GLuint geometry_shader = 0;
+    if (!binary_filename.empty() && LoadBinary(binary_filename)) {
+      return;
+    }
+    std::vector<GLuint> shaders;
+    shaders.push_back(CompileShader(GL_VERTEX_SHADER, vertex_shader_source));
     if (!geometry_shader_source.empty()) {
-      source = geometry_shader_source.c_str();
-      geometry_shader = glCreateShader(GL_GEOMETRY_SHADER);
-      glShaderSource(geometry_shader, 1, &source, NULL);
-      glCompileShader(geometry_shader);
-      CheckShader(geometry_shader);
-      glAttachShader(program_, geometry_shader);
+      shaders.push_back(
+          CompileShader(GL_GEOMETRY_SHADER, geometry_shader_source));
     }
+    shaders.push_back(
+        CompileShader(GL_FRAGMENT_SHADER, fragment_shader_source));
+    Link(shaders, binary_filename);
+  }
 
-    source = fragment_shader_source.c_str();
-    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment_shader, 1, &source, NULL);
-    glCompileShader(fragment_shader);
-    CheckShader(fragment_shader);
-    glAttachShader(program_, fragment_shader);
-
-    glLinkProgram(program_);
-    CheckProgram(program_);
-
-    glDetachShader(program_, vertex_shader);
-    glDeleteShader(vertex_shader);
-    if (!geometry_shader_source.empty()) {
-      glDetachShader(program_, geometry_shader);
-      glDeleteShader(geometry_shader);
+  // Creates a program with a single shader of the given type (e.g. a compute
+  // shader).
+  Program(
+      GLenum shader_type,
+      const std::string& shader_source,
+      const std::string& binary_filename = "") {
+    program_ = glCreateProgram();
+    if (!binary_filename.empty() && LoadBinary(binary_filename)) {
+      return;
     }
-    glDetachShader(program_, fragment_shader);
-    glDeleteShader(fragment_shader);
+    Link({CompileShader(shader_type, shader_source)}, binary_filename);
   }
 
   ~Program() {
     glDeleteProgram(program_);
   }
 
+  GLuint id() const {
+    return program_;
+  }
+
   void Use() const {
     glUseProgram(program_);
   }
@@ -353,10 +709,27 @@ class Program {
         1, true /* transpose */, value.data());
   }
 
+  void BindVec3(const std::string& uniform_name,
+      const std::array<double, 3>& value) const {
+    glUniform3f(glGetUniformLocation(program_, uniform_name.c_str()),
+        value[0], value[1], value[2]);
+  }
+
+  void BindImage(const std::string& image_uniform_name, GLuint texture,
+      GLenum format, GLuint image_unit) const {
+    glBindImageTexture(image_unit, texture, 0, GL_TRUE /* layered */, 0,
+        GL_READ_WRITE, format);
+    BindInt(image_uniform_name, image_unit);
+  }
+
   void BindInt(const std::string& uniform_name, int value) const {
     glUniform1i(glGetUniformLocation(program_, uniform_name.c_str()), value);
   }
 
+  void BindFloat(const std::string& uniform_name, double value) const {
+    glUniform1f(glGetUniformLocation(program_, uniform_name.c_str()), value);
+  }
+
   void BindTexture2d(const std::string& sampler_uniform_name, GLuint texture,
       GLuint texture_unit) const {
     glActiveTexture(GL_TEXTURE0 + texture_unit);
@@ -372,6 +745,81 @@ class Program {
   }
 
  private:
+  GLuint CompileShader(GLenum shader_type, const std::string& shader_source) {
+    const char* source = shader_source.c_str();
+    GLuint shader = glCreateShader(shader_type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    CheckShader(shader);
+    glAttachShader(program_, shader);
+    return shader;
+  }
+
+  void Link(const std::vector<GLuint>& shaders,
+      const std::string& binary_filename) {
+    if (!binary_filename.empty() && GLEW_ARB_get_program_binary) {
+      glProgramParameteri(
+          program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(program_);
+    CheckProgram(program_);
+    if (!binary_filename.empty()) {
+      SaveBinary(binary_filename);
+    }
+    for (GLuint shader : shaders) {
+      glDetachShader(program_, shader);
+      glDeleteShader(shader);
+    }
+  }
+
+  // The binary files contain the binary format (as a 32 bits integer),
+  // followed by the program binary returned by the driver.
+  bool LoadBinary(const std::string& filename) {
+    if (!GLEW_ARB_get_program_binary) {
+      return false;
+    }
+    std::ifstream file(filename, std::ifstream::binary);
+    uint32_t binary_format;
+    if (!file.read(reinterpret_cast<char*>(&binary_format),
+            sizeof(binary_format))) {
+      return false;
+    }
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)),
+        std::istreambuf_iterator<char>());
+    if (binary.empty()) {
+      return false;
+    }
+    glProgramBinary(program_, binary_format, binary.data(), binary.size());
+    // The driver can reject a binary saved by another driver version, in which
+    // case we must compile the shaders instead (and ignore the error generated
+    // by an unsupported binary format, if any).
+    GLint link_status;
+    glGetProgramiv(program_, GL_LINK_STATUS, &link_status);
+    if (link_status != GL_TRUE) {
+      glGetError();
+      return false;
+    }
+    return true;
+  }
+
+  void SaveBinary(const std::string& filename) const {
+    GLint binary_length = 0;
+    if (GLEW_ARB_get_program_binary) {
+      glGetProgramiv(program_, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+    }
+    if (binary_length <= 0) {
+      return;
+    }
+    std::vector<char> binary(binary_length);
+    GLenum binary_format;
+    glGetProgramBinary(program_, binary_length, &binary_length,
+        &binary_format, binary.data());
+    std::ofstream file(filename, std::ofstream::binary);
+    uint32_t format = binary_format;
+    file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    file.write(binary.data(), binary_length);
+  }
+
   static void CheckShader(GLuint shader) {
     GLint compile_status;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
@@ -417,10 +865,11 @@ class Program {
 };
 
 /*
-<p>We also need functions to allocate the precomputed textures on GPU:
+<p>We also need functions to allocate the precomputed textures on GPU (with 4
+components instead of 3 if <code>format</code> is <code>GL_RGBA</code>):
 */
 
-GLuint NewTexture2d(int width, int height) {
+GLuint NewTexture2d(int width, int height, GLenum format) {
   GLuint texture;
   glGenTextures(1, &texture);
   glActiveTexture(GL_TEXTURE0);
@@ -431,8 +880,8 @@ GLuint NewTexture2d(int width, int height) {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
   // 16F precision for the transmittance gives artifacts.
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0,
-      GL_RGB, GL_FLOAT, NULL);
+  glTexImage2D(GL_TEXTURE_2D, 0, format == GL_RGBA ? GL_RGBA32F : GL_RGB32F,
+      width, height, 0, format, GL_FLOAT, NULL);
   return texture;
 }
 
@@ -478,6 +927,251 @@ void DrawQuad(const std::vector<bool>& enable_blend) {
   }
 }
 
+/*
+<p>With compute shaders, we instead need a function to run a compute shader over
+a whole texture (with the local work group size used in our compute shaders),
+and to wait for its results before they are used by the next precomputation
+pass (or read back with <code>glGetTexImage</code>):
+*/
+
+void DispatchCompute(int width, int height, int depth) {
+  constexpr int kLocalSize = 8;
+  glDispatchCompute((width + kLocalSize - 1) / kLocalSize,
+      (height + kLocalSize - 1) / kLocalSize, depth);
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT |
+      GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+}
+
+/*
+<p>The precomputed textures are allocated with the following function, both in
+the constructor and at the start of an incremental precomputation (see
+<code>BeginInit</code>). The textures which only need 3 components use
+<code>rgb_format</code>, which must be <code>GL_RGBA</code> if they are
+computed with compute shaders (image load and store operations do not support
+3 components formats), and <code>GL_RGB</code> otherwise:
+*/
+
+void NewPrecomputedTextures(bool combine_scattering_textures,
+    bool half_precision, GLenum rgb_format, GLuint* transmittance_texture,
+    GLuint* scattering_texture, GLuint* optional_single_mie_scattering_texture,
+    GLuint* irradiance_texture) {
+  *transmittance_texture = NewTexture2d(
+      TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT, rgb_format);
+  *scattering_texture = NewTexture3d(
+      SCATTERING_TEXTURE_WIDTH,
+      SCATTERING_TEXTURE_HEIGHT,
+      SCATTERING_TEXTURE_DEPTH,
+      combine_scattering_textures ? GL_RGBA : rgb_format,
+      half_precision);
+  if (combine_scattering_textures) {
+    *optional_single_mie_scattering_texture = 0;
+  } else {
+    *optional_single_mie_scattering_texture = NewTexture3d(
+        SCATTERING_TEXTURE_WIDTH,
+        SCATTERING_TEXTURE_HEIGHT,
+        SCATTERING_TEXTURE_DEPTH,
+        rgb_format,
+        half_precision);
+  }
+  *irradiance_texture = NewTexture2d(
+      IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT, rgb_format);
+}
+
+/*
+<p>Each precomputation step renders in one or more textures, which we attach to
+the framebuffer used for the precomputations with the following function (the
+unused color attachments are detached):
+*/
+
+void SetColorAttachments(const std::vector<GLuint>& textures) {
+  constexpr unsigned int kMaxColorAttachments = 4;
+  const GLenum kDrawBuffers[kMaxColorAttachments] = {
+    GL_COLOR_ATTACHMENT0,
+    GL_COLOR_ATTACHMENT1,
+    GL_COLOR_ATTACHMENT2,
+    GL_COLOR_ATTACHMENT3
+  };
+  assert(textures.size() <= kMaxColorAttachments);
+  for (unsigned int i = 0; i < kMaxColorAttachments; ++i) {
+    glFramebufferTexture(GL_FRAMEBUFFER, kDrawBuffers[i],
+        i < textures.size() ? textures[i] : 0, 0);
+  }
+  glDrawBuffers(textures.size(), kDrawBuffers);
+}
+
+/*
+<p>Finally, since the precomputations can be interleaved with the rendering of
+the client application (see <code>Step</code>), they must not change the GL
+state used by the client. This is ensured with the following class, which saves
+the GL state modified by the precomputations in its constructor, and restores
+it in its destructor (the image units, used by the compute shaders, are only
+saved if <code>save_image_units</code> is true, since they require OpenGL
+4.2). It also disables blending and the scissor test, which the
+precomputations do not expect, and restores them in its destructor (blending is
+saved and restored separately for each draw buffer, since
+<code>DrawQuad</code> enables and disables it for each color attachment):
+*/
+
+class GlStateSaver {
+ public:
+  explicit GlStateSaver(bool save_image_units = false)
+      : save_image_units_(save_image_units) {
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_framebuffer_);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer_);
+    glGetIntegerv(GL_VIEWPORT, viewport_);
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program_);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture_);
+    glGetIntegerv(GL_BLEND_EQUATION_RGB, &blend_equation_rgb_);
+    glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &blend_equation_alpha_);
+    glGetIntegerv(GL_BLEND_SRC_RGB, &blend_src_rgb_);
+    glGetIntegerv(GL_BLEND_DST_RGB, &blend_dst_rgb_);
+    glGetIntegerv(GL_BLEND_SRC_ALPHA, &blend_src_alpha_);
+    glGetIntegerv(GL_BLEND_DST_ALPHA, &blend_dst_alpha_);
+    for (unsigned int i = 0; i < kNumDrawBuffers; ++i) {
+      blend_[i] = glIsEnabledi(GL_BLEND, i);
+    }
+    scissor_test_ = glIsEnabled(GL_SCISSOR_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+    for (unsigned int i = 0; i < kNumTextureUnits; ++i) {
+      glActiveTexture(GL_TEXTURE0 + i);
+      glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture_2d_[i]);
+      glGetIntegerv(GL_TEXTURE_BINDING_3D, &texture_3d_[i]);
+    }
+    glActiveTexture(active_texture_);
+    for (unsigned int i = 0; save_image_units_ && i < kNumImageUnits; ++i) {
+      glGetIntegeri_v(GL_IMAGE_BINDING_NAME, i, &image_[i].name);
+      glGetIntegeri_v(GL_IMAGE_BINDING_LEVEL, i, &image_[i].level);
+      glGetIntegeri_v(GL_IMAGE_BINDING_LAYERED, i, &image_[i].layered);
+      glGetIntegeri_v(GL_IMAGE_BINDING_LAYER, i, &image_[i].layer);
+      glGetIntegeri_v(GL_IMAGE_BINDING_ACCESS, i, &image_[i].access);
+      glGetIntegeri_v(GL_IMAGE_BINDING_FORMAT, i, &image_[i].format);
+    }
+  }
+
+  ~GlStateSaver() {
+    for (unsigned int i = 0; save_image_units_ && i < kNumImageUnits; ++i) {
+      glBindImageTexture(i, image_[i].name, image_[i].level,
+          image_[i].layered, image_[i].layer, image_[i].access,
+          image_[i].format);
+    }
+    for (unsigned int i = 0; i < kNumTextureUnits; ++i) {
+      glActiveTexture(GL_TEXTURE0 + i);
+      glBindTexture(GL_TEXTURE_2D, texture_2d_[i]);
+      glBindTexture(GL_TEXTURE_3D, texture_3d_[i]);
+    }
+    glActiveTexture(active_texture_);
+    for (unsigned int i = 0; i < kNumDrawBuffers; ++i) {
+      if (blend_[i]) {
+        glEnablei(GL_BLEND, i);
+      } else {
+        glDisablei(GL_BLEND, i);
+      }
+    }
+    if (scissor_test_) {
+      glEnable(GL_SCISSOR_TEST);
+    }
+    glBlendEquationSeparate(blend_equation_rgb_, blend_equation_alpha_);
+    glBlendFuncSeparate(
+        blend_src_rgb_, blend_dst_rgb_, blend_src_alpha_, blend_dst_alpha_);
+    glUseProgram(program_);
+    glViewport(viewport_[0], viewport_[1], viewport_[2], viewport_[3]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_framebuffer_);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer_);
+  }
+
+ private:
+  // The number of texture and image units, and of draw buffers, used by the
+  // precomputations.
+  static constexpr unsigned int kNumTextureUnits = 5;
+  static constexpr unsigned int kNumImageUnits = 6;
+  static constexpr unsigned int kNumDrawBuffers = 4;
+
+  struct ImageBinding {
+    GLint name;
+    GLint level;
+    GLint layered;
+    GLint layer;
+    GLint access;
+    GLint format;
+  };
+
+  GLint draw_framebuffer_;
+  GLint read_framebuffer_;
+  GLint viewport_[4];
+  GLint program_;
+  GLint active_texture_;
+  GLint blend_equation_rgb_;
+  GLint blend_equation_alpha_;
+  GLint blend_src_rgb_;
+  GLint blend_dst_rgb_;
+  GLint blend_src_alpha_;
+  GLint blend_dst_alpha_;
+  GLboolean blend_[kNumDrawBuffers];
+  GLboolean scissor_test_;
+  GLint texture_2d_[kNumTextureUnits];
+  GLint texture_3d_[kNumTextureUnits];
+  bool save_image_units_;
+  ImageBinding image_[kNumImageUnits];
+};
+
+/*
+<p>The GLSL code of all our shaders starts with the following preamble, which
+defines the macros used in <a href="functions.glsl.html">functions.glsl</a> for
+the double C++/GLSL compilation, and the texture sizes:
+*/
+
+std::string GetGlslPreamble() {
+  return std::string(
+      "#define IN(x) const in x\n"
+      "#define OUT(x) out x\n"
+      "#define TEMPLATE(x)\n"
+      "#define TEMPLATE_ARGUMENT(x)\n"
+      "#define assert(x)\n"
+      "#define COUNT(x)\n"
+      "#define COUNT_IF(x, condition) (condition)\n") +
+      "const int TRANSMITTANCE_TEXTURE_WIDTH = " +
+          std::to_string(TRANSMITTANCE_TEXTURE_WIDTH) + ";\n" +
+      "const int TRANSMITTANCE_TEXTURE_HEIGHT = " +
+          std::to_string(TRANSMITTANCE_TEXTURE_HEIGHT) + ";\n" +
+      "const int SCATTERING_TEXTURE_R_SIZE = " +
+          std::to_string(SCATTERING_TEXTURE_R_SIZE) + ";\n" +
+      "const int SCATTERING_TEXTURE_MU_SIZE = " +
+          std::to_string(SCATTERING_TEXTURE_MU_SIZE) + ";\n" +
+      "const int SCATTERING_TEXTURE_MU_S_SIZE = " +
+          std::to_string(SCATTERING_TEXTURE_MU_S_SIZE) + ";\n" +
+      "const int SCATTERING_TEXTURE_NU_SIZE = " +
+          std::to_string(SCATTERING_TEXTURE_NU_SIZE) + ";\n" +
+      "const int IRRADIANCE_TEXTURE_WIDTH = " +
+          std::to_string(IRRADIANCE_TEXTURE_WIDTH) + ";\n" +
+      "const int IRRADIANCE_TEXTURE_HEIGHT = " +
+          std::to_string(IRRADIANCE_TEXTURE_HEIGHT) + ";\n" +
+      "const int TRANSMITTANCE_SAMPLE_COUNT = " +
+          std::to_string(TRANSMITTANCE_SAMPLE_COUNT) + ";\n" +
+      "const int SINGLE_SCATTERING_SAMPLE_COUNT = " +
+          std::to_string(SINGLE_SCATTERING_SAMPLE_COUNT) + ";\n" +
+      "const int SCATTERING_DENSITY_SAMPLE_COUNT = " +
+          std::to_string(SCATTERING_DENSITY_SAMPLE_COUNT) + ";\n" +
+      "const int INDIRECT_IRRADIANCE_SAMPLE_COUNT = " +
+          std::to_string(INDIRECT_IRRADIANCE_SAMPLE_COUNT) + ";\n" +
+      "const int MULTIPLE_SCATTERING_SAMPLE_COUNT = " +
+          std::to_string(MULTIPLE_SCATTERING_SAMPLE_COUNT) + ";\n" +
+      "const int MULTI_SCATTERING_TEXTURE_WIDTH = " +
+          std::to_string(MULTI_SCATTERING_TEXTURE_WIDTH) + ";\n" +
+      "const int MULTI_SCATTERING_TEXTURE_HEIGHT = " +
+          std::to_string(MULTI_SCATTERING_TEXTURE_HEIGHT) + ";\n" +
+      "const int SKY_VIEW_TEXTURE_WIDTH = " +
+          std::to_string(SKY_VIEW_TEXTURE_WIDTH) + ";\n" +
+      "const int SKY_VIEW_TEXTURE_HEIGHT = " +
+          std::to_string(SKY_VIEW_TEXTURE_HEIGHT) + ";\n" +
+      "const int AERIAL_PERSPECTIVE_TEXTURE_WIDTH = " +
+          std::to_string(AERIAL_PERSPECTIVE_TEXTURE_WIDTH) + ";\n" +
+      "const int AERIAL_PERSPECTIVE_TEXTURE_HEIGHT = " +
+          std::to_string(AERIAL_PERSPECTIVE_TEXTURE_HEIGHT) + ";\n" +
+      "const int AERIAL_PERSPECTIVE_TEXTURE_DEPTH = " +
+          std::to_string(AERIAL_PERSPECTIVE_TEXTURE_DEPTH) + ";\n";
+}
+
 /*
 <p>Finally, we need a utility function to compute the value of the conversion
 constants *<code>_RADIANCE_TO_LUMINANCE</code>, used above to convert the
@@ -571,22 +1265,401 @@ void ComputeSpectralRadianceToLuminanceFactors(
   *k_b *= MAX_LUMINOUS_EFFICACY * dlambda;
 }
 
-}  // anonymous namespace
+/*
+<p>Last but not least, the precomputed textures can be saved to a file, to be
+reused later without having to recompute them (see <code>SaveTextures</code>
+below). To detect files which have been precomputed with different atmosphere
+parameters, we store a 64 bits hash of these parameters in the file. We use the
+<a href="http://www.isthe.com/chongo/tech/comp/fnv/">FNV-1a</a> hash function,
+which is simple and fast enough for our needs:
+*/
 
-/*<h3 id="implementation">Model implementation</h3>
+class ParameterHash {
+ public:
+  ParameterHash() : hash_(14695981039346656037ULL) {}
 
-<p>Using the above utility functions and classes, we can now implement the
-constructor of the <code>Model</code> class. This constructor generates a piece
-of GLSL code that defines an <code>ATMOSPHERE</code> constant containing the
-atmosphere parameters (we use constants instead of uniforms to enable constant
-folding and propagation optimizations in the GLSL compiler), concatenated with
-<a href="functions.glsl.html">functions.glsl</a>, and with
-<code>kAtmosphereShader</code>, to get the shader exposed by our API in
-<code>GetShader</code>. It also allocates the precomputed textures, but does not
-initialize them.
+  void AddBytes(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash_ = (hash_ ^ bytes[i]) * 1099511628211ULL;
+    }
+  }
+
+  void AddInt(uint64_t value) { AddBytes(&value, sizeof(value)); }
+
+  void AddDouble(double value) { AddBytes(&value, sizeof(value)); }
+
+  void AddVector(const std::vector<double>& values) {
+    AddInt(values.size());
+    AddBytes(values.data(), values.size() * sizeof(double));
+  }
+
+  void AddDensityProfile(const std::vector<DensityProfileLayer>& layers) {
+    AddInt(layers.size());
+    for (const DensityProfileLayer& layer : layers) {
+      AddDouble(layer.width);
+      AddDouble(layer.exp_term);
+      AddDouble(layer.exp_scale);
+      AddDouble(layer.linear_term);
+      AddDouble(layer.constant_term);
+    }
+  }
+
+  uint64_t value() const { return hash_; }
+
+ private:
+  uint64_t hash_;
+};
+
+/*
+<p>The same hash function is used to name the program binary files (see the
+<code>Program</code> class), from the shader sources and from the driver
+identification strings (since the program binaries can only be used with the
+driver which produced them):
 */
 
-Model::Model(
+std::string GetProgramBinaryFilename(const std::string& cache_directory,
+    const std::vector<std::string>& shader_sources) {
+  ParameterHash hash;
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    const char* value = reinterpret_cast<const char*>(glGetString(name));
+    hash.AddBytes(value, value == nullptr ? 0 : strlen(value) + 1);
+  }
+  for (const std::string& source : shader_sources) {
+    hash.AddBytes(source.c_str(), source.size() + 1);
+  }
+  char filename[64];
+  snprintf(filename, sizeof(filename), "program_%016llx.bin",
+      static_cast<unsigned long long>(hash.value()));  // NOLINT
+  return cache_directory + filename;
+}
+
+/*
+<p>The file starts with the following header, followed by the texture data (see
+<code>SaveTextures</code> for the details). All the values are stored in little
+endian order:
+*/
+
+constexpr char kTexturesFileMagic[4] = {'A', 'L', 'U', 'T'};
+constexpr uint32_t kTexturesFileVersion = 1;
+
+struct TexturesFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t transmittance_width;
+  uint32_t transmittance_height;
+  uint32_t scattering_width;
+  uint32_t scattering_height;
+  uint32_t scattering_depth;
+  uint32_t irradiance_width;
+  uint32_t irradiance_height;
+  // The number of bytes per component of the scattering textures (2 for half
+  // precision floats, 4 for single precision floats). The transmittance and
+  // irradiance textures always use single precision floats.
+  uint32_t scattering_component_size;
+  // 1 if the single Mie scattering is packed in the alpha channel of the
+  // scattering texture (then stored with 4 components per texel), 0 if it is
+  // stored in a separate texture (then both stored with 3 components).
+  uint32_t combined_scattering_textures;
+  uint32_t num_precomputed_wavelengths;
+  uint32_t num_scattering_orders;
+  uint32_t padding;
+  uint64_t parameter_hash;
+};
+static_assert(sizeof(TexturesFileHeader) == 64,
+    "TexturesFileHeader must not contain implicit padding");
+
+TexturesFileHeader NewTexturesFileHeader(
+    unsigned int num_precomputed_wavelengths,
+    bool combine_scattering_textures,
+    bool half_precision,
+    unsigned int num_scattering_orders,
+    uint64_t parameter_hash) {
+  TexturesFileHeader header;
+  std::copy(kTexturesFileMagic, kTexturesFileMagic + 4, header.magic);
+  header.version = kTexturesFileVersion;
+  header.transmittance_width = TRANSMITTANCE_TEXTURE_WIDTH;
+  header.transmittance_height = TRANSMITTANCE_TEXTURE_HEIGHT;
+  header.scattering_width = SCATTERING_TEXTURE_WIDTH;
+  header.scattering_height = SCATTERING_TEXTURE_HEIGHT;
+  header.scattering_depth = SCATTERING_TEXTURE_DEPTH;
+  header.irradiance_width = IRRADIANCE_TEXTURE_WIDTH;
+  header.irradiance_height = IRRADIANCE_TEXTURE_HEIGHT;
+  header.scattering_component_size = half_precision ? 2 : 4;
+  header.combined_scattering_textures = combine_scattering_textures ? 1 : 0;
+  header.num_precomputed_wavelengths = num_precomputed_wavelengths;
+  header.num_scattering_orders = num_scattering_orders;
+  header.padding = 0;
+  header.parameter_hash = parameter_hash;
+  return header;
+}
+
+/*
+<p>The size in bytes of the data of each texture follows from the header:
+*/
+
+constexpr size_t kTransmittanceTextureSize =
+    TRANSMITTANCE_TEXTURE_WIDTH * TRANSMITTANCE_TEXTURE_HEIGHT * 3 *
+    sizeof(float);
+constexpr size_t kIrradianceTextureSize =
+    IRRADIANCE_TEXTURE_WIDTH * IRRADIANCE_TEXTURE_HEIGHT * 3 * sizeof(float);
+
+size_t GetScatteringTextureSize(const TexturesFileHeader& header,
+    int num_components) {
+  return static_cast<size_t>(header.scattering_width) *
+      header.scattering_height * header.scattering_depth * num_components *
+      header.scattering_component_size;
+}
+
+size_t GetTexturesDataSize(const TexturesFileHeader& header) {
+  return kTransmittanceTextureSize + kIrradianceTextureSize +
+      (header.combined_scattering_textures ?
+          GetScatteringTextureSize(header, 4) :
+          2 * GetScatteringTextureSize(header, 3));
+}
+
+/*
+<p>The texture data is read back from the GPU with the following function, which
+appends the texels of the given texture to a byte buffer (the texels are
+uploaded back to the GPU in <code>LoadTextures</code>, with
+<code>glTexImage2D</code> and <code>glTexImage3D</code>):
+*/
+
+void AppendTexture(GLenum target, GLuint texture, GLenum format, GLenum type,
+    size_t size, std::vector<char>* data) {
+  size_t offset = data->size();
+  data->resize(offset + size);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(target, texture);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glGetTexImage(target, 0, format, type, data->data() + offset);
+}
+
+/*
+<p>The precomputed textures can also be converted from those computed on CPU by
+the <a href="reference/model.h.html">reference model</a>, which saves them in
+its cache directory. These files contain one spectrum per texel, with 47
+samples (in double precision) at the center of 47 bins of 10nm between 360 and
+830nm, and with the texels in the same order as in our GPU textures. The
+following function reads such a file and converts each spectrum to 3 values,
+with a 3x47 matrix (see <code>LoadReferenceTextures</code>). The file is read by
+chunks, because the scattering files are quite large (almost 400MB each):
+*/
+
+constexpr int kReferenceNumWavelengths = 47;
+typedef std::array<double, 3 * kReferenceNumWavelengths> SpectrumConversion;
+
+bool ReadReferenceTexture(const std::string& filename, size_t num_texels,
+    const SpectrumConversion& conversion, int num_components,
+    std::vector<float>* texels) {
+  constexpr size_t kTexelSize = kReferenceNumWavelengths * sizeof(double);
+  std::ifstream file(filename, std::ifstream::binary | std::ifstream::ate);
+  if (!file.good() ||
+      static_cast<size_t>(file.tellg()) != num_texels * kTexelSize) {
+    return false;
+  }
+  file.seekg(0);
+  texels->assign(num_texels * num_components, 0.0f);
+
+  constexpr size_t kChunkSize = 4096;
+  std::vector<double> spectra(kChunkSize * kReferenceNumWavelengths);
+  for (size_t first = 0; first < num_texels; first += kChunkSize) {
+    size_t count = std::min(kChunkSize, num_texels - first);
+    file.read(reinterpret_cast<char*>(spectra.data()), count * kTexelSize);
+    if (file.fail()) {
+      return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      const double* spectrum = spectra.data() + i * kReferenceNumWavelengths;
+      float* texel = texels->data() + (first + i) * num_components;
+      for (int c = 0; c < 3; ++c) {
+        double value = 0.0;
+        for (int k = 0; k < kReferenceNumWavelengths; ++k) {
+          value += conversion[c * kReferenceNumWavelengths + k] * spectrum[k];
+        }
+        texel[c] = static_cast<float>(value);
+      }
+    }
+  }
+  return true;
+}
+
+/*
+<p>Finally, the projections from view rays to clip space coordinates used in
+the aerial perspective lookups are computed by inverting the user provided
+projections, with the following function (for row major 3x3 matrices):
+*/
+
+std::array<double, 9> Invert(const std::array<double, 9>& m) {
+  const std::array<double, 9> cofactors = {{
+    m[4] * m[8] - m[5] * m[7], m[5] * m[6] - m[3] * m[8],
+    m[3] * m[7] - m[4] * m[6],
+    m[2] * m[7] - m[1] * m[8], m[0] * m[8] - m[2] * m[6],
+    m[1] * m[6] - m[0] * m[7],
+    m[1] * m[5] - m[2] * m[4], m[2] * m[3] - m[0] * m[5],
+    m[0] * m[4] - m[1] * m[3]
+  }};
+  double determinant =
+      m[0] * cofactors[0] + m[1] * cofactors[1] + m[2] * cofactors[2];
+  std::array<double, 9> result;
+  for (int row = 0; row < 3; ++row) {
+    for (int col = 0; col < 3; ++col) {
+      result[col + 3 * row] = cofactors[row + 3 * col] / determinant;
+    }
+  }
+  return result;
+}
+
+}  // anonymous namespace
+
+/*<h3 id="implementation">Model implementation</h3>
+
+<p>The precomputations are done in many small steps, each rendering at most one
+layer of a 3D texture (or running one compute shader dispatch), so that they
+can be spread over several frames (see
+<code>BeginInit</code> and <code>Step</code>). The pending steps, as well as
+the textures and programs they use, are stored in the following class:
+*/
+
+class Model::Precomputation {
+ public:
+  ~Precomputation() {
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &delta_scattering_density_texture);
+    glDeleteTextures(1, &delta_mie_scattering_texture);
+    glDeleteTextures(1, &delta_rayleigh_scattering_texture);
+    glDeleteTextures(1, &delta_irradiance_texture);
+    glDeleteTextures(1, &next_delta_irradiance_texture);
+    if (owns_textures) {
+      glDeleteTextures(1, &transmittance_texture);
+      glDeleteTextures(1, &scattering_texture);
+      if (optional_single_mie_scattering_texture != 0) {
+        glDeleteTextures(1, &optional_single_mie_scattering_texture);
+      }
+      glDeleteTextures(1, &irradiance_texture);
+    }
+  }
+
+  unsigned int num_scattering_orders = 0;
+
+  // The textures where the results are stored. In incremental mode they are
+  // new textures, owned by this object until they replace the Model textures.
+  bool owns_textures = false;
+  GLuint transmittance_texture = 0;
+  GLuint scattering_texture = 0;
+  GLuint optional_single_mie_scattering_texture = 0;
+  GLuint irradiance_texture = 0;
+
+  // The temporary textures and framebuffer used by the precomputations (with
+  // compute shaders, the scattering density and indirect irradiance passes
+  // read delta_irradiance_texture and write next_delta_irradiance_texture,
+  // and then these textures are swapped. The framebuffer is not used).
+  GLuint delta_irradiance_texture = 0;
+  GLuint next_delta_irradiance_texture = 0;
+  GLuint delta_rayleigh_scattering_texture = 0;
+  GLuint delta_mie_scattering_texture = 0;
+  GLuint delta_scattering_density_texture = 0;
+  GLuint delta_multiple_scattering_texture = 0;
+  GLuint fbo = 0;
+
+  // Sets the wavelength dependent atmosphere parameters in all the programs
+  // (in the order of kSpectrumUniformNames).
+  void BindSpectrumUniforms(const std::vector<vec3>& values) const {
+    for (const Program* program : {compute_transmittance.get(),
+        compute_direct_irradiance.get(), compute_single_scattering.get(),
+        compute_scattering_density.get(), compute_indirect_irradiance.get(),
+        compute_multiple_scattering.get()}) {
+      if (program == nullptr) {
+        continue;
+      }
+      program->Use();
+      for (int i = 0; i < kNumSpectrumUniforms; ++i) {
+        program->BindVec3(kSpectrumUniformNames[i], values[i]);
+      }
+    }
+  }
+
+  // The programs used by the precomputation steps. With compute shaders, the
+  // direct and indirect irradiance are computed by the single scattering and
+  // scattering density programs, respectively, and the corresponding programs
+  // are null.
+  std::unique_ptr<Program> compute_transmittance;
+  std::unique_ptr<Program> compute_direct_irradiance;
+  std::unique_ptr<Program> compute_single_scattering;
+  std::unique_ptr<Program> compute_scattering_density;
+  std::unique_ptr<Program> compute_indirect_irradiance;
+  std::unique_ptr<Program> compute_multiple_scattering;
+
+  // A precomputation step. Its name, and the scattering order and texture
+  // layer it computes (or -1 if it computes a whole texture), are only used to
+  // trace its execution (see RunPrecomputation).
+  struct Step {
+    Step(const char* name, int scattering_order, int layer,
+        const std::function<void()>& run)
+        : name(name), scattering_order(scattering_order), layer(layer),
+          run(run) {}
+
+    const char* name;
+    int scattering_order;
+    int layer;
+    std::function<void()> run;
+  };
+
+  // The precomputation steps, and the number of steps already executed.
+  std::vector<Step> steps;
+  unsigned int num_executed_steps = 0;
+};
+
+/*
+<p>The aerial perspective volume is only allocated if it is used, in
+<code>UpdateAerialPerspective</code>. Its textures, the program to compute them,
+and the projection needed to look them up are stored in the following class:
+*/
+
+class Model::AerialPerspectiveVolume {
+ public:
+  AerialPerspectiveVolume(const std::string& glsl_header, bool half_precision)
+      : program(kVertexShader, kGeometryShader,
+            glsl_header + kComputeAerialPerspectiveVolumeShader),
+        clip_from_view_ray{{1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0}},
+        max_distance(0.0) {
+    scattering_texture = NewTexture3d(AERIAL_PERSPECTIVE_TEXTURE_WIDTH,
+        AERIAL_PERSPECTIVE_TEXTURE_HEIGHT, AERIAL_PERSPECTIVE_TEXTURE_DEPTH,
+        GL_RGB, half_precision);
+    transmittance_texture = NewTexture3d(AERIAL_PERSPECTIVE_TEXTURE_WIDTH,
+        AERIAL_PERSPECTIVE_TEXTURE_HEIGHT, AERIAL_PERSPECTIVE_TEXTURE_DEPTH,
+        GL_RGB, half_precision);
+    glGenFramebuffers(1, &fbo);
+  }
+
+  ~AerialPerspectiveVolume() {
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &scattering_texture);
+    glDeleteTextures(1, &transmittance_texture);
+  }
+
+  Program program;
+  GLuint scattering_texture;
+  GLuint transmittance_texture;
+  GLuint fbo;
+  std::array<double, 9> clip_from_view_ray;
+  double max_distance;
+};
+
+/*
+<p>Using the above utility functions and classes, we can now implement the
+constructor of the <code>Model</code> class. This constructor generates a piece
+of GLSL code that defines an <code>ATMOSPHERE</code> constant containing the
+atmosphere parameters (we use constants instead of uniforms to enable constant
+folding and propagation optimizations in the GLSL compiler), concatenated with
+<a href="functions.glsl.html">functions.glsl</a>, with
+<a href="fast_functions.glsl.html">fast_functions.glsl</a> (for the aerial
+perspective volume lookups), and with <code>kAtmosphereShader</code>, to get
+the shader exposed by our API in <code>GetShader</code>. It also allocates the
+precomputed textures, but does not initialize them.
+*/
+
+Model::Model(
     const std::vector<double>& wavelengths,
     const std::vector<double>& solar_irradiance,
     const double sun_angular_radius,
@@ -605,16 +1678,44 @@ Model::Model(
     double length_unit_in_meters,
     unsigned int num_precomputed_wavelengths,
     bool combine_scattering_textures,
-    bool half_precision) :
+    bool half_precision,
+    const std::string& cache_directory,
+    bool use_compute_shaders) :
         num_precomputed_wavelengths_(num_precomputed_wavelengths),
-        half_precision_(half_precision) {
-  auto to_string = [&wavelengths](const std::vector<double>& v,
-      const vec3& lambdas, double scale) {
-    double r = Interpolate(wavelengths, v, lambdas[0]) * scale;
-    double g = Interpolate(wavelengths, v, lambdas[1]) * scale;
-    double b = Interpolate(wavelengths, v, lambdas[2]) * scale;
-    return "vec3(" + std::to_string(r) + "," + std::to_string(g) + "," +
-        std::to_string(b) + ")";
+        combine_scattering_textures_(combine_scattering_textures),
+        half_precision_(half_precision),
+        use_compute_shaders_(use_compute_shaders && GLEW_VERSION_4_3),
+        num_scattering_orders_(0),
+        cache_directory_(cache_directory) {
+  // A lambda that returns the values of the wavelength dependent atmosphere
+  // parameters for the 3 wavelengths in 'lambdas', in the order of
+  // kSpectrumUniformNames. The values are rounded like in the GLSL constants
+  // of glsl_header_factory_ (see below), so that the precomputation programs
+  // and the shaders using the ATMOSPHERE constant use the same values. Note
+  // that the parameters must be captured by value, since this lambda is used
+  // after the constructor has returned.
+  spectrum_values_factory_ = [=](const vec3& lambdas) {
+    auto values = [&wavelengths, &lambdas](const std::vector<double>& v,
+        double scale) {
+      vec3 result;
+      for (int i = 0; i < 3; ++i) {
+        result[i] = std::stod(std::to_string(
+            Interpolate(wavelengths, v, lambdas[i]) * scale));
+      }
+      return result;
+    };
+    return std::vector<vec3>{
+      values(solar_irradiance, 1.0),
+      values(rayleigh_scattering, length_unit_in_meters),
+      values(mie_scattering, length_unit_in_meters),
+      values(mie_extinction, length_unit_in_meters),
+      values(absorption_extinction, length_unit_in_meters),
+      values(ground_albedo, 1.0)
+    };
+  };
+  auto to_string = [](const vec3& v) {
+    return "vec3(" + std::to_string(v[0]) + "," + std::to_string(v[1]) + "," +
+        std::to_string(v[2]) + ")";
   };
   auto density_layer =
       [length_unit_in_meters](const DensityProfileLayer& layer) {
@@ -660,53 +1761,36 @@ Model::Model(
   ComputeSpectralRadianceToLuminanceFactors(wavelengths, solar_irradiance,
       0 /* lambda_power */, &sun_k_r, &sun_k_g, &sun_k_b);
 
+  // A lambda that returns the GLSL expression of the atmosphere parameters,
+  // with the given GLSL expressions for the wavelength dependent parameters
+  // (in the order of kSpectrumUniformNames).
+  auto atmosphere_parameters = [=](const std::vector<std::string>& spectra) {
+    return "AtmosphereParameters(" +
+        spectra[0] + "," +
+        std::to_string(sun_angular_radius) + "," +
+        std::to_string(bottom_radius / length_unit_in_meters) + "," +
+        std::to_string(top_radius / length_unit_in_meters) + "," +
+        density_profile(rayleigh_density) + "," +
+        spectra[1] + "," +
+        density_profile(mie_density) + "," +
+        spectra[2] + "," +
+        spectra[3] + "," +
+        std::to_string(mie_phase_function_g) + "," +
+        density_profile(absorption_density) + "," +
+        spectra[4] + "," +
+        spectra[5] + "," +
+        std::to_string(cos(max_sun_zenith_angle)) + ")";
+  };
+
   // A lambda that creates a GLSL header containing our atmosphere computation
-  // functions, specialized for the given atmosphere parameters and for the 3
-  // wavelengths in 'lambdas'.
-  glsl_header_factory_ = [=](const vec3& lambdas) {
-    return
-      "#version 330\n"
-      "#define IN(x) const in x\n"
-      "#define OUT(x) out x\n"
-      "#define TEMPLATE(x)\n"
-      "#define TEMPLATE_ARGUMENT(x)\n"
-      "#define assert(x)\n"
-      "const int TRANSMITTANCE_TEXTURE_WIDTH = " +
-          std::to_string(TRANSMITTANCE_TEXTURE_WIDTH) + ";\n" +
-      "const int TRANSMITTANCE_TEXTURE_HEIGHT = " +
-          std::to_string(TRANSMITTANCE_TEXTURE_HEIGHT) + ";\n" +
-      "const int SCATTERING_TEXTURE_R_SIZE = " +
-          std::to_string(SCATTERING_TEXTURE_R_SIZE) + ";\n" +
-      "const int SCATTERING_TEXTURE_MU_SIZE = " +
-          std::to_string(SCATTERING_TEXTURE_MU_SIZE) + ";\n" +
-      "const int SCATTERING_TEXTURE_MU_S_SIZE = " +
-          std::to_string(SCATTERING_TEXTURE_MU_S_SIZE) + ";\n" +
-      "const int SCATTERING_TEXTURE_NU_SIZE = " +
-          std::to_string(SCATTERING_TEXTURE_NU_SIZE) + ";\n" +
-      "const int IRRADIANCE_TEXTURE_WIDTH = " +
-          std::to_string(IRRADIANCE_TEXTURE_WIDTH) + ";\n" +
-      "const int IRRADIANCE_TEXTURE_HEIGHT = " +
-          std::to_string(IRRADIANCE_TEXTURE_HEIGHT) + ";\n" +
+  // functions, specialized for the given atmosphere parameters and with the
+  // given definition of ATMOSPHERE.
+  auto glsl_header = [=](const std::string& atmosphere_definition) {
+    return GetGlslPreamble() +
       (combine_scattering_textures ?
           "#define COMBINED_SCATTERING_TEXTURES\n" : "") +
       definitions_glsl +
-      "const AtmosphereParameters ATMOSPHERE = AtmosphereParameters(\n" +
-          to_string(solar_irradiance, lambdas, 1.0) + ",\n" +
-          std::to_string(sun_angular_radius) + ",\n" +
-          std::to_string(bottom_radius / length_unit_in_meters) + ",\n" +
-          std::to_string(top_radius / length_unit_in_meters) + ",\n" +
-          density_profile(rayleigh_density) + ",\n" +
-          to_string(
-              rayleigh_scattering, lambdas, length_unit_in_meters) + ",\n" +
-          density_profile(mie_density) + ",\n" +
-          to_string(mie_scattering, lambdas, length_unit_in_meters) + ",\n" +
-          to_string(mie_extinction, lambdas, length_unit_in_meters) + ",\n" +
-          std::to_string(mie_phase_function_g) + ",\n" +
-          density_profile(absorption_density) + ",\n" +
-          to_string(
-              absorption_extinction, lambdas, length_unit_in_meters) + ",\n" +
-          to_string(ground_albedo, lambdas, 1.0) + ",\n" +
-          std::to_string(cos(max_sun_zenith_angle)) + ");\n" +
+      atmosphere_definition +
       "const vec3 SKY_SPECTRAL_RADIANCE_TO_LUMINANCE = vec3(" +
           std::to_string(sky_k_r) + "," +
           std::to_string(sky_k_g) + "," +
@@ -718,33 +1802,77 @@ Model::Model(
       functions_glsl;
   };
 
-  // Allocate the precomputed textures, but don't precompute them yet.
-  transmittance_texture_ = NewTexture2d(
-      TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
-  scattering_texture_ = NewTexture3d(
-      SCATTERING_TEXTURE_WIDTH,
-      SCATTERING_TEXTURE_HEIGHT,
-      SCATTERING_TEXTURE_DEPTH,
-      combine_scattering_textures ? GL_RGBA : GL_RGB,
-      half_precision);
-  if (combine_scattering_textures) {
-    optional_single_mie_scattering_texture_ = 0;
-  } else {
-    optional_single_mie_scattering_texture_ = NewTexture3d(
-        SCATTERING_TEXTURE_WIDTH,
-        SCATTERING_TEXTURE_HEIGHT,
-        SCATTERING_TEXTURE_DEPTH,
-        GL_RGB,
-        half_precision);
+  // A lambda that creates a GLSL header where ATMOSPHERE is a constant, with
+  // the atmosphere parameters for the 3 wavelengths in 'lambdas'.
+  glsl_header_factory_ = [=](const vec3& lambdas) {
+    std::vector<std::string> spectra;
+    for (const vec3& value : spectrum_values_factory_(lambdas)) {
+      spectra.push_back(to_string(value));
+    }
+    return "#version 330\n" +
+        glsl_header("const AtmosphereParameters ATMOSPHERE = " +
+            atmosphere_parameters(spectra) + ";\n");
+  };
+
+  // The GLSL header used by the precomputation programs, where the wavelength
+  // dependent parameters are uniforms, so that these programs can be compiled
+  // once and used for all the precomputed wavelengths (see Precompute). The
+  // other parameters remain constants, to enable constant folding. Since a
+  // constant can't be initialized with uniforms, and since the initializers of
+  // global variables must be constant expressions, ATMOSPHERE is a macro here.
+  // This header does not contain the #version directive, which depends on the
+  // shader type (see BeginPrecomputation).
+  std::string spectrum_uniforms;
+  std::vector<std::string> spectra;
+  for (int i = 0; i < kNumSpectrumUniforms; ++i) {
+    spectrum_uniforms +=
+        "uniform vec3 " + std::string(kSpectrumUniformNames[i]) + ";\n";
+    spectra.push_back(kSpectrumUniformNames[i]);
   }
-  irradiance_texture_ = NewTexture2d(
-      IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
+  precomputation_glsl_header_ = glsl_header(spectrum_uniforms +
+      "#define ATMOSPHERE " + atmosphere_parameters(spectra) + "\n");
+
+  // Hash all the parameters which have an influence on the precomputed
+  // textures, to identify them in the files written by SaveTextures.
+  ParameterHash hash;
+  hash.AddInt(kTexturesFileVersion);
+  hash.AddVector(wavelengths);
+  hash.AddVector(solar_irradiance);
+  hash.AddDouble(sun_angular_radius);
+  hash.AddDouble(bottom_radius);
+  hash.AddDouble(top_radius);
+  hash.AddDensityProfile(rayleigh_density);
+  hash.AddVector(rayleigh_scattering);
+  hash.AddDensityProfile(mie_density);
+  hash.AddVector(mie_scattering);
+  hash.AddVector(mie_extinction);
+  hash.AddDouble(mie_phase_function_g);
+  hash.AddDensityProfile(absorption_density);
+  hash.AddVector(absorption_extinction);
+  hash.AddVector(ground_albedo);
+  hash.AddDouble(max_sun_zenith_angle);
+  hash.AddDouble(length_unit_in_meters);
+  hash.AddInt(num_precomputed_wavelengths);
+  hash.AddInt(combine_scattering_textures);
+  hash.AddInt(half_precision);
+  hash.AddInt(TRANSMITTANCE_SAMPLE_COUNT);
+  hash.AddInt(SINGLE_SCATTERING_SAMPLE_COUNT);
+  hash.AddInt(SCATTERING_DENSITY_SAMPLE_COUNT);
+  hash.AddInt(INDIRECT_IRRADIANCE_SAMPLE_COUNT);
+  hash.AddInt(MULTIPLE_SCATTERING_SAMPLE_COUNT);
+  parameter_hash_ = hash.value();
+
+  // Allocate the precomputed textures, but don't precompute them yet.
+  NewPrecomputedTextures(combine_scattering_textures, half_precision,
+      use_compute_shaders_ ? GL_RGBA : GL_RGB,
+      &transmittance_texture_, &scattering_texture_,
+      &optional_single_mie_scattering_texture_, &irradiance_texture_);
 
   // Create and compile the shader providing our API.
   std::string shader =
       glsl_header_factory_({kLambdaR, kLambdaG, kLambdaB}) +
       (precompute_illuminance ? "" : "#define RADIANCE_API_ENABLED\n") +
-      kAtmosphereShader;
+      fast_functions_glsl + kAtmosphereShader;
   const char* source = shader.c_str();
   atmosphere_shader_ = glCreateShader(GL_FRAGMENT_SHADER);
   glShaderSource(atmosphere_shader_, 1, &source, NULL);
@@ -766,9 +1894,16 @@ Model::~Model() {
 }
 
 /*
-<p>The Init method precomputes the atmosphere textures. It first allocates the
-temporary resources it needs, then calls <code>Precompute</code> to do the
-actual precomputations, and finally destroys the temporary resources.
+<p>The Init method precomputes the atmosphere textures, unless they can be
+loaded from the cache directory (see <code>LoadTextures</code> below). The
+precomputations are split in many small steps (see
+<code>Precomputation</code>), which are prepared by the following
+<code>BeginPrecomputation</code> method. It first allocates the temporary
+resources needed by the precomputations, then calls <code>Precompute</code> to
+add the actual precomputation steps. The steps are then executed by
+<code>RunPrecomputation</code> (see below), which destroys the temporary
+resources at the end (and saves the precomputed textures in the cache
+directory, if any).
 
 <p>Note that there are two precomputation modes here, depending on whether we
 want to store precomputed irradiance or illuminance values:
@@ -818,54 +1953,168 @@ want to store precomputed irradiance or illuminance values:
 <p>This yields the following implementation:
 */
 
-void Model::Init(unsigned int num_scattering_orders) {
+void Model::BeginPrecomputation(unsigned int num_scattering_orders,
+    bool incremental) {
+  trace::Span span("precompute", "BeginPrecomputation", "scattering_orders",
+      num_scattering_orders);
+  GlStateSaver gl_state_saver;
+  precomputation_.reset();
+
+  // If the textures have already been precomputed with the same parameters,
+  // simply load them from the cache directory.
+  const std::string cache_filename = GetCacheFilename(num_scattering_orders);
+  if (!cache_filename.empty() &&
+      LoadTextures(cache_filename, num_scattering_orders)) {
+    return;
+  }
+
+  // In incremental mode, the textures are precomputed in new textures, and the
+  // current ones remain usable until the end of the precomputations.
+  std::unique_ptr<Precomputation> p(new Precomputation());
+  p->num_scattering_orders = num_scattering_orders;
+  p->owns_textures = incremental;
+  const GLenum rgb_format = use_compute_shaders_ ? GL_RGBA : GL_RGB;
+  if (incremental) {
+    NewPrecomputedTextures(combine_scattering_textures_, half_precision_,
+        rgb_format, &p->transmittance_texture, &p->scattering_texture,
+        &p->optional_single_mie_scattering_texture, &p->irradiance_texture);
+  } else {
+    p->transmittance_texture = transmittance_texture_;
+    p->scattering_texture = scattering_texture_;
+    p->optional_single_mie_scattering_texture =
+        optional_single_mie_scattering_texture_;
+    p->irradiance_texture = irradiance_texture_;
+  }
+
   // The precomputations require temporary textures, in particular to store the
   // contribution of one scattering order, which is needed to compute the next
   // order of scattering (the final precomputed textures store the sum of all
-  // the scattering orders). We allocate them here, and destroy them at the end
-  // of this method.
-  GLuint delta_irradiance_texture = NewTexture2d(
-      IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
-  GLuint delta_rayleigh_scattering_texture = NewTexture3d(
+  // the scattering orders). We allocate them here (they are destroyed at the
+  // end of the precomputations).
+  p->delta_irradiance_texture = NewTexture2d(
+      IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT, rgb_format);
+  if (use_compute_shaders_) {
+    p->next_delta_irradiance_texture = NewTexture2d(
+        IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT, rgb_format);
+  }
+  p->delta_rayleigh_scattering_texture = NewTexture3d(
       SCATTERING_TEXTURE_WIDTH,
       SCATTERING_TEXTURE_HEIGHT,
       SCATTERING_TEXTURE_DEPTH,
-      GL_RGB,
+      rgb_format,
       half_precision_);
-  GLuint delta_mie_scattering_texture = NewTexture3d(
+  p->delta_mie_scattering_texture = NewTexture3d(
       SCATTERING_TEXTURE_WIDTH,
       SCATTERING_TEXTURE_HEIGHT,
       SCATTERING_TEXTURE_DEPTH,
-      GL_RGB,
+      rgb_format,
       half_precision_);
-  GLuint delta_scattering_density_texture = NewTexture3d(
+  p->delta_scattering_density_texture = NewTexture3d(
       SCATTERING_TEXTURE_WIDTH,
       SCATTERING_TEXTURE_HEIGHT,
       SCATTERING_TEXTURE_DEPTH,
-      GL_RGB,
+      rgb_format,
       half_precision_);
   // delta_multiple_scattering_texture is only needed to compute scattering
   // order 3 or more, while delta_rayleigh_scattering_texture and
   // delta_mie_scattering_texture are only needed to compute double scattering.
   // Therefore, to save memory, we can store delta_rayleigh_scattering_texture
   // and delta_multiple_scattering_texture in the same GPU texture.
-  GLuint delta_multiple_scattering_texture = delta_rayleigh_scattering_texture;
+  p->delta_multiple_scattering_texture = p->delta_rayleigh_scattering_texture;
 
-  // The precomputations also require a temporary framebuffer object, created
-  // here (and destroyed at the end of this method).
-  GLuint fbo;
-  glGenFramebuffers(1, &fbo);
-  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  // The precomputations with fragment shaders also require a temporary
+  // framebuffer object.
+  if (!use_compute_shaders_) {
+    glGenFramebuffers(1, &p->fbo);
+  }
+
+  // The precomputations require specific GLSL programs, for each precomputation
+  // step. We create and compile them in the first steps (one program per step,
+  // since compiling them can take some time). These programs are used for all
+  // the precomputed wavelengths (see Precompute), and are destroyed at the end
+  // of the precomputations. If there is a cache directory, the program
+  // binaries are also cached there, to avoid compiling them again later.
+  auto new_program = [this](const std::string& geometry_shader_source,
+      const std::string& fragment_shader_source) {
+    const std::string source =
+        "#version 330\n" + precomputation_glsl_header_ + fragment_shader_source;
+    const std::string binary_filename = cache_directory_.empty() ? "" :
+        GetProgramBinaryFilename(cache_directory_,
+            {kVertexShader, geometry_shader_source, source});
+    return new Program(
+        kVertexShader, geometry_shader_source, source, binary_filename);
+  };
+  auto new_compute_program = [this](const std::string& compute_shader_source) {
+    const std::string source = "#version 430\n"
+        "#define SCATTERING_IMAGE_FORMAT " +
+        std::string(half_precision_ ? "rgba16f" : "rgba32f") + "\n" +
+        precomputation_glsl_header_ + compute_shader_source;
+    const std::string binary_filename = cache_directory_.empty() ? "" :
+        GetProgramBinaryFilename(cache_directory_, {source});
+    return new Program(GL_COMPUTE_SHADER, source, binary_filename);
+  };
+  Precomputation* precomputation = p.get();
+  if (use_compute_shaders_) {
+    p->steps.emplace_back("compile_transmittance", 0, -1,
+        [precomputation, new_compute_program]() {
+      precomputation->compute_transmittance.reset(
+          new_compute_program(kTransmittanceComputeShader));
+    });
+    p->steps.emplace_back("compile_single_scattering", 0, -1,
+        [precomputation, new_compute_program]() {
+      precomputation->compute_single_scattering.reset(
+          new_compute_program(kSingleScatteringComputeShader));
+    });
+    p->steps.emplace_back("compile_scattering_density", 0, -1,
+        [precomputation, new_compute_program]() {
+      precomputation->compute_scattering_density.reset(
+          new_compute_program(kScatteringDensityComputeShader));
+    });
+    p->steps.emplace_back("compile_multiple_scattering", 0, -1,
+        [precomputation, new_compute_program]() {
+      precomputation->compute_multiple_scattering.reset(
+          new_compute_program(kMultipleScatteringComputeShader));
+    });
+  } else {
+    p->steps.emplace_back("compile_transmittance", 0, -1,
+        [precomputation, new_program]() {
+      precomputation->compute_transmittance.reset(
+          new_program("", kComputeTransmittanceShader));
+    });
+    p->steps.emplace_back("compile_direct_irradiance", 0, -1,
+        [precomputation, new_program]() {
+      precomputation->compute_direct_irradiance.reset(
+          new_program("", kComputeDirectIrradianceShader));
+    });
+    p->steps.emplace_back("compile_single_scattering", 0, -1,
+        [precomputation, new_program]() {
+      precomputation->compute_single_scattering.reset(
+          new_program(kGeometryShader, kComputeSingleScatteringShader));
+    });
+    p->steps.emplace_back("compile_scattering_density", 0, -1,
+        [precomputation, new_program]() {
+      precomputation->compute_scattering_density.reset(
+          new_program(kGeometryShader, kComputeScatteringDensityShader));
+    });
+    p->steps.emplace_back("compile_indirect_irradiance", 0, -1,
+        [precomputation, new_program]() {
+      precomputation->compute_indirect_irradiance.reset(
+          new_program("", kComputeIndirectIrradianceShader));
+    });
+    p->steps.emplace_back("compile_multiple_scattering", 0, -1,
+        [precomputation, new_program]() {
+      precomputation->compute_multiple_scattering.reset(
+          new_program(kGeometryShader, kComputeMultipleScatteringShader));
+    });
+  }
 
   // The actual precomputations depend on whether we want to store precomputed
   // irradiance or illuminance values.
   if (num_precomputed_wavelengths_ <= 3) {
     vec3 lambdas{kLambdaR, kLambdaG, kLambdaB};
     mat3 luminance_from_radiance{1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0};
-    Precompute(fbo, delta_irradiance_texture, delta_rayleigh_scattering_texture,
-        delta_mie_scattering_texture, delta_scattering_density_texture,
-        delta_multiple_scattering_texture, lambdas, luminance_from_radiance,
-        false /* blend */, num_scattering_orders);
+    Precompute(p.get(), lambdas, luminance_from_radiance, false /* blend */,
+        num_scattering_orders);
   } else {
     constexpr double kLambdaMin = 360.0;
     constexpr double kLambdaMax = 830.0;
@@ -896,37 +2145,405 @@ void Model::Init(unsigned int num_scattering_orders) {
         coeff(lambdas[0], 1), coeff(lambdas[1], 1), coeff(lambdas[2], 1),
         coeff(lambdas[0], 2), coeff(lambdas[1], 2), coeff(lambdas[2], 2)
       };
-      Precompute(fbo, delta_irradiance_texture,
-          delta_rayleigh_scattering_texture, delta_mie_scattering_texture,
-          delta_scattering_density_texture, delta_multiple_scattering_texture,
-          lambdas, luminance_from_radiance, i > 0 /* blend */,
-          num_scattering_orders);
+      Precompute(p.get(), lambdas, luminance_from_radiance,
+          i > 0 /* blend */, num_scattering_orders);
     }
 
     // After the above iterations, the transmittance texture contains the
     // transmittance for the 3 wavelengths used at the last iteration. But we
     // want the transmittance at kLambdaR, kLambdaG, kLambdaB instead, so we
     // must recompute it here for these 3 wavelengths:
-    std::string header = glsl_header_factory_({kLambdaR, kLambdaG, kLambdaB});
-    Program compute_transmittance(
-        kVertexShader, header + kComputeTransmittanceShader);
-    glFramebufferTexture(
-        GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, transmittance_texture_, 0);
-    glDrawBuffer(GL_COLOR_ATTACHMENT0);
-    glViewport(0, 0, TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
-    compute_transmittance.Use();
-    DrawQuad({});
+    const std::vector<vec3> spectrum_values =
+        spectrum_values_factory_(vec3{kLambdaR, kLambdaG, kLambdaB});
+    const bool use_compute_shaders = use_compute_shaders_;
+    p->steps.emplace_back("transmittance", 0, -1,
+        [precomputation, spectrum_values, use_compute_shaders]() {
+      precomputation->BindSpectrumUniforms(spectrum_values);
+      const Program& program = *precomputation->compute_transmittance;
+      program.Use();
+      if (use_compute_shaders) {
+        program.BindImage("transmittance_image",
+            precomputation->transmittance_texture, GL_RGBA32F, 0);
+        DispatchCompute(
+            TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT, 1);
+      } else {
+        SetColorAttachments({precomputation->transmittance_texture});
+        glViewport(
+            0, 0, TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
+        DrawQuad({});
+      }
+    });
+  }
+  precomputation_ = std::move(p);
+}
+
+/*
+<p>The <code>RunPrecomputation</code> method executes the precomputation steps
+prepared above, in order, either all at once (if <code>budget_ms</code> is
+negative) or until the given time budget is exhausted (but at least one step).
+In the latter case we wait for the GPU to complete each step before measuring
+the elapsed time, since the GPU commands are otherwise executed asynchronously.
+When all the steps are done, the precomputed textures replace the current ones
+if they are new textures (the old ones are then deleted with the temporary
+resources, which are owned by the <code>Precomputation</code> instance).
+
+<p>If <a href="trace.h.html">tracing</a> is enabled, each step is recorded on
+the CPU and, if timer queries are supported, on the GPU. For the latter we
+record a GPU timestamp before and after each step, and read them back at the
+end (to avoid waiting for the GPU after each step). They are converted to CPU
+times with a reference GPU timestamp, read synchronously at the beginning:
+*/
+
+bool Model::RunPrecomputation(double budget_ms) {
+  if (!precomputation_) {
+    return true;
+  }
+  trace::Span span("precompute", "RunPrecomputation");
+  Precomputation& p = *precomputation_;
+  {
+    GlStateSaver gl_state_saver(use_compute_shaders_);
+    glBindFramebuffer(GL_FRAMEBUFFER, p.fbo);
+    glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
+    const bool gpu_trace = trace::IsEnabled() &&
+        (GLEW_VERSION_3_3 || GLEW_ARB_timer_query);
+    const unsigned int first_step = p.num_executed_steps;
+    std::vector<GLuint> timer_queries;
+    GLint64 gpu_reference_time = 0;
+    double cpu_reference_time = 0.0;
+    if (gpu_trace) {
+      glGetInteger64v(GL_TIMESTAMP, &gpu_reference_time);
+      cpu_reference_time = trace::NowMicros();
+    }
+    auto start = std::chrono::steady_clock::now();
+    while (p.num_executed_steps < p.steps.size()) {
+      const Precomputation::Step& step = p.steps[p.num_executed_steps++];
+      if (gpu_trace) {
+        timer_queries.resize(timer_queries.size() + 2);
+        glGenQueries(2, &timer_queries[timer_queries.size() - 2]);
+        glQueryCounter(timer_queries[timer_queries.size() - 2], GL_TIMESTAMP);
+      }
+      {
+        trace::Span step_span("precompute", step.name, "scattering_order",
+            step.scattering_order, step.layer >= 0 ? "layer" : nullptr,
+            step.layer);
+        step.run();
+      }
+      if (gpu_trace) {
+        glQueryCounter(timer_queries.back(), GL_TIMESTAMP);
+      }
+      if (budget_ms >= 0.0) {
+        glFinish();
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        if (elapsed.count() >= budget_ms) {
+          break;
+        }
+      }
+    }
+    for (unsigned int i = 0; i < timer_queries.size(); i += 2) {
+      const Precomputation::Step& step = p.steps[first_step + i / 2];
+      GLint64 begin;
+      GLint64 end;
+      glGetQueryObjecti64v(timer_queries[i], GL_QUERY_RESULT, &begin);
+      glGetQueryObjecti64v(timer_queries[i + 1], GL_QUERY_RESULT, &end);
+      trace::AddEvent("precompute", step.name, trace::kGpuThread,
+          cpu_reference_time + (begin - gpu_reference_time) * 1e-3,
+          cpu_reference_time + (end - gpu_reference_time) * 1e-3,
+          "scattering_order", step.scattering_order,
+          step.layer >= 0 ? "layer" : nullptr, step.layer);
+    }
+    if (!timer_queries.empty()) {
+      glDeleteQueries(timer_queries.size(), timer_queries.data());
+    }
+  }
+  if (p.num_executed_steps < p.steps.size()) {
+    return false;
   }
 
-  // Delete the temporary resources allocated at the begining of this method.
-  glUseProgram(0);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  glDeleteFramebuffers(1, &fbo);
-  glDeleteTextures(1, &delta_scattering_density_texture);
-  glDeleteTextures(1, &delta_mie_scattering_texture);
-  glDeleteTextures(1, &delta_rayleigh_scattering_texture);
-  glDeleteTextures(1, &delta_irradiance_texture);
+  if (p.owns_textures) {
+    std::swap(transmittance_texture_, p.transmittance_texture);
+    std::swap(scattering_texture_, p.scattering_texture);
+    std::swap(optional_single_mie_scattering_texture_,
+        p.optional_single_mie_scattering_texture);
+    std::swap(irradiance_texture_, p.irradiance_texture);
+  }
+  num_scattering_orders_ = p.num_scattering_orders;
+  precomputation_.reset();
   assert(glGetError() == 0);
+
+  const std::string cache_filename = GetCacheFilename(num_scattering_orders_);
+  if (!cache_filename.empty()) {
+    GlStateSaver gl_state_saver;
+    SaveTextures(cache_filename);
+  }
+  return true;
+}
+
+/*
+<p>With these two methods, the public initialization methods are trivial:
+*/
+
+void Model::Init(unsigned int num_scattering_orders) {
+  BeginPrecomputation(num_scattering_orders, false /* incremental */);
+  RunPrecomputation(-1.0 /* no time budget */);
+}
+
+void Model::BeginInit(unsigned int num_scattering_orders) {
+  BeginPrecomputation(num_scattering_orders, true /* incremental */);
+}
+
+bool Model::Step(double budget_ms) {
+  return RunPrecomputation(budget_ms);
+}
+
+/*
+<p>The cache file name contains the parameter hash, so that several models can
+share the same cache directory:
+*/
+
+std::string Model::GetCacheFilename(unsigned int num_scattering_orders) const {
+  if (cache_directory_.empty()) {
+    return "";
+  }
+  char hash[17];
+  snprintf(hash, sizeof(hash), "%016llx",
+      static_cast<unsigned long long>(parameter_hash_));  // NOLINT
+  return cache_directory_ + "precomputed_textures_" + hash + "_" +
+      std::to_string(num_scattering_orders) + ".dat";
+}
+
+/*
+<p>The <code>SaveTextures</code> method writes the precomputed textures to a
+file, which starts with a <code>TexturesFileHeader</code> (see above), followed
+by the texels of the following textures, in this order:
+<ul>
+<li>the transmittance texture, with 3 single precision floats per texel,</li>
+<li>the scattering texture, with 4 components per texel if
+<code>combine_scattering_textures</code> is true, or 3 otherwise. Each
+component is a half or a single precision float, depending on
+<code>half_precision</code>,</li>
+<li>the optional single Mie scattering texture, if
+<code>combine_scattering_textures</code> is false, with the same format as the
+scattering texture (and thus with 3 components per texel),</li>
+<li>the irradiance texture, with 3 single precision floats per texel.</li>
+</ul>
+<p>The texels of each texture are stored row by row (and layer by layer for the
+3D textures), without padding, starting with the texel at (0,0,0). The textures
+are read back from the GPU as is, so that the file contains exactly the
+precomputed values (in particular, the half precision values are not converted
+to single precision floats):
+*/
+
+bool Model::SaveTextures(const std::string& filename) const {
+  assert(num_scattering_orders_ > 0);
+  const TexturesFileHeader header = NewTexturesFileHeader(
+      num_precomputed_wavelengths_, combine_scattering_textures_,
+      half_precision_, num_scattering_orders_, parameter_hash_);
+  const GLenum scattering_type = half_precision_ ? GL_HALF_FLOAT : GL_FLOAT;
+
+  GLint pack_alignment;
+  glGetIntegerv(GL_PACK_ALIGNMENT, &pack_alignment);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  std::vector<char> data;
+  data.reserve(GetTexturesDataSize(header));
+  AppendTexture(GL_TEXTURE_2D, transmittance_texture_, GL_RGB, GL_FLOAT,
+      kTransmittanceTextureSize, &data);
+  if (combine_scattering_textures_) {
+    AppendTexture(GL_TEXTURE_3D, scattering_texture_, GL_RGBA, scattering_type,
+        GetScatteringTextureSize(header, 4), &data);
+  } else {
+    AppendTexture(GL_TEXTURE_3D, scattering_texture_, GL_RGB, scattering_type,
+        GetScatteringTextureSize(header, 3), &data);
+    AppendTexture(GL_TEXTURE_3D, optional_single_mie_scattering_texture_,
+        GL_RGB, scattering_type, GetScatteringTextureSize(header, 3), &data);
+  }
+  AppendTexture(GL_TEXTURE_2D, irradiance_texture_, GL_RGB, GL_FLOAT,
+      kIrradianceTextureSize, &data);
+  glPixelStorei(GL_PACK_ALIGNMENT, pack_alignment);
+  assert(glGetError() == 0);
+
+  std::ofstream file(filename, std::ofstream::binary);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(data.data(), data.size());
+  file.close();
+  return !file.fail();
+}
+
+/*
+<p>Conversely, the <code>LoadTextures</code> method reads a file written by
+<code>SaveTextures</code>, and uploads its content to the GPU. The file header
+must be exactly the one <code>SaveTextures</code> would write for this model
+(which checks at once the file format version, the texture sizes and formats,
+the number of scattering orders and the parameter hash), and the file size must
+match the expected texture data size. The whole file is read and checked before
+any texture is modified, so that the model remains usable (e.g. to precompute
+its textures with <code>Init</code>) if the file is invalid:
+*/
+
+bool Model::LoadTextures(const std::string& filename,
+    unsigned int num_scattering_orders) {
+  std::ifstream file(filename, std::ifstream::binary);
+  if (!file.good()) {
+    return false;
+  }
+  const TexturesFileHeader expected_header = NewTexturesFileHeader(
+      num_precomputed_wavelengths_, combine_scattering_textures_,
+      half_precision_, num_scattering_orders, parameter_hash_);
+  TexturesFileHeader header;
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (file.fail() ||
+      std::memcmp(&header, &expected_header, sizeof(header)) != 0) {
+    return false;
+  }
+  std::vector<char> data(GetTexturesDataSize(header));
+  file.read(data.data(), data.size());
+  if (file.fail() || file.peek() != std::ifstream::traits_type::eof()) {
+    return false;
+  }
+  file.close();
+
+  const char* texels = data.data();
+  const char* scattering = texels + kTransmittanceTextureSize;
+  const char* single_mie_scattering = combine_scattering_textures_ ? nullptr :
+      scattering + GetScatteringTextureSize(header, 3);
+  const char* irradiance =
+      texels + GetTexturesDataSize(header) - kIrradianceTextureSize;
+
+  UploadTextures(texels, scattering, single_mie_scattering, irradiance,
+      half_precision_ ? GL_HALF_FLOAT : GL_FLOAT);
+  num_scattering_orders_ = num_scattering_orders;
+  return true;
+}
+
+/*
+<p>The <code>UploadTextures</code> method, used above, replaces the content of
+the precomputed textures with the given texels, in the same layout as in the
+files written by <code>SaveTextures</code>. The transmittance and irradiance
+texels must be single precision floats, while the type of the scattering texels
+is given by <code>scattering_type</code> (<code>GL_HALF_FLOAT</code> or
+<code>GL_FLOAT</code> - the texels are converted, if necessary, to the internal
+format of the textures, which depends on <code>half_precision</code> and on
+whether compute shaders are used):
+*/
+
+void Model::UploadTextures(
+    const void* transmittance,
+    const void* scattering,
+    const void* optional_single_mie_scattering,
+    const void* irradiance,
+    unsigned int scattering_type) {
+  GLint unpack_alignment;
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  glActiveTexture(GL_TEXTURE0);
+
+  glBindTexture(GL_TEXTURE_2D, transmittance_texture_);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TRANSMITTANCE_TEXTURE_WIDTH,
+      TRANSMITTANCE_TEXTURE_HEIGHT, GL_RGB, GL_FLOAT, transmittance);
+
+  glBindTexture(GL_TEXTURE_3D, scattering_texture_);
+  if (combine_scattering_textures_) {
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, SCATTERING_TEXTURE_WIDTH,
+        SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH, GL_RGBA,
+        scattering_type, scattering);
+  } else {
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, SCATTERING_TEXTURE_WIDTH,
+        SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH, GL_RGB,
+        scattering_type, scattering);
+    glBindTexture(GL_TEXTURE_3D, optional_single_mie_scattering_texture_);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, SCATTERING_TEXTURE_WIDTH,
+        SCATTERING_TEXTURE_HEIGHT, SCATTERING_TEXTURE_DEPTH, GL_RGB,
+        scattering_type, optional_single_mie_scattering);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, irradiance_texture_);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, IRRADIANCE_TEXTURE_WIDTH,
+      IRRADIANCE_TEXTURE_HEIGHT, GL_RGB, GL_FLOAT, irradiance);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+  assert(glGetError() == 0);
+}
+
+/*
+<p>Finally, the <code>LoadReferenceTextures</code> method converts the textures
+precomputed by the CPU reference model to our GPU textures. The reference model
+computes them for 47 wavelengths, while we need:
+<ul>
+<li>for the transmittance texture, and for the other textures in precomputed
+irradiance mode, the values at <code>kLambdaR</code>, <code>kLambdaG</code> and
+<code>kLambdaB</code>, which we get by linear interpolation of the spectra (as
+in <code>Interpolate</code>),</li>
+<li>for the other textures in precomputed illuminance mode, the sRGB values,
+without the <code>MAX_LUMINOUS_EFFICACY</code> factor (see <code>Init</code>).
+We compute them with the same integration as in <code>Init</code>, but using
+all the reference samples (i.e. with a 10nm integration step).</li>
+</ul>
+<p>Each conversion is linear, so we represent it with a 3x47 matrix. With
+<code>combine_scattering_textures</code>, the red component of the single Mie
+scattering is then packed in the alpha channel of the scattering texture:
+*/
+
+bool Model::LoadReferenceTextures(const std::string& cache_directory,
+    unsigned int num_scattering_orders) {
+  const double dlambda = static_cast<double>(kLambdaMax - kLambdaMin) /
+      kReferenceNumWavelengths;
+  std::vector<double> wavelengths;
+  for (int k = 0; k < kReferenceNumWavelengths; ++k) {
+    wavelengths.push_back(kLambdaMin + (k + 0.5) * dlambda);
+  }
+  SpectrumConversion interpolation;
+  SpectrumConversion luminance_from_radiance;
+  const vec3 lambdas{kLambdaR, kLambdaG, kLambdaB};
+  for (int k = 0; k < kReferenceNumWavelengths; ++k) {
+    std::vector<double> sample(kReferenceNumWavelengths, 0.0);
+    sample[k] = 1.0;
+    double x = CieColorMatchingFunctionTableValue(wavelengths[k], 1);
+    double y = CieColorMatchingFunctionTableValue(wavelengths[k], 2);
+    double z = CieColorMatchingFunctionTableValue(wavelengths[k], 3);
+    for (int c = 0; c < 3; ++c) {
+      interpolation[c * kReferenceNumWavelengths + k] =
+          Interpolate(wavelengths, sample, lambdas[c]);
+      luminance_from_radiance[c * kReferenceNumWavelengths + k] = (
+          XYZ_TO_SRGB[c * 3] * x +
+          XYZ_TO_SRGB[c * 3 + 1] * y +
+          XYZ_TO_SRGB[c * 3 + 2] * z) * dlambda;
+    }
+  }
+  const SpectrumConversion& conversion = num_precomputed_wavelengths_ <= 3 ?
+      interpolation : luminance_from_radiance;
+
+  const size_t num_scattering_texels = static_cast<size_t>(
+      SCATTERING_TEXTURE_WIDTH) * SCATTERING_TEXTURE_HEIGHT *
+      SCATTERING_TEXTURE_DEPTH;
+  std::vector<float> transmittance;
+  std::vector<float> scattering;
+  std::vector<float> single_mie_scattering;
+  std::vector<float> irradiance;
+  if (!ReadReferenceTexture(cache_directory + "transmittance.dat",
+          TRANSMITTANCE_TEXTURE_WIDTH * TRANSMITTANCE_TEXTURE_HEIGHT,
+          interpolation, 3, &transmittance) ||
+      !ReadReferenceTexture(cache_directory + "scattering.dat",
+          num_scattering_texels, conversion,
+          combine_scattering_textures_ ? 4 : 3, &scattering) ||
+      !ReadReferenceTexture(cache_directory + "single_mie_scattering.dat",
+          num_scattering_texels, conversion, 3, &single_mie_scattering) ||
+      !ReadReferenceTexture(cache_directory + "irradiance.dat",
+          IRRADIANCE_TEXTURE_WIDTH * IRRADIANCE_TEXTURE_HEIGHT,
+          conversion, 3, &irradiance)) {
+    return false;
+  }
+  if (combine_scattering_textures_) {
+    for (size_t i = 0; i < num_scattering_texels; ++i) {
+      scattering[4 * i + 3] = single_mie_scattering[3 * i];
+    }
+  }
+
+  UploadTextures(transmittance.data(), scattering.data(),
+      combine_scattering_textures_ ? nullptr : single_mie_scattering.data(),
+      irradiance.data(), GL_FLOAT);
+  num_scattering_orders_ = num_scattering_orders;
+  return true;
 }
 
 /*
@@ -965,6 +2582,80 @@ void Model::SetProgramUniforms(
   }
 }
 
+/*
+<p>The volume is computed by rendering one quad per layer, with the same GLSL
+header as the shader exposed by our API (the volume is always computed with
+fragment shaders, since it is small enough to be recomputed at each frame):
+*/
+
+void Model::UpdateAerialPerspective(const std::array<double, 3>& camera,
+    const std::array<double, 3>& sun_direction,
+    const std::array<double, 9>& view_ray_from_clip, double max_distance) {
+  GlStateSaver gl_state_saver;
+  if (!aerial_perspective_volume_) {
+    aerial_perspective_volume_.reset(new AerialPerspectiveVolume(
+        glsl_header_factory_({kLambdaR, kLambdaG, kLambdaB}) +
+            fast_functions_glsl,
+        half_precision_));
+  }
+  AerialPerspectiveVolume& volume = *aerial_perspective_volume_;
+  glBindFramebuffer(GL_FRAMEBUFFER, volume.fbo);
+  SetColorAttachments({volume.scattering_texture,
+      volume.transmittance_texture});
+  glViewport(0, 0, AERIAL_PERSPECTIVE_TEXTURE_WIDTH,
+      AERIAL_PERSPECTIVE_TEXTURE_HEIGHT);
+
+  std::array<float, 9> view_ray_from_clip_float;
+  std::copy(view_ray_from_clip.begin(), view_ray_from_clip.end(),
+      view_ray_from_clip_float.begin());
+  const Program& program = volume.program;
+  program.Use();
+  program.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
+  program.BindTexture3d("scattering_texture", scattering_texture_, 1);
+  if (optional_single_mie_scattering_texture_ != 0) {
+    program.BindTexture3d("single_mie_scattering_texture",
+        optional_single_mie_scattering_texture_, 2);
+  }
+  program.BindVec3("camera", camera);
+  program.BindVec3("sun_direction", sun_direction);
+  program.BindMat3("view_ray_from_clip", view_ray_from_clip_float);
+  program.BindFloat("max_distance", max_distance);
+  for (int layer = 0; layer < AERIAL_PERSPECTIVE_TEXTURE_DEPTH; ++layer) {
+    program.BindInt("layer", layer);
+    DrawQuad({});
+  }
+  volume.clip_from_view_ray = Invert(view_ray_from_clip);
+  volume.max_distance = max_distance;
+}
+
+void Model::SetAerialPerspectiveUniforms(
+    unsigned int program,
+    unsigned int aerial_perspective_scattering_texture_unit,
+    unsigned int aerial_perspective_transmittance_texture_unit) const {
+  assert(aerial_perspective_volume_);
+  const AerialPerspectiveVolume& volume = *aerial_perspective_volume_;
+  glActiveTexture(GL_TEXTURE0 + aerial_perspective_scattering_texture_unit);
+  glBindTexture(GL_TEXTURE_3D, volume.scattering_texture);
+  glUniform1i(
+      glGetUniformLocation(program, "aerial_perspective_scattering_texture"),
+      aerial_perspective_scattering_texture_unit);
+
+  glActiveTexture(GL_TEXTURE0 + aerial_perspective_transmittance_texture_unit);
+  glBindTexture(GL_TEXTURE_3D, volume.transmittance_texture);
+  glUniform1i(
+      glGetUniformLocation(program, "aerial_perspective_transmittance_texture"),
+      aerial_perspective_transmittance_texture_unit);
+
+  std::array<float, 9> clip_from_view_ray;
+  std::copy(volume.clip_from_view_ray.begin(), volume.clip_from_view_ray.end(),
+      clip_from_view_ray.begin());
+  glUniformMatrix3fv(
+      glGetUniformLocation(program, "aerial_perspective_clip_from_view_ray"),
+      1, true /* transpose */, clip_from_view_ray.data());
+  glUniform1f(glGetUniformLocation(program, "aerial_perspective_max_distance"),
+      volume.max_distance);
+}
+
 /*
 <p>The utility method <code>ConvertSpectrumToLinearSrgb</code> is implemented
 with a simple numerical integration of the given function, times the CIE color
@@ -1001,91 +2692,72 @@ described in Algorithm 4.1 of
 explained by the inline comments below.
 */
 void Model::Precompute(
-    unsigned int fbo,
-    unsigned int delta_irradiance_texture,
-    unsigned int delta_rayleigh_scattering_texture,
-    unsigned int delta_mie_scattering_texture,
-    unsigned int delta_scattering_density_texture,
-    unsigned int delta_multiple_scattering_texture,
+    Precomputation* precomputation,
     const vec3& lambdas,
     const mat3& luminance_from_radiance,
     bool blend,
     unsigned int num_scattering_orders) {
-  // The precomputations require specific GLSL programs, for each precomputation
-  // step. We create and compile them here (they are automatically destroyed
-  // when this method returns, via the Program destructor).
-  std::string header = glsl_header_factory_(lambdas);
-  Program compute_transmittance(
-      kVertexShader, header + kComputeTransmittanceShader);
-  Program compute_direct_irradiance(
-      kVertexShader, header + kComputeDirectIrradianceShader);
-  Program compute_single_scattering(kVertexShader, kGeometryShader,
-      header + kComputeSingleScatteringShader);
-  Program compute_scattering_density(kVertexShader, kGeometryShader,
-      header + kComputeScatteringDensityShader);
-  Program compute_indirect_irradiance(
-      kVertexShader, header + kComputeIndirectIrradianceShader);
-  Program compute_multiple_scattering(kVertexShader, kGeometryShader,
-      header + kComputeMultipleScatteringShader);
-
-  const GLuint kDrawBuffers[4] = {
-    GL_COLOR_ATTACHMENT0,
-    GL_COLOR_ATTACHMENT1,
-    GL_COLOR_ATTACHMENT2,
-    GL_COLOR_ATTACHMENT3
-  };
-  glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
-  glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
-
-  // Compute the transmittance, and store it in transmittance_texture_.
-  glFramebufferTexture(
-      GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, transmittance_texture_, 0);
-  glDrawBuffer(GL_COLOR_ATTACHMENT0);
-  glViewport(0, 0, TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
-  compute_transmittance.Use();
-  DrawQuad({});
+  Precomputation* p = precomputation;
+
+  // Set the wavelength dependent atmosphere parameters in the precomputation
+  // programs (see BeginPrecomputation).
+  const std::vector<vec3> spectrum_values = spectrum_values_factory_(lambdas);
+  p->steps.emplace_back("bind_spectrum_uniforms", 0, -1,
+      [p, spectrum_values]() {
+    p->BindSpectrumUniforms(spectrum_values);
+  });
+  if (use_compute_shaders_) {
+    PrecomputeWithComputeShaders(p, luminance_from_radiance, blend,
+        num_scattering_orders);
+    return;
+  }
+
+  // Compute the transmittance, and store it in transmittance_texture.
+  p->steps.emplace_back("transmittance", 0, -1, [p]() {
+    SetColorAttachments({p->transmittance_texture});
+    glViewport(
+        0, 0, TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
+    p->compute_transmittance->Use();
+    DrawQuad({});
+  });
 
   // Compute the direct irradiance, store it in delta_irradiance_texture and,
-  // depending on 'blend', either initialize irradiance_texture_ with zeros or
+  // depending on 'blend', either initialize irradiance_texture with zeros or
   // leave it unchanged (we don't want the direct irradiance in
-  // irradiance_texture_, but only the irradiance from the sky).
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-      delta_irradiance_texture, 0);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
-      irradiance_texture_, 0);
-  glDrawBuffers(2, kDrawBuffers);
-  glViewport(0, 0, IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
-  compute_direct_irradiance.Use();
-  compute_direct_irradiance.BindTexture2d(
-      "transmittance_texture", transmittance_texture_, 0);
-  DrawQuad({false, blend});
+  // irradiance_texture, but only the irradiance from the sky).
+  p->steps.emplace_back("direct_irradiance", 0, -1, [p, blend]() {
+    SetColorAttachments({p->delta_irradiance_texture, p->irradiance_texture});
+    glViewport(0, 0, IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
+    p->compute_direct_irradiance->Use();
+    p->compute_direct_irradiance->BindTexture2d(
+        "transmittance_texture", p->transmittance_texture, 0);
+    DrawQuad({false, blend});
+  });
 
   // Compute the rayleigh and mie single scattering, store them in
   // delta_rayleigh_scattering_texture and delta_mie_scattering_texture, and
-  // either store them or accumulate them in scattering_texture_ and
-  // optional_single_mie_scattering_texture_.
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-      delta_rayleigh_scattering_texture, 0);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
-      delta_mie_scattering_texture, 0);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2,
-      scattering_texture_, 0);
-  if (optional_single_mie_scattering_texture_ != 0) {
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3,
-        optional_single_mie_scattering_texture_, 0);
-    glDrawBuffers(4, kDrawBuffers);
-  } else {
-    glDrawBuffers(3, kDrawBuffers);
-  }
-  glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
-  compute_single_scattering.Use();
-  compute_single_scattering.BindMat3(
-      "luminance_from_radiance", luminance_from_radiance);
-  compute_single_scattering.BindTexture2d(
-      "transmittance_texture", transmittance_texture_, 0);
+  // either store them or accumulate them in scattering_texture and
+  // optional_single_mie_scattering_texture (one step per layer).
   for (unsigned int layer = 0; layer < SCATTERING_TEXTURE_DEPTH; ++layer) {
-    compute_single_scattering.BindInt("layer", layer);
-    DrawQuad({false, false, blend, blend});
+    p->steps.emplace_back("single_scattering", 1, layer,
+        [p, luminance_from_radiance, blend, layer]() {
+      if (p->optional_single_mie_scattering_texture != 0) {
+        SetColorAttachments({p->delta_rayleigh_scattering_texture,
+            p->delta_mie_scattering_texture, p->scattering_texture,
+            p->optional_single_mie_scattering_texture});
+      } else {
+        SetColorAttachments({p->delta_rayleigh_scattering_texture,
+            p->delta_mie_scattering_texture, p->scattering_texture});
+      }
+      glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
+      p->compute_single_scattering->Use();
+      p->compute_single_scattering->BindMat3(
+          "luminance_from_radiance", luminance_from_radiance);
+      p->compute_single_scattering->BindTexture2d(
+          "transmittance_texture", p->transmittance_texture, 0);
+      p->compute_single_scattering->BindInt("layer", layer);
+      DrawQuad({false, false, blend, blend});
+    });
   }
 
   // Compute the 2nd, 3rd and 4th order of scattering, in sequence.
@@ -1093,80 +2765,491 @@ void Model::Precompute(
        scattering_order <= num_scattering_orders;
        ++scattering_order) {
     // Compute the scattering density, and store it in
-    // delta_scattering_density_texture.
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-        delta_scattering_density_texture, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, 0, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, 0, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, 0, 0);
-    glDrawBuffer(GL_COLOR_ATTACHMENT0);
-    glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
-    compute_scattering_density.Use();
-    compute_scattering_density.BindTexture2d(
-        "transmittance_texture", transmittance_texture_, 0);
-    compute_scattering_density.BindTexture3d(
-        "single_rayleigh_scattering_texture",
-        delta_rayleigh_scattering_texture,
-        1);
-    compute_scattering_density.BindTexture3d(
-        "single_mie_scattering_texture", delta_mie_scattering_texture, 2);
-    compute_scattering_density.BindTexture3d(
-        "multiple_scattering_texture", delta_multiple_scattering_texture, 3);
-    compute_scattering_density.BindTexture2d(
-        "irradiance_texture", delta_irradiance_texture, 4);
-    compute_scattering_density.BindInt("scattering_order", scattering_order);
+    // delta_scattering_density_texture (one step per layer).
     for (unsigned int layer = 0; layer < SCATTERING_TEXTURE_DEPTH; ++layer) {
-      compute_scattering_density.BindInt("layer", layer);
-      DrawQuad({});
+      p->steps.emplace_back("scattering_density", scattering_order, layer,
+          [p, scattering_order, layer]() {
+        SetColorAttachments({p->delta_scattering_density_texture});
+        glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
+        const Program& program = *p->compute_scattering_density;
+        program.Use();
+        program.BindTexture2d(
+            "transmittance_texture", p->transmittance_texture, 0);
+        program.BindTexture3d("single_rayleigh_scattering_texture",
+            p->delta_rayleigh_scattering_texture, 1);
+        program.BindTexture3d("single_mie_scattering_texture",
+            p->delta_mie_scattering_texture, 2);
+        program.BindTexture3d("multiple_scattering_texture",
+            p->delta_multiple_scattering_texture, 3);
+        program.BindTexture2d(
+            "irradiance_texture", p->delta_irradiance_texture, 4);
+        program.BindInt("scattering_order", scattering_order);
+        program.BindInt("layer", layer);
+        DrawQuad({});
+      });
     }
 
     // Compute the indirect irradiance, store it in delta_irradiance_texture and
-    // accumulate it in irradiance_texture_.
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-        delta_irradiance_texture, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
-        irradiance_texture_, 0);
-    glDrawBuffers(2, kDrawBuffers);
-    glViewport(0, 0, IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
-    compute_indirect_irradiance.Use();
-    compute_indirect_irradiance.BindMat3(
-        "luminance_from_radiance", luminance_from_radiance);
-    compute_indirect_irradiance.BindTexture3d(
-        "single_rayleigh_scattering_texture",
-        delta_rayleigh_scattering_texture,
-        0);
-    compute_indirect_irradiance.BindTexture3d(
-        "single_mie_scattering_texture", delta_mie_scattering_texture, 1);
-    compute_indirect_irradiance.BindTexture3d(
-        "multiple_scattering_texture", delta_multiple_scattering_texture, 2);
-    compute_indirect_irradiance.BindInt("scattering_order",
-        scattering_order - 1);
-    DrawQuad({false, true});
+    // accumulate it in irradiance_texture.
+    p->steps.emplace_back("indirect_irradiance", scattering_order, -1,
+        [p, luminance_from_radiance, scattering_order]() {
+      SetColorAttachments({p->delta_irradiance_texture, p->irradiance_texture});
+      glViewport(0, 0, IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT);
+      const Program& program = *p->compute_indirect_irradiance;
+      program.Use();
+      program.BindMat3("luminance_from_radiance", luminance_from_radiance);
+      program.BindTexture3d("single_rayleigh_scattering_texture",
+          p->delta_rayleigh_scattering_texture, 0);
+      program.BindTexture3d("single_mie_scattering_texture",
+          p->delta_mie_scattering_texture, 1);
+      program.BindTexture3d("multiple_scattering_texture",
+          p->delta_multiple_scattering_texture, 2);
+      program.BindInt("scattering_order", scattering_order - 1);
+      DrawQuad({false, true});
+    });
 
     // Compute the multiple scattering, store it in
     // delta_multiple_scattering_texture, and accumulate it in
-    // scattering_texture_.
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-        delta_multiple_scattering_texture, 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
-        scattering_texture_, 0);
-    glDrawBuffers(2, kDrawBuffers);
-    glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
-    compute_multiple_scattering.Use();
-    compute_multiple_scattering.BindMat3(
-        "luminance_from_radiance", luminance_from_radiance);
-    compute_multiple_scattering.BindTexture2d(
-        "transmittance_texture", transmittance_texture_, 0);
-    compute_multiple_scattering.BindTexture3d(
-        "scattering_density_texture", delta_scattering_density_texture, 1);
+    // scattering_texture (one step per layer).
     for (unsigned int layer = 0; layer < SCATTERING_TEXTURE_DEPTH; ++layer) {
-      compute_multiple_scattering.BindInt("layer", layer);
-      DrawQuad({false, true});
+      p->steps.emplace_back("multiple_scattering", scattering_order, layer,
+          [p, luminance_from_radiance, layer]() {
+        SetColorAttachments(
+            {p->delta_multiple_scattering_texture, p->scattering_texture});
+        glViewport(0, 0, SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT);
+        const Program& program = *p->compute_multiple_scattering;
+        program.Use();
+        program.BindMat3("luminance_from_radiance", luminance_from_radiance);
+        program.BindTexture2d(
+            "transmittance_texture", p->transmittance_texture, 0);
+        program.BindTexture3d("scattering_density_texture",
+            p->delta_scattering_density_texture, 1);
+        program.BindInt("layer", layer);
+        DrawQuad({false, true});
+      });
     }
   }
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, 0, 0);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, 0, 0);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, 0, 0);
+}
+
+/*
+<p>The same algorithm is implemented with compute shaders as follows, with one
+precomputation step per dispatch (see the compute shaders above for the fused
+passes):
+*/
+
+void Model::PrecomputeWithComputeShaders(
+    Precomputation* precomputation,
+    const mat3& luminance_from_radiance,
+    bool blend,
+    unsigned int num_scattering_orders) {
+  Precomputation* p = precomputation;
+  const GLenum scattering_format = half_precision_ ? GL_RGBA16F : GL_RGBA32F;
+
+  // Compute the transmittance, and store it in transmittance_texture.
+  p->steps.emplace_back("transmittance", 0, -1, [p]() {
+    const Program& program = *p->compute_transmittance;
+    program.Use();
+    program.BindImage(
+        "transmittance_image", p->transmittance_texture, GL_RGBA32F, 0);
+    DispatchCompute(
+        TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT, 1);
+  });
+
+  // Compute the rayleigh and mie single scattering, store them in
+  // delta_rayleigh_scattering_texture and delta_mie_scattering_texture, and
+  // either store them or accumulate them in scattering_texture and
+  // optional_single_mie_scattering_texture. Compute also the direct
+  // irradiance, store it in delta_irradiance_texture and, depending on
+  // 'blend', either initialize irradiance_texture with zeros or leave it
+  // unchanged.
+  p->steps.emplace_back("single_scattering", 1, -1,
+      [p, luminance_from_radiance, blend, scattering_format]() {
+    const Program& program = *p->compute_single_scattering;
+    program.Use();
+    program.BindMat3("luminance_from_radiance", luminance_from_radiance);
+    program.BindTexture2d(
+        "transmittance_texture", p->transmittance_texture, 0);
+    program.BindInt("blend", blend);
+    program.BindImage("delta_rayleigh_image",
+        p->delta_rayleigh_scattering_texture, scattering_format, 0);
+    program.BindImage("delta_mie_image",
+        p->delta_mie_scattering_texture, scattering_format, 1);
+    program.BindImage(
+        "scattering_image", p->scattering_texture, scattering_format, 2);
+    if (p->optional_single_mie_scattering_texture != 0) {
+      program.BindImage("single_mie_scattering_image",
+          p->optional_single_mie_scattering_texture, scattering_format, 3);
+    }
+    program.BindImage("delta_irradiance_image",
+        p->delta_irradiance_texture, GL_RGBA32F, 4);
+    program.BindImage(
+        "irradiance_image", p->irradiance_texture, GL_RGBA32F, 5);
+    DispatchCompute(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT,
+        SCATTERING_TEXTURE_DEPTH);
+  });
+
+  // Compute the 2nd, 3rd and 4th order of scattering, in sequence.
+  GLuint delta_irradiance_texture = p->delta_irradiance_texture;
+  GLuint next_delta_irradiance_texture = p->next_delta_irradiance_texture;
+  for (unsigned int scattering_order = 2;
+       scattering_order <= num_scattering_orders;
+       ++scattering_order) {
+    // Compute the scattering density, and store it in
+    // delta_scattering_density_texture. Compute also the indirect irradiance
+    // for the previous order, store it in next_delta_irradiance_texture, and
+    // accumulate it in irradiance_texture.
+    p->steps.emplace_back("scattering_density", scattering_order, -1,
+        [p, luminance_from_radiance, scattering_order, scattering_format,
+            delta_irradiance_texture, next_delta_irradiance_texture]() {
+      const Program& program = *p->compute_scattering_density;
+      program.Use();
+      program.BindMat3("luminance_from_radiance", luminance_from_radiance);
+      program.BindTexture2d(
+          "transmittance_texture", p->transmittance_texture, 0);
+      program.BindTexture3d("single_rayleigh_scattering_texture",
+          p->delta_rayleigh_scattering_texture, 1);
+      program.BindTexture3d("single_mie_scattering_texture",
+          p->delta_mie_scattering_texture, 2);
+      program.BindTexture3d("multiple_scattering_texture",
+          p->delta_multiple_scattering_texture, 3);
+      program.BindTexture2d(
+          "irradiance_texture", delta_irradiance_texture, 4);
+      program.BindInt("scattering_order", scattering_order);
+      program.BindImage("scattering_density_image",
+          p->delta_scattering_density_texture, scattering_format, 0);
+      program.BindImage("delta_irradiance_image",
+          next_delta_irradiance_texture, GL_RGBA32F, 1);
+      program.BindImage(
+          "irradiance_image", p->irradiance_texture, GL_RGBA32F, 2);
+      DispatchCompute(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT,
+          SCATTERING_TEXTURE_DEPTH);
+    });
+    std::swap(delta_irradiance_texture, next_delta_irradiance_texture);
+
+    // Compute the multiple scattering, store it in
+    // delta_multiple_scattering_texture, and accumulate it in
+    // scattering_texture.
+    p->steps.emplace_back("multiple_scattering", scattering_order, -1,
+        [p, luminance_from_radiance, scattering_format]() {
+      const Program& program = *p->compute_multiple_scattering;
+      program.Use();
+      program.BindMat3("luminance_from_radiance", luminance_from_radiance);
+      program.BindTexture2d(
+          "transmittance_texture", p->transmittance_texture, 0);
+      program.BindTexture3d("scattering_density_texture",
+          p->delta_scattering_density_texture, 1);
+      program.BindImage("delta_multiple_scattering_image",
+          p->delta_multiple_scattering_texture, scattering_format, 0);
+      program.BindImage(
+          "scattering_image", p->scattering_texture, scattering_format, 1);
+      DispatchCompute(SCATTERING_TEXTURE_WIDTH, SCATTERING_TEXTURE_HEIGHT,
+          SCATTERING_TEXTURE_DEPTH);
+    });
+  }
+}
+
+/*<h3 id="fast_model_implementation">FastModel implementation</h3>
+
+<p>The <code>FastModel</code> programs are compiled once in the constructor, and
+stored in the following class:
+*/
+
+class FastModel::Programs {
+ public:
+  explicit Programs(const std::string& glsl_header)
+      : compute_transmittance(kVertexShader,
+            glsl_header + kComputeTransmittanceShader),
+        compute_multi_scattering(kVertexShader,
+            glsl_header + kComputeMultiScatteringShader),
+        compute_sky_view(kVertexShader, glsl_header + kComputeSkyViewShader),
+        compute_aerial_perspective(kVertexShader, kGeometryShader,
+            glsl_header + kComputeAerialPerspectiveShader) {
+  }
+
+  Program compute_transmittance;
+  Program compute_multi_scattering;
+  Program compute_sky_view;
+  Program compute_aerial_perspective;
+};
+
+/*
+<p>The constructor creates a GLSL header where <code>ATMOSPHERE</code> is a
+uniform struct (as well as the luminance conversion factors), used both by the
+above programs and by the shader exposed by the API. It also allocates the
+textures, which are computed in <code>Update</code>:
+*/
+
+FastModel::FastModel(const Parameters& parameters,
+    double length_unit_in_meters, bool half_precision)
+    : length_unit_in_meters_(length_unit_in_meters),
+      parameters_changed_(true),
+      clip_from_view_ray_{{1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0}},
+      aerial_perspective_max_distance_(1.0) {
+  const std::string glsl_header = "#version 330\n" + GetGlslPreamble() +
+      definitions_glsl +
+      "uniform AtmosphereParameters atmosphere_parameters;\n"
+      "#define ATMOSPHERE atmosphere_parameters\n"
+      "uniform vec3 SKY_SPECTRAL_RADIANCE_TO_LUMINANCE;\n"
+      "uniform vec3 SUN_SPECTRAL_RADIANCE_TO_LUMINANCE;\n" +
+      functions_glsl + fast_functions_glsl;
+  programs_.reset(new Programs(glsl_header));
+
+  std::string shader = glsl_header + kFastAtmosphereShader;
+  const char* source = shader.c_str();
+  atmosphere_shader_ = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(atmosphere_shader_, 1, &source, NULL);
+  glCompileShader(atmosphere_shader_);
+
+  transmittance_texture_ = NewTexture2d(
+      TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT, GL_RGB);
+  multi_scattering_texture_ = NewTexture2d(MULTI_SCATTERING_TEXTURE_WIDTH,
+      MULTI_SCATTERING_TEXTURE_HEIGHT, GL_RGB);
+  sky_view_texture_ = NewTexture2d(
+      SKY_VIEW_TEXTURE_WIDTH, SKY_VIEW_TEXTURE_HEIGHT, GL_RGB);
+  aerial_perspective_scattering_texture_ = NewTexture3d(
+      AERIAL_PERSPECTIVE_TEXTURE_WIDTH, AERIAL_PERSPECTIVE_TEXTURE_HEIGHT,
+      AERIAL_PERSPECTIVE_TEXTURE_DEPTH, GL_RGB, half_precision);
+  aerial_perspective_transmittance_texture_ = NewTexture3d(
+      AERIAL_PERSPECTIVE_TEXTURE_WIDTH, AERIAL_PERSPECTIVE_TEXTURE_HEIGHT,
+      AERIAL_PERSPECTIVE_TEXTURE_DEPTH, GL_RGB, half_precision);
+  glGenFramebuffers(1, &fbo_);
+
+  SetParameters(parameters);
+}
+
+FastModel::~FastModel() {
+  glDeleteFramebuffers(1, &fbo_);
+  glDeleteTextures(1, &transmittance_texture_);
+  glDeleteTextures(1, &multi_scattering_texture_);
+  glDeleteTextures(1, &sky_view_texture_);
+  glDeleteTextures(1, &aerial_perspective_scattering_texture_);
+  glDeleteTextures(1, &aerial_perspective_transmittance_texture_);
+  glDeleteShader(atmosphere_shader_);
+}
+
+/*
+<p>The atmosphere parameters are converted to the values of the uniforms of the
+<code>atmosphere_parameters</code> struct, with the same conversions as in the
+<code>Model</code> constructor (in particular the spectra are sampled at the 3
+wavelengths <code>kLambdaR</code>, <code>kLambdaG</code> and
+<code>kLambdaB</code>). These uniform values are then set in each program with
+<code>BindAtmosphereUniforms</code>:
+*/
+
+void FastModel::SetParameters(const Parameters& parameters) {
+  const double length_unit = length_unit_in_meters_;
+  auto spectrum = [&parameters](const std::vector<double>& v, double scale) {
+    vec3 result;
+    const double lambdas[3] = {Model::kLambdaR, Model::kLambdaG,
+        Model::kLambdaB};
+    for (int i = 0; i < 3; ++i) {
+      result[i] = Interpolate(parameters.wavelengths, v, lambdas[i]) * scale;
+    }
+    return result;
+  };
+  const std::string kPrefix = "atmosphere_parameters.";
+  vec3_uniforms_ = {
+    {kPrefix + "solar_irradiance", spectrum(parameters.solar_irradiance, 1.0)},
+    {kPrefix + "rayleigh_scattering",
+        spectrum(parameters.rayleigh_scattering, length_unit)},
+    {kPrefix + "mie_scattering",
+        spectrum(parameters.mie_scattering, length_unit)},
+    {kPrefix + "mie_extinction",
+        spectrum(parameters.mie_extinction, length_unit)},
+    {kPrefix + "absorption_extinction",
+        spectrum(parameters.absorption_extinction, length_unit)},
+    {kPrefix + "ground_albedo", spectrum(parameters.ground_albedo, 1.0)}
+  };
+  float_uniforms_ = {
+    {kPrefix + "sun_angular_radius", parameters.sun_angular_radius},
+    {kPrefix + "bottom_radius", parameters.bottom_radius / length_unit},
+    {kPrefix + "top_radius", parameters.top_radius / length_unit},
+    {kPrefix + "mie_phase_function_g", parameters.mie_phase_function_g},
+    // Not used in this mode.
+    {kPrefix + "mu_s_min", -1.0}
+  };
+  auto density_profile = [&](const std::string& name,
+      std::vector<DensityProfileLayer> layers) {
+    constexpr int kLayerCount = 2;
+    while (layers.size() < kLayerCount) {
+      layers.insert(layers.begin(), DensityProfileLayer());
+    }
+    for (int i = 0; i < kLayerCount; ++i) {
+      const std::string layer =
+          kPrefix + name + ".layers[" + std::to_string(i) + "].";
+      float_uniforms_.push_back({layer + "width",
+          layers[i].width / length_unit});
+      float_uniforms_.push_back({layer + "exp_term", layers[i].exp_term});
+      float_uniforms_.push_back({layer + "exp_scale",
+          layers[i].exp_scale * length_unit});
+      float_uniforms_.push_back({layer + "linear_term",
+          layers[i].linear_term * length_unit});
+      float_uniforms_.push_back({layer + "constant_term",
+          layers[i].constant_term});
+    }
+  };
+  density_profile("rayleigh_density", parameters.rayleigh_density);
+  density_profile("mie_density", parameters.mie_density);
+  density_profile("absorption_density", parameters.absorption_density);
+
+  vec3 sky_k;
+  vec3 sun_k;
+  ComputeSpectralRadianceToLuminanceFactors(parameters.wavelengths,
+      parameters.solar_irradiance, -3 /* lambda_power */,
+      &sky_k[0], &sky_k[1], &sky_k[2]);
+  ComputeSpectralRadianceToLuminanceFactors(parameters.wavelengths,
+      parameters.solar_irradiance, 0 /* lambda_power */,
+      &sun_k[0], &sun_k[1], &sun_k[2]);
+  vec3_uniforms_.push_back({"SKY_SPECTRAL_RADIANCE_TO_LUMINANCE", sky_k});
+  vec3_uniforms_.push_back({"SUN_SPECTRAL_RADIANCE_TO_LUMINANCE", sun_k});
+
+  bottom_radius_ = parameters.bottom_radius / length_unit;
+  top_radius_ = parameters.top_radius / length_unit;
+  parameters_changed_ = true;
+}
+
+void FastModel::BindAtmosphereUniforms(unsigned int program) const {
+  for (const auto& uniform : vec3_uniforms_) {
+    glUniform3f(glGetUniformLocation(program, uniform.first.c_str()),
+        uniform.second[0], uniform.second[1], uniform.second[2]);
+  }
+  for (const auto& uniform : float_uniforms_) {
+    glUniform1f(glGetUniformLocation(program, uniform.first.c_str()),
+        uniform.second);
+  }
+}
+
+/*
+<p>The <code>Update</code> method recomputes the textures by rendering quads,
+as in the <code>Model</code> precomputations. The transmittance and multiple
+scattering textures only depend on the atmosphere parameters, while the sky view
+texture depends on the viewer altitude and on the Sun zenith angle, and the
+aerial perspective textures on the viewer position, the Sun direction and the
+projection. Finally, the projection from view rays to clip space coordinates is
+computed for <code>SetProgramUniforms</code> (the aerial perspective texture
+coordinates are computed with this projection):
+*/
+
+void FastModel::Update(const vec3& camera, const vec3& sun_direction,
+    const mat3& view_ray_from_clip, double aerial_perspective_max_distance) {
+  GlStateSaver gl_state_saver;
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+
+  if (parameters_changed_) {
+    for (const Program* program : {&programs_->compute_transmittance,
+        &programs_->compute_multi_scattering, &programs_->compute_sky_view,
+        &programs_->compute_aerial_perspective}) {
+      program->Use();
+      BindAtmosphereUniforms(program->id());
+    }
+
+    SetColorAttachments({transmittance_texture_});
+    glViewport(
+        0, 0, TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT);
+    programs_->compute_transmittance.Use();
+    DrawQuad({});
+
+    SetColorAttachments({multi_scattering_texture_});
+    glViewport(
+        0, 0, MULTI_SCATTERING_TEXTURE_WIDTH, MULTI_SCATTERING_TEXTURE_HEIGHT);
+    programs_->compute_multi_scattering.Use();
+    programs_->compute_multi_scattering.BindTexture2d(
+        "transmittance_texture", transmittance_texture_, 0);
+    DrawQuad({});
+    parameters_changed_ = false;
+  }
+
+  double camera_radius = std::sqrt(camera[0] * camera[0] +
+      camera[1] * camera[1] + camera[2] * camera[2]);
+  double r = std::max(bottom_radius_, std::min(top_radius_, camera_radius));
+  double mu_s = camera_radius == 0.0 ? 1.0 : std::max(-1.0, std::min(1.0,
+      (camera[0] * sun_direction[0] + camera[1] * sun_direction[1] +
+       camera[2] * sun_direction[2]) / camera_radius));
+  const Program& sky_view = programs_->compute_sky_view;
+  SetColorAttachments({sky_view_texture_});
+  glViewport(0, 0, SKY_VIEW_TEXTURE_WIDTH, SKY_VIEW_TEXTURE_HEIGHT);
+  sky_view.Use();
+  sky_view.BindTexture2d("transmittance_texture", transmittance_texture_, 0);
+  sky_view.BindTexture2d(
+      "multi_scattering_texture", multi_scattering_texture_, 1);
+  sky_view.BindFloat("r", r);
+  sky_view.BindFloat("mu_s", mu_s);
+  DrawQuad({});
+
+  std::array<float, 9> view_ray_from_clip_float;
+  std::copy(view_ray_from_clip.begin(), view_ray_from_clip.end(),
+      view_ray_from_clip_float.begin());
+  const Program& aerial_perspective = programs_->compute_aerial_perspective;
+  SetColorAttachments({aerial_perspective_scattering_texture_,
+      aerial_perspective_transmittance_texture_});
+  glViewport(0, 0, AERIAL_PERSPECTIVE_TEXTURE_WIDTH,
+      AERIAL_PERSPECTIVE_TEXTURE_HEIGHT);
+  aerial_perspective.Use();
+  aerial_perspective.BindTexture2d(
+      "transmittance_texture", transmittance_texture_, 0);
+  aerial_perspective.BindTexture2d(
+      "multi_scattering_texture", multi_scattering_texture_, 1);
+  aerial_perspective.BindVec3("camera", camera);
+  aerial_perspective.BindVec3("sun_direction", sun_direction);
+  aerial_perspective.BindMat3("view_ray_from_clip", view_ray_from_clip_float);
+  aerial_perspective.BindFloat("max_distance", aerial_perspective_max_distance);
+  for (int layer = 0; layer < AERIAL_PERSPECTIVE_TEXTURE_DEPTH; ++layer) {
+    aerial_perspective.BindInt("layer", layer);
+    DrawQuad({});
+  }
+
+  clip_from_view_ray_ = Invert(view_ray_from_clip);
+  aerial_perspective_max_distance_ = aerial_perspective_max_distance;
+}
+
+/*
+<p>Finally, <code>SetProgramUniforms</code> binds the textures and sets the
+uniforms needed by the shader exposed by the API:
+*/
+
+void FastModel::SetProgramUniforms(
+    unsigned int program,
+    unsigned int transmittance_texture_unit,
+    unsigned int multi_scattering_texture_unit,
+    unsigned int sky_view_texture_unit,
+    unsigned int aerial_perspective_scattering_texture_unit,
+    unsigned int aerial_perspective_transmittance_texture_unit) const {
+  glActiveTexture(GL_TEXTURE0 + transmittance_texture_unit);
+  glBindTexture(GL_TEXTURE_2D, transmittance_texture_);
+  glUniform1i(glGetUniformLocation(program, "transmittance_texture"),
+      transmittance_texture_unit);
+
+  glActiveTexture(GL_TEXTURE0 + multi_scattering_texture_unit);
+  glBindTexture(GL_TEXTURE_2D, multi_scattering_texture_);
+  glUniform1i(glGetUniformLocation(program, "multi_scattering_texture"),
+      multi_scattering_texture_unit);
+
+  glActiveTexture(GL_TEXTURE0 + sky_view_texture_unit);
+  glBindTexture(GL_TEXTURE_2D, sky_view_texture_);
+  glUniform1i(glGetUniformLocation(program, "sky_view_texture"),
+      sky_view_texture_unit);
+
+  glActiveTexture(GL_TEXTURE0 + aerial_perspective_scattering_texture_unit);
+  glBindTexture(GL_TEXTURE_3D, aerial_perspective_scattering_texture_);
+  glUniform1i(
+      glGetUniformLocation(program, "aerial_perspective_scattering_texture"),
+      aerial_perspective_scattering_texture_unit);
+
+  glActiveTexture(GL_TEXTURE0 + aerial_perspective_transmittance_texture_unit);
+  glBindTexture(GL_TEXTURE_3D, aerial_perspective_transmittance_texture_);
+  glUniform1i(
+      glGetUniformLocation(program, "aerial_perspective_transmittance_texture"),
+      aerial_perspective_transmittance_texture_unit);
+
+  BindAtmosphereUniforms(program);
+  std::array<float, 9> clip_from_view_ray;
+  std::copy(clip_from_view_ray_.begin(), clip_from_view_ray_.end(),
+      clip_from_view_ray.begin());
+  glUniformMatrix3fv(
+      glGetUniformLocation(program, "aerial_perspective_clip_from_view_ray"),
+      1, true /* transpose */, clip_from_view_ray.data());
+  glUniform1f(glGetUniformLocation(program, "aerial_perspective_max_distance"),
+      aerial_perspective_max_distance_);
 }
 
 }  // namespace atmosphere
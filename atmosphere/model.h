@@ -34,7 +34,9 @@ To use it:
 <ul>
 <li>create a <code>Model</code> instance with the desired atmosphere
 parameters.</li>
-<li>call <code>Init</code> to precompute the atmosphere textures,</li>
+<li>call <code>Init</code> to precompute the atmosphere textures (or to load
+them from the cache directory, if one was given to the constructor and if they
+have already been precomputed with the same parameters),</li>
 <li>link <code>GetShader</code> with your shaders that need access to the
 atmosphere shading functions.</li>
 <li>for each GLSL program linked with <code>GetShader</code>, call
@@ -117,6 +119,29 @@ along the specified segment at the 3 wavelengths <code>kLambdaR</code>,
 <code>kLambdaG</code>, <code>kLambdaB</code> (in this order).</li>
 </ul>
 
+<p>For scenes with many points (e.g. terrain),
+<code>GetSkyRadianceToPoint</code> can be replaced with a single trilinear
+lookup in an <i>aerial perspective volume</i>, containing the in-scattered
+radiance and the transmittance between the camera and the points of a 3D grid
+aligned with the view frustum. This
+volume must be recomputed with <code>UpdateAerialPerspective</code> when the
+camera or the Sun move (e.g. at each frame), and bound to each program using it
+with <code>SetAerialPerspectiveUniforms</code>. It is used by the following
+functions, which return the same values as <code>GetSkyRadianceToPoint</code>
+and <code>GetSkyLuminanceToPoint</code> with a null <code>shadow_length</code>
+(the radiance variant is only provided when the other radiance functions are).
+'camera' and 'sun_direction' must be the values passed to
+<code>UpdateAerialPerspective</code>, and points outside the volume fall back to
+<code>GetSkyRadianceToPoint</code>:
+
+<pre class="prettyprint">
+vec3 GetSkyRadianceToPointFromVolume(vec3 camera, vec3 p, vec3 sun_direction,
+    out vec3 transmittance);
+
+vec3 GetSkyLuminanceToPointFromVolume(vec3 camera, vec3 p, vec3 sun_direction,
+    out vec3 transmittance);
+</pre>
+
 <p><b>Note</b> The precomputed atmosphere textures can store either irradiance
 or illuminance values (see the <code>num_precomputed_wavelengths</code>
 parameter):
@@ -150,8 +175,11 @@ parameter):
 #define ATMOSPHERE_MODEL_H_
 
 #include <array>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace atmosphere {
@@ -277,14 +305,75 @@ class Model {
     // Whether to use half precision floats (16 bits) or single precision floats
     // (32 bits) for the precomputed textures. Half precision is sufficient for
     // most cases, except for very high exposure values.
-    bool half_precision);
+    bool half_precision,
+    // An optional directory where the precomputed textures are cached (with a
+    // trailing path separator, e.g. "output/"). If not empty, Init loads the
+    // textures from this directory if they have already been precomputed with
+    // the same parameters, and otherwise saves them there once precomputed.
+    // The binaries of the GLSL programs used for the precomputations are also
+    // cached there, if the driver supports it.
+    const std::string& cache_directory = "",
+    // Whether to precompute the textures with compute shaders, if the OpenGL
+    // context supports them (OpenGL 4.3 or more). Otherwise, or if this is
+    // false (the default), the textures are precomputed by rendering quads
+    // with fragment shaders. In the first case, the textures which only need 3
+    // components use 4 components formats instead (required by the image load
+    // and store operations used in compute shaders).
+    bool use_compute_shaders = false);
 
   ~Model();
 
   void Init(unsigned int num_scattering_orders = 4);
 
+  // Starts an incremental precomputation of the textures, which is then
+  // executed in small steps with Step (e.g. once per frame, to avoid long
+  // frame hitches). Until it completes, the textures precomputed by a previous
+  // Init or BeginInit remain available for rendering (the new textures are
+  // precomputed in separate GPU textures, which replace the old ones at the
+  // end). Any incremental precomputation in progress is abandoned.
+  void BeginInit(unsigned int num_scattering_orders = 4);
+
+  // Executes the precomputation steps started with BeginInit, until they are
+  // all done or until 'budget_ms' milliseconds have elapsed (at least one step
+  // is executed each time). The GL state (framebuffer, viewport, program,
+  // texture bindings, blending and scissor test) is preserved. Returns true
+  // when the precomputation is complete (or if none is in progress). The
+  // texture handles change at this point, so SetProgramUniforms must be called
+  // again for each program using this model.
+  bool Step(double budget_ms);
+
   unsigned int GetShader() const { return atmosphere_shader_; }
 
+  // Writes the precomputed textures to the given file, in the binary format
+  // described in model.cc (a header with the texture sizes and formats, the
+  // number of scattering orders and a hash of the atmosphere parameters,
+  // followed by the raw texels of each texture). Must be called after Init.
+  // Returns false if the file could not be written.
+  bool SaveTextures(const std::string& filename) const;
+
+  // Loads textures saved with SaveTextures, and uploads them to the GPU
+  // instead of precomputing them with Init. Returns false, without modifying
+  // the current textures, if the file can't be read, or if it does not contain
+  // textures precomputed with the same constructor parameters (checked with
+  // their hash) and with the given number of scattering orders.
+  bool LoadTextures(const std::string& filename,
+      unsigned int num_scattering_orders);
+
+  // Loads the textures precomputed on CPU by a reference::Model (see
+  // reference/model.h) from its cache directory (with a trailing path
+  // separator), and converts them to the layout and precision of this model,
+  // instead of precomputing them with Init. The reference::Model must use the
+  // same atmosphere parameters as this model, and 'num_scattering_orders' must
+  // be the number of orders it was initialized with. Returns false, without
+  // modifying the current textures, if the files can't be read.
+  bool LoadReferenceTextures(const std::string& cache_directory,
+      unsigned int num_scattering_orders);
+
+  // Returns a hash of the constructor parameters, which identifies the
+  // precomputed textures of this model (independently of the number of
+  // scattering orders used in Init).
+  uint64_t GetParameterHash() const { return parameter_hash_; }
+
   void SetProgramUniforms(
       unsigned int program,
       unsigned int transmittance_texture_unit,
@@ -292,6 +381,25 @@ class Model {
       unsigned int irradiance_texture_unit,
       unsigned int optional_single_mie_scattering_texture_unit = 0) const;
 
+  // Recomputes the aerial perspective volume (see above) for the given camera
+  // position and Sun direction, with GetSkyRadianceToPoint. Must be called
+  // after Init. 'view_ray_from_clip' is a row major matrix giving the
+  // (unnormalized) view ray direction for the clip space coordinates (x,y,1),
+  // and the volume extends from the camera to 'max_distance' (in the unit
+  // passed to the constructor's 'length_unit_in_meters' argument). The GL state
+  // is preserved.
+  void UpdateAerialPerspective(const std::array<double, 3>& camera,
+      const std::array<double, 3>& sun_direction,
+      const std::array<double, 9>& view_ray_from_clip, double max_distance);
+
+  // Binds the aerial perspective volume textures to the given texture units,
+  // and sets the other uniforms needed by the *FromVolume functions of the
+  // given program. Must be called after each UpdateAerialPerspective.
+  void SetAerialPerspectiveUniforms(
+      unsigned int program,
+      unsigned int aerial_perspective_scattering_texture_unit,
+      unsigned int aerial_perspective_transmittance_texture_unit) const;
+
   // Utility method to convert a function of the wavelength to linear sRGB.
   // 'wavelengths' and 'spectrum' must have the same size. The integral of
   // 'spectrum' times each CIE_2_DEG_COLOR_MATCHING_FUNCTIONS (and times
@@ -310,26 +418,164 @@ class Model {
   typedef std::array<double, 3> vec3;
   typedef std::array<float, 9> mat3;
 
+  void UploadTextures(
+      const void* transmittance,
+      const void* scattering,
+      const void* optional_single_mie_scattering,
+      const void* irradiance,
+      unsigned int scattering_type);
+
+  class Precomputation;
+  class AerialPerspectiveVolume;
+
+  void BeginPrecomputation(unsigned int num_scattering_orders,
+      bool incremental);
+
+  bool RunPrecomputation(double budget_ms);
+
+  std::string GetCacheFilename(unsigned int num_scattering_orders) const;
+
   void Precompute(
-      unsigned int fbo,
-      unsigned int delta_irradiance_texture,
-      unsigned int delta_rayleigh_scattering_texture,
-      unsigned int delta_mie_scattering_texture,
-      unsigned int delta_scattering_density_texture,
-      unsigned int delta_multiple_scattering_texture,
+      Precomputation* precomputation,
       const vec3& lambdas,
       const mat3& luminance_from_radiance,
       bool blend,
       unsigned int num_scattering_orders);
 
+  void PrecomputeWithComputeShaders(
+      Precomputation* precomputation,
+      const mat3& luminance_from_radiance,
+      bool blend,
+      unsigned int num_scattering_orders);
+
   unsigned int num_precomputed_wavelengths_;
+  bool combine_scattering_textures_;
   bool half_precision_;
+  bool use_compute_shaders_;
+  unsigned int num_scattering_orders_;
+  uint64_t parameter_hash_;
+  std::string cache_directory_;
+  std::function<std::vector<vec3>(const vec3&)> spectrum_values_factory_;
   std::function<std::string(const vec3&)> glsl_header_factory_;
+  std::string precomputation_glsl_header_;
   unsigned int transmittance_texture_;
   unsigned int scattering_texture_;
   unsigned int optional_single_mie_scattering_texture_;
   unsigned int irradiance_texture_;
   unsigned int atmosphere_shader_;
+  std::unique_ptr<Precomputation> precomputation_;
+  std::unique_ptr<AerialPerspectiveVolume> aerial_perspective_volume_;
+};
+
+/*
+<p>The <code>FastModel</code> class is an alternative to the above
+<code>Model</code>, based on the "fast" precomputation mode described in
+<a href="fast_functions.glsl.html">fast_functions.glsl</a>. Instead of the
+scattering and irradiance textures, which take seconds to precompute, it uses
+small textures which can be recomputed at each frame, so that the atmosphere
+parameters can change dynamically (e.g. for weather changes). Its shader
+provides the same functions as the <code>Model</code> shader (in precomputed
+irradiance mode), with the following differences:
+<ul>
+<li>the sky and aerial perspective textures are computed for a given viewer,
+Sun direction and projection, in <code>Update</code>. The sky and aerial
+perspective functions must thus be called with the same camera and Sun
+direction as in the last <code>Update</code> call (except for viewers in space,
+for which the sky radiance is computed without the sky texture). Likewise, the
+points outside the view frustum used in <code>Update</code>, or farther than
+the maximum aerial perspective distance, are computed without the aerial
+perspective textures, and are thus much more costly,</li>
+<li>the <code>shadow_length</code> arguments are ignored,</li>
+<li>the sky irradiance is approximated from the multiple scattering texture,
+which assumes a uniform sky radiance.</li>
+</ul>
+*/
+
+class FastModel {
+ public:
+  typedef std::array<double, 3> vec3;
+  typedef std::array<double, 9> mat3;
+
+  // The atmosphere parameters, with the same meaning and units as the
+  // corresponding Model constructor parameters.
+  struct Parameters {
+    std::vector<double> wavelengths;
+    std::vector<double> solar_irradiance;
+    double sun_angular_radius;
+    double bottom_radius;
+    double top_radius;
+    std::vector<DensityProfileLayer> rayleigh_density;
+    std::vector<double> rayleigh_scattering;
+    std::vector<DensityProfileLayer> mie_density;
+    std::vector<double> mie_scattering;
+    std::vector<double> mie_extinction;
+    double mie_phase_function_g;
+    std::vector<DensityProfileLayer> absorption_density;
+    std::vector<double> absorption_extinction;
+    std::vector<double> ground_albedo;
+  };
+
+  // 'length_unit_in_meters' and 'half_precision' have the same meaning as the
+  // corresponding Model constructor parameters ('half_precision' is only used
+  // for the aerial perspective textures).
+  FastModel(const Parameters& parameters, double length_unit_in_meters,
+      bool half_precision);
+
+  ~FastModel();
+
+  // Changes the atmosphere parameters. This does not recompile any shader,
+  // but the textures are only recomputed at the next Update call. Since the
+  // atmosphere parameters are uniforms of the shader returned by GetShader,
+  // SetProgramUniforms must also be called again.
+  void SetParameters(const Parameters& parameters);
+
+  // Recomputes the transmittance and multiple scattering textures if the
+  // atmosphere parameters have changed, and the sky and aerial perspective
+  // textures for the given viewer and Sun direction (in the same reference
+  // frame and length unit as the API functions). 'view_ray_from_clip' is a row
+  // major matrix giving the (unnormalized) view ray direction for the clip
+  // space coordinates (x,y,1), and the aerial perspective textures cover the
+  // distances from 0 to 'aerial_perspective_max_distance' (in length unit).
+  // The GL state is preserved, as in Model::Step.
+  void Update(const vec3& camera, const vec3& sun_direction,
+      const mat3& view_ray_from_clip, double aerial_perspective_max_distance);
+
+  unsigned int GetShader() const { return atmosphere_shader_; }
+
+  // Binds the textures to the given program, and sets the atmosphere
+  // parameters and the view parameters of the last Update call in its uniforms
+  // (the program must be the current program).
+  void SetProgramUniforms(
+      unsigned int program,
+      unsigned int transmittance_texture_unit,
+      unsigned int multi_scattering_texture_unit,
+      unsigned int sky_view_texture_unit,
+      unsigned int aerial_perspective_scattering_texture_unit,
+      unsigned int aerial_perspective_transmittance_texture_unit) const;
+
+ private:
+  class Programs;
+
+  void BindAtmosphereUniforms(unsigned int program) const;
+
+  double length_unit_in_meters_;
+  // The uniform names and values of the atmosphere parameters and of the
+  // luminance conversion factors, computed in SetParameters.
+  std::vector<std::pair<std::string, vec3>> vec3_uniforms_;
+  std::vector<std::pair<std::string, double>> float_uniforms_;
+  double bottom_radius_;
+  double top_radius_;
+  bool parameters_changed_;
+  mat3 clip_from_view_ray_;
+  double aerial_perspective_max_distance_;
+  unsigned int transmittance_texture_;
+  unsigned int multi_scattering_texture_;
+  unsigned int sky_view_texture_;
+  unsigned int aerial_perspective_scattering_texture_;
+  unsigned int aerial_perspective_transmittance_texture_;
+  unsigned int fbo_;
+  unsigned int atmosphere_shader_;
+  std::unique_ptr<Programs> programs_;
 };
 
 }  // namespace atmosphere
@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/benchmark.cc</h2>
+
+<p>This file implements the utility functions shared by the benchmarks. The
+atmosphere parameters have the same structure as the Earth atmosphere of the
+<a href="model_test.cc.html">model tests</a> (Earth radius, Rayleigh and Mie
+exponential profiles, and a two layers ozone profile), but with simpler values
+(e.g. a constant solar irradiance and ozone cross section):
+*/
+
+#include "atmosphere/reference/benchmark.h"
+
+#include <sys/resource.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace atmosphere {
+namespace reference {
+
+AtmosphereParameters GetBenchmarkAtmosphereParameters() {
+  constexpr int kLambdaMin = 360;
+  constexpr int kLambdaMax = 830;
+  constexpr ScatteringCoefficient kRayleigh = 1.24062e-6 / m;
+  constexpr Length kRayleighScaleHeight = 8000.0 * m;
+  constexpr Length kMieScaleHeight = 1200.0 * m;
+  constexpr ScatteringCoefficient kMie = 5.328e-3 / kMieScaleHeight;
+  constexpr ScatteringCoefficient kMaxOzoneExtinction = 1.5e-6 / m;
+
+  std::vector<SpectralIrradiance> solar_irradiance;
+  std::vector<ScatteringCoefficient> rayleigh_scattering;
+  std::vector<ScatteringCoefficient> mie_scattering;
+  std::vector<ScatteringCoefficient> mie_extinction;
+  std::vector<ScatteringCoefficient> absorption_extinction;
+  for (int l = kLambdaMin; l <= kLambdaMax; l += 10) {
+    double lambda = static_cast<double>(l) * 1e-3;  // micro-meters
+    solar_irradiance.push_back(1.5 * watt_per_square_meter_per_nm);
+    rayleigh_scattering.push_back(kRayleigh * pow(lambda, -4));
+    mie_scattering.push_back(kMie * 0.9);
+    mie_extinction.push_back(kMie);
+    absorption_extinction.push_back(kMaxOzoneExtinction);
+  }
+
+  AtmosphereParameters atmosphere;
+  atmosphere.solar_irradiance = IrradianceSpectrum(
+      kLambdaMin * nm, kLambdaMax * nm, solar_irradiance);
+  atmosphere.sun_angular_radius = 0.2678 * deg;
+  atmosphere.bottom_radius = 6360.0 * km;
+  atmosphere.top_radius = 6420.0 * km;
+  atmosphere.rayleigh_density.layers[1] = DensityProfileLayer(
+      0.0 * m, 1.0, -1.0 / kRayleighScaleHeight, 0.0 / m, 0.0);
+  atmosphere.rayleigh_scattering = ScatteringSpectrum(
+      kLambdaMin * nm, kLambdaMax * nm, rayleigh_scattering);
+  atmosphere.mie_density.layers[1] = DensityProfileLayer(
+      0.0 * m, 1.0, -1.0 / kMieScaleHeight, 0.0 / m, 0.0);
+  atmosphere.mie_scattering = ScatteringSpectrum(
+      kLambdaMin * nm, kLambdaMax * nm, mie_scattering);
+  atmosphere.mie_extinction = ScatteringSpectrum(
+      kLambdaMin * nm, kLambdaMax * nm, mie_extinction);
+  atmosphere.mie_phase_function_g = 0.8;
+  atmosphere.absorption_density.layers[0] = DensityProfileLayer(
+      25.0 * km, 0.0, 0.0 / km, 1.0 / (15.0 * km), -2.0 / 3.0);
+  atmosphere.absorption_density.layers[1] = DensityProfileLayer(
+      0.0 * km, 0.0, 0.0 / km, -1.0 / (15.0 * km), 8.0 / 3.0);
+  atmosphere.absorption_extinction = ScatteringSpectrum(
+      kLambdaMin * nm, kLambdaMax * nm, absorption_extinction);
+  atmosphere.ground_albedo = DimensionlessSpectrum(0.1);
+  atmosphere.mu_s_min = cos(102.0 * deg);
+  return atmosphere;
+}
+
+/*
+<p>The CPU time and the peak RSS are measured with the following functions.
+In order to measure the peak RSS of each precomputation phase separately, the
+benchmarks reset it at the beginning of each phase, which is possible on Linux
+by writing "5" in <code>/proc/self/clear_refs</code>:
+*/
+
+double GetCpuTime() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+void ResetPeakRss() {
+  std::ofstream file("/proc/self/clear_refs");
+  file << "5";
+}
+
+long GetPeakRss() {  // NOLINT
+  std::ifstream file("/proc/self/status");
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::atol(line.substr(6).c_str());
+    }
+  }
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+std::string GetCurrentDate() {
+  char date[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+  return date;
+}
+
+std::string GetBuildType() {
+#ifdef NDEBUG
+  return "release";
+#else
+  return "debug";
+#endif
+}
+
+}  // namespace reference
+}  // namespace atmosphere
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/benchmark.h</h2>
+
+<p>This file provides utility functions shared by the
+<a href="functions_bench.cc.html">function</a> and
+<a href="model_bench.cc.html">model</a> benchmarks, and by the
+<a href="model_sweep.cc.html">model sweep</a> tool.
+*/
+
+#ifndef ATMOSPHERE_REFERENCE_BENCHMARK_H_
+#define ATMOSPHERE_REFERENCE_BENCHMARK_H_
+
+#include <string>
+
+#include "atmosphere/reference/definitions.h"
+
+namespace atmosphere {
+namespace reference {
+
+// Returns atmosphere parameters with the same structure as the Earth
+// atmosphere used in model_test.cc (47 wavelengths, exponential Rayleigh and
+// Mie profiles, and a two layers ozone profile), but with simpler values.
+// The cost of the model functions only depends on this structure.
+AtmosphereParameters GetBenchmarkAtmosphereParameters();
+
+// Returns the CPU time used so far by the process, summed over all its
+// threads, in seconds.
+double GetCpuTime();
+
+// Resets the peak resident set size (RSS) of the process, if possible (this
+// is only supported on Linux).
+void ResetPeakRss();
+
+// Returns the peak RSS of the process in kB, since the last ResetPeakRss call
+// if it was successful, or since the start of the process otherwise.
+long GetPeakRss();  // NOLINT
+
+// Returns the current UTC date and time, in ISO 8601 format.
+std::string GetCurrentDate();
+
+// Returns "release" if NDEBUG is defined, or "debug" otherwise.
+std::string GetBuildType();
+
+}  // namespace reference
+}  // namespace atmosphere
+
+#endif  // ATMOSPHERE_REFERENCE_BENCHMARK_H_
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/counters.h</h2>
+
+<p>This file defines the counters of the instrumented build of the C++
+<a href="functions.cc.html">functions</a>, which counts the texture lookups,
+integrand evaluations, transcendental function calls and branch outcomes of the
+<a href="../functions.glsl.html">GLSL functions</a> compiled as C++. This build
+is enabled by defining <code>ATMOSPHERE_COUNTERS</code> when compiling
+<code>functions.cc</code> and <code>model.cc</code> (e.g. with
+<code>make model_counters</code>), and the counters of each precomputation phase
+are then printed at the end of <code>Model::Init</code>. Otherwise the counting
+macros expand to nothing, and the counters remain null.
+
+<p>The counters are stored per thread, so that incrementing them does not need
+any synchronization (the <a href="model.cc.html">model</a> resets them before
+each job and adds them to the totals of the current phase after it).
+*/
+
+#ifndef ATMOSPHERE_REFERENCE_COUNTERS_H_
+#define ATMOSPHERE_REFERENCE_COUNTERS_H_
+
+#include <cstdint>
+
+namespace atmosphere {
+namespace reference {
+
+#ifdef ATMOSPHERE_COUNTERS
+constexpr bool kCountersEnabled = true;
+#else
+constexpr bool kCountersEnabled = false;
+#endif
+
+// The counters. A branch counter (used with COUNT_IF) counts the evaluations of
+// a condition, and the next counter counts those where it is true.
+enum Counter {
+  kTransmittanceLookups,
+  kScatteringLookups,
+  kIrradianceLookups,
+  kOpticalLengthSamples,
+  kSingleScatteringSamples,
+  kScatteringDensitySamples,
+  kMultipleScatteringSamples,
+  kIndirectIrradianceSamples,
+  kExpCalls,
+  kPowCalls,
+  kSqrtCalls,
+  kSinCosCalls,
+  kRayIntersectsGround,
+  kRayIntersectsGroundTrue,
+  kNumCounters
+};
+
+constexpr const char* kCounterNames[kNumCounters] = {
+  "transmittance_lookups",
+  "scattering_lookups",
+  "irradiance_lookups",
+  "optical_length_samples",
+  "single_scattering_samples",
+  "scattering_density_samples",
+  "multiple_scattering_samples",
+  "indirect_irradiance_samples",
+  "exp_calls",
+  "pow_calls",
+  "sqrt_calls",
+  "sin_cos_calls",
+  "ray_intersects_ground",
+  "ray_intersects_ground_true"
+};
+
+struct Counters {
+  uint64_t value[kNumCounters] = {};
+
+  Counters& operator+=(const Counters& rhs) {
+    for (int i = 0; i < kNumCounters; ++i) {
+      value[i] += rhs.value[i];
+    }
+    return *this;
+  }
+};
+
+// Returns the counters of the calling thread.
+inline Counters& GetThreadCounters() {
+  static thread_local Counters counters;
+  return counters;
+}
+
+inline bool CountIf(Counter counter, bool condition) {
+  Counters& counters = GetThreadCounters();
+  ++counters.value[counter];
+  if (condition) {
+    ++counters.value[counter + 1];
+  }
+  return condition;
+}
+
+}  // namespace reference
+}  // namespace atmosphere
+
+#endif  // ATMOSPHERE_REFERENCE_COUNTERS_H_
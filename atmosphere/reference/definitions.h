@@ -165,6 +165,28 @@ typedef dimensional::BinaryFunction<
     IRRADIANCE_TEXTURE_HEIGHT,
     IrradianceSpectrum> IrradianceTexture;
 
+typedef dimensional::BinaryFunction<
+    MULTI_SCATTERING_TEXTURE_WIDTH,
+    MULTI_SCATTERING_TEXTURE_HEIGHT,
+    RadianceSpectrum> MultiScatteringTexture;
+
+typedef dimensional::BinaryFunction<
+    SKY_VIEW_TEXTURE_WIDTH,
+    SKY_VIEW_TEXTURE_HEIGHT,
+    RadianceSpectrum> SkyViewTexture;
+
+typedef dimensional::TernaryFunction<
+    AERIAL_PERSPECTIVE_TEXTURE_WIDTH,
+    AERIAL_PERSPECTIVE_TEXTURE_HEIGHT,
+    AERIAL_PERSPECTIVE_TEXTURE_DEPTH,
+    RadianceSpectrum> AerialPerspectiveScatteringTexture;
+
+typedef dimensional::TernaryFunction<
+    AERIAL_PERSPECTIVE_TEXTURE_WIDTH,
+    AERIAL_PERSPECTIVE_TEXTURE_HEIGHT,
+    AERIAL_PERSPECTIVE_TEXTURE_DEPTH,
+    DimensionlessSpectrum> AerialPerspectiveTransmittanceTexture;
+
 /*
 <h3>Physical units</h3>
 
@@ -0,0 +1,410 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/fast_path_test.cc</h2>
+
+<p>This file provides tests that compare the images rendered with the CPU fast
+paths of our atmosphere model with the images rendered with the full CPU
+<a href="model.h.html">model</a>, for the same <a href="scene.h.html">test
+scene</a> as the <a href="model_test.cc.html">model tests</a>. Unlike the
+latter, these tests do not need an OpenGL context, and can thus run on headless
+machines. The fast paths currently tested are:
+<ul>
+<li>the <code>FastModel</code>, which replaces the precomputed textures with
+low resolution textures computed for a given viewer and Sun direction, and
+approximates the multiple scattering (see
+<a href="../fast_functions.glsl.html">fast_functions.glsl</a>),</li>
+<li>the aerial perspective volume of the <code>Model</code>, which replaces the
+two 4D texture lookups of <code>GetSkyRadianceToPoint</code> with a single
+trilinear lookup in a frustum aligned 3D texture (without light shafts).</li>
+</ul>
+Each test checks that the PSNR between the two images is larger than a
+threshold. It also reports the ratio between the render times with the full
+model and with the fast path (the render speedup), and the time needed to update
+the textures of the fast path for the current view, which is not included in
+this ratio (for the <code>FastModel</code> this update replaces the
+precomputations of the full model, which are much longer). These times are not
+checked, since wall clock times are not reliable on loaded machines (the
+<a href="functions_bench.cc.html">benchmarks</a> should be used instead).
+Alternative fast paths (e.g. single precision or vectorized implementations)
+should be added here, with a threshold based on their expected precision.
+
+<p>The test results can be seen <a href="fast_path_test_report.html">here</a>.
+*/
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "atmosphere/reference/definitions.h"
+#include "atmosphere/reference/image.h"
+#include "atmosphere/reference/model.h"
+#include "atmosphere/reference/scene.h"
+#include "minpng/minpng.h"
+#include "test/test_case.h"
+
+namespace atmosphere {
+namespace reference {
+
+namespace {
+
+/*
+<p>The test images are stored on disk, in the same directory as the images of
+the model tests, with the following function, which is a simple wrapper around
+the <a href="https://github.com/jrmuizel/minpng">minpng</a> library. Their size
+and the maximum distance covered by the aerial perspective volumes are the
+following constants:
+*/
+
+const char kOutputDir[] = "output/Doc/atmosphere/reference/";
+constexpr unsigned int kWidth = 640;
+constexpr unsigned int kHeight = 360;
+constexpr Length kAerialPerspectiveMaxDistance = 32.0 * km;
+const char kRadiance[] = "spectral radiance at 3 predefined wavelengths";
+const char kLuminance[] = "sRGB luminance";
+
+void WritePngArgb(const std::string& name, const Image& image) {
+  write_png((std::string(kOutputDir) + name).c_str(),
+      const_cast<unsigned int*>(image.data()), kWidth, kHeight);
+}
+
+double GetTime() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // anonymous namespace
+
+/*
+<h3>Test fixture</h3>
+
+<p>The test fixture extends the <code>TestCase</code> class provided by the <a
+href="https://github.com/ebruneton/dimensional_types">dimensional_types</a>
+library. Its <code>SetUp</code> method creates the test scene and the full
+model, whose textures are precomputed in the first test, and then loaded from
+the <code>output</code> directory (the model tests use the same cache):
+*/
+
+class FastPathTest : public dimensional::TestCase {
+ public:
+  template<typename T>
+  FastPathTest(const std::string& name, T test)
+      : TestCase("FastPathTest " + name, static_cast<Test>(test)),
+        name_(name), scene_(kWidth, kHeight) {}
+
+  void SetUp() override {
+    scene_ = Scene(kWidth, kHeight);
+    model_.reset(new Model(scene_.atmosphere_parameters(), "output/"));
+    model_->Init();
+  }
+
+  void TearDown() override {
+    model_ = nullptr;
+    fast_model_ = nullptr;
+  }
+
+/*
+<p>The fast paths are rendered in two steps: an update of their textures for
+the current view, followed by the rendering itself. The first step is
+implemented by the following methods (note that the model methods expect
+positions relative to the Earth center):
+*/
+
+  void UpdateFastModel() {
+    fast_model_.reset(new FastModel(scene_.atmosphere_parameters()));
+    fast_model_->Update(scene_.camera() - scene_.earth_center(),
+        scene_.sun_direction(), scene_.view_ray_from_clip(),
+        kAerialPerspectiveMaxDistance);
+  }
+
+  void UpdateAerialPerspectiveVolume() {
+    model_->UpdateAerialPerspective(scene_.camera() - scene_.earth_center(),
+        scene_.sun_direction(), scene_.view_ray_from_clip(),
+        kAerialPerspectiveMaxDistance);
+  }
+
+/*
+<p>The following method renders the current view with the full model and with
+a fast path, and measures the render times. It adds the two images, their PSNR
+and SSIM, a heatmap of their RMS error per tile, the render speedup of the fast
+path and its update time to an HTML test report, and returns the PSNR:
+*/
+
+  double Compare(const std::function<void()>& update_fast_path,
+      const std::function<Image()>& render_fast_path,
+      const std::string& caption, bool append) {
+    double start_time = GetTime();
+    Image reference_image = scene_.Render(*model_);
+    const double reference_time = GetTime() - start_time;
+    start_time = GetTime();
+    update_fast_path();
+    const double update_time = GetTime() - start_time;
+    start_time = GetTime();
+    Image fast_path_image = render_fast_path();
+    const double fast_path_time = GetTime() - start_time;
+
+    const ImageComparison comparison =
+        CompareImages(reference_image, fast_path_image);
+    const double max_tile_error = *std::max_element(
+        comparison.tile_rms_error.begin(), comparison.tile_rms_error.end());
+    const double speedup = reference_time / fast_path_time;
+    std::printf("  %s: PSNR = %.2fdB, SSIM = %.4f, render speedup = %.2f "
+        "(%.3fs vs %.3fs), update time = %.3fs\n", name_.c_str(),
+        comparison.psnr, comparison.ssim, speedup, fast_path_time,
+        reference_time,
+        update_time);
+    WritePngArgb(name_ + "1.png", reference_image);
+    WritePngArgb(name_ + "2.png", fast_path_image);
+    WritePngArgb(name_ + "_error.png",
+        CreateHeatmap(comparison, comparison.tile_rms_error, max_tile_error));
+    std::ofstream file(std::string(kOutputDir) + "fast_path_test_report.html",
+        append ? std::ios_base::app : std::ios_base::trunc);
+    file << "<h2>" << name_ << " (PSNR = " << comparison.psnr << "dB, SSIM = "
+         << comparison.ssim << ", render speedup = " << speedup
+         << ", update time = " << update_time << "s)</h2>" << std::endl
+         << "<p>" << caption << " Bottom: RMS error per tile (white = "
+         << max_tile_error << ")." << std::endl
+         << "<p><img src=\"" << name_ << "1.png\">" << std::endl
+         << "<img src=\"" << name_ << "2.png\">" << std::endl
+         << "<br><img src=\"" << name_ << "_error.png\">" << std::endl;
+    file.close();
+    return comparison.psnr;
+  }
+
+  void CompareFastModel(const std::string& output, double min_psnr,
+      bool append) {
+    ExpectLess(min_psnr, Compare([this]() { UpdateFastModel(); },
+        [this]() { return scene_.Render(*fast_model_); },
+        "Left: full CPU model. Right: CPU FastModel. Both images show the " +
+        output + ".", append));
+  }
+
+  void CompareAerialPerspectiveVolume(const std::string& output,
+      double min_psnr, bool append) {
+    ExpectLess(min_psnr, Compare([this]() { UpdateAerialPerspectiveVolume(); },
+        [this]() { return scene_.RenderWithAerialPerspectiveVolume(*model_); },
+        "Left: full CPU model. Right: CPU model with an aerial perspective "
+        "volume. Both images show the " + output + ".", append));
+  }
+
+/*
+<h3>Test cases</h3>
+
+<p>The first test cases compare the <code>FastModel</code> with the full model,
+for the radiance and luminance outputs, with a high and a low Sun. The
+multiple scattering approximation of the <code>FastModel</code>, and the low
+resolution of its aerial perspective textures (which cause aliasing at the
+sphere silhouette), lead to relatively low thresholds. Sunsets have a larger
+error, because the relative contribution of the multiple scattering is larger:
+*/
+
+  void TestFastModelRadiance() {
+    SetViewParameters(65.0 * deg, false /* use_luminance */);
+    CompareFastModel(kRadiance, 37.0, false);
+  }
+
+  void TestFastModelRadianceSunSet() {
+    SetViewParameters(88.0 * deg, false /* use_luminance */);
+    CompareFastModel(kRadiance, 36.0, true);
+  }
+
+  void TestFastModelLuminance() {
+    SetViewParameters(65.0 * deg, true /* use_luminance */);
+    CompareFastModel(kLuminance, 37.0, true);
+  }
+
+  void TestFastModelLuminanceSunSet() {
+    SetViewParameters(88.0 * deg, true /* use_luminance */);
+    CompareFastModel(kLuminance, 36.0, true);
+  }
+
+/*
+<p>The next test cases compare the aerial perspective volume with the full
+model. The volume uses the same precomputed textures as the full model, so we
+expect a smaller difference than with the <code>FastModel</code>, mostly in the
+light shafts behind the sphere, which are not supported by the volume:
+*/
+
+  void TestAerialPerspectiveVolumeRadiance() {
+    SetViewParameters(65.0 * deg, false /* use_luminance */);
+    CompareAerialPerspectiveVolume(kRadiance, 39.0, true);
+  }
+
+  void TestAerialPerspectiveVolumeLuminanceSunSet() {
+    SetViewParameters(88.0 * deg, true /* use_luminance */);
+    CompareAerialPerspectiveVolume(kLuminance, 39.0, true);
+  }
+
+/*
+<p>The last test case measures the error of the aerial perspective volume
+itself, for points at several distances from a camera 500m above the ground,
+looking at the horizon, with a Sun zenith angle of 60 degrees (the points of
+the test scene are all less than a few km away). For each distance, it prints
+the relative RMS error of the radiance and of the transmittance for the view
+rays above the horizon, for those hitting the ground well below the horizon,
+and for those in a thin band around the horizon. The volume uses a quadratic
+distance mapping, so the error is larger for the nearest points. It is also
+larger around the horizon, where the radiance and the transmittance vary
+quickly with the view ray direction. We thus only check the error of the
+radiance for sky rays beyond 1km, and of the transmittance outside the horizon
+band:
+*/
+
+  void TestAerialPerspectiveVolumeErrors() {
+    constexpr unsigned int kNumColumns = 64;
+    constexpr unsigned int kNumRows = 36;
+    constexpr Length kMaxDistance = 50.0 * km;
+    const AtmosphereParameters& atmosphere = scene_.atmosphere_parameters();
+    const Position camera(0.0 * m, 0.0 * m,
+        atmosphere.bottom_radius + 500.0 * m);
+    const Direction sun_direction(0.0, sin(60.0 * deg), cos(60.0 * deg));
+    // Looking along the y axis, slightly above the horizon.
+    const std::array<double, 9> view_ray_from_clip =
+        {{1.2, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.6, 0.1}};
+    model_->UpdateAerialPerspective(
+        camera, sun_direction, view_ray_from_clip, kMaxDistance);
+
+    enum Group { kSky, kGround, kHorizon, kNumGroups };
+    std::printf("  %8s %27s %27s\n", "", "radiance (relative RMS)",
+        "transmittance (rel. RMS)");
+    std::printf("  %8s %8s %8s %8s %8s %8s %8s\n", "distance", "sky",
+        "ground", "horizon", "sky", "ground", "horizon");
+    for (double distance_km : {0.2, 1.0, 5.0, 10.0, 20.0, 40.0}) {
+      double radiance_error[kNumGroups] = {0.0, 0.0, 0.0};
+      double radiance_norm[kNumGroups] = {0.0, 0.0, 0.0};
+      double transmittance_error[kNumGroups] = {0.0, 0.0, 0.0};
+      double transmittance_norm[kNumGroups] = {0.0, 0.0, 0.0};
+      for (unsigned int j = 0; j < kNumRows; ++j) {
+        const double y = (j + 0.5) / kNumRows * 2.0 - 1.0;
+        const Group group = y > 0.0 ? kSky : (y < -0.4 ? kGround : kHorizon);
+        for (unsigned int i = 0; i < kNumColumns; ++i) {
+          const double x = (i + 0.5) / kNumColumns * 2.0 - 1.0;
+          const Direction view_ray = normalize(Direction(
+              view_ray_from_clip[0] * x + view_ray_from_clip[1] * y +
+                  view_ray_from_clip[2],
+              view_ray_from_clip[3] * x + view_ray_from_clip[4] * y +
+                  view_ray_from_clip[5],
+              view_ray_from_clip[6] * x + view_ray_from_clip[7] * y +
+                  view_ray_from_clip[8]));
+          // Stop at the ground, if the view ray intersects it.
+          Length distance = distance_km * km;
+          const Length r_mu = dot(camera, view_ray);
+          const Area discriminant = r_mu * r_mu - dot(camera, camera) +
+              atmosphere.bottom_radius * atmosphere.bottom_radius;
+          if (r_mu < 0.0 * m && discriminant >= 0.0 * m2) {
+            distance = std::min(distance, -r_mu - sqrt(discriminant));
+          }
+          const Position point = camera + view_ray * distance;
+
+          DimensionlessSpectrum transmittance;
+          DimensionlessSpectrum volume_transmittance;
+          const RadianceSpectrum radiance = model_->GetSkyRadianceToPoint(
+              camera, point, 0.0 * m, sun_direction, &transmittance);
+          const RadianceSpectrum volume_radiance =
+              model_->GetSkyRadianceToPointFromVolume(
+                  camera, point, sun_direction, &volume_transmittance);
+          for (unsigned int k = 0; k < radiance.size(); ++k) {
+            const double l =
+                radiance[k].to(watt_per_square_meter_per_sr_per_nm);
+            const double t = transmittance[k]();
+            const double dl = volume_radiance[k].to(
+                watt_per_square_meter_per_sr_per_nm) - l;
+            const double dt = volume_transmittance[k]() - t;
+            radiance_error[group] += dl * dl;
+            radiance_norm[group] += l * l;
+            transmittance_error[group] += dt * dt;
+            transmittance_norm[group] += t * t;
+          }
+        }
+      }
+      double radiance_rms[kNumGroups];
+      double transmittance_rms[kNumGroups];
+      for (int g = 0; g < kNumGroups; ++g) {
+        radiance_rms[g] = std::sqrt(radiance_error[g] / radiance_norm[g]);
+        transmittance_rms[g] =
+            std::sqrt(transmittance_error[g] / transmittance_norm[g]);
+      }
+      std::printf("  %6.1fkm %7.2f%% %7.2f%% %7.2f%% %7.2f%% %7.2f%% "
+          "%7.2f%%\n", distance_km, 100.0 * radiance_rms[kSky],
+          100.0 * radiance_rms[kGround], 100.0 * radiance_rms[kHorizon],
+          100.0 * transmittance_rms[kSky], 100.0 * transmittance_rms[kGround],
+          100.0 * transmittance_rms[kHorizon]);
+      if (distance_km >= 1.0) {
+        ExpectLess(radiance_rms[kSky], 0.02);
+      }
+      ExpectLess(transmittance_rms[kSky], 0.01);
+      ExpectLess(transmittance_rms[kGround], 0.01);
+    }
+  }
+
+ private:
+  void SetViewParameters(Angle sun_theta, bool use_luminance) {
+    scene_.SetViewParameters(sun_theta, 90.0 * deg, use_luminance);
+  }
+
+  std::string name_;
+  Scene scene_;
+  std::unique_ptr<Model> model_;
+  std::unique_ptr<FastModel> fast_model_;
+};
+
+namespace {
+
+FastPathTest fast_model1(
+    "FastModelRadiance",
+    &FastPathTest::TestFastModelRadiance);
+FastPathTest fast_model2(
+    "FastModelRadianceSunSet",
+    &FastPathTest::TestFastModelRadianceSunSet);
+FastPathTest fast_model3(
+    "FastModelLuminance",
+    &FastPathTest::TestFastModelLuminance);
+FastPathTest fast_model4(
+    "FastModelLuminanceSunSet",
+    &FastPathTest::TestFastModelLuminanceSunSet);
+FastPathTest aerial_perspective_volume1(
+    "AerialPerspectiveVolumeRadiance",
+    &FastPathTest::TestAerialPerspectiveVolumeRadiance);
+FastPathTest aerial_perspective_volume2(
+    "AerialPerspectiveVolumeLuminanceSunSet",
+    &FastPathTest::TestAerialPerspectiveVolumeLuminanceSunSet);
+FastPathTest aerial_perspective_volume3(
+    "AerialPerspectiveVolumeErrors",
+    &FastPathTest::TestAerialPerspectiveVolumeErrors);
+
+}  // anonymous namespace
+
+}  // namespace reference
+}  // namespace atmosphere
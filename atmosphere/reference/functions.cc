@@ -34,24 +34,78 @@ the real implementation is provided in the
 <a href="../functions.glsl">corresponding GLSL file</a>, which is included here,
 after the definition of the macros which are needed to be able to compile this
 GLSL code as C++.
+
+<p>In the instrumented build (see <a href="counters.h.html">counters.h</a>), the
+<code>COUNT</code> and <code>COUNT_IF</code> macros used in the GLSL file
+increment the counters of the calling thread, and the texture lookups and the
+transcendental functions are also redefined as macros, to count them before
+calling the original functions (a macro is not expanded again inside its own
+expansion). The texture lookups are counted per texture type, with the
+<code>GetLookupCounter</code> overloads below.
 */
 
 #include "atmosphere/reference/functions.h"
 
 #include <cassert>
 
+#include "atmosphere/reference/counters.h"
+
 #define IN(x) const x&
 #define OUT(x) x&
 #define TEMPLATE(x) template<class x>
 #define TEMPLATE_ARGUMENT(x) <x>
 
+#ifdef ATMOSPHERE_COUNTERS
+#define COUNT(x) (++GetThreadCounters().value[x])
+#define COUNT_IF(x, condition) CountIf(x, condition)
+#define texture(t, uv) (COUNT(GetLookupCounter(t)), texture(t, uv))
+#define exp(...) (COUNT(kExpCalls), exp(__VA_ARGS__))
+#define pow(...) (COUNT(kPowCalls), pow(__VA_ARGS__))
+#define sqrt(...) (COUNT(kSqrtCalls), sqrt(__VA_ARGS__))
+#define sin(...) (COUNT(kSinCosCalls), sin(__VA_ARGS__))
+#define cos(...) (COUNT(kSinCosCalls), cos(__VA_ARGS__))
+#else
+#define COUNT(x)
+#define COUNT_IF(x, condition) (condition)
+#endif
+
 namespace atmosphere {
 namespace reference {
 
 using std::max;
 using std::min;
 
+#ifdef ATMOSPHERE_COUNTERS
+namespace {
+
+Counter GetLookupCounter(const TransmittanceTexture&) {
+  return kTransmittanceLookups;
+}
+
+Counter GetLookupCounter(const IrradianceTexture&) {
+  return kIrradianceLookups;
+}
+
+template<class T>
+Counter GetLookupCounter(const AbstractScatteringTexture<T>&) {
+  return kScatteringLookups;
+}
+
+}  // anonymous namespace
+#endif
+
 #include "atmosphere/functions.glsl"
 
+#ifdef ATMOSPHERE_COUNTERS
+#undef texture
+#undef exp
+#undef pow
+#undef sqrt
+#undef sin
+#undef cos
+#endif
+
+#include "atmosphere/fast_functions.glsl"
+
 }  // namespace reference
 }  // namespace atmosphere
@@ -243,6 +243,121 @@ IrradianceSpectrum GetSunAndSkyIrradiance(
     const Position& point, const Direction& normal,
     const Direction& sun_direction, IrradianceSpectrum& sky_irradiance);
 
+// Fast precomputation mode.
+
+void ComputeMediumCoefficients(const AtmosphereParameters& atmosphere,
+    Length r, ScatteringSpectrum& rayleigh_scattering,
+    ScatteringSpectrum& mie_scattering, ScatteringSpectrum& extinction);
+
+void ComputeIsotropicScatteringIntegrals(
+    const AtmosphereParameters& atmosphere,
+    const TransmittanceTexture& transmittance_texture,
+    Length r, Number mu, Number mu_s, Number nu,
+    RadianceSpectrum& radiance, DimensionlessSpectrum& transfer);
+
+RadianceSpectrum ComputeMultiScattering(
+    const AtmosphereParameters& atmosphere,
+    const TransmittanceTexture& transmittance_texture,
+    Length r, Number mu_s);
+
+vec2 GetMultiScatteringTextureUvFromRMuS(
+    const AtmosphereParameters& atmosphere, Length r, Number mu_s);
+
+void GetRMuSFromMultiScatteringTextureUv(
+    const AtmosphereParameters& atmosphere, const vec2& uv,
+    Length& r, Number& mu_s);
+
+RadianceSpectrum ComputeMultiScatteringTexture(
+    const AtmosphereParameters& atmosphere,
+    const TransmittanceTexture& transmittance_texture,
+    const vec2& gl_frag_coord);
+
+RadianceSpectrum GetMultiScattering(
+    const AtmosphereParameters& atmosphere,
+    const MultiScatteringTexture& multi_scattering_texture,
+    Length r, Number mu_s);
+
+RadianceSpectrum ComputeScatteredRadiance(
+    const AtmosphereParameters& atmosphere,
+    const TransmittanceTexture& transmittance_texture,
+    const MultiScatteringTexture& multi_scattering_texture,
+    Length r, Number mu, Number mu_s, Number nu, Length d, int sample_count,
+    DimensionlessSpectrum& transmittance);
+
+vec2 GetSkyViewTextureUvFromRMuMuSNu(const AtmosphereParameters& atmosphere,
+    Length r, Number mu, Number mu_s, Number nu,
+    bool ray_r_mu_intersects_ground);
+
+void GetMuNuFromSkyViewTextureUv(const AtmosphereParameters& atmosphere,
+    const vec2& uv, Length r, Number mu_s, Number& mu, Number& nu,
+    bool& ray_r_mu_intersects_ground);
+
+RadianceSpectrum ComputeSkyViewTexture(
+    const AtmosphereParameters& atmosphere,
+    const TransmittanceTexture& transmittance_texture,
+    const MultiScatteringTexture& multi_scattering_texture,
+    const vec2& gl_frag_coord, Length r, Number mu_s);
+
+RadianceSpectrum GetSkyView(
+    const AtmosphereParameters& atmosphere,
+    const SkyViewTexture& sky_view_texture,
+    Length r, Number mu, Number mu_s, Number nu,
+    bool ray_r_mu_intersects_ground);
+
+Length GetAerialPerspectiveDistanceFromTextureCoord(Number w,
+    Length max_distance);
+
+Number GetAerialPerspectiveTextureCoordFromDistance(Length d,
+    Length max_distance);
+
+RadianceSpectrum ComputeAerialPerspective(
+    const AtmosphereParameters& atmosphere,
+    const TransmittanceTexture& transmittance_texture,
+    const MultiScatteringTexture& multi_scattering_texture,
+    Position camera, const Direction& view_ray, Length d,
+    const Direction& sun_direction, int sample_count,
+    DimensionlessSpectrum& transmittance);
+
+RadianceSpectrum ComputeAerialPerspectiveTexture(
+    const AtmosphereParameters& atmosphere,
+    const TransmittanceTexture& transmittance_texture,
+    const MultiScatteringTexture& multi_scattering_texture,
+    const Position& camera, const Direction& view_ray,
+    const Direction& sun_direction, int slice, Length max_distance,
+    DimensionlessSpectrum& transmittance);
+
+RadianceSpectrum ComputeAerialPerspectiveVolumeTexture(
+    const AtmosphereParameters& atmosphere,
+    const TransmittanceTexture& transmittance_texture,
+    const ReducedScatteringTexture& scattering_texture,
+    const ReducedScatteringTexture& single_mie_scattering_texture,
+    const Position& camera, const Direction& view_ray,
+    const Direction& sun_direction, int slice, Length max_distance,
+    DimensionlessSpectrum& transmittance);
+
+RadianceSpectrum GetAerialPerspective(
+    const AerialPerspectiveScatteringTexture&
+        aerial_perspective_scattering_texture,
+    const AerialPerspectiveTransmittanceTexture&
+        aerial_perspective_transmittance_texture,
+    const vec2& uv, Length d, Length max_distance,
+    DimensionlessSpectrum& transmittance);
+
+RadianceSpectrum GetFastSkyRadiance(
+    const AtmosphereParameters& atmosphere,
+    const TransmittanceTexture& transmittance_texture,
+    const MultiScatteringTexture& multi_scattering_texture,
+    const SkyViewTexture& sky_view_texture,
+    Position camera, const Direction& view_ray,
+    const Direction& sun_direction, DimensionlessSpectrum& transmittance);
+
+IrradianceSpectrum GetFastSunAndSkyIrradiance(
+    const AtmosphereParameters& atmosphere,
+    const TransmittanceTexture& transmittance_texture,
+    const MultiScatteringTexture& multi_scattering_texture,
+    const Position& point, const Direction& normal,
+    const Direction& sun_direction, IrradianceSpectrum& sky_irradiance);
+
 }  // namespace reference
 }  // namespace atmosphere
 
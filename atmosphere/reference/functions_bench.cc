@@ -0,0 +1,455 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/functions_bench.cc</h2>
+
+<p>This file provides microbenchmarks for the C++ version of the <a href=
+"../functions.glsl.html">GLSL functions</a> that implement our atmosphere
+model. Each function is called on a fixed set of pseudo random, but realistic,
+$(r,\mu,\mu_s,\nu)$ input values, first to warm up the caches and to find how
+many calls are needed to get a measurable duration, and then several times to
+get statistics about the time per call. The results are printed on the standard
+output and, optionally, saved in a JSON file to track performance regressions
+over time. The command line syntax is
+<pre>
+atmosphere_bench [--filter=&lt;substring&gt;] [--repetitions=&lt;n&gt;]
+    [--label=&lt;label&gt;] [&lt;output.json&gt;]
+</pre>
+where <code>--filter</code> selects the functions whose name contains the
+given substring, and <code>--label</code> gives an arbitrary string (e.g. a
+commit ID) which is copied in the JSON output. The <code>atmosphere_bench</code>
+target of the Makefile (or its <code>bench</code> alias) builds and runs this
+program, labeled with the current commit ID.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "atmosphere/constants.h"
+#include "atmosphere/reference/benchmark.h"
+#include "atmosphere/reference/definitions.h"
+#include "atmosphere/reference/functions.h"
+
+namespace atmosphere {
+namespace reference {
+
+namespace {
+
+constexpr unsigned int kNumSamples = 128;
+constexpr unsigned int kDefaultRepetitions = 10;
+constexpr double kMinRepetitionTime = 0.01;  // seconds
+constexpr int kScatteringOrder = 2;
+
+/*
+<h3>Inputs</h3>
+
+<p>The atmosphere parameters are provided by
+<a href="benchmark.h.html">benchmark.h</a>. The input values are generated from
+a fixed seed, so that all the runs use the same values. The altitude is biased
+towards the ground, where most viewers are, the view and Sun directions are
+uniformly distributed on the sphere (for the Sun, above the minimum Sun zenith
+angle), and the distance $d$ used by the functions computing values along a
+segment is uniformly distributed between 0 and the distance to the nearest
+atmosphere boundary. The corresponding camera position, view ray and Sun
+direction are also precomputed for the rendering functions:
+*/
+
+struct Sample {
+  Length r;
+  Number mu;
+  Number mu_s;
+  Number nu;
+  bool ray_r_mu_intersects_ground;
+  Length d;
+  Position camera;
+  Direction view_ray;
+  Direction sun_direction;
+};
+
+std::vector<Sample> GenerateSamples(const AtmosphereParameters& atmosphere,
+    unsigned int num_samples) {
+  std::mt19937 generator(12345);
+  std::uniform_real_distribution<double> random(0.0, 1.0);
+  const Length h_top = atmosphere.top_radius - atmosphere.bottom_radius;
+  std::vector<Sample> samples;
+  for (unsigned int i = 0; i < num_samples; ++i) {
+    Sample s;
+    double u = random(generator);
+    s.r = atmosphere.bottom_radius + h_top * (u * u);
+    s.mu = 2.0 * random(generator) - 1.0;
+    s.mu_s = atmosphere.mu_s_min() +
+        (1.0 - atmosphere.mu_s_min()) * random(generator);
+    Angle phi = 2.0 * pi * random(generator);
+    Number sin_mu = sqrt(1.0 - s.mu * s.mu);
+    Number sin_mu_s = sqrt(1.0 - s.mu_s * s.mu_s);
+    s.nu = s.mu * s.mu_s + sin_mu * sin_mu_s * cos(phi);
+    s.ray_r_mu_intersects_ground = RayIntersectsGround(atmosphere, s.r, s.mu);
+    s.d = DistanceToNearestAtmosphereBoundary(
+        atmosphere, s.r, s.mu, s.ray_r_mu_intersects_ground) *
+            random(generator);
+    s.camera = Position(0.0 * m, 0.0 * m, s.r);
+    s.view_ray = Direction(sin_mu, 0.0, s.mu);
+    s.sun_direction =
+        Direction(sin_mu_s * cos(phi), sin_mu_s * sin(phi), s.mu_s);
+    samples.push_back(s);
+  }
+  return samples;
+}
+
+/*
+<h3>Benchmark runner</h3>
+
+<p>Each benchmarked function is wrapped in a function taking a sample as input
+and returning a number derived from the result. The runner accumulates these
+numbers in a volatile variable, to make sure that the compiler does not
+optimize the function calls away. Each repetition calls the function at least
+once on each sample, so that the results are representative of the whole input
+distribution. The runner first doubles the number of calls per repetition until
+a repetition lasts at least <code>kMinRepetitionTime</code> (which also serves
+as warmup), and then measures the requested number of repetitions:
+*/
+
+typedef std::function<double(const Sample&)> BenchmarkFunction;
+
+struct BenchmarkResult {
+  std::string name;
+  unsigned int iterations;
+  double min_ns;
+  double median_ns;
+  double mean_ns;
+  double stddev_ns;
+  double max_ns;
+};
+
+class BenchmarkRunner {
+ public:
+  BenchmarkRunner(const std::vector<Sample>& samples, const std::string& filter,
+      unsigned int repetitions)
+      : samples_(samples), filter_(filter), repetitions_(repetitions),
+        sink_(0.0) {}
+
+  void Run(const std::string& name, const BenchmarkFunction& function) {
+    if (!IsEnabled(name)) {
+      return;
+    }
+    unsigned int iterations = samples_.size();
+    while (RunIterations(function, iterations) < kMinRepetitionTime) {
+      iterations *= 2;
+    }
+    std::vector<double> ns_per_call;
+    for (unsigned int i = 0; i < repetitions_; ++i) {
+      ns_per_call.push_back(
+          RunIterations(function, iterations) * 1e9 / iterations);
+    }
+    std::sort(ns_per_call.begin(), ns_per_call.end());
+
+    BenchmarkResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.min_ns = ns_per_call.front();
+    result.max_ns = ns_per_call.back();
+    unsigned int n = ns_per_call.size();
+    result.median_ns = n % 2 == 1 ? ns_per_call[n / 2] :
+        0.5 * (ns_per_call[n / 2 - 1] + ns_per_call[n / 2]);
+    double sum = 0.0;
+    for (double t : ns_per_call) {
+      sum += t;
+    }
+    result.mean_ns = sum / n;
+    double variance = 0.0;
+    for (double t : ns_per_call) {
+      variance += (t - result.mean_ns) * (t - result.mean_ns);
+    }
+    result.stddev_ns = n > 1 ? std::sqrt(variance / (n - 1)) : 0.0;
+    results_.push_back(result);
+
+    std::printf("%-45s %12.1f ns %12.1f ns %8.2f%%  (%u calls)\n",
+        name.c_str(), result.median_ns, result.min_ns,
+        100.0 * result.stddev_ns / result.mean_ns, iterations);
+    std::fflush(stdout);
+  }
+
+  bool IsEnabled(const std::string& name) const {
+    return name.find(filter_) != std::string::npos;
+  }
+
+  const std::vector<BenchmarkResult>& results() const { return results_; }
+
+ private:
+  double RunIterations(const BenchmarkFunction& function,
+      unsigned int iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; ++i) {
+      sink_ = sink_ + function(samples_[i % samples_.size()]);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+  }
+
+  const std::vector<Sample>& samples_;
+  const std::string filter_;
+  const unsigned int repetitions_;
+  volatile double sink_;
+  std::vector<BenchmarkResult> results_;
+};
+
+/*
+<p>The results are saved in the following JSON format (one entry per function,
+with all times in nanoseconds per call):
+*/
+
+void SaveResults(const std::string& filename, const std::string& label,
+    unsigned int repetitions, const std::vector<BenchmarkResult>& results) {
+  std::ofstream file(filename);
+  file << "{\n";
+  file << "  \"context\": {\n";
+  file << "    \"date\": \"" << GetCurrentDate() << "\",\n";
+  file << "    \"label\": \"" << label << "\",\n";
+  file << "    \"build_type\": \"" << GetBuildType() << "\",\n";
+  file << "    \"num_samples\": " << kNumSamples << ",\n";
+  file << "    \"repetitions\": " << repetitions << ",\n";
+  file << "    \"time_unit\": \"ns\"\n";
+  file << "  },\n";
+  file << "  \"benchmarks\": [\n";
+  for (unsigned int i = 0; i < results.size(); ++i) {
+    const BenchmarkResult& result = results[i];
+    file << "    {\n";
+    file << "      \"name\": \"" << result.name << "\",\n";
+    file << "      \"iterations\": " << result.iterations << ",\n";
+    file << "      \"min\": " << result.min_ns << ",\n";
+    file << "      \"median\": " << result.median_ns << ",\n";
+    file << "      \"mean\": " << result.mean_ns << ",\n";
+    file << "      \"stddev\": " << result.stddev_ns << ",\n";
+    file << "      \"max\": " << result.max_ns << "\n";
+    file << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  file << "  ]\n";
+  file << "}\n";
+}
+
+/*
+<h3>Benchmarks</h3>
+
+<p>Some functions need precomputed textures as input. Computing them completely
+would take much longer than the benchmarks themselves, and their cost does not
+depend on the texel values. We thus only precompute the transmittance texture
+(which is fast), and use textures with constant values for the others. Since
+the scattering textures are large, we allocate them only if needed by the
+selected benchmarks, and only for the duration of these benchmarks:
+*/
+
+void RunBenchmarks(const AtmosphereParameters& atmosphere,
+    BenchmarkRunner* runner) {
+  constexpr SpectralRadiance kRadianceUnit =
+      watt_per_square_meter_per_sr_per_nm;
+  constexpr SpectralIrradiance kIrradianceUnit = watt_per_square_meter_per_nm;
+  std::unique_ptr<TransmittanceTexture> transmittance_texture(
+      new TransmittanceTexture());
+  for (int j = 0; j < TRANSMITTANCE_TEXTURE_HEIGHT; ++j) {
+    for (int i = 0; i < TRANSMITTANCE_TEXTURE_WIDTH; ++i) {
+      transmittance_texture->Set(i, j,
+          ComputeTransmittanceToTopAtmosphereBoundaryTexture(
+              atmosphere, vec2(i + 0.5, j + 0.5)));
+    }
+  }
+  const TransmittanceTexture& transmittance = *transmittance_texture;
+  const IrradianceTexture irradiance(IrradianceSpectrum(0.1 * kIrradianceUnit));
+  const MultiScatteringTexture multi_scattering(
+      RadianceSpectrum(0.01 * kRadianceUnit));
+  const SkyViewTexture sky_view(RadianceSpectrum(0.1 * kRadianceUnit));
+
+  // Transmittance.
+  runner->Run("ComputeTransmittanceToTopAtmosphereBoundary",
+      [&](const Sample& s) {
+        return ComputeTransmittanceToTopAtmosphereBoundary(
+            atmosphere, s.r, s.mu)[0]();
+      });
+  runner->Run("GetTransmittanceToTopAtmosphereBoundary", [&](const Sample& s) {
+    return GetTransmittanceToTopAtmosphereBoundary(
+        atmosphere, transmittance, s.r, s.mu)[0]();
+  });
+  runner->Run("GetTransmittance", [&](const Sample& s) {
+    return GetTransmittance(atmosphere, transmittance, s.r, s.mu, s.d,
+        s.ray_r_mu_intersects_ground)[0]();
+  });
+
+  // Single scattering.
+  runner->Run("ComputeSingleScattering", [&](const Sample& s) {
+    IrradianceSpectrum rayleigh;
+    IrradianceSpectrum mie;
+    ComputeSingleScattering(atmosphere, transmittance, s.r, s.mu, s.mu_s, s.nu,
+        s.ray_r_mu_intersects_ground, rayleigh, mie);
+    return (rayleigh[0] + mie[0]).to(kIrradianceUnit);
+  });
+  runner->Run("ComputeDirectIrradiance", [&](const Sample& s) {
+    return ComputeDirectIrradiance(
+        atmosphere, transmittance, s.r, s.mu_s)[0].to(kIrradianceUnit);
+  });
+
+  // Multiple scattering, and rendering with the full scattering textures.
+  if (runner->IsEnabled("GetScattering") ||
+      runner->IsEnabled("ComputeScatteringDensity") ||
+      runner->IsEnabled("ComputeIndirectIrradiance") ||
+      runner->IsEnabled("GetSkyRadiance") ||
+      runner->IsEnabled("GetSkyRadianceToPoint")) {
+    std::unique_ptr<ReducedScatteringTexture> single_rayleigh(
+        new ReducedScatteringTexture(
+            IrradianceSpectrum(0.1 * kIrradianceUnit)));
+    std::unique_ptr<ReducedScatteringTexture> single_mie(
+        new ReducedScatteringTexture(
+            IrradianceSpectrum(0.01 * kIrradianceUnit)));
+    std::unique_ptr<ScatteringTexture> multiple(
+        new ScatteringTexture(RadianceSpectrum(0.01 * kRadianceUnit)));
+
+    runner->Run("GetScattering", [&](const Sample& s) {
+      return GetScattering(atmosphere, *single_rayleigh, *single_mie,
+          *multiple, s.r, s.mu, s.mu_s, s.nu, s.ray_r_mu_intersects_ground,
+          kScatteringOrder)[0].to(kRadianceUnit);
+    });
+    runner->Run("ComputeScatteringDensity", [&](const Sample& s) {
+      return ComputeScatteringDensity(atmosphere, transmittance,
+          *single_rayleigh, *single_mie, *multiple, irradiance,
+          s.r, s.mu, s.mu_s, s.nu,
+          kScatteringOrder)[0].to(watt_per_cubic_meter_per_sr_per_nm);
+    });
+    runner->Run("ComputeIndirectIrradiance", [&](const Sample& s) {
+      return ComputeIndirectIrradiance(atmosphere, *single_rayleigh,
+          *single_mie, *multiple, s.r, s.mu_s, kScatteringOrder)[0].to(
+              kIrradianceUnit);
+    });
+    runner->Run("GetSkyRadiance", [&](const Sample& s) {
+      DimensionlessSpectrum transmittance_to_top;
+      return GetSkyRadiance(atmosphere, transmittance, *single_rayleigh,
+          *single_mie, s.camera, s.view_ray, 0.0 * m, s.sun_direction,
+          transmittance_to_top)[0].to(kRadianceUnit);
+    });
+    runner->Run("GetSkyRadianceToPoint", [&](const Sample& s) {
+      DimensionlessSpectrum transmittance_to_point;
+      return GetSkyRadianceToPoint(atmosphere, transmittance, *single_rayleigh,
+          *single_mie, s.camera, s.camera + s.view_ray * s.d, 0.0 * m,
+          s.sun_direction, transmittance_to_point)[0].to(kRadianceUnit);
+    });
+  }
+  if (runner->IsEnabled("ComputeMultipleScattering")) {
+    std::unique_ptr<ScatteringDensityTexture> scattering_density(
+        new ScatteringDensityTexture(RadianceDensitySpectrum(
+            1e-6 * watt_per_cubic_meter_per_sr_per_nm)));
+    runner->Run("ComputeMultipleScattering", [&](const Sample& s) {
+      return ComputeMultipleScattering(atmosphere, transmittance,
+          *scattering_density, s.r, s.mu, s.mu_s, s.nu,
+          s.ray_r_mu_intersects_ground)[0].to(kRadianceUnit);
+    });
+  }
+  runner->Run("GetSunAndSkyIrradiance", [&](const Sample& s) {
+    IrradianceSpectrum sky_irradiance;
+    return GetSunAndSkyIrradiance(atmosphere, transmittance, irradiance,
+        s.camera, Direction(0.0, 0.0, 1.0), s.sun_direction,
+        sky_irradiance)[0].to(kIrradianceUnit);
+  });
+
+  // Fast precomputation mode.
+  runner->Run("ComputeMultiScattering", [&](const Sample& s) {
+    return ComputeMultiScattering(
+        atmosphere, transmittance, s.r, s.mu_s)[0].to(kRadianceUnit);
+  });
+  runner->Run("GetSkyView", [&](const Sample& s) {
+    return GetSkyView(atmosphere, sky_view, s.r, s.mu, s.mu_s, s.nu,
+        s.ray_r_mu_intersects_ground)[0].to(kRadianceUnit);
+  });
+  runner->Run("GetFastSkyRadiance", [&](const Sample& s) {
+    DimensionlessSpectrum transmittance_to_top;
+    return GetFastSkyRadiance(atmosphere, transmittance, multi_scattering,
+        sky_view, s.camera, s.view_ray, s.sun_direction,
+        transmittance_to_top)[0].to(kRadianceUnit);
+  });
+}
+
+}  // anonymous namespace
+
+}  // namespace reference
+}  // namespace atmosphere
+
+/*
+<h3>Main function</h3>
+
+<p>Finally, the main function parses the command line arguments, runs the
+selected benchmarks, and saves the results:
+*/
+
+using atmosphere::reference::AtmosphereParameters;
+using atmosphere::reference::BenchmarkRunner;
+using atmosphere::reference::GenerateSamples;
+using atmosphere::reference::GetBenchmarkAtmosphereParameters;
+using atmosphere::reference::RunBenchmarks;
+using atmosphere::reference::Sample;
+using atmosphere::reference::SaveResults;
+using atmosphere::reference::kDefaultRepetitions;
+using atmosphere::reference::kNumSamples;
+
+int main(int argc, char** argv) {
+  std::string filter;
+  std::string label;
+  std::string output_filename;
+  unsigned int repetitions = kDefaultRepetitions;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.compare(0, 9, "--filter=") == 0) {
+      filter = arg.substr(9);
+    } else if (arg.compare(0, 8, "--label=") == 0) {
+      label = arg.substr(8);
+    } else if (arg.compare(0, 14, "--repetitions=") == 0) {
+      repetitions = std::max(1, std::atoi(arg.substr(14).c_str()));
+    } else if (arg.compare(0, 2, "--") != 0 && output_filename.empty()) {
+      output_filename = arg;
+    } else {
+      std::fprintf(stderr, "Usage: %s [--filter=<substring>] "
+          "[--repetitions=<n>] [--label=<label>] [<output.json>]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  const AtmosphereParameters atmosphere = GetBenchmarkAtmosphereParameters();
+  const std::vector<Sample> samples = GenerateSamples(atmosphere, kNumSamples);
+  BenchmarkRunner runner(samples, filter, repetitions);
+  std::printf("%-45s %15s %15s %9s\n", "Function", "Median", "Min", "Stddev");
+  RunBenchmarks(atmosphere, &runner);
+  if (!output_filename.empty()) {
+    SaveResults(output_filename, label, repetitions, runner.results());
+  }
+  return 0;
+}
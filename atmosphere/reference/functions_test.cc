@@ -40,6 +40,7 @@ of some (arbitrary) values for the atmosphere parameters:
 #include <string>
 
 #include "atmosphere/reference/definitions.h"
+#include "atmosphere/reference/lazy_textures.h"
 #include "atmosphere/constants.h"
 #include "test/test_case.h"
 
@@ -74,219 +75,9 @@ Number CosineOfHorizonZenithAngle(Length r) {
 /*
 <p>Some unit tests need a precomputed texture as input, but we don't want to
 precompute a whole texture for that, for efficiency reasons. Our solution is to
-provide lazily computed textures instead, i.e. textures whose texels are
-computed the first time we try to read them. The first type of texture we need
-is a lazy transmittance texture (negative values mean "not yet computed"):
-*/
+use the <a href="lazy_textures.h.html">lazy textures</a> instead, i.e. textures
+whose texels are computed the first time we try to read them.
 
-class LazyTransmittanceTexture :
-    public dimensional::BinaryFunction<TRANSMITTANCE_TEXTURE_WIDTH,
-                                       TRANSMITTANCE_TEXTURE_HEIGHT,
-                                       DimensionlessSpectrum> {
- public:
-  explicit LazyTransmittanceTexture(
-      const AtmosphereParameters& atmosphere_parameters)
-    : BinaryFunction(DimensionlessSpectrum(-1.0)),
-      atmosphere_parameters_(atmosphere_parameters) {
-  }
-
-  virtual const DimensionlessSpectrum& Get(int i, int j) const {
-    int index = i + j * TRANSMITTANCE_TEXTURE_HEIGHT;
-    if (value_[index][0]() < 0.0) {
-      value_[index] = ComputeTransmittanceToTopAtmosphereBoundaryTexture(
-          atmosphere_parameters_, vec2(i + 0.5, j + 0.5));
-    }
-    return value_[index];
-  }
-
-  void Clear() {
-    constexpr unsigned int n =
-        TRANSMITTANCE_TEXTURE_WIDTH * TRANSMITTANCE_TEXTURE_HEIGHT;
-    for (unsigned int i = 0; i < n; ++i) {
-      value_[i] = DimensionlessSpectrum(-1.0);
-    }
-  }
-
- private:
-  const AtmosphereParameters& atmosphere_parameters_;
-};
-
-/*
-<p>We also need a lazy single scattering texture:
-*/
-
-class LazySingleScatteringTexture :
-    public dimensional::TernaryFunction<SCATTERING_TEXTURE_WIDTH,
-                                        SCATTERING_TEXTURE_HEIGHT,
-                                        SCATTERING_TEXTURE_DEPTH,
-                                        IrradianceSpectrum> {
- public:
-  LazySingleScatteringTexture(
-      const AtmosphereParameters& atmosphere_parameters,
-      const TransmittanceTexture& transmittance_texture,
-      bool rayleigh)
-      : TernaryFunction(IrradianceSpectrum(-watt_per_square_meter_per_nm)),
-        atmosphere_parameters_(atmosphere_parameters),
-        transmittance_texture_(transmittance_texture),
-        rayleigh_(rayleigh) {
-  }
-
-  virtual const IrradianceSpectrum& Get(int i, int j, int k) const {
-    int index =
-        i + SCATTERING_TEXTURE_WIDTH * (j + SCATTERING_TEXTURE_HEIGHT * k);
-    if (value_[index][0] < 0.0 * watt_per_square_meter_per_nm) {
-      IrradianceSpectrum rayleigh;
-      IrradianceSpectrum mie;
-      ComputeSingleScatteringTexture(atmosphere_parameters_,
-          transmittance_texture_, vec3(i + 0.5, j + 0.5, k + 0.5),
-          rayleigh, mie);
-      value_[index] = rayleigh_ ? rayleigh : mie;
-    }
-    return value_[index];
-  }
-
- private:
-  const AtmosphereParameters& atmosphere_parameters_;
-  const TransmittanceTexture& transmittance_texture_;
-  const bool rayleigh_;
-};
-
-/*
-<p>a lazy multiple scattering texture, for step 1:
-*/
-
-class LazyScatteringDensityTexture :
-    public dimensional::TernaryFunction<SCATTERING_TEXTURE_WIDTH,
-                                        SCATTERING_TEXTURE_HEIGHT,
-                                        SCATTERING_TEXTURE_DEPTH,
-                                        RadianceDensitySpectrum> {
- public:
-  LazyScatteringDensityTexture(
-      const AtmosphereParameters& atmosphere_parameters,
-      const TransmittanceTexture& transmittance_texture,
-      const ReducedScatteringTexture& single_rayleigh_scattering_texture,
-      const ReducedScatteringTexture& single_mie_scattering_texture,
-      const ScatteringTexture& multiple_scattering_texture,
-      const IrradianceTexture& irradiance_texture,
-      const int order)
-      : TernaryFunction(
-            RadianceDensitySpectrum(-watt_per_cubic_meter_per_sr_per_nm)),
-        atmosphere_parameters_(atmosphere_parameters),
-        transmittance_texture_(transmittance_texture),
-        single_rayleigh_scattering_texture_(single_rayleigh_scattering_texture),
-        single_mie_scattering_texture_(single_mie_scattering_texture),
-        multiple_scattering_texture_(multiple_scattering_texture),
-        irradiance_texture_(irradiance_texture),
-        order_(order) {
-  }
-
-  virtual const RadianceDensitySpectrum& Get(int i, int j, int k) const {
-    int index =
-        i + SCATTERING_TEXTURE_WIDTH * (j + SCATTERING_TEXTURE_HEIGHT * k);
-    if (value_[index][0] < 0.0 * watt_per_cubic_meter_per_sr_per_nm) {
-      value_[index] = ComputeScatteringDensityTexture(
-          atmosphere_parameters_, transmittance_texture_,
-          single_rayleigh_scattering_texture_, single_mie_scattering_texture_,
-          multiple_scattering_texture_, irradiance_texture_,
-          vec3(i + 0.5, j + 0.5, k + 0.5), order_);
-    }
-    return value_[index];
-  }
-
- private:
-  const AtmosphereParameters& atmosphere_parameters_;
-  const TransmittanceTexture& transmittance_texture_;
-  const ReducedScatteringTexture& single_rayleigh_scattering_texture_;
-  const ReducedScatteringTexture& single_mie_scattering_texture_;
-  const ScatteringTexture& multiple_scattering_texture_;
-  const IrradianceTexture& irradiance_texture_;
-  const int order_;
-};
-
-
-/*
-<p>and step 2 of the multiple scattering computations:
-*/
-
-class LazyMultipleScatteringTexture :
-    public dimensional::TernaryFunction<SCATTERING_TEXTURE_WIDTH,
-                                        SCATTERING_TEXTURE_HEIGHT,
-                                        SCATTERING_TEXTURE_DEPTH,
-                                        RadianceSpectrum> {
- public:
-  LazyMultipleScatteringTexture(
-      const AtmosphereParameters& atmosphere_parameters,
-      const TransmittanceTexture& transmittance_texture,
-      const ScatteringDensityTexture& scattering_density_texture)
-      : TernaryFunction(RadianceSpectrum(-watt_per_square_meter_per_sr_per_nm)),
-        atmosphere_parameters_(atmosphere_parameters),
-        transmittance_texture_(transmittance_texture),
-        scattering_density_texture_(scattering_density_texture) {
-  }
-
-  virtual const RadianceSpectrum& Get(int i, int j, int k) const {
-    int index =
-        i + SCATTERING_TEXTURE_WIDTH * (j + SCATTERING_TEXTURE_HEIGHT * k);
-    if (value_[index][0] < 0.0 * watt_per_square_meter_per_sr_per_nm) {
-      Number ignored;
-      value_[index] = ComputeMultipleScatteringTexture(atmosphere_parameters_,
-          transmittance_texture_, scattering_density_texture_,
-          vec3(i + 0.5, j + 0.5, k + 0.5), ignored);
-    }
-    return value_[index];
-  }
-
- private:
-  const AtmosphereParameters& atmosphere_parameters_;
-  const TransmittanceTexture& transmittance_texture_;
-  const ScatteringDensityTexture& scattering_density_texture_;
-};
-
-/*
-<p>and, finally, a lazy ground irradiance texture:
-*/
-
-class LazyIndirectIrradianceTexture :
-    public dimensional::BinaryFunction<IRRADIANCE_TEXTURE_WIDTH,
-                                       IRRADIANCE_TEXTURE_HEIGHT,
-                                       IrradianceSpectrum> {
- public:
-  LazyIndirectIrradianceTexture(
-      const AtmosphereParameters& atmosphere_parameters,
-      const ReducedScatteringTexture& single_rayleigh_scattering_texture,
-      const ReducedScatteringTexture& single_mie_scattering_texture,
-      const ScatteringTexture& multiple_scattering_texture,
-      int scattering_order)
-      : BinaryFunction(IrradianceSpectrum(-watt_per_square_meter_per_nm)),
-        atmosphere_parameters_(atmosphere_parameters),
-        single_rayleigh_scattering_texture_(single_rayleigh_scattering_texture),
-        single_mie_scattering_texture_(single_mie_scattering_texture),
-        multiple_scattering_texture_(multiple_scattering_texture),
-        scattering_order_(scattering_order) {
-  }
-
-  virtual const IrradianceSpectrum& Get(int i, int j) const {
-    int index = i + j * IRRADIANCE_TEXTURE_HEIGHT;
-    if (value_[index][0] < 0.0 * watt_per_square_meter_per_nm) {
-      value_[index] = ComputeIndirectIrradianceTexture(atmosphere_parameters_,
-          single_rayleigh_scattering_texture_,
-          single_mie_scattering_texture_,
-          multiple_scattering_texture_,
-          vec2(i + 0.5, j + 0.5),
-          scattering_order_);
-    }
-    return value_[index];
-  }
-
- private:
-  const AtmosphereParameters& atmosphere_parameters_;
-  const ReducedScatteringTexture& single_rayleigh_scattering_texture_;
-  const ReducedScatteringTexture& single_mie_scattering_texture_;
-  const ScatteringTexture& multiple_scattering_texture_;
-  int scattering_order_;
-};
-
-/*
 <p>We can now define the unit tests themselves. Each test is an instance of the
 following <code>TestCase</code> subclass, which has an
 <code>atmosphere_parameters_</code> field initialized from the above constants.
@@ -1442,6 +1233,181 @@ in the precomputed ground irradiance texture.
         kEpsilon);
   }
 
+/*
+<h3 id="fast_mode">Fast precomputation mode</h3>
+
+<p>The following tests check the functions of the fast precomputation mode,
+defined in <a href="../fast_functions.glsl.html">fast_functions.glsl</a>.
+
+<p><i>Mapping to and from multiple scattering texture coordinates</i>: check
+that the boundary values of $r$ and $\mu_s$ are mapped to the centers of the
+boundary texels of the multiple scattering texture, and that a lookup at the
+center of a texel returns the value of this texel.
+*/
+
+  void TestMultiScatteringTextureMapping() {
+    ExpectNear(
+        0.5 / MULTI_SCATTERING_TEXTURE_HEIGHT,
+        GetMultiScatteringTextureUvFromRMuS(
+            atmosphere_parameters_, kBottomRadius, 0.0).y(),
+        kEpsilon);
+    ExpectNear(
+        1.0 - 0.5 / MULTI_SCATTERING_TEXTURE_HEIGHT,
+        GetMultiScatteringTextureUvFromRMuS(
+            atmosphere_parameters_, kTopRadius, 0.0).y(),
+        kEpsilon);
+    ExpectNear(
+        0.5 / MULTI_SCATTERING_TEXTURE_WIDTH,
+        GetMultiScatteringTextureUvFromRMuS(
+            atmosphere_parameters_, kBottomRadius, -1.0).x(),
+        kEpsilon);
+    ExpectNear(
+        1.0 - 0.5 / MULTI_SCATTERING_TEXTURE_WIDTH,
+        GetMultiScatteringTextureUvFromRMuS(
+            atmosphere_parameters_, kBottomRadius, 1.0).x(),
+        kEpsilon);
+
+    LazyTransmittanceTexture transmittance_texture(atmosphere_parameters_);
+    MultiScatteringTexture multi_scattering_texture(
+        RadianceSpectrum(0.0 * watt_per_square_meter_per_sr_per_nm));
+    const int i = 7;
+    const int j = 11;
+    multi_scattering_texture.Set(i, j, ComputeMultiScatteringTexture(
+        atmosphere_parameters_, transmittance_texture, vec2(i + 0.5, j + 0.5)));
+    Length r;
+    Number mu_s;
+    GetRMuSFromMultiScatteringTextureUv(atmosphere_parameters_,
+        vec2((i + 0.5) / MULTI_SCATTERING_TEXTURE_WIDTH,
+             (j + 0.5) / MULTI_SCATTERING_TEXTURE_HEIGHT),
+        r, mu_s);
+    RadianceSpectrum expected = ComputeMultiScattering(
+        atmosphere_parameters_, transmittance_texture, r, mu_s);
+    ExpectLess(0.0, expected[0].to(watt_per_square_meter_per_sr_per_nm));
+    ExpectNear(
+        1.0,
+        (GetMultiScattering(atmosphere_parameters_, multi_scattering_texture,
+            r, mu_s) / expected)[0](),
+        kEpsilon);
+  }
+
+/*
+<p><i>Mapping to and from sky view texture coordinates</i>: check that the
+horizon is mapped to the middle of the texture, and that the view directions
+above and below the horizon are mapped back to themselves.
+*/
+
+  void TestSkyViewTextureMapping() {
+    const Length r = kBottomRadius * 0.9 + kTopRadius * 0.1;
+    const Number mu_s = 0.3;
+    const Number mu_horizon = CosineOfHorizonZenithAngle(r);
+    ExpectNear(
+        0.5,
+        GetSkyViewTextureUvFromRMuMuSNu(
+            atmosphere_parameters_, r, mu_horizon, mu_s, mu_s * mu_horizon,
+            false).y(),
+        kEpsilon);
+    const Number kMus[4] = {-0.9, mu_horizon - 0.01, mu_horizon + 0.01, 0.6};
+    for (Number mu : kMus) {
+      bool ray_r_mu_intersects_ground =
+          RayIntersectsGround(atmosphere_parameters_, r, mu);
+      for (double cos_phi : {-0.8, 0.1, 0.7}) {
+        Number nu = mu * mu_s +
+            sqrt((1.0 - mu * mu) * (1.0 - mu_s * mu_s)) * cos_phi;
+        vec2 uv = GetSkyViewTextureUvFromRMuMuSNu(
+            atmosphere_parameters_, r, mu, mu_s, nu,
+            ray_r_mu_intersects_ground);
+        Number mu2;
+        Number nu2;
+        bool ray_r_mu_intersects_ground2;
+        GetMuNuFromSkyViewTextureUv(atmosphere_parameters_, uv, r, mu_s,
+            mu2, nu2, ray_r_mu_intersects_ground2);
+        ExpectNear(mu, mu2, Number(kEpsilon));
+        ExpectNear(nu, nu2, Number(kEpsilon));
+        ExpectTrue(ray_r_mu_intersects_ground == ray_r_mu_intersects_ground2);
+      }
+    }
+  }
+
+/*
+<p><i>Scattered radiance</i>: check that, without multiple scattering, the
+integration in <code>ComputeScatteredRadiance</code> gives the same result as
+<code>ComputeSingleScattering</code> (times the phase functions), for a vertical
+ray from the ground with the Sun at the zenith (see
+<code>TestComputeSingleScattering</code>), and that the transmittance along the
+ray is the expected one.
+*/
+
+  void TestComputeScatteredRadiance() {
+    LazyTransmittanceTexture transmittance_texture(atmosphere_parameters_);
+    MultiScatteringTexture no_multi_scattering(
+        RadianceSpectrum(0.0 * watt_per_square_meter_per_sr_per_nm));
+    const Length h_top = kTopRadius - kBottomRadius;
+    DimensionlessSpectrum transmittance;
+    RadianceSpectrum radiance = ComputeScatteredRadiance(
+        atmosphere_parameters_, transmittance_texture, no_multi_scattering,
+        kBottomRadius, 1.0, 1.0, 1.0, h_top, 30 /* sample_count */,
+        transmittance);
+    IrradianceSpectrum rayleigh;
+    IrradianceSpectrum mie;
+    ComputeSingleScattering(
+        atmosphere_parameters_, transmittance_texture,
+        kBottomRadius, 1.0, 1.0, 1.0, false, rayleigh, mie);
+    RadianceSpectrum expected = rayleigh * RayleighPhaseFunction(1.0) +
+        mie * MiePhaseFunction(
+            atmosphere_parameters_.mie_phase_function_g, 1.0);
+    ExpectNear(1.0, (radiance / expected)[0](), 10.0 * kEpsilon);
+
+    Number rayleigh_optical_depth = kRayleighScattering * kRayleighScaleHeight *
+        (1.0 - exp(-h_top / kRayleighScaleHeight));
+    Number mie_optical_depth = kMieExtinction * kMieScaleHeight *
+        (1.0 - exp(-h_top / kMieScaleHeight));
+    ExpectNear(
+        exp(-rayleigh_optical_depth - mie_optical_depth),
+        transmittance[0],
+        Number(kEpsilon));
+  }
+
+/*
+<p><i>Aerial perspective lookup</i>: check that a lookup at the center of a
+slice returns the texture values, and that the results are interpolated linearly
+towards no in-scattering and a unit transmittance between the first slice and
+the viewer.
+*/
+
+  void TestGetAerialPerspective() {
+    const Length max_distance = 100.0 * km;
+    const RadianceSpectrum kRadiance =
+        RadianceSpectrum(2.0 * watt_per_square_meter_per_sr_per_nm);
+    const DimensionlessSpectrum kTransmittance = DimensionlessSpectrum(0.5);
+    AerialPerspectiveScatteringTexture scattering_texture(kRadiance);
+    AerialPerspectiveTransmittanceTexture transmittance_texture(
+        kTransmittance);
+    const vec2 uv(0.3, 0.6);
+    DimensionlessSpectrum transmittance;
+    Length d = GetAerialPerspectiveDistanceFromTextureCoord(
+        3.5 / AERIAL_PERSPECTIVE_TEXTURE_DEPTH, max_distance);
+    ExpectNear(
+        3.5 / AERIAL_PERSPECTIVE_TEXTURE_DEPTH,
+        GetAerialPerspectiveTextureCoordFromDistance(d, max_distance)(),
+        kEpsilon);
+    RadianceSpectrum radiance = GetAerialPerspective(scattering_texture,
+        transmittance_texture, uv, d, max_distance, transmittance);
+    ExpectNear(1.0, (radiance / kRadiance)[0](), kEpsilon);
+    ExpectNear(0.5, transmittance[0](), kEpsilon);
+
+    d = GetAerialPerspectiveDistanceFromTextureCoord(
+        0.25 / AERIAL_PERSPECTIVE_TEXTURE_DEPTH, max_distance);
+    radiance = GetAerialPerspective(scattering_texture,
+        transmittance_texture, uv, d, max_distance, transmittance);
+    ExpectNear(0.5, (radiance / kRadiance)[0](), kEpsilon);
+    ExpectNear(0.75, transmittance[0](), kEpsilon);
+
+    radiance = GetAerialPerspective(scattering_texture,
+        transmittance_texture, uv, 0.0 * m, max_distance, transmittance);
+    ExpectNear(0.0, (radiance / kRadiance)[0](), kEpsilon);
+    ExpectNear(1.0, transmittance[0](), kEpsilon);
+  }
+
 /*
 <p>And that's it for the unit tests! We just need to implement the two methods
 that we used above to set a uniform density of air molecules and aerosols, and
@@ -1556,6 +1522,19 @@ FunctionsTest get_irradiance(
     "GetComputeAndGetIrradiance",
     &FunctionsTest::TestComputeAndGetIrradiance);
 
+FunctionsTest multi_scattering_texture_mapping(
+    "MultiScatteringTextureMapping",
+    &FunctionsTest::TestMultiScatteringTextureMapping);
+FunctionsTest sky_view_texture_mapping(
+    "SkyViewTextureMapping",
+    &FunctionsTest::TestSkyViewTextureMapping);
+FunctionsTest compute_scattered_radiance(
+    "ComputeScatteredRadiance",
+    &FunctionsTest::TestComputeScatteredRadiance);
+FunctionsTest get_aerial_perspective(
+    "GetAerialPerspective",
+    &FunctionsTest::TestGetAerialPerspective);
+
 }  // anonymous namespace
 
 }  // namespace reference
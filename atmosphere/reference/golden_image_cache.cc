@@ -0,0 +1,169 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/golden_image_cache.cc</h2>
+
+<p>This file implements the <a href="golden_image_cache.h.html">golden image
+cache</a> of the model tests. The cache keys are computed with the
+<a href="http://www.isthe.com/chongo/tech/comp/fnv/">FNV-1a</a> hash function,
+as the names of the cached program binaries of the GPU model (see
+<a href="../model.cc.html">model.cc</a>). The code version is hashed via the
+GLSL sources (as provided by the generated <code>.glsl.inc</code> files) and
+via a hash of the C++ sources of the CPU model and of the test scene, computed
+by the Makefile in the generated <code>golden_image_sources.inc</code> file:
+*/
+
+#include "atmosphere/reference/golden_image_cache.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace atmosphere {
+namespace reference {
+
+namespace {
+
+#include "atmosphere/definitions.glsl.inc"
+#include "atmosphere/functions.glsl.inc"
+#include "atmosphere/reference/golden_image_sources.inc"
+#include "atmosphere/reference/model_test.glsl.inc"
+
+class KeyHash {
+ public:
+  KeyHash() : hash_(14695981039346656037ULL) {}
+
+  void AddBytes(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash_ = (hash_ ^ bytes[i]) * 1099511628211ULL;
+    }
+  }
+
+  void AddString(const char* value) { AddBytes(value, strlen(value) + 1); }
+
+  // Adds the bytes of the given value, which must only contain numbers (e.g.
+  // a dimensional::Scalar, a vector or a spectrum), in order to not hash any
+  // padding bytes.
+  template<class T>
+  void Add(const T& value) { AddBytes(&value, sizeof(value)); }
+
+  uint64_t value() const { return hash_; }
+
+ private:
+  uint64_t hash_;
+};
+
+}  // anonymous namespace
+
+uint64_t GoldenImageCache::GetKey(const Scene& scene,
+    unsigned int num_scattering_orders) {
+  KeyHash hash;
+  hash.AddString(golden_image_sources_hash);
+  hash.AddString(definitions_glsl);
+  hash.AddString(functions_glsl);
+  hash.AddString(model_test_glsl);
+  const int kConstants[] = {
+    TRANSMITTANCE_TEXTURE_WIDTH, TRANSMITTANCE_TEXTURE_HEIGHT,
+    SCATTERING_TEXTURE_R_SIZE, SCATTERING_TEXTURE_MU_SIZE,
+    SCATTERING_TEXTURE_MU_S_SIZE, SCATTERING_TEXTURE_NU_SIZE,
+    IRRADIANCE_TEXTURE_WIDTH, IRRADIANCE_TEXTURE_HEIGHT,
+    TRANSMITTANCE_SAMPLE_COUNT, SINGLE_SCATTERING_SAMPLE_COUNT,
+    SCATTERING_DENSITY_SAMPLE_COUNT, INDIRECT_IRRADIANCE_SAMPLE_COUNT,
+    MULTIPLE_SCATTERING_SAMPLE_COUNT
+  };
+  hash.Add(kConstants);
+  hash.Add(num_scattering_orders);
+
+  const AtmosphereParameters& atmosphere = scene.atmosphere_parameters();
+  hash.Add(atmosphere.solar_irradiance);
+  hash.Add(atmosphere.sun_angular_radius);
+  hash.Add(atmosphere.bottom_radius);
+  hash.Add(atmosphere.top_radius);
+  hash.Add(atmosphere.rayleigh_density);
+  hash.Add(atmosphere.rayleigh_scattering);
+  hash.Add(atmosphere.mie_density);
+  hash.Add(atmosphere.mie_scattering);
+  hash.Add(atmosphere.mie_extinction);
+  hash.Add(atmosphere.mie_phase_function_g);
+  hash.Add(atmosphere.absorption_density);
+  hash.Add(atmosphere.absorption_extinction);
+  hash.Add(atmosphere.ground_albedo);
+  hash.Add(atmosphere.mu_s_min);
+
+  const unsigned int size[2] = { scene.width(), scene.height() };
+  const Wavelength lambdas[3] = { kLambdaR, kLambdaG, kLambdaB };
+  const bool use_luminance = scene.use_luminance();
+  hash.Add(size);
+  hash.Add(scene.ground_albedo());
+  hash.Add(scene.sphere_albedo());
+  hash.Add(scene.earth_center());
+  hash.Add(scene.sun_size());
+  hash.Add(scene.model_from_clip());
+  hash.Add(scene.camera());
+  hash.Add(scene.sun_direction());
+  hash.Add(use_luminance);
+  hash.Add(lambdas);
+  return hash.value();
+}
+
+std::string GoldenImageCache::GetFilename(uint64_t key) const {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "golden_%016llx.pfm",
+      static_cast<unsigned long long>(key));  // NOLINT
+  return directory_ + buffer;
+}
+
+bool GoldenImageCache::Load(uint64_t key, HdrImage* image) const {
+  return LoadHdrImage(GetFilename(key), image);
+}
+
+bool GoldenImageCache::Save(uint64_t key, const HdrImage& image) const {
+  const std::string filename = GetFilename(key);
+  std::string temp_filename = filename + ".XXXXXX";
+  const int fd = mkstemp(&temp_filename[0]);
+  if (fd == -1) {
+    return false;
+  }
+  // mkstemp creates files which are only readable by their owner.
+  fchmod(fd, 0644);
+  close(fd);
+  if (!SaveHdrImage(image, temp_filename)) {
+    std::remove(temp_filename.c_str());
+    return false;
+  }
+  return std::rename(temp_filename.c_str(), filename.c_str()) == 0;
+}
+
+}  // namespace reference
+}  // namespace atmosphere
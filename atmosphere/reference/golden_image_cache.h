@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/golden_image_cache.h</h2>
+
+<p>This file provides a disk cache for the reference images of the
+<a href="model_test.cc.html">model tests</a>, i.e. the HDR images of the
+<a href="scene.h.html">test scene</a> rendered with the full spectral CPU
+<a href="model.h.html"><code>Model</code></a>. Rendering these images is slow
+by design, but their result only depends on a few inputs:
+<ul>
+<li>the atmosphere parameters of the scene and the number of scattering orders
+used to initialize the model,</li>
+<li>the view parameters of the scene, except the exposure (which is applied by
+<code>Scene::ToneMap</code>),</li>
+<li>the code of the model and of the scene, i.e. the GLSL code in
+<a href="../functions.glsl.html">functions.glsl</a> and
+<a href="model_test.glsl.html">model_test.glsl</a>, the texture sizes and
+sample counts in <a href="../constants.h.html">constants.h</a>, and the C++
+code in this directory.</li>
+</ul>
+
+<p>The images are thus cached in files named from a content hash of all these
+inputs, so that they are rendered again only when one of them changes (the C++
+code is taken into account via a hash of the sources of the CPU model and of
+the test scene, computed by the Makefile). Old cache files are never deleted
+automatically.
+*/
+
+#ifndef ATMOSPHERE_REFERENCE_GOLDEN_IMAGE_CACHE_H_
+#define ATMOSPHERE_REFERENCE_GOLDEN_IMAGE_CACHE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "atmosphere/reference/image.h"
+#include "atmosphere/reference/scene.h"
+
+namespace atmosphere {
+namespace reference {
+
+class GoldenImageCache {
+ public:
+  // Creates a cache storing its files in the given directory, which must exist
+  // (and must end with a path separator).
+  explicit GoldenImageCache(const std::string& directory)
+      : directory_(directory) {}
+
+  // Returns the key of the HDR image of the given scene, with its current view
+  // parameters, rendered with a Model initialized with the atmosphere
+  // parameters of the scene and with the given number of scattering orders.
+  static uint64_t GetKey(const Scene& scene,
+      unsigned int num_scattering_orders);
+
+  // Returns the name of the file storing the image with the given key.
+  std::string GetFilename(uint64_t key) const;
+
+  // Loads the image with the given key, or returns false if it is not cached.
+  bool Load(uint64_t key, HdrImage* image) const;
+
+  // Stores the image with the given key. The image is first written in a
+  // temporary file with a unique name, which is then renamed, so that
+  // concurrent test runs never see partially written images.
+  bool Save(uint64_t key, const HdrImage& image) const;
+
+ private:
+  std::string directory_;
+};
+
+}  // namespace reference
+}  // namespace atmosphere
+
+#endif  // ATMOSPHERE_REFERENCE_GOLDEN_IMAGE_CACHE_H_
@@ -0,0 +1,481 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/image.cc</h2>
+
+<p>This file implements the image comparison and the image I/O functions
+declared in <a href="image.h.html">image.h</a>.
+*/
+
+#include "atmosphere/reference/image.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "util/progress_bar.h"
+
+namespace atmosphere {
+namespace reference {
+
+namespace {
+
+struct Lab {
+  double l;
+  double a;
+  double b;
+};
+
+// Converts an 0xAARRGGBB value to CIELAB, using the D65 white point of sRGB.
+Lab ArgbToLab(unsigned int argb) {
+  auto linear = [](unsigned int value) {
+    return std::pow((value & 0xFF) / 255.0, 2.2);
+  };
+  const double r = linear(argb >> 16);
+  const double g = linear(argb >> 8);
+  const double b = linear(argb);
+  const double x = (0.4124 * r + 0.3576 * g + 0.1805 * b) / 0.95047;
+  const double y = 0.2126 * r + 0.7152 * g + 0.0722 * b;
+  const double z = (0.0193 * r + 0.1192 * g + 0.9505 * b) / 1.08883;
+  auto f = [](double t) {
+    constexpr double kDelta = 6.0 / 29.0;
+    return t > kDelta * kDelta * kDelta ?
+        std::cbrt(t) : t / (3.0 * kDelta * kDelta) + 4.0 / 29.0;
+  };
+  return Lab{116.0 * f(y) - 16.0, 500.0 * (f(x) - f(y)), 200.0 * (f(y) - f(z))};
+}
+
+}  // anonymous namespace
+
+double ComputePsnr(const Image& image1, const Image& image2) {
+  assert(image1.width() == image2.width());
+  assert(image1.height() == image2.height());
+  const unsigned int num_pixels = image1.width() * image1.height();
+  double square_error_sum = 0.0;
+  for (unsigned int i = 0; i < num_pixels; ++i) {
+    const unsigned int argb1 = image1.data()[i];
+    const unsigned int argb2 = image2.data()[i];
+    for (int shift = 0; shift <= 16; shift += 8) {
+      const double error = static_cast<double>((argb1 >> shift) & 0xFF) -
+          static_cast<double>((argb2 >> shift) & 0xFF);
+      square_error_sum += error * error;
+    }
+  }
+  double mean_square_error = std::sqrt(square_error_sum / num_pixels);
+  return 10.0 * std::log(255 * 255 / mean_square_error) / std::log(10.0);
+}
+
+double ComputeMeanDeltaE(const Image& image1, const Image& image2) {
+  assert(image1.width() == image2.width());
+  assert(image1.height() == image2.height());
+  const unsigned int num_pixels = image1.width() * image1.height();
+  double delta_e_sum = 0.0;
+  for (unsigned int i = 0; i < num_pixels; ++i) {
+    const unsigned int argb1 = image1.data()[i];
+    const unsigned int argb2 = image2.data()[i];
+    if (argb1 == argb2) {
+      continue;
+    }
+    const Lab lab1 = ArgbToLab(argb1);
+    const Lab lab2 = ArgbToLab(argb2);
+    const double dl = lab1.l - lab2.l;
+    const double da = lab1.a - lab2.a;
+    const double db = lab1.b - lab2.b;
+    delta_e_sum += std::sqrt(dl * dl + da * da + db * db);
+  }
+  return delta_e_sum / num_pixels;
+}
+
+/*
+<p>The <code>CompareImages</code> functions first convert the two images to a
+planar representation, with one float array per channel, plus one for the
+luminance (used for the SSIM). The error computations can then use simple loops
+over contiguous float arrays, which the compiler can vectorize. Each row is
+converted by a separate job:
+*/
+
+namespace {
+
+struct PlanarImage {
+  PlanarImage(unsigned int width, unsigned int height)
+      : width(width), height(height), luminance(width * height) {
+    for (std::vector<float>& channel : channels) {
+      channel.resize(width * height);
+    }
+  }
+
+  unsigned int width;
+  unsigned int height;
+  std::vector<float> channels[3];
+  std::vector<float> luminance;
+};
+
+void ComputeLuminance(unsigned int j, PlanarImage* image) {
+  const unsigned int offset = j * image->width;
+  const float* r = image->channels[0].data() + offset;
+  const float* g = image->channels[1].data() + offset;
+  const float* b = image->channels[2].data() + offset;
+  float* y = image->luminance.data() + offset;
+  for (unsigned int i = 0; i < image->width; ++i) {
+    y[i] = 0.2126f * r[i] + 0.7152f * g[i] + 0.0722f * b[i];
+  }
+}
+
+PlanarImage ToPlanarImage(const Image& image) {
+  PlanarImage result(image.width(), image.height());
+  RunJobs([&](unsigned int j) {
+    const unsigned int offset = j * image.width();
+    const unsigned int* argb = image.data() + offset;
+    float* r = result.channels[0].data() + offset;
+    float* g = result.channels[1].data() + offset;
+    float* b = result.channels[2].data() + offset;
+    for (unsigned int i = 0; i < image.width(); ++i) {
+      r[i] = (argb[i] >> 16) & 0xFF;
+      g[i] = (argb[i] >> 8) & 0xFF;
+      b[i] = argb[i] & 0xFF;
+    }
+    ComputeLuminance(j, &result);
+  }, image.height());
+  return result;
+}
+
+PlanarImage ToPlanarImage(const HdrImage& image) {
+  PlanarImage result(image.width(), image.height());
+  RunJobs([&](unsigned int j) {
+    const unsigned int offset = j * image.width();
+    const float* rgb = image.data() + 3 * offset;
+    float* r = result.channels[0].data() + offset;
+    float* g = result.channels[1].data() + offset;
+    float* b = result.channels[2].data() + offset;
+    for (unsigned int i = 0; i < image.width(); ++i) {
+      r[i] = rgb[3 * i];
+      g[i] = rgb[3 * i + 1];
+      b[i] = rgb[3 * i + 2];
+    }
+    ComputeLuminance(j, &result);
+  }, image.height());
+  return result;
+}
+
+/*
+<p>The SSIM of a window is computed from the means, the variances and the
+covariance of the luminance values in this window, with the usual constants
+$C_1=(0.01L)^2$ and $C_2=(0.03L)^2$, where $L$ is the peak value. The sums are
+computed in single precision for each row of the window, and then accumulated
+in double precision:
+*/
+
+constexpr unsigned int kSsimWindowSize = 8;
+constexpr unsigned int kSsimWindowStride = 4;
+
+double ComputeWindowSsim(const PlanarImage& image1, const PlanarImage& image2,
+    unsigned int x, unsigned int y, unsigned int size_x, unsigned int size_y,
+    double peak_value) {
+  double sum1 = 0.0;
+  double sum2 = 0.0;
+  double sum11 = 0.0;
+  double sum22 = 0.0;
+  double sum12 = 0.0;
+  for (unsigned int j = y; j < y + size_y; ++j) {
+    const float* a = image1.luminance.data() + j * image1.width + x;
+    const float* b = image2.luminance.data() + j * image2.width + x;
+    float row_sum1 = 0.0f;
+    float row_sum2 = 0.0f;
+    float row_sum11 = 0.0f;
+    float row_sum22 = 0.0f;
+    float row_sum12 = 0.0f;
+    for (unsigned int i = 0; i < size_x; ++i) {
+      row_sum1 += a[i];
+      row_sum2 += b[i];
+      row_sum11 += a[i] * a[i];
+      row_sum22 += b[i] * b[i];
+      row_sum12 += a[i] * b[i];
+    }
+    sum1 += row_sum1;
+    sum2 += row_sum2;
+    sum11 += row_sum11;
+    sum22 += row_sum22;
+    sum12 += row_sum12;
+  }
+  const double n = size_x * size_y;
+  const double mean1 = sum1 / n;
+  const double mean2 = sum2 / n;
+  const double variance1 = std::max(sum11 / n - mean1 * mean1, 0.0);
+  const double variance2 = std::max(sum22 / n - mean2 * mean2, 0.0);
+  const double covariance = sum12 / n - mean1 * mean2;
+  const double c1 = (0.01 * peak_value) * (0.01 * peak_value);
+  const double c2 = (0.03 * peak_value) * (0.03 * peak_value);
+  return (2.0 * mean1 * mean2 + c1) * (2.0 * covariance + c2) /
+      ((mean1 * mean1 + mean2 * mean2 + c1) * (variance1 + variance2 + c2));
+}
+
+/*
+<p>The tiles are then compared in parallel, each row of tiles being compared by
+a separate job. The global results are finally computed from the tile results,
+in tile order, so that they do not depend on the number of threads:
+*/
+
+struct TileErrors {
+  double square_error_sum;
+  double max_error;
+  double ssim_sum;
+  unsigned int num_windows;
+};
+
+TileErrors CompareTiles(const PlanarImage& image1, const PlanarImage& image2,
+    unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1,
+    double peak_value) {
+  TileErrors errors = {0.0, 0.0, 0.0, 0};
+  for (unsigned int j = y0; j < y1; ++j) {
+    for (int c = 0; c < 3; ++c) {
+      const float* a = image1.channels[c].data() + j * image1.width;
+      const float* b = image2.channels[c].data() + j * image2.width;
+      float row_square_error_sum = 0.0f;
+      float row_max_error = 0.0f;
+      for (unsigned int i = x0; i < x1; ++i) {
+        const float error = a[i] - b[i];
+        row_square_error_sum += error * error;
+        row_max_error = std::max(row_max_error, std::abs(error));
+      }
+      errors.square_error_sum += row_square_error_sum;
+      errors.max_error = std::max<double>(errors.max_error, row_max_error);
+    }
+  }
+
+  const unsigned int window_size_x = std::min(kSsimWindowSize, image1.width);
+  const unsigned int window_size_y = std::min(kSsimWindowSize, image1.height);
+  auto first_window = [](unsigned int start) {
+    return (start + kSsimWindowStride - 1) / kSsimWindowStride *
+        kSsimWindowStride;
+  };
+  for (unsigned int y = first_window(y0);
+      y < y1 && y + window_size_y <= image1.height; y += kSsimWindowStride) {
+    for (unsigned int x = first_window(x0);
+        x < x1 && x + window_size_x <= image1.width; x += kSsimWindowStride) {
+      errors.ssim_sum += ComputeWindowSsim(image1, image2, x, y,
+          window_size_x, window_size_y, peak_value);
+      errors.num_windows += 1;
+    }
+  }
+  return errors;
+}
+
+ImageComparison CompareImages(const PlanarImage& image1,
+    const PlanarImage& image2, double peak_value, unsigned int tile_size) {
+  assert(image1.width == image2.width);
+  assert(image1.height == image2.height);
+  assert(tile_size > 0);
+  ImageComparison result;
+  result.width = image1.width;
+  result.height = image1.height;
+  result.tile_size = tile_size;
+  result.num_tiles_x = (image1.width + tile_size - 1) / tile_size;
+  result.num_tiles_y = (image1.height + tile_size - 1) / tile_size;
+  const unsigned int num_tiles = result.num_tiles_x * result.num_tiles_y;
+  std::vector<TileErrors> tiles(num_tiles);
+  RunJobs([&](unsigned int tile_j) {
+    const unsigned int y0 = tile_j * tile_size;
+    const unsigned int y1 = std::min(y0 + tile_size, image1.height);
+    for (unsigned int tile_i = 0; tile_i < result.num_tiles_x; ++tile_i) {
+      const unsigned int x0 = tile_i * tile_size;
+      const unsigned int x1 = std::min(x0 + tile_size, image1.width);
+      tiles[tile_i + tile_j * result.num_tiles_x] =
+          CompareTiles(image1, image2, x0, y0, x1, y1, peak_value);
+    }
+  }, result.num_tiles_y);
+
+  double square_error_sum = 0.0;
+  double ssim_sum = 0.0;
+  unsigned int num_windows = 0;
+  result.max_error = 0.0;
+  for (unsigned int tile = 0; tile < num_tiles; ++tile) {
+    const TileErrors& errors = tiles[tile];
+    const unsigned int tile_i = tile % result.num_tiles_x;
+    const unsigned int tile_j = tile / result.num_tiles_x;
+    const unsigned int tile_width =
+        std::min(tile_size, image1.width - tile_i * tile_size);
+    const unsigned int tile_height =
+        std::min(tile_size, image1.height - tile_j * tile_size);
+    result.tile_rms_error.push_back(std::sqrt(
+        errors.square_error_sum / (3.0 * tile_width * tile_height)));
+    result.tile_ssim.push_back(errors.num_windows > 0 ?
+        errors.ssim_sum / errors.num_windows : 1.0);
+    result.tile_max_error.push_back(errors.max_error);
+    square_error_sum += errors.square_error_sum;
+    ssim_sum += errors.ssim_sum;
+    num_windows += errors.num_windows;
+    result.max_error = std::max(result.max_error, errors.max_error);
+  }
+  const double mean_square_error =
+      std::sqrt(square_error_sum / (image1.width * image1.height));
+  result.psnr = 10.0 * std::log(peak_value * peak_value / mean_square_error) /
+      std::log(10.0);
+  result.ssim = num_windows > 0 ? ssim_sum / num_windows : 1.0;
+  return result;
+}
+
+}  // anonymous namespace
+
+ImageComparison CompareImages(const Image& image1, const Image& image2,
+    unsigned int tile_size) {
+  return CompareImages(ToPlanarImage(image1), ToPlanarImage(image2), 255.0,
+      tile_size);
+}
+
+ImageComparison CompareImages(const HdrImage& image1, const HdrImage& image2,
+    double peak_value, unsigned int tile_size) {
+  return CompareImages(ToPlanarImage(image1), ToPlanarImage(image2),
+      peak_value, tile_size);
+}
+
+/*
+<p>The heatmaps use a "black body" color map, from black to red, yellow and
+white:
+*/
+
+Image CreateHeatmap(const ImageComparison& comparison,
+    const std::vector<double>& tile_values, double max_value) {
+  assert(tile_values.size() ==
+      comparison.num_tiles_x * comparison.num_tiles_y);
+  Image heatmap(comparison.width, comparison.height);
+  for (unsigned int j = 0; j < comparison.height; ++j) {
+    for (unsigned int i = 0; i < comparison.width; ++i) {
+      const unsigned int tile = i / comparison.tile_size +
+          j / comparison.tile_size * comparison.num_tiles_x;
+      const double t = std::max(0.0, std::min(1.0,
+          max_value > 0.0 ? tile_values[tile] / max_value : 0.0));
+      auto channel = [t](double offset) {
+        return static_cast<unsigned int>(
+            255.0 * std::max(0.0, std::min(1.0, 3.0 * t - offset)));
+      };
+      heatmap.Set(i, j,
+          (255u << 24) | (channel(0.0) << 16) | (channel(1.0) << 8) |
+          channel(2.0));
+    }
+  }
+  return heatmap;
+}
+
+bool SaveImage(const Image& image, const std::string& filename) {
+  std::ofstream file(filename, std::ofstream::binary);
+  file << "P6\n" << image.width() << " " << image.height() << "\n255\n";
+  const unsigned int num_pixels = image.width() * image.height();
+  for (unsigned int i = 0; i < num_pixels; ++i) {
+    const unsigned int argb = image.data()[i];
+    const char rgb[3] = {
+      static_cast<char>((argb >> 16) & 0xFF),
+      static_cast<char>((argb >> 8) & 0xFF),
+      static_cast<char>(argb & 0xFF)
+    };
+    file.write(rgb, 3);
+  }
+  return file.good();
+}
+
+bool LoadImage(const std::string& filename, Image* image) {
+  std::ifstream file(filename, std::ifstream::binary);
+  std::string magic;
+  unsigned int width;
+  unsigned int height;
+  unsigned int max_value;
+  file >> magic >> width >> height >> max_value;
+  if (!file.good() || magic != "P6" || max_value != 255) {
+    return false;
+  }
+  file.get();  // The single whitespace character before the pixel data.
+  Image result(width, height);
+  for (unsigned int i = 0; i < width * height; ++i) {
+    unsigned char rgb[3];
+    file.read(reinterpret_cast<char*>(rgb), 3);
+    result.data()[i] = (255u << 24) | (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+  }
+  if (!file.good()) {
+    return false;
+  }
+  *image = result;
+  return true;
+}
+
+/*
+<p>The HDR images are saved in the
+<a href="http://www.pauldebevec.com/Research/HDR/PFM/">PFM</a> format, where
+the sign of the scale factor in the header gives the byte order of the float
+values (negative for little endian), and where the rows are stored from bottom
+to top:
+*/
+
+namespace {
+
+bool IsLittleEndian() {
+  const uint16_t value = 1;
+  return *reinterpret_cast<const unsigned char*>(&value) == 1;
+}
+
+}  // anonymous namespace
+
+bool SaveHdrImage(const HdrImage& image, const std::string& filename) {
+  std::ofstream file(filename, std::ofstream::binary);
+  file << "PF\n" << image.width() << " " << image.height() << "\n"
+       << (IsLittleEndian() ? "-1.0" : "1.0") << "\n";
+  for (unsigned int j = image.height(); j > 0; --j) {
+    file.write(reinterpret_cast<const char*>(image.Get(0, j - 1)),
+        3 * image.width() * sizeof(float));
+  }
+  return file.good();
+}
+
+bool LoadHdrImage(const std::string& filename, HdrImage* image) {
+  std::ifstream file(filename, std::ifstream::binary);
+  std::string magic;
+  unsigned int width;
+  unsigned int height;
+  double scale;
+  file >> magic >> width >> height >> scale;
+  if (!file.good() || magic != "PF" || (scale < 0.0) != IsLittleEndian()) {
+    return false;
+  }
+  file.get();  // The single whitespace character before the pixel data.
+  HdrImage result(width, height);
+  for (unsigned int j = height; j > 0; --j) {
+    file.read(reinterpret_cast<char*>(result.data() + 3 * width * (j - 1)),
+        3 * width * sizeof(float));
+  }
+  if (!file.good()) {
+    return false;
+  }
+  *image = result;
+  return true;
+}
+
+}  // namespace reference
+}  // namespace atmosphere
@@ -0,0 +1,190 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/image.h</h2>
+
+<p>This file provides simple image classes, with 8 bits per channel or with
+float channels (e.g. for high dynamic range radiance values), and functions to
+compare two images and to save or load them in the binary
+<a href="https://en.wikipedia.org/wiki/Netpbm_format">PPM</a> format (or in the
+PFM format, for float images). They are
+used to compare images of the <a href="scene.h.html">test scene</a> rendered
+with different models, or with different model parameters.
+
+<p>The <code>CompareImages</code> functions compute several error metrics at
+once, for the whole images and for each tile of a regular grid, so that the
+location of the errors can be shown with a heatmap (see
+<code>CreateHeatmap</code>). They use one thread per hardware thread.
+*/
+
+#ifndef ATMOSPHERE_REFERENCE_IMAGE_H_
+#define ATMOSPHERE_REFERENCE_IMAGE_H_
+
+#include <string>
+#include <vector>
+
+namespace atmosphere {
+namespace reference {
+
+// An image with 8 bits per channel, stored in row major order from the top
+// left pixel, with one 0xAARRGGBB value per pixel.
+class Image {
+ public:
+  Image(unsigned int width, unsigned int height)
+      : width_(width), height_(height), pixels_(width * height) {}
+
+  unsigned int width() const { return width_; }
+  unsigned int height() const { return height_; }
+
+  unsigned int Get(unsigned int i, unsigned int j) const {
+    return pixels_[i + j * width_];
+  }
+  void Set(unsigned int i, unsigned int j, unsigned int argb) {
+    pixels_[i + j * width_] = argb;
+  }
+
+  const unsigned int* data() const { return pixels_.data(); }
+  unsigned int* data() { return pixels_.data(); }
+
+ private:
+  unsigned int width_;
+  unsigned int height_;
+  std::vector<unsigned int> pixels_;
+};
+
+// An image with 3 float channels per pixel, stored in row major order from the
+// top left pixel, with the red, green and blue values of each pixel stored
+// consecutively.
+class HdrImage {
+ public:
+  HdrImage(unsigned int width, unsigned int height)
+      : width_(width), height_(height), pixels_(3 * width * height) {}
+
+  unsigned int width() const { return width_; }
+  unsigned int height() const { return height_; }
+
+  const float* Get(unsigned int i, unsigned int j) const {
+    return pixels_.data() + 3 * (i + j * width_);
+  }
+  void Set(unsigned int i, unsigned int j, float r, float g, float b) {
+    float* rgb = pixels_.data() + 3 * (i + j * width_);
+    rgb[0] = r;
+    rgb[1] = g;
+    rgb[2] = b;
+  }
+
+  const float* data() const { return pixels_.data(); }
+  float* data() { return pixels_.data(); }
+
+ private:
+  unsigned int width_;
+  unsigned int height_;
+  std::vector<float> pixels_;
+};
+
+// Returns the Peak Signal to Noise Ratio between two images of the same size,
+// in dB, computed as in model_test.cc (the error of each pixel is the squared
+// norm of the difference of its RGB values).
+double ComputePsnr(const Image& image1, const Image& image2);
+
+// Returns the mean CIE76 color difference between two images of the same size,
+// i.e. the mean Euclidean distance between the CIELAB colors of their pixels
+// (the RGB values are interpreted as sRGB primaries encoded with a 2.2 gamma,
+// as produced by the tone mapping of the test scene). A difference of about
+// 2.3 is just noticeable.
+double ComputeMeanDeltaE(const Image& image1, const Image& image2);
+
+// The result of the comparison of two images of the same size. The images are
+// divided in square tiles of 'tile_size' pixels (the tiles on the right and
+// bottom borders can be smaller), and the error metrics are computed for the
+// whole images and for each tile. The tile values are stored in row major
+// order from the top left tile.
+struct ImageComparison {
+  unsigned int width;
+  unsigned int height;
+  unsigned int tile_size;
+  unsigned int num_tiles_x;
+  unsigned int num_tiles_y;
+
+  // The Peak Signal to Noise Ratio in dB, computed as in ComputePsnr (with the
+  // peak value of the compared images).
+  double psnr;
+  // The mean Structural SIMilarity index of the luminance of the two images,
+  // computed on 8x8 windows with a stride of 4 pixels (see "Image quality
+  // assessment: from error visibility to structural similarity", Wang et al.,
+  // IEEE Transactions on Image Processing, 2004). 1 for identical images.
+  double ssim;
+  // The maximum absolute difference between two corresponding channel values.
+  double max_error;
+
+  // The root mean square error of the channel values of each tile.
+  std::vector<double> tile_rms_error;
+  // The mean SSIM of the windows whose top left pixel is in each tile (or 1 if
+  // there is no such window).
+  std::vector<double> tile_ssim;
+  // The maximum absolute channel difference in each tile.
+  std::vector<double> tile_max_error;
+};
+
+constexpr unsigned int kDefaultTileSize = 32;
+
+// Compares two images of the same size, whose channel values are between 0 and
+// 255 (the alpha channel is ignored).
+ImageComparison CompareImages(const Image& image1, const Image& image2,
+    unsigned int tile_size = kDefaultTileSize);
+
+// Compares two HDR images of the same size, whose channel values should be
+// between 0 and 'peak_value' (this value is used for the PSNR and the SSIM).
+ImageComparison CompareImages(const HdrImage& image1, const HdrImage& image2,
+    double peak_value, unsigned int tile_size = kDefaultTileSize);
+
+// Returns an image of the size of the compared images showing the given tile
+// values (e.g. comparison.tile_rms_error), from black for 0 to red, yellow and
+// white for 'max_value' and above.
+Image CreateHeatmap(const ImageComparison& comparison,
+    const std::vector<double>& tile_values, double max_value);
+
+// Saves an image in binary PPM format (the alpha channel is not saved).
+bool SaveImage(const Image& image, const std::string& filename);
+
+// Loads an image saved with SaveImage, or returns false if it can't be read.
+bool LoadImage(const std::string& filename, Image* image);
+
+// Saves an HDR image in PFM format, i.e. as raw float values, in the native
+// byte order.
+bool SaveHdrImage(const HdrImage& image, const std::string& filename);
+
+// Loads an image saved with SaveHdrImage, or returns false if it can't be read
+// (this includes the case where it has been saved with another byte order).
+bool LoadHdrImage(const std::string& filename, HdrImage* image);
+
+}  // namespace reference
+}  // namespace atmosphere
+
+#endif  // ATMOSPHERE_REFERENCE_IMAGE_H_
@@ -0,0 +1,276 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/image_test.cc</h2>
+
+<p>This file provides unit tests for the image comparison functions of
+<a href="image.h.html">image.h</a>. The test images are filled with the
+following deterministic pseudo random values (the image sizes are not multiples
+of the tile size, in order to test the border tiles):
+*/
+
+#include "atmosphere/reference/image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "test/test_case.h"
+
+namespace atmosphere {
+namespace reference {
+
+namespace {
+
+constexpr unsigned int kWidth = 70;
+constexpr unsigned int kHeight = 45;
+constexpr unsigned int kTileSize = 32;
+
+unsigned int NextRandom(unsigned int* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+Image CreateRandomImage(unsigned int seed) {
+  Image image(kWidth, kHeight);
+  for (unsigned int j = 0; j < kHeight; ++j) {
+    for (unsigned int i = 0; i < kWidth; ++i) {
+      image.Set(i, j, (255u << 24) | (NextRandom(&seed) & 0xFFFFFF));
+    }
+  }
+  return image;
+}
+
+// Returns a copy of 'image' with a random error between -amplitude and
+// +amplitude added to each channel of each pixel.
+Image AddNoise(const Image& image, int amplitude, unsigned int seed) {
+  Image result(image.width(), image.height());
+  for (unsigned int j = 0; j < image.height(); ++j) {
+    for (unsigned int i = 0; i < image.width(); ++i) {
+      unsigned int argb = 255u << 24;
+      for (int shift = 0; shift <= 16; shift += 8) {
+        int value = (image.Get(i, j) >> shift) & 0xFF;
+        value += static_cast<int>(NextRandom(&seed) % (2 * amplitude + 1)) -
+            amplitude;
+        argb |= static_cast<unsigned int>(
+            value < 0 ? 0 : (value > 255 ? 255 : value)) << shift;
+      }
+      result.Set(i, j, argb);
+    }
+  }
+  return result;
+}
+
+HdrImage ToHdrImage(const Image& image) {
+  HdrImage result(image.width(), image.height());
+  for (unsigned int j = 0; j < image.height(); ++j) {
+    for (unsigned int i = 0; i < image.width(); ++i) {
+      const unsigned int argb = image.Get(i, j);
+      result.Set(i, j, (argb >> 16) & 0xFF, (argb >> 8) & 0xFF, argb & 0xFF);
+    }
+  }
+  return result;
+}
+
+}  // anonymous namespace
+
+class ImageTest : public dimensional::TestCase {
+ public:
+  template<typename T>
+  ImageTest(const std::string& name, T test)
+      : TestCase("ImageTest " + name, static_cast<Test>(test)) {}
+
+/*
+<p>The first test checks the results for two identical images, and the size of
+the tile grid:
+*/
+
+  void TestCompareIdenticalImages() {
+    const Image image = CreateRandomImage(1);
+    const ImageComparison comparison =
+        CompareImages(image, image, kTileSize);
+    ExpectTrue(comparison.num_tiles_x == 3u);
+    ExpectTrue(comparison.num_tiles_y == 2u);
+    ExpectTrue(comparison.tile_rms_error.size() == 6u);
+    ExpectNear(1.0, comparison.ssim, 1e-9);
+    ExpectEquals(0.0, comparison.max_error);
+    for (unsigned int tile = 0; tile < 6; ++tile) {
+      ExpectEquals(0.0, comparison.tile_rms_error[tile]);
+      ExpectNear(1.0, comparison.tile_ssim[tile], 1e-9);
+      ExpectEquals(0.0, comparison.tile_max_error[tile]);
+    }
+  }
+
+/*
+<p>The PSNR must be the same as the one computed by <code>ComputePsnr</code>,
+and the SSIM must decrease when the noise increases:
+*/
+
+  void TestComparePsnrAndSsim() {
+    const Image image = CreateRandomImage(2);
+    const Image small_noise = AddNoise(image, 4, 3);
+    const Image large_noise = AddNoise(image, 32, 4);
+    const ImageComparison small_comparison =
+        CompareImages(image, small_noise, kTileSize);
+    const ImageComparison large_comparison =
+        CompareImages(image, large_noise, kTileSize);
+    ExpectNear(ComputePsnr(image, small_noise), small_comparison.psnr, 1e-9);
+    ExpectNear(ComputePsnr(image, large_noise), large_comparison.psnr, 1e-9);
+    ExpectLess(large_comparison.psnr, small_comparison.psnr);
+    ExpectLess(large_comparison.ssim, small_comparison.ssim);
+    ExpectLess(small_comparison.ssim, 1.0);
+    ExpectLess(0.0, large_comparison.ssim);
+    ExpectNear(4.0, small_comparison.max_error, 1e-9);
+    ExpectNear(32.0, large_comparison.max_error, 1e-9);
+  }
+
+/*
+<p>An error in a single pixel must only change the values of its tile (here a
+bottom border tile, of size 32x13):
+*/
+
+  void TestCompareTiles() {
+    const Image image = CreateRandomImage(5);
+    Image modified_image = image;
+    const unsigned int argb = image.Get(40, 35);
+    const unsigned int green = (argb >> 8) & 0xFF;
+    const unsigned int new_green = green < 128 ? green + 100 : green - 100;
+    modified_image.Set(40, 35, (argb & 0xFFFF00FF) | (new_green << 8));
+
+    const ImageComparison comparison =
+        CompareImages(image, modified_image, kTileSize);
+    ExpectNear(100.0, comparison.max_error, 1e-9);
+    for (unsigned int tile = 0; tile < 6; ++tile) {
+      if (tile == 4) {
+        ExpectNear(std::sqrt(100.0 * 100.0 / (3.0 * 32.0 * 13.0)),
+            comparison.tile_rms_error[tile], 1e-6);
+        ExpectLess(comparison.tile_ssim[tile], 1.0);
+        ExpectNear(100.0, comparison.tile_max_error[tile], 1e-9);
+      } else {
+        ExpectEquals(0.0, comparison.tile_rms_error[tile]);
+        ExpectEquals(0.0, comparison.tile_max_error[tile]);
+      }
+    }
+  }
+
+/*
+<p>The comparison of HDR images must give the same results as the comparison of
+8 bits images with the same values and the same peak value:
+*/
+
+  void TestCompareHdrImages() {
+    const Image image = CreateRandomImage(6);
+    const Image noisy_image = AddNoise(image, 16, 7);
+    const ImageComparison comparison =
+        CompareImages(image, noisy_image, kTileSize);
+    const ImageComparison hdr_comparison = CompareImages(
+        ToHdrImage(image), ToHdrImage(noisy_image), 255.0, kTileSize);
+    ExpectNear(comparison.psnr, hdr_comparison.psnr, 1e-6);
+    ExpectNear(comparison.ssim, hdr_comparison.ssim, 1e-6);
+    ExpectNear(comparison.max_error, hdr_comparison.max_error, 1e-6);
+    for (unsigned int tile = 0; tile < 6; ++tile) {
+      ExpectNear(comparison.tile_rms_error[tile],
+          hdr_comparison.tile_rms_error[tile], 1e-6);
+    }
+  }
+
+/*
+<p>An HDR image saved to disk must be loaded back without any loss:
+*/
+
+  void TestSaveAndLoadHdrImage() {
+    const std::string kFilename = "output/Debug/image_test.pfm";
+    HdrImage image(kWidth, kHeight);
+    unsigned int seed = 9;
+    for (unsigned int j = 0; j < kHeight; ++j) {
+      for (unsigned int i = 0; i < kWidth; ++i) {
+        image.Set(i, j, NextRandom(&seed) * 1e-3f, NextRandom(&seed) * 1e-6f,
+            NextRandom(&seed) * 1e3f);
+      }
+    }
+    ExpectTrue(SaveHdrImage(image, kFilename));
+    HdrImage loaded_image(1, 1);
+    ExpectTrue(LoadHdrImage(kFilename, &loaded_image));
+    ExpectTrue(loaded_image.width() == kWidth);
+    ExpectTrue(loaded_image.height() == kHeight);
+    if (loaded_image.width() == kWidth && loaded_image.height() == kHeight) {
+      ExpectTrue(std::equal(image.data(), image.data() + 3 * kWidth * kHeight,
+          loaded_image.data()));
+    }
+    ExpectFalse(LoadHdrImage(kFilename + ".missing", &loaded_image));
+  }
+
+/*
+<p>Finally, the heatmap must show each tile with a uniform color, from black
+for a null value to white for the maximum value:
+*/
+
+  void TestCreateHeatmap() {
+    const Image image = CreateRandomImage(8);
+    const ImageComparison comparison = CompareImages(image, image, kTileSize);
+    const std::vector<double> tile_values =
+        {0.0, 0.5, 1.0, 2.0, 1.0 / 3.0, 0.0};
+    const Image heatmap = CreateHeatmap(comparison, tile_values, 1.0);
+    ExpectTrue(heatmap.width() == kWidth);
+    ExpectTrue(heatmap.height() == kHeight);
+    ExpectTrue(heatmap.Get(0, 0) == 0xFF000000u);
+    ExpectTrue(heatmap.Get(31, 31) == 0xFF000000u);
+    ExpectTrue(heatmap.Get(32, 0) == 0xFFFF7F00u);
+    ExpectTrue(heatmap.Get(69, 31) == 0xFFFFFFFFu);
+    ExpectTrue(heatmap.Get(0, 44) == 0xFFFFFFFFu);
+    ExpectTrue(heatmap.Get(40, 44) == 0xFFFF0000u);
+    ExpectTrue(heatmap.Get(69, 44) == 0xFF000000u);
+  }
+};
+
+namespace {
+
+ImageTest compare_identical_images(
+    "CompareIdenticalImages",
+    &ImageTest::TestCompareIdenticalImages);
+ImageTest compare_psnr_and_ssim(
+    "ComparePsnrAndSsim",
+    &ImageTest::TestComparePsnrAndSsim);
+ImageTest compare_tiles(
+    "CompareTiles",
+    &ImageTest::TestCompareTiles);
+ImageTest compare_hdr_images(
+    "CompareHdrImages",
+    &ImageTest::TestCompareHdrImages);
+ImageTest save_and_load_hdr_image(
+    "SaveAndLoadHdrImage",
+    &ImageTest::TestSaveAndLoadHdrImage);
+ImageTest create_heatmap(
+    "CreateHeatmap",
+    &ImageTest::TestCreateHeatmap);
+
+}  // anonymous namespace
+
+}  // namespace reference
+}  // namespace atmosphere
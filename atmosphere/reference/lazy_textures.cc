@@ -0,0 +1,373 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/lazy_textures.cc</h2>
+
+<p>This file implements the <a href="lazy_textures.h.html">lazy textures</a>.
+Each lazy texture computes a texel with the same function and the same
+arguments as in <a href="model.cc.html"><code>Model::Init</code></a>, and stores
+it at the index used by its base <code>BinaryFunction</code> or
+<code>TernaryFunction</code> class, i.e. <code>i + j * width</code> or
+<code>i + (j + k * height) * width</code>:
+*/
+
+#include "atmosphere/reference/lazy_textures.h"
+
+#include <new>
+
+#include "atmosphere/reference/functions.h"
+
+namespace atmosphere {
+namespace reference {
+
+namespace {
+
+constexpr unsigned int kTransmittanceTexels =
+    TRANSMITTANCE_TEXTURE_WIDTH * TRANSMITTANCE_TEXTURE_HEIGHT;
+constexpr unsigned int kIrradianceTexels =
+    IRRADIANCE_TEXTURE_WIDTH * IRRADIANCE_TEXTURE_HEIGHT;
+constexpr unsigned int kScatteringTexels = SCATTERING_TEXTURE_WIDTH *
+    SCATTERING_TEXTURE_HEIGHT * SCATTERING_TEXTURE_DEPTH;
+
+unsigned int GetTransmittanceIndex(int i, int j) {
+  return i + j * TRANSMITTANCE_TEXTURE_WIDTH;
+}
+
+unsigned int GetIrradianceIndex(int i, int j) {
+  return i + j * IRRADIANCE_TEXTURE_WIDTH;
+}
+
+unsigned int GetScatteringIndex(int i, int j, int k) {
+  return i + (j + k * SCATTERING_TEXTURE_HEIGHT) * SCATTERING_TEXTURE_WIDTH;
+}
+
+}  // anonymous namespace
+
+LazyTransmittanceTexture::LazyTransmittanceTexture(
+    const AtmosphereParameters& atmosphere_parameters)
+    : LazyTexture(kTransmittanceTexels),
+      atmosphere_parameters_(atmosphere_parameters) {}
+
+const DimensionlessSpectrum& LazyTransmittanceTexture::Get(
+    int i, int j) const {
+  const unsigned int index = GetTransmittanceIndex(i, j);
+  ComputeOnce(index, [&]() {
+    value_[index] = ComputeTransmittanceToTopAtmosphereBoundaryTexture(
+        atmosphere_parameters_, vec2(i + 0.5, j + 0.5));
+  });
+  return value_[index];
+}
+
+LazyDirectIrradianceTexture::LazyDirectIrradianceTexture(
+    const AtmosphereParameters& atmosphere_parameters,
+    const TransmittanceTexture& transmittance_texture)
+    : LazyTexture(kIrradianceTexels),
+      atmosphere_parameters_(atmosphere_parameters),
+      transmittance_texture_(transmittance_texture) {}
+
+const IrradianceSpectrum& LazyDirectIrradianceTexture::Get(
+    int i, int j) const {
+  const unsigned int index = GetIrradianceIndex(i, j);
+  ComputeOnce(index, [&]() {
+    value_[index] = ComputeDirectIrradianceTexture(atmosphere_parameters_,
+        transmittance_texture_, vec2(i + 0.5, j + 0.5));
+  });
+  return value_[index];
+}
+
+LazySingleScatteringTexture::LazySingleScatteringTexture(
+    const AtmosphereParameters& atmosphere_parameters,
+    const TransmittanceTexture& transmittance_texture,
+    bool rayleigh)
+    : LazyTexture(kScatteringTexels),
+      atmosphere_parameters_(atmosphere_parameters),
+      transmittance_texture_(transmittance_texture),
+      rayleigh_(rayleigh) {}
+
+const IrradianceSpectrum& LazySingleScatteringTexture::Get(
+    int i, int j, int k) const {
+  const unsigned int index = GetScatteringIndex(i, j, k);
+  ComputeOnce(index, [&]() {
+    IrradianceSpectrum rayleigh;
+    IrradianceSpectrum mie;
+    ComputeSingleScatteringTexture(atmosphere_parameters_,
+        transmittance_texture_, vec3(i + 0.5, j + 0.5, k + 0.5), rayleigh,
+        mie);
+    value_[index] = rayleigh_ ? rayleigh : mie;
+  });
+  return value_[index];
+}
+
+LazyScatteringDensityTexture::LazyScatteringDensityTexture(
+    const AtmosphereParameters& atmosphere_parameters,
+    const TransmittanceTexture& transmittance_texture,
+    const ReducedScatteringTexture& single_rayleigh_scattering_texture,
+    const ReducedScatteringTexture& single_mie_scattering_texture,
+    const ScatteringTexture& multiple_scattering_texture,
+    const IrradianceTexture& irradiance_texture,
+    int order)
+    : LazyTexture(kScatteringTexels),
+      atmosphere_parameters_(atmosphere_parameters),
+      transmittance_texture_(transmittance_texture),
+      single_rayleigh_scattering_texture_(single_rayleigh_scattering_texture),
+      single_mie_scattering_texture_(single_mie_scattering_texture),
+      multiple_scattering_texture_(multiple_scattering_texture),
+      irradiance_texture_(irradiance_texture),
+      order_(order) {}
+
+const RadianceDensitySpectrum& LazyScatteringDensityTexture::Get(
+    int i, int j, int k) const {
+  const unsigned int index = GetScatteringIndex(i, j, k);
+  ComputeOnce(index, [&]() {
+    value_[index] = ComputeScatteringDensityTexture(atmosphere_parameters_,
+        transmittance_texture_, single_rayleigh_scattering_texture_,
+        single_mie_scattering_texture_, multiple_scattering_texture_,
+        irradiance_texture_, vec3(i + 0.5, j + 0.5, k + 0.5), order_);
+  });
+  return value_[index];
+}
+
+LazyMultipleScatteringTexture::LazyMultipleScatteringTexture(
+    const AtmosphereParameters& atmosphere_parameters,
+    const TransmittanceTexture& transmittance_texture,
+    const ScatteringDensityTexture& scattering_density_texture)
+    : LazyTexture(kScatteringTexels),
+      atmosphere_parameters_(atmosphere_parameters),
+      transmittance_texture_(transmittance_texture),
+      scattering_density_texture_(scattering_density_texture),
+      nu_(kScatteringTexels) {}
+
+const RadianceSpectrum& LazyMultipleScatteringTexture::Get(
+    int i, int j, int k) const {
+  const unsigned int index = GetScatteringIndex(i, j, k);
+  ComputeOnce(index, [&]() {
+    value_[index] = ComputeMultipleScatteringTexture(atmosphere_parameters_,
+        transmittance_texture_, scattering_density_texture_,
+        vec3(i + 0.5, j + 0.5, k + 0.5), nu_[index]);
+  });
+  return value_[index];
+}
+
+Number LazyMultipleScatteringTexture::GetNu(int i, int j, int k) const {
+  Get(i, j, k);
+  return nu_[GetScatteringIndex(i, j, k)];
+}
+
+LazyIndirectIrradianceTexture::LazyIndirectIrradianceTexture(
+    const AtmosphereParameters& atmosphere_parameters,
+    const ReducedScatteringTexture& single_rayleigh_scattering_texture,
+    const ReducedScatteringTexture& single_mie_scattering_texture,
+    const ScatteringTexture& multiple_scattering_texture,
+    int scattering_order)
+    : LazyTexture(kIrradianceTexels),
+      atmosphere_parameters_(atmosphere_parameters),
+      single_rayleigh_scattering_texture_(single_rayleigh_scattering_texture),
+      single_mie_scattering_texture_(single_mie_scattering_texture),
+      multiple_scattering_texture_(multiple_scattering_texture),
+      scattering_order_(scattering_order) {}
+
+const IrradianceSpectrum& LazyIndirectIrradianceTexture::Get(
+    int i, int j) const {
+  const unsigned int index = GetIrradianceIndex(i, j);
+  ComputeOnce(index, [&]() {
+    value_[index] = ComputeIndirectIrradianceTexture(atmosphere_parameters_,
+        single_rayleigh_scattering_texture_, single_mie_scattering_texture_,
+        multiple_scattering_texture_, vec2(i + 0.5, j + 0.5),
+        scattering_order_);
+  });
+  return value_[index];
+}
+
+/*
+<p>The final scattering and irradiance textures of
+<code>LazyPrecomputedTextures</code> are the sums of the textures of each
+scattering order, as in <code>Model::Init</code>. The multiple scattering is
+divided by the Rayleigh phase function, to be stored with the single Rayleigh
+scattering, in the same texture:
+*/
+
+class LazyPrecomputedTextures::LazyScatteringTexture :
+    public LazyTexture<ReducedScatteringTexture> {
+ public:
+  LazyScatteringTexture(
+      const ReducedScatteringTexture& single_rayleigh_scattering_texture,
+      const std::vector<std::unique_ptr<LazyMultipleScatteringTexture>>&
+          multiple_scattering_textures)
+      : LazyTexture(kScatteringTexels),
+        single_rayleigh_scattering_texture_(
+            single_rayleigh_scattering_texture),
+        multiple_scattering_textures_(multiple_scattering_textures) {}
+
+  const IrradianceSpectrum& Get(int i, int j, int k) const override {
+    const unsigned int index = GetScatteringIndex(i, j, k);
+    ComputeOnce(index, [&]() {
+      IrradianceSpectrum scattering =
+          single_rayleigh_scattering_texture_.Get(i, j, k);
+      for (const auto& multiple_scattering : multiple_scattering_textures_) {
+        scattering = scattering + multiple_scattering->Get(i, j, k) *
+            (1.0 / RayleighPhaseFunction(multiple_scattering->GetNu(i, j, k)));
+      }
+      value_[index] = scattering;
+    });
+    return value_[index];
+  }
+
+ private:
+  const ReducedScatteringTexture& single_rayleigh_scattering_texture_;
+  const std::vector<std::unique_ptr<LazyMultipleScatteringTexture>>&
+      multiple_scattering_textures_;
+};
+
+class LazyPrecomputedTextures::LazyIrradianceTexture :
+    public LazyTexture<IrradianceTexture> {
+ public:
+  explicit LazyIrradianceTexture(
+      const std::vector<std::unique_ptr<LazyIndirectIrradianceTexture>>&
+          indirect_irradiance_textures)
+      : LazyTexture(kIrradianceTexels),
+        indirect_irradiance_textures_(indirect_irradiance_textures) {}
+
+  const IrradianceSpectrum& Get(int i, int j) const override {
+    const unsigned int index = GetIrradianceIndex(i, j);
+    ComputeOnce(index, [&]() {
+      IrradianceSpectrum irradiance =
+          IrradianceSpectrum(0.0 * watt_per_square_meter_per_nm);
+      for (const auto& indirect_irradiance : indirect_irradiance_textures_) {
+        irradiance = irradiance + indirect_irradiance->Get(i, j);
+      }
+      value_[index] = irradiance;
+    });
+    return value_[index];
+  }
+
+ private:
+  const std::vector<std::unique_ptr<LazyIndirectIrradianceTexture>>&
+      indirect_irradiance_textures_;
+};
+
+/*
+<p>The intermediate textures are connected as in <code>Model::Init</code>: the
+scattering density of order n uses the multiple scattering of order n - 1 and
+the indirect irradiance of order n - 2 (or the single scattering and the direct
+irradiance for n = 2), and the indirect irradiance of order n uses the multiple
+scattering of order n (or the single scattering for n = 1):
+*/
+
+LazyPrecomputedTextures::LazyPrecomputedTextures(
+    const AtmosphereParameters& atmosphere_parameters,
+    unsigned int num_scattering_orders)
+    : atmosphere_parameters_(atmosphere_parameters) {
+  const AtmosphereParameters& atmosphere = atmosphere_parameters_;
+  transmittance_texture_.reset(new LazyTransmittanceTexture(atmosphere));
+  direct_irradiance_texture_.reset(
+      new LazyDirectIrradianceTexture(atmosphere, *transmittance_texture_));
+  single_rayleigh_scattering_texture_.reset(new LazySingleScatteringTexture(
+      atmosphere, *transmittance_texture_, true /* rayleigh */));
+  single_mie_scattering_texture_.reset(new LazySingleScatteringTexture(
+      atmosphere, *transmittance_texture_, false /* rayleigh */));
+  scattering_density_textures_.reserve(num_scattering_orders);
+  multiple_scattering_textures_.reserve(num_scattering_orders);
+  indirect_irradiance_textures_.reserve(num_scattering_orders);
+  for (unsigned int order = 2; order <= num_scattering_orders; ++order) {
+    // The scattering density of order 2 and the indirect irradiance of order
+    // 1 do not read their multiple scattering texture argument (they use the
+    // single scattering textures instead). Rather than allocating a texture
+    // only for this argument, we pass the multiple scattering texture of order
+    // 2, whose storage is allocated here, but which can only be constructed
+    // after the scattering density texture it depends on (binding a reference
+    // to it before that is fine, as long as it is not read).
+    void* storage = order == 2 ?
+        ::operator new(sizeof(LazyMultipleScatteringTexture)) : nullptr;
+    const ScatteringTexture& previous_multiple_scattering = order == 2 ?
+        *static_cast<LazyMultipleScatteringTexture*>(storage) :
+        *multiple_scattering_textures_.back();
+    try {
+      indirect_irradiance_textures_.emplace_back(
+          new LazyIndirectIrradianceTexture(atmosphere,
+              *single_rayleigh_scattering_texture_,
+              *single_mie_scattering_texture_, previous_multiple_scattering,
+              order - 1));
+      const IrradianceTexture& previous_irradiance = order == 2 ?
+          static_cast<const IrradianceTexture&>(*direct_irradiance_texture_) :
+          *indirect_irradiance_textures_[order - 3];
+      scattering_density_textures_.emplace_back(
+          new LazyScatteringDensityTexture(atmosphere, *transmittance_texture_,
+              *single_rayleigh_scattering_texture_,
+              *single_mie_scattering_texture_, previous_multiple_scattering,
+              previous_irradiance, order));
+      const ScatteringDensityTexture& scattering_density =
+          *scattering_density_textures_.back();
+      multiple_scattering_textures_.emplace_back(storage == nullptr ?
+          new LazyMultipleScatteringTexture(atmosphere,
+              *transmittance_texture_, scattering_density) :
+          new (storage) LazyMultipleScatteringTexture(atmosphere,
+              *transmittance_texture_, scattering_density));
+    } catch (...) {
+      ::operator delete(storage);
+      throw;
+    }
+  }
+  scattering_texture_.reset(new LazyScatteringTexture(
+      *single_rayleigh_scattering_texture_, multiple_scattering_textures_));
+  irradiance_texture_.reset(
+      new LazyIrradianceTexture(indirect_irradiance_textures_));
+}
+
+LazyPrecomputedTextures::~LazyPrecomputedTextures() {}
+
+const ReducedScatteringTexture&
+LazyPrecomputedTextures::scattering_texture() const {
+  return *scattering_texture_;
+}
+
+const IrradianceTexture& LazyPrecomputedTextures::irradiance_texture() const {
+  return *irradiance_texture_;
+}
+
+unsigned int LazyPrecomputedTextures::num_computed_texels() const {
+  unsigned int result = transmittance_texture_->num_computed_texels() +
+      direct_irradiance_texture_->num_computed_texels() +
+      single_rayleigh_scattering_texture_->num_computed_texels() +
+      single_mie_scattering_texture_->num_computed_texels() +
+      scattering_texture_->num_computed_texels() +
+      irradiance_texture_->num_computed_texels();
+  for (const auto& texture : scattering_density_textures_) {
+    result += texture->num_computed_texels();
+  }
+  for (const auto& texture : multiple_scattering_textures_) {
+    result += texture->num_computed_texels();
+  }
+  for (const auto& texture : indirect_irradiance_textures_) {
+    result += texture->num_computed_texels();
+  }
+  return result;
+}
+
+}  // namespace reference
+}  // namespace atmosphere
@@ -0,0 +1,300 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/lazy_textures.h</h2>
+
+<p>This file provides lazily computed versions of the textures precomputed by
+the CPU <a href="model.h.html"><code>Model</code></a>, i.e. textures whose
+texels are computed the first time they are read, with the
+<a href="functions.h.html">functions</a> of the model. They can be used as
+inputs of these functions, e.g. to test a function which needs a precomputed
+texture without precomputing the whole texture (see
+<a href="functions_test.cc.html">functions_test.cc</a>), or to compute the sky
+radiance for a few view rays with new atmosphere parameters, without a full
+precomputation (see <code>LazyPrecomputedTextures</code> below).
+
+<p>The lazy textures can be read concurrently from several threads. For this,
+each texel has an atomic state (not computed, being computed, or computed): the
+first thread reading a texel which is not computed yet computes it, while the
+other threads reading it at the same time wait for this computation to finish.
+A texel which is already computed is read without any lock.
+*/
+
+#ifndef ATMOSPHERE_REFERENCE_LAZY_TEXTURES_H_
+#define ATMOSPHERE_REFERENCE_LAZY_TEXTURES_H_
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "atmosphere/reference/definitions.h"
+
+namespace atmosphere {
+namespace reference {
+
+// The base class of the lazy textures, providing the state of each texel of a
+// texture of the given type (a TransmittanceTexture, a ScatteringTexture,
+// etc).
+template<class Texture>
+class LazyTexture : public Texture {
+ public:
+  // Returns the number of texels computed so far.
+  unsigned int num_computed_texels() const {
+    return num_computed_texels_.load(std::memory_order_relaxed);
+  }
+
+  // Marks all the texels as not computed. This must not be called while other
+  // threads are reading this texture.
+  void Clear() {
+    for (unsigned int i = 0; i < num_texels_; ++i) {
+      state_[i].store(kNotComputed, std::memory_order_relaxed);
+    }
+    num_computed_texels_.store(0, std::memory_order_relaxed);
+  }
+
+ protected:
+  explicit LazyTexture(unsigned int num_texels)
+      : num_texels_(num_texels),
+        state_(new std::atomic<unsigned char>[num_texels]),
+        num_computed_texels_(0) {
+    Clear();
+  }
+
+  // Calls 'compute_texel' if the texel with the given index has not been
+  // computed yet, and if no other thread is computing it. Otherwise, waits
+  // until it has been computed by the other thread, if necessary. In all
+  // cases, the result of 'compute_texel' is visible when this method returns.
+  template<class Function>
+  void ComputeOnce(unsigned int index, const Function& compute_texel) const {
+    std::atomic<unsigned char>& state = state_[index];
+    if (state.load(std::memory_order_acquire) == kComputed) {
+      return;
+    }
+    unsigned char expected = kNotComputed;
+    if (state.compare_exchange_strong(expected, kComputing,
+            std::memory_order_acquire)) {
+      compute_texel();
+      num_computed_texels_.fetch_add(1, std::memory_order_relaxed);
+      state.store(kComputed, std::memory_order_release);
+    } else {
+      while (state.load(std::memory_order_acquire) != kComputed) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+ private:
+  static constexpr unsigned char kNotComputed = 0;
+  static constexpr unsigned char kComputing = 1;
+  static constexpr unsigned char kComputed = 2;
+
+  const unsigned int num_texels_;
+  std::unique_ptr<std::atomic<unsigned char>[]> state_;
+  mutable std::atomic<unsigned int> num_computed_texels_;
+};
+
+// A lazy transmittance texture (see
+// ComputeTransmittanceToTopAtmosphereBoundaryTexture).
+class LazyTransmittanceTexture : public LazyTexture<TransmittanceTexture> {
+ public:
+  explicit LazyTransmittanceTexture(
+      const AtmosphereParameters& atmosphere_parameters);
+
+  const DimensionlessSpectrum& Get(int i, int j) const override;
+
+ private:
+  const AtmosphereParameters& atmosphere_parameters_;
+};
+
+// A lazy direct irradiance texture (see ComputeDirectIrradianceTexture).
+class LazyDirectIrradianceTexture : public LazyTexture<IrradianceTexture> {
+ public:
+  LazyDirectIrradianceTexture(
+      const AtmosphereParameters& atmosphere_parameters,
+      const TransmittanceTexture& transmittance_texture);
+
+  const IrradianceSpectrum& Get(int i, int j) const override;
+
+ private:
+  const AtmosphereParameters& atmosphere_parameters_;
+  const TransmittanceTexture& transmittance_texture_;
+};
+
+// A lazy single Rayleigh or Mie scattering texture (see
+// ComputeSingleScatteringTexture).
+class LazySingleScatteringTexture :
+    public LazyTexture<ReducedScatteringTexture> {
+ public:
+  LazySingleScatteringTexture(
+      const AtmosphereParameters& atmosphere_parameters,
+      const TransmittanceTexture& transmittance_texture,
+      bool rayleigh);
+
+  const IrradianceSpectrum& Get(int i, int j, int k) const override;
+
+ private:
+  const AtmosphereParameters& atmosphere_parameters_;
+  const TransmittanceTexture& transmittance_texture_;
+  const bool rayleigh_;
+};
+
+// A lazy scattering density texture, for the given scattering order (see
+// ComputeScatteringDensityTexture).
+class LazyScatteringDensityTexture :
+    public LazyTexture<ScatteringDensityTexture> {
+ public:
+  LazyScatteringDensityTexture(
+      const AtmosphereParameters& atmosphere_parameters,
+      const TransmittanceTexture& transmittance_texture,
+      const ReducedScatteringTexture& single_rayleigh_scattering_texture,
+      const ReducedScatteringTexture& single_mie_scattering_texture,
+      const ScatteringTexture& multiple_scattering_texture,
+      const IrradianceTexture& irradiance_texture,
+      int order);
+
+  const RadianceDensitySpectrum& Get(int i, int j, int k) const override;
+
+ private:
+  const AtmosphereParameters& atmosphere_parameters_;
+  const TransmittanceTexture& transmittance_texture_;
+  const ReducedScatteringTexture& single_rayleigh_scattering_texture_;
+  const ReducedScatteringTexture& single_mie_scattering_texture_;
+  const ScatteringTexture& multiple_scattering_texture_;
+  const IrradianceTexture& irradiance_texture_;
+  const int order_;
+};
+
+// A lazy multiple scattering texture, for one scattering order (see
+// ComputeMultipleScatteringTexture).
+class LazyMultipleScatteringTexture : public LazyTexture<ScatteringTexture> {
+ public:
+  LazyMultipleScatteringTexture(
+      const AtmosphereParameters& atmosphere_parameters,
+      const TransmittanceTexture& transmittance_texture,
+      const ScatteringDensityTexture& scattering_density_texture);
+
+  const RadianceSpectrum& Get(int i, int j, int k) const override;
+
+  // Returns the cosine of the view-sun angle of the given texel.
+  Number GetNu(int i, int j, int k) const;
+
+ private:
+  const AtmosphereParameters& atmosphere_parameters_;
+  const TransmittanceTexture& transmittance_texture_;
+  const ScatteringDensityTexture& scattering_density_texture_;
+  mutable std::vector<Number> nu_;
+};
+
+// A lazy indirect irradiance texture, for the given scattering order (see
+// ComputeIndirectIrradianceTexture).
+class LazyIndirectIrradianceTexture : public LazyTexture<IrradianceTexture> {
+ public:
+  LazyIndirectIrradianceTexture(
+      const AtmosphereParameters& atmosphere_parameters,
+      const ReducedScatteringTexture& single_rayleigh_scattering_texture,
+      const ReducedScatteringTexture& single_mie_scattering_texture,
+      const ScatteringTexture& multiple_scattering_texture,
+      int scattering_order);
+
+  const IrradianceSpectrum& Get(int i, int j) const override;
+
+ private:
+  const AtmosphereParameters& atmosphere_parameters_;
+  const ReducedScatteringTexture& single_rayleigh_scattering_texture_;
+  const ReducedScatteringTexture& single_mie_scattering_texture_;
+  const ScatteringTexture& multiple_scattering_texture_;
+  const int scattering_order_;
+};
+
+// The lazy equivalent of the textures precomputed by Model::Init, i.e. of the
+// transmittance texture, of the scattering texture (containing the single
+// Rayleigh scattering and the multiple scattering), of the single Mie
+// scattering texture, and of the irradiance texture (containing the indirect
+// irradiance only). They are computed from the intermediate textures of all
+// the scattering orders, which are themselves lazy. These textures can be used
+// with the GetSkyRadiance, GetSkyRadianceToPoint and GetSunAndSkyIrradiance
+// functions, which then only compute the texels they need.
+//
+// Note that only the computations are lazy, not the memory allocations: each
+// lazy texture allocates all its texels (plus one byte of state per texel)
+// when it is created. Each scattering order from 2 to num_scattering_orders
+// thus costs a scattering density texture and a multiple scattering texture,
+// i.e. 2 * SCATTERING_TEXTURE_WIDTH * SCATTERING_TEXTURE_HEIGHT *
+// SCATTERING_TEXTURE_DEPTH spectra (about 790 MB with the default constants
+// and 47 double precision wavelength samples per spectrum), plus a small
+// indirect irradiance texture. The transmittance, direct irradiance, single
+// scattering and final textures cost about 1.2 GB more, independently of the
+// number of scattering orders.
+class LazyPrecomputedTextures {
+ public:
+  LazyPrecomputedTextures(const AtmosphereParameters& atmosphere_parameters,
+      unsigned int num_scattering_orders = 4);
+  ~LazyPrecomputedTextures();
+
+  const TransmittanceTexture& transmittance_texture() const {
+    return *transmittance_texture_;
+  }
+  const ReducedScatteringTexture& scattering_texture() const;
+  const ReducedScatteringTexture& single_mie_scattering_texture() const {
+    return *single_mie_scattering_texture_;
+  }
+  const IrradianceTexture& irradiance_texture() const;
+
+  // Returns the number of texels computed so far, in all the final and
+  // intermediate textures.
+  unsigned int num_computed_texels() const;
+
+ private:
+  class LazyScatteringTexture;
+  class LazyIrradianceTexture;
+
+  const AtmosphereParameters atmosphere_parameters_;
+  std::unique_ptr<LazyTransmittanceTexture> transmittance_texture_;
+  std::unique_ptr<LazyDirectIrradianceTexture> direct_irradiance_texture_;
+  std::unique_ptr<LazySingleScatteringTexture>
+      single_rayleigh_scattering_texture_;
+  std::unique_ptr<LazySingleScatteringTexture>
+      single_mie_scattering_texture_;
+  // The textures of the scattering orders 2 to num_scattering_orders.
+  std::vector<std::unique_ptr<LazyScatteringDensityTexture>>
+      scattering_density_textures_;
+  std::vector<std::unique_ptr<LazyMultipleScatteringTexture>>
+      multiple_scattering_textures_;
+  // The textures of the scattering orders 1 to num_scattering_orders - 1.
+  std::vector<std::unique_ptr<LazyIndirectIrradianceTexture>>
+      indirect_irradiance_textures_;
+  std::unique_ptr<LazyScatteringTexture> scattering_texture_;
+  std::unique_ptr<LazyIrradianceTexture> irradiance_texture_;
+};
+
+}  // namespace reference
+}  // namespace atmosphere
+
+#endif  // ATMOSPHERE_REFERENCE_LAZY_TEXTURES_H_
@@ -0,0 +1,205 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/lazy_textures_test.cc</h2>
+
+<p>This file provides unit tests for the <a href="lazy_textures.h.html">lazy
+textures</a>. They use the same (arbitrary) atmosphere parameters as the
+<a href="functions_test.cc.html">functions tests</a>:
+*/
+
+#include "atmosphere/reference/lazy_textures.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "atmosphere/reference/definitions.h"
+#include "atmosphere/reference/functions.h"
+#include "test/test_case.h"
+
+namespace atmosphere {
+namespace reference {
+
+namespace {
+
+constexpr unsigned int kNumThreads = 4;
+
+AtmosphereParameters GetTestAtmosphereParameters() {
+  AtmosphereParameters atmosphere_parameters;
+  atmosphere_parameters.solar_irradiance[0] =
+      123.0 * watt_per_square_meter_per_nm;
+  atmosphere_parameters.bottom_radius = 1000.0 * km;
+  atmosphere_parameters.top_radius = 1500.0 * km;
+  atmosphere_parameters.rayleigh_density.layers[1] = DensityProfileLayer(
+      0.0 * m, 1.0, -1.0 / (60.0 * km), 0.0 / m, 0.0);
+  atmosphere_parameters.rayleigh_scattering[0] = 0.001 / km;
+  atmosphere_parameters.mie_density.layers[1] = DensityProfileLayer(
+      0.0 * m, 1.0, -1.0 / (30.0 * km), 0.0 / m, 0.0);
+  atmosphere_parameters.mie_scattering[0] = 0.0015 / km;
+  atmosphere_parameters.mie_extinction[0] = 0.002 / km;
+  atmosphere_parameters.ground_albedo[0] = 0.1;
+  atmosphere_parameters.mu_s_min = -1.0;
+  return atmosphere_parameters;
+}
+
+// Calls 'function' from kNumThreads threads at the same time.
+template<class Function>
+void RunConcurrently(const Function& function) {
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back(function);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // anonymous namespace
+
+class LazyTexturesTest : public dimensional::TestCase {
+ public:
+  template<typename T>
+  LazyTexturesTest(const std::string& name, T test)
+      : TestCase("LazyTexturesTest " + name, static_cast<Test>(test)),
+        atmosphere_parameters_(GetTestAtmosphereParameters()) {}
+
+/*
+<p>The first test reads the same texels from several threads at the same time,
+and checks that each texel is computed only once, at the right index, and that
+all the threads get the correct values:
+*/
+
+  void TestConcurrentReads() {
+    LazyTransmittanceTexture transmittance_texture(atmosphere_parameters_);
+    // Not a std::vector<bool>, whose elements share memory words, so that each
+    // thread can write its own element without a data race.
+    std::vector<char> correct_values(kNumThreads, true);
+    std::atomic<unsigned int> thread_index(0);
+    RunConcurrently([&]() {
+      const unsigned int index = thread_index.fetch_add(1);
+      for (int j = 0; j < TRANSMITTANCE_TEXTURE_HEIGHT; j += 7) {
+        for (int i = 0; i < TRANSMITTANCE_TEXTURE_WIDTH; i += 13) {
+          const DimensionlessSpectrum expected =
+              ComputeTransmittanceToTopAtmosphereBoundaryTexture(
+                  atmosphere_parameters_, vec2(i + 0.5, j + 0.5));
+          if (!(transmittance_texture.Get(i, j)[0] == expected[0])) {
+            correct_values[index] = false;
+          }
+        }
+      }
+    });
+    for (unsigned int i = 0; i < kNumThreads; ++i) {
+      ExpectTrue(correct_values[i]);
+    }
+    const unsigned int kNumTexels =
+        ((TRANSMITTANCE_TEXTURE_WIDTH + 12) / 13) *
+        ((TRANSMITTANCE_TEXTURE_HEIGHT + 6) / 7);
+    ExpectTrue(transmittance_texture.num_computed_texels() == kNumTexels);
+    for (int j = 0; j < TRANSMITTANCE_TEXTURE_HEIGHT; ++j) {
+      for (int i = 0; i < TRANSMITTANCE_TEXTURE_WIDTH; ++i) {
+        transmittance_texture.Get(i, j);
+      }
+    }
+    ExpectTrue(transmittance_texture.num_computed_texels() ==
+        TRANSMITTANCE_TEXTURE_WIDTH * TRANSMITTANCE_TEXTURE_HEIGHT);
+  }
+
+/*
+<p>After a <code>Clear</code>, the texels must be computed again, with the new
+atmosphere parameters:
+*/
+
+  void TestClear() {
+    LazyTransmittanceTexture transmittance_texture(atmosphere_parameters_);
+    const Number transmittance = transmittance_texture.Get(0, 0)[0];
+    atmosphere_parameters_.mie_extinction[0] = 0.004 / km;
+    ExpectTrue(transmittance_texture.Get(0, 0)[0] == transmittance);
+    transmittance_texture.Clear();
+    ExpectTrue(transmittance_texture.num_computed_texels() == 0);
+    ExpectLess(transmittance_texture.Get(0, 0)[0], transmittance);
+    ExpectTrue(transmittance_texture.num_computed_texels() == 1);
+  }
+
+/*
+<p>Finally, the final textures of <code>LazyPrecomputedTextures</code> must be
+equal to the sum of the intermediate textures of each scattering order, as in
+<code>Model::Init</code>, and they must only compute the texels they need:
+*/
+
+  void TestLazyPrecomputedTextures() {
+    LazyPrecomputedTextures textures(atmosphere_parameters_,
+        2 /* num_scattering_orders */);
+    LazyTransmittanceTexture transmittance_texture(atmosphere_parameters_);
+    LazySingleScatteringTexture single_rayleigh_scattering_texture(
+        atmosphere_parameters_, transmittance_texture, true /* rayleigh */);
+    LazySingleScatteringTexture single_mie_scattering_texture(
+        atmosphere_parameters_, transmittance_texture, false /* rayleigh */);
+    ScatteringTexture no_multiple_scattering(
+        RadianceSpectrum(0.0 * watt_per_square_meter_per_sr_per_nm));
+    LazyIndirectIrradianceTexture indirect_irradiance_texture(
+        atmosphere_parameters_, single_rayleigh_scattering_texture,
+        single_mie_scattering_texture, no_multiple_scattering, 1);
+
+    RunConcurrently([&]() {
+      textures.irradiance_texture().Get(5, 3);
+      textures.single_mie_scattering_texture().Get(7, 11, 2);
+    });
+    ExpectTrue(textures.irradiance_texture().Get(5, 3)[0] ==
+        indirect_irradiance_texture.Get(5, 3)[0]);
+    ExpectTrue(textures.single_mie_scattering_texture().Get(7, 11, 2)[0] ==
+        single_mie_scattering_texture.Get(7, 11, 2)[0]);
+    ExpectLess(0.0 * watt_per_square_meter_per_nm,
+        textures.irradiance_texture().Get(5, 3)[0]);
+    ExpectTrue(textures.num_computed_texels() <
+        SCATTERING_TEXTURE_WIDTH * SCATTERING_TEXTURE_HEIGHT *
+            SCATTERING_TEXTURE_DEPTH / 10);
+  }
+
+ private:
+  AtmosphereParameters atmosphere_parameters_;
+};
+
+namespace {
+
+LazyTexturesTest concurrent_reads(
+    "ConcurrentReads",
+    &LazyTexturesTest::TestConcurrentReads);
+LazyTexturesTest clear(
+    "Clear",
+    &LazyTexturesTest::TestClear);
+LazyTexturesTest lazy_precomputed_textures(
+    "LazyPrecomputedTextures",
+    &LazyTexturesTest::TestLazyPrecomputedTextures);
+
+}  // anonymous namespace
+
+}  // namespace reference
+}  // namespace atmosphere
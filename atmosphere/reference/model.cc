@@ -44,12 +44,17 @@ This is the role of the following code.
 
 #include "atmosphere/reference/model.h"
 
+#include <atomic>
+#include <cstdio>
+
 #include "atmosphere/reference/functions.h"
+#include "atmosphere/trace.h"
 #include "util/progress_bar.h"
 
 /*
 <p>The constructor of the <code>Model</code> class allocates the precomputed
-textures, but does not initialize them.
+textures, but does not initialize them (the aerial perspective volume is only
+allocated if <code>UpdateAerialPerspective</code> is called).
 */
 
 namespace atmosphere {
@@ -58,7 +63,12 @@ namespace reference {
 Model::Model(const AtmosphereParameters& atmosphere,
              const std::string& cache_directory)
     : atmosphere_(atmosphere),
-      cache_directory_(cache_directory) {
+      cache_directory_(cache_directory),
+      num_threads_(0),
+      reverse_job_order_(false),
+      init_listener_(nullptr),
+      clip_from_view_ray_{{1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0}},
+      aerial_perspective_max_distance_(0.0 * m) {
   transmittance_texture_.reset(new TransmittanceTexture());
   scattering_texture_.reset(new ReducedScatteringTexture());
   single_mie_scattering_texture_.reset(new ReducedScatteringTexture());
@@ -71,6 +81,8 @@ the textures from disk, if they have already been precomputed.
 */
 
 void Model::Init(unsigned int num_scattering_orders) {
+  trace::Span span("reference", "Init", "scattering_orders",
+      num_scattering_orders);
   std::ifstream file;
   file.open(cache_directory_ + "transmittance.dat");
   if (file.good()) {
@@ -107,7 +119,9 @@ destroyed at the end of this method).
 <p>Since the computation phase takes several minutes, we show a progress bar to
 provide feedback to the user. The following constants roughly represent the
 relative duration of each computation phase, and are used to display a progress
-value which is roughly proportional to the elapsed time.
+value which is roughly proportional to the elapsed time (the actual duration of
+each phase can be measured with <a href="model_bench.cc.html">model_bench.cc
+</a>).
 */
 
   constexpr unsigned int kTransmittanceProgress = 1;
@@ -133,11 +147,21 @@ value which is roughly proportional to the elapsed time.
 /*
 <p>The remaining code of this method implements Algorithm 4.1 of our paper,
 using several threads to speed up computations (by computing several texels of
-a texture in parallel).
+a texture in parallel). Each step is a "phase" computing one texture, executed
+with the <code>RunPhase</code> method defined below.
 */
 
+  constexpr unsigned int kTransmittanceTexels =
+      TRANSMITTANCE_TEXTURE_WIDTH * TRANSMITTANCE_TEXTURE_HEIGHT;
+  constexpr unsigned int kIrradianceTexels =
+      IRRADIANCE_TEXTURE_WIDTH * IRRADIANCE_TEXTURE_HEIGHT;
+  constexpr unsigned int kScatteringTexels = SCATTERING_TEXTURE_WIDTH *
+      SCATTERING_TEXTURE_HEIGHT * SCATTERING_TEXTURE_DEPTH;
+
+  phase_counters_.clear();
+
   // Compute the transmittance, and store it in transmittance_texture_.
-  RunJobs([&](unsigned int j) {
+  RunPhase("transmittance", 0, kTransmittanceTexels, [&](unsigned int j) {
     for (unsigned int i = 0; i < TRANSMITTANCE_TEXTURE_WIDTH; ++i) {
       transmittance_texture_->Set(i, j,
           ComputeTransmittanceToTopAtmosphereBoundaryTexture(
@@ -149,7 +173,7 @@ a texture in parallel).
   // Compute the direct irradiance, store it in delta_irradiance_texture, and
   // initialize irradiance_texture_ with zeros (we don't want the direct
   // irradiance in irradiance_texture_, but only the irradiance from the sky).
-  RunJobs([&](unsigned int j) {
+  RunPhase("direct_irradiance", 0, kIrradianceTexels, [&](unsigned int j) {
     for (unsigned int i = 0; i < IRRADIANCE_TEXTURE_WIDTH; ++i) {
       delta_irradiance_texture->Set(i, j,
           ComputeDirectIrradianceTexture(
@@ -163,7 +187,7 @@ a texture in parallel).
   // Compute the rayleigh and mie single scattering, and store them in
   // delta_rayleigh_scattering_texture and delta_mie_scattering_texture, as well
   // as in scattering_texture.
-  RunJobs([&](unsigned int k) {
+  RunPhase("single_scattering", 1, kScatteringTexels, [&](unsigned int k) {
     for (unsigned int j = 0; j < SCATTERING_TEXTURE_HEIGHT; ++j) {
       for (unsigned int i = 0; i < SCATTERING_TEXTURE_WIDTH; ++i) {
         IrradianceSpectrum rayleigh;
@@ -184,7 +208,8 @@ a texture in parallel).
        ++scattering_order) {
     // Compute the scattering density, and store it in
     // delta_scattering_density_texture.
-    RunJobs([&](unsigned int k) {
+    RunPhase("scattering_density", scattering_order, kScatteringTexels,
+        [&](unsigned int k) {
       for (unsigned int j = 0; j < SCATTERING_TEXTURE_HEIGHT; ++j) {
         for (unsigned int i = 0; i < SCATTERING_TEXTURE_WIDTH; ++i) {
           RadianceDensitySpectrum scattering_density;
@@ -201,7 +226,8 @@ a texture in parallel).
 
     // Compute the indirect irradiance, store it in delta_irradiance_texture and
     // accumulate it in irradiance_texture_.
-    RunJobs([&](unsigned int j) {
+    RunPhase("indirect_irradiance", scattering_order, kIrradianceTexels,
+        [&](unsigned int j) {
       for (unsigned int i = 0; i < IRRADIANCE_TEXTURE_WIDTH; ++i) {
         IrradianceSpectrum delta_irradiance;
         delta_irradiance = ComputeIndirectIrradianceTexture(
@@ -217,7 +243,8 @@ a texture in parallel).
     // Compute the multiple scattering, store it in
     // delta_multiple_scattering_texture, and accumulate it in
     // scattering_texture_.
-    RunJobs([&](unsigned int k) {
+    RunPhase("multiple_scattering", scattering_order, kScatteringTexels,
+        [&](unsigned int k) {
       for (unsigned int j = 0; j < SCATTERING_TEXTURE_HEIGHT; ++j) {
         for (unsigned int i = 0; i < SCATTERING_TEXTURE_WIDTH; ++i) {
           RadianceSpectrum delta_multiple_scattering;
@@ -242,6 +269,162 @@ a texture in parallel).
   single_mie_scattering_texture_->Save(
       cache_directory_ + "single_mie_scattering.dat");
   irradiance_texture_->Save(cache_directory_ + "irradiance.dat");
+
+  if (kCountersEnabled) {
+    PrintPhaseCounters();
+  }
+}
+
+/*
+<p>The phases are executed with the following methods. The first one runs the
+given jobs in parallel, with at most <code>num_threads_</code> threads. For
+this, we use the <code>RunJobs</code> function of the progress bar library,
+which uses one thread per hardware thread, to run <code>num_threads_</code>
+"worker" jobs, each executing jobs until there are no more (in reverse order if
+<code>reverse_job_order_</code> is true). The second method
+notifies the listener, if any, before and after running the jobs, and records
+the phase and each of its jobs (one "slice" of the texture computed by one
+thread) in the <a href="../trace.h.html">trace</a>, if enabled. In the
+instrumented build (see <a href="counters.h.html">counters.h</a>), it also
+collects the counters of each slice, and adds them in slice order, to get
+totals which do not depend on the number of threads. Note that the precomputed
+textures do not depend on it either, because each texel is computed by a single
+job, with the same operations whatever the thread executing it, and because the
+scattering orders are accumulated per texel, in scattering order (and
+<code>irradiance_texture_</code> only after all the jobs of a phase are done).
+Any future parallel reduction (e.g. a sum of partial results computed by
+several jobs) must preserve this property, by combining the partial results of
+each slice in slice order, as done here for the counters:
+*/
+
+void Model::RunJobs(const std::function<void(unsigned int)>& job,
+    unsigned int num_jobs) const {
+  const std::function<void(unsigned int)> ordered_job = reverse_job_order_ ?
+      std::function<void(unsigned int)>([&](unsigned int job_index) {
+        job(num_jobs - 1 - job_index);
+      }) : job;
+  if (num_threads_ == 0) {
+    ::RunJobs(ordered_job, num_jobs);
+    return;
+  }
+  std::atomic<unsigned int> next_job(0);
+  ::RunJobs([&](unsigned int) {
+    unsigned int job_index;
+    while ((job_index = next_job++) < num_jobs) {
+      ordered_job(job_index);
+    }
+  }, num_threads_);
+}
+
+void Model::RunPhase(const std::string& phase, unsigned int scattering_order,
+    unsigned int num_texels, const std::function<void(unsigned int)>& job,
+    unsigned int num_jobs) {
+  std::vector<Counters> slice_counters(kCountersEnabled ? num_jobs : 0);
+  if (init_listener_ != nullptr) {
+    init_listener_->BeginPhase(phase, scattering_order, num_texels);
+  }
+  {
+    trace::Span span("reference", phase.c_str(), "scattering_order",
+        scattering_order);
+    RunJobs([&](unsigned int slice) {
+      trace::Span slice_span("reference", phase.c_str(), "slice", slice);
+      if (kCountersEnabled) {
+        GetThreadCounters() = Counters();
+      }
+      job(slice);
+      if (kCountersEnabled) {
+        slice_counters[slice] = GetThreadCounters();
+      }
+    }, num_jobs);
+  }
+  if (init_listener_ != nullptr) {
+    init_listener_->EndPhase(phase, scattering_order, num_texels);
+  }
+  if (kCountersEnabled) {
+    PhaseCounters counters{phase, scattering_order, num_texels, Counters()};
+    for (const Counters& c : slice_counters) {
+      counters.counters += c;
+    }
+    phase_counters_.push_back(counters);
+  }
+}
+
+/*
+<p>The counters of each phase are printed with the following method, at the end
+of <code>Init</code>. For each non-null counter we print its total value and its
+average value per texel, and the percentage of true conditions for the branch
+counters:
+*/
+
+void Model::PrintPhaseCounters() const {
+  for (const PhaseCounters& phase : phase_counters_) {
+    std::printf("%s (order %u, %u texels):\n", phase.phase.c_str(),
+        phase.scattering_order, phase.num_texels);
+    const uint64_t* value = phase.counters.value;
+    for (int i = 0; i < kNumCounters; ++i) {
+      if (value[i] == 0) {
+        continue;
+      }
+      std::printf("  %-30s %15llu %12.1f/texel", kCounterNames[i],
+          static_cast<unsigned long long>(value[i]),  // NOLINT
+          static_cast<double>(value[i]) / phase.num_texels);
+      if (i == kRayIntersectsGroundTrue) {
+        std::printf(" %6.1f%%", 100.0 * value[i] / value[i - 1]);
+      }
+      std::printf("\n");
+    }
+  }
+}
+
+/*
+<p>The content of the precomputed textures can be checked with the following
+method, which hashes the bytes of each texel with the
+<a href="http://www.isthe.com/chongo/tech/comp/fnv/">FNV-1a</a> hash function
+(this is used in <a href="model_bench.cc.html">model_bench.cc</a> to check that
+they do not depend on the number of threads):
+*/
+
+namespace {
+
+template<class T>
+void HashTexel(const T& texel, uint64_t* hash) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&texel);
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    *hash = (*hash ^ bytes[i]) * 1099511628211ULL;
+  }
+}
+
+template<unsigned int W, unsigned int H, class T>
+void HashTexture(const dimensional::BinaryFunction<W, H, T>& texture,
+    uint64_t* hash) {
+  for (unsigned int j = 0; j < H; ++j) {
+    for (unsigned int i = 0; i < W; ++i) {
+      HashTexel(texture.Get(i, j), hash);
+    }
+  }
+}
+
+template<unsigned int W, unsigned int H, unsigned int D, class T>
+void HashTexture(const dimensional::TernaryFunction<W, H, D, T>& texture,
+    uint64_t* hash) {
+  for (unsigned int k = 0; k < D; ++k) {
+    for (unsigned int j = 0; j < H; ++j) {
+      for (unsigned int i = 0; i < W; ++i) {
+        HashTexel(texture.Get(i, j, k), hash);
+      }
+    }
+  }
+}
+
+}  // anonymous namespace
+
+uint64_t Model::GetTexturesChecksum() const {
+  uint64_t hash = 14695981039346656037ULL;
+  HashTexture(*transmittance_texture_, &hash);
+  HashTexture(*scattering_texture_, &hash);
+  HashTexture(*single_mie_scattering_texture_, &hash);
+  HashTexture(*irradiance_texture_, &hash);
+  return hash;
 }
 
 /*
@@ -281,5 +464,238 @@ IrradianceSpectrum Model::GetSunAndSkyIrradiance(Position point,
       *irradiance_texture_, point, normal, sun_direction, *sky_irradiance);
 }
 
+/*
+<p>The aerial perspective volume uses the same textures and the same mapping as
+the aerial perspective textures of the <code>FastModel</code> (see
+<a href="../fast_functions.glsl.html#aerial_perspective">fast_functions.glsl
+</a>). The view ray of a texel, and the texture coordinates of a point, are
+computed with the following helper functions (the second one returns false if
+the point is outside the volume):
+*/
+
+namespace {
+
+Direction GetAerialPerspectiveViewRay(
+    const std::array<double, 9>& view_ray_from_clip, unsigned int i,
+    unsigned int j) {
+  const std::array<double, 9>& matrix = view_ray_from_clip;
+  double x = 2.0 * (i + 0.5) / AERIAL_PERSPECTIVE_TEXTURE_WIDTH - 1.0;
+  double y = 2.0 * (j + 0.5) / AERIAL_PERSPECTIVE_TEXTURE_HEIGHT - 1.0;
+  return normalize(Direction(
+      matrix[0] * x + matrix[1] * y + matrix[2],
+      matrix[3] * x + matrix[4] * y + matrix[5],
+      matrix[6] * x + matrix[7] * y + matrix[8]));
+}
+
+bool GetAerialPerspectiveUv(const std::array<double, 9>& clip_from_view_ray,
+    Position camera, Position point, Length max_distance, vec2* uv) {
+  const std::array<double, 9>& matrix = clip_from_view_ray;
+  Position v = point - camera;
+  Length clip_x = matrix[0] * v.x + matrix[1] * v.y + matrix[2] * v.z;
+  Length clip_y = matrix[3] * v.x + matrix[4] * v.y + matrix[5] * v.z;
+  Length clip_z = matrix[6] * v.x + matrix[7] * v.y + matrix[8] * v.z;
+  if (clip_z <= 0.0 * m || length(v) > max_distance) {
+    return false;
+  }
+  *uv = vec2(clip_x / clip_z * 0.5 + 0.5, clip_y / clip_z * 0.5 + 0.5);
+  return uv->x >= 0.0 && uv->x <= 1.0 && uv->y >= 0.0 && uv->y <= 1.0;
+}
+
+// Inverts a 3x3 row major matrix, with its cofactor matrix.
+std::array<double, 9> Invert(const std::array<double, 9>& matrix) {
+  const std::array<double, 9>& a = matrix;
+  const std::array<double, 9> cofactors = {{
+    a[4] * a[8] - a[5] * a[7], a[5] * a[6] - a[3] * a[8],
+    a[3] * a[7] - a[4] * a[6],
+    a[2] * a[7] - a[1] * a[8], a[0] * a[8] - a[2] * a[6],
+    a[1] * a[6] - a[0] * a[7],
+    a[1] * a[5] - a[2] * a[4], a[2] * a[3] - a[0] * a[5],
+    a[0] * a[4] - a[1] * a[3]
+  }};
+  double determinant =
+      a[0] * cofactors[0] + a[1] * cofactors[1] + a[2] * cofactors[2];
+  std::array<double, 9> result;
+  for (int row = 0; row < 3; ++row) {
+    for (int col = 0; col < 3; ++col) {
+      result[col + 3 * row] = cofactors[row + 3 * col] / determinant;
+    }
+  }
+  return result;
+}
+
+}  // anonymous namespace
+
+/*
+<p>The volume is then computed with several threads, each computing a slice of
+the volume, with <code>ComputeAerialPerspectiveVolumeTexture</code>:
+*/
+
+void Model::UpdateAerialPerspective(Position camera, Direction sun_direction,
+    const std::array<double, 9>& view_ray_from_clip, Length max_distance) {
+  if (!aerial_perspective_scattering_texture_) {
+    aerial_perspective_scattering_texture_.reset(
+        new AerialPerspectiveScatteringTexture());
+    aerial_perspective_transmittance_texture_.reset(
+        new AerialPerspectiveTransmittanceTexture());
+  }
+  RunJobs([&](unsigned int k) {
+    for (unsigned int j = 0; j < AERIAL_PERSPECTIVE_TEXTURE_HEIGHT; ++j) {
+      for (unsigned int i = 0; i < AERIAL_PERSPECTIVE_TEXTURE_WIDTH; ++i) {
+        Direction view_ray =
+            GetAerialPerspectiveViewRay(view_ray_from_clip, i, j);
+        DimensionlessSpectrum transmittance;
+        aerial_perspective_scattering_texture_->Set(i, j, k,
+            ComputeAerialPerspectiveVolumeTexture(atmosphere_,
+                *transmittance_texture_, *scattering_texture_,
+                *single_mie_scattering_texture_, camera, view_ray,
+                sun_direction, k, max_distance, transmittance));
+        aerial_perspective_transmittance_texture_->Set(i, j, k, transmittance);
+      }
+    }
+  }, AERIAL_PERSPECTIVE_TEXTURE_DEPTH);
+  clip_from_view_ray_ = Invert(view_ray_from_clip);
+  aerial_perspective_max_distance_ = max_distance;
+}
+
+RadianceSpectrum Model::GetSkyRadianceToPointFromVolume(Position camera,
+    Position point, Direction sun_direction,
+    DimensionlessSpectrum* transmittance) const {
+  vec2 uv;
+  if (aerial_perspective_scattering_texture_ &&
+      GetAerialPerspectiveUv(clip_from_view_ray_, camera, point,
+          aerial_perspective_max_distance_, &uv)) {
+    return GetAerialPerspective(*aerial_perspective_scattering_texture_,
+        *aerial_perspective_transmittance_texture_, uv, length(point - camera),
+        aerial_perspective_max_distance_, *transmittance);
+  }
+  return GetSkyRadianceToPoint(
+      camera, point, 0.0 * m, sun_direction, transmittance);
+}
+
+/*
+<p>The <code>FastModel</code> class does not need any precomputation. Its
+constructor simply allocates the textures, which are computed in
+<code>Update</code>:
+*/
+
+FastModel::FastModel(const AtmosphereParameters& atmosphere)
+    : atmosphere_(atmosphere),
+      atmosphere_changed_(true),
+      clip_from_view_ray_{{1.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 1.0}},
+      aerial_perspective_max_distance_(1.0 * m) {
+  transmittance_texture_.reset(new TransmittanceTexture());
+  multi_scattering_texture_.reset(new MultiScatteringTexture());
+  sky_view_texture_.reset(new SkyViewTexture());
+  aerial_perspective_scattering_texture_.reset(
+      new AerialPerspectiveScatteringTexture());
+  aerial_perspective_transmittance_texture_.reset(
+      new AerialPerspectiveTransmittanceTexture());
+}
+
+void FastModel::SetAtmosphere(const AtmosphereParameters& atmosphere) {
+  atmosphere_ = atmosphere;
+  atmosphere_changed_ = true;
+}
+
+/*
+<p>As in <code>Model::Init</code>, the textures are computed with several
+threads, each computing a row or a slice of a texture:
+*/
+
+void FastModel::Update(Position camera, Direction sun_direction,
+    const std::array<double, 9>& view_ray_from_clip,
+    Length aerial_perspective_max_distance) {
+  if (atmosphere_changed_) {
+    RunJobs([&](unsigned int j) {
+      for (unsigned int i = 0; i < TRANSMITTANCE_TEXTURE_WIDTH; ++i) {
+        transmittance_texture_->Set(i, j,
+            ComputeTransmittanceToTopAtmosphereBoundaryTexture(
+                atmosphere_, vec2(i + 0.5, j + 0.5)));
+      }
+    }, TRANSMITTANCE_TEXTURE_HEIGHT);
+    RunJobs([&](unsigned int j) {
+      for (unsigned int i = 0; i < MULTI_SCATTERING_TEXTURE_WIDTH; ++i) {
+        multi_scattering_texture_->Set(i, j,
+            ComputeMultiScatteringTexture(atmosphere_, *transmittance_texture_,
+                vec2(i + 0.5, j + 0.5)));
+      }
+    }, MULTI_SCATTERING_TEXTURE_HEIGHT);
+    atmosphere_changed_ = false;
+  }
+
+  Length r = max(atmosphere_.bottom_radius,
+      min(atmosphere_.top_radius, length(camera)));
+  Number mu_s = max(Number(-1.0),
+      min(Number(1.0), dot(camera, sun_direction) / length(camera)));
+  RunJobs([&](unsigned int j) {
+    for (unsigned int i = 0; i < SKY_VIEW_TEXTURE_WIDTH; ++i) {
+      sky_view_texture_->Set(i, j,
+          ComputeSkyViewTexture(atmosphere_, *transmittance_texture_,
+              *multi_scattering_texture_, vec2(i + 0.5, j + 0.5), r, mu_s));
+    }
+  }, SKY_VIEW_TEXTURE_HEIGHT);
+
+  RunJobs([&](unsigned int k) {
+    for (unsigned int j = 0; j < AERIAL_PERSPECTIVE_TEXTURE_HEIGHT; ++j) {
+      for (unsigned int i = 0; i < AERIAL_PERSPECTIVE_TEXTURE_WIDTH; ++i) {
+        Direction view_ray =
+            GetAerialPerspectiveViewRay(view_ray_from_clip, i, j);
+        DimensionlessSpectrum transmittance;
+        aerial_perspective_scattering_texture_->Set(i, j, k,
+            ComputeAerialPerspectiveTexture(atmosphere_,
+                *transmittance_texture_, *multi_scattering_texture_, camera,
+                view_ray, sun_direction, k, aerial_perspective_max_distance,
+                transmittance));
+        aerial_perspective_transmittance_texture_->Set(i, j, k, transmittance);
+      }
+    }
+  }, AERIAL_PERSPECTIVE_TEXTURE_DEPTH);
+  clip_from_view_ray_ = Invert(view_ray_from_clip);
+  aerial_perspective_max_distance_ = aerial_perspective_max_distance;
+}
+
+/*
+<p>The other methods are implemented like the corresponding functions of the
+GPU <code>FastModel</code> shader:
+*/
+
+RadianceSpectrum FastModel::GetSolarRadiance() const {
+  SolidAngle sun_solid_angle = 2.0 * PI *
+      (1.0 - cos(atmosphere_.sun_angular_radius)) * sr;
+  return atmosphere_.solar_irradiance * (1.0 / sun_solid_angle);
+}
+
+RadianceSpectrum FastModel::GetSkyRadiance(Position camera,
+    Direction view_ray, Length shadow_length, Direction sun_direction,
+    DimensionlessSpectrum* transmittance) const {
+  return GetFastSkyRadiance(atmosphere_, *transmittance_texture_,
+      *multi_scattering_texture_, *sky_view_texture_, camera, view_ray,
+      sun_direction, *transmittance);
+}
+
+RadianceSpectrum FastModel::GetSkyRadianceToPoint(Position camera,
+    Position point, Length shadow_length, Direction sun_direction,
+    DimensionlessSpectrum* transmittance) const {
+  vec2 uv;
+  if (GetAerialPerspectiveUv(clip_from_view_ray_, camera, point,
+          aerial_perspective_max_distance_, &uv)) {
+    return GetAerialPerspective(*aerial_perspective_scattering_texture_,
+        *aerial_perspective_transmittance_texture_, uv, length(point - camera),
+        aerial_perspective_max_distance_, *transmittance);
+  }
+  return ComputeAerialPerspective(atmosphere_, *transmittance_texture_,
+      *multi_scattering_texture_, camera, normalize(point - camera),
+      length(point - camera), sun_direction, AERIAL_PERSPECTIVE_TEXTURE_DEPTH,
+      *transmittance);
+}
+
+IrradianceSpectrum FastModel::GetSunAndSkyIrradiance(Position point,
+    Direction normal, Direction sun_direction,
+    IrradianceSpectrum* sky_irradiance) const {
+  return GetFastSunAndSkyIrradiance(atmosphere_, *transmittance_texture_,
+      *multi_scattering_texture_, point, normal, sun_direction,
+      *sky_irradiance);
+}
+
 }  // namespace reference
 }  // namespace atmosphere
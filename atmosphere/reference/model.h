@@ -42,20 +42,71 @@ desired,</li>
 <li>delete your <code>Model</code> when you no longer need it (the destructor
 deletes the precomputed textures from memory).</li>
 </ul>
+
+<p>The textures saved in the cache directory can also be loaded in a GPU
+<a href="../model.h.html"><code>Model</code></a> with the same atmosphere
+parameters, with <code>LoadReferenceTextures</code>, to avoid precomputing them
+again on GPU.
+
+<p>For scenes with many points, a <code>Model</code> can also compute an aerial
+perspective volume, i.e. the in-scattered radiance and the transmittance between
+a viewer and the points of a 3D grid aligned with its view frustum, with
+<code>UpdateAerialPerspective</code>. Then
+<code>GetSkyRadianceToPointFromVolume</code> returns the aerial perspective for
+a point with a single trilinear lookup in this volume (without light shafts,
+i.e. with a null <code>shadow_length</code>).
+
+<p>The precomputations done in <code>Init</code> use one thread per hardware
+thread by default, which can be changed with <code>SetNumThreads</code>. An
+optional <code>InitListener</code> can also be notified at the beginning and at
+the end of each precomputation phase, e.g. to measure their duration. The
+precomputed textures do not depend on the number of threads, nor on the order in
+which the threads execute their jobs: for a given executable they are
+byte-identical, which can be checked with the hash of their content returned by
+<code>GetTexturesChecksum</code> (see
+<a href="model_bench.cc.html">model_bench.cc</a>, which also uses
+<code>SetReverseJobOrder</code> to change the job scheduling order).
+
+<p>The <code>FastModel</code> class is the CPU version of the GPU
+<a href="../model.h.html"><code>FastModel</code></a>, based on the textures
+described in <a href="../fast_functions.glsl.html">fast_functions.glsl</a>. It
+does not need any precomputation: the textures are computed in
+<code>Update</code>, for a given viewer, Sun direction and projection, and the
+other methods must then be called with the same viewer and Sun direction (the
+<code>shadow_length</code> arguments are ignored).
 */
 
 #ifndef ATMOSPHERE_REFERENCE_MODEL_H_
 #define ATMOSPHERE_REFERENCE_MODEL_H_
 
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "atmosphere/reference/counters.h"
 #include "atmosphere/reference/definitions.h"
 
 namespace atmosphere {
 namespace reference {
 
+class InitListener {
+ public:
+  virtual ~InitListener() {}
+
+  // Called before and after each precomputation phase of Model::Init. 'phase'
+  // is the name of the phase (e.g. "scattering_density"), 'scattering_order'
+  // the scattering order it computes (0 for the transmittance and the direct
+  // irradiance), and 'num_texels' the number of texels it computes. These
+  // methods are called from the thread calling Init.
+  virtual void BeginPhase(const std::string& phase,
+      unsigned int scattering_order, unsigned int num_texels) = 0;
+  virtual void EndPhase(const std::string& phase,
+      unsigned int scattering_order, unsigned int num_texels) = 0;
+};
+
 class Model {
  public:
   Model(const AtmosphereParameters& atmosphere,
@@ -63,6 +114,29 @@ class Model {
 
   void Init(unsigned int num_scattering_orders = 4);
 
+  // Sets the maximum number of threads used by Init and
+  // UpdateAerialPerspective. 0, the default, means one thread per hardware
+  // thread (this is also the effective maximum).
+  void SetNumThreads(unsigned int num_threads) { num_threads_ = num_threads; }
+
+  // Sets whether the threads used by Init and UpdateAerialPerspective execute
+  // the jobs of each phase (one texture slice each) in reverse order (false by
+  // default). This does not change the results, and is only useful to check
+  // that they do not depend on the job scheduling order.
+  void SetReverseJobOrder(bool reverse_job_order) {
+    reverse_job_order_ = reverse_job_order;
+  }
+
+  // Sets an optional listener notified by Init of each precomputation phase
+  // (not owned by this model, and null by default). Init does not notify it if
+  // the textures are loaded from the cache directory.
+  void SetInitListener(InitListener* listener) { init_listener_ = listener; }
+
+  // Returns a 64 bits FNV-1a hash of the texel values of the transmittance,
+  // scattering, single Mie scattering and irradiance textures, in this order.
+  // Must be called after Init.
+  uint64_t GetTexturesChecksum() const;
+
   RadianceSpectrum GetSolarRadiance() const;
 
   RadianceSpectrum GetSkyRadiance(Position camera, Direction view_ray,
@@ -76,13 +150,101 @@ class Model {
   IrradianceSpectrum GetSunAndSkyIrradiance(Position p, Direction normal,
       Direction sun_direction, IrradianceSpectrum* sky_irradiance) const;
 
+  // Computes the aerial perspective volume for the given viewer and Sun
+  // direction, with GetSkyRadianceToPoint (and with several threads). Must be
+  // called after Init. 'view_ray_from_clip' is a row major matrix giving the
+  // (unnormalized) view ray direction for the clip space coordinates (x,y,1),
+  // and the volume extends from the viewer to 'max_distance'.
+  void UpdateAerialPerspective(Position camera, Direction sun_direction,
+      const std::array<double, 9>& view_ray_from_clip, Length max_distance);
+
+  // Returns the same result as GetSkyRadianceToPoint with a null shadow length,
+  // using the aerial perspective volume if 'point' is inside it (otherwise
+  // GetSkyRadianceToPoint is used). 'camera' and 'sun_direction' must be the
+  // values used in the last UpdateAerialPerspective call.
+  RadianceSpectrum GetSkyRadianceToPointFromVolume(Position camera,
+      Position point, Direction sun_direction,
+      DimensionlessSpectrum* transmittance) const;
+
  private:
+  void RunJobs(const std::function<void(unsigned int)>& job,
+      unsigned int num_jobs) const;
+
+  void RunPhase(const std::string& phase, unsigned int scattering_order,
+      unsigned int num_texels, const std::function<void(unsigned int)>& job,
+      unsigned int num_jobs);
+
+  void PrintPhaseCounters() const;
+
+  // The counters of each phase of the last Init call, in the instrumented build
+  // (see counters.h).
+  struct PhaseCounters {
+    std::string phase;
+    unsigned int scattering_order;
+    unsigned int num_texels;
+    Counters counters;
+  };
+
   const AtmosphereParameters atmosphere_;
   const std::string cache_directory_;
+  unsigned int num_threads_;
+  bool reverse_job_order_;
+  InitListener* init_listener_;
+  std::vector<PhaseCounters> phase_counters_;
   std::unique_ptr<TransmittanceTexture> transmittance_texture_;
   std::unique_ptr<ReducedScatteringTexture> scattering_texture_;
   std::unique_ptr<ReducedScatteringTexture> single_mie_scattering_texture_;
   std::unique_ptr<IrradianceTexture> irradiance_texture_;
+  std::array<double, 9> clip_from_view_ray_;
+  Length aerial_perspective_max_distance_;
+  std::unique_ptr<AerialPerspectiveScatteringTexture>
+      aerial_perspective_scattering_texture_;
+  std::unique_ptr<AerialPerspectiveTransmittanceTexture>
+      aerial_perspective_transmittance_texture_;
+};
+
+class FastModel {
+ public:
+  explicit FastModel(const AtmosphereParameters& atmosphere);
+
+  // Changes the atmosphere parameters. The textures are only recomputed at the
+  // next Update call.
+  void SetAtmosphere(const AtmosphereParameters& atmosphere);
+
+  // Recomputes the transmittance and multiple scattering textures if the
+  // atmosphere parameters have changed, and the sky view and aerial
+  // perspective textures for the given viewer and Sun direction.
+  // 'view_ray_from_clip' is a row major matrix giving the (unnormalized) view
+  // ray direction for the clip space coordinates (x,y,1).
+  void Update(Position camera, Direction sun_direction,
+      const std::array<double, 9>& view_ray_from_clip,
+      Length aerial_perspective_max_distance);
+
+  RadianceSpectrum GetSolarRadiance() const;
+
+  RadianceSpectrum GetSkyRadiance(Position camera, Direction view_ray,
+      Length shadow_length, Direction sun_direction,
+      DimensionlessSpectrum* transmittance) const;
+
+  RadianceSpectrum GetSkyRadianceToPoint(Position camera, Position point,
+      Length shadow_length, Direction sun_direction,
+      DimensionlessSpectrum* transmittance) const;
+
+  IrradianceSpectrum GetSunAndSkyIrradiance(Position p, Direction normal,
+      Direction sun_direction, IrradianceSpectrum* sky_irradiance) const;
+
+ private:
+  AtmosphereParameters atmosphere_;
+  bool atmosphere_changed_;
+  std::array<double, 9> clip_from_view_ray_;
+  Length aerial_perspective_max_distance_;
+  std::unique_ptr<TransmittanceTexture> transmittance_texture_;
+  std::unique_ptr<MultiScatteringTexture> multi_scattering_texture_;
+  std::unique_ptr<SkyViewTexture> sky_view_texture_;
+  std::unique_ptr<AerialPerspectiveScatteringTexture>
+      aerial_perspective_scattering_texture_;
+  std::unique_ptr<AerialPerspectiveTransmittanceTexture>
+      aerial_perspective_transmittance_texture_;
 };
 
 }  // namespace reference
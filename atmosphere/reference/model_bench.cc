@@ -0,0 +1,414 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/model_bench.cc</h2>
+
+<p>This file provides an end-to-end benchmark of the precomputations done by
+<code>Init</code> in the CPU <a href="model.h.html">model</a>. It runs these
+precomputations once for each requested number of threads, and measures the
+wall time, the CPU time (summed over all threads), the number of texels
+computed per second and the peak resident set size (RSS) of each precomputation
+phase, as well as their sum for each scattering order and for the whole
+precomputation. The results are printed on the standard output and,
+optionally, saved in a JSON file, to compare the scaling curves and to detect
+performance regressions. The command line syntax is
+<pre>
+atmosphere_model_bench [--threads=&lt;n1&gt;,&lt;n2&gt;,...]
+    [--orders=&lt;n&gt;] [--label=&lt;label&gt;] [--trace=&lt;trace.json&gt;]
+    [--check_determinism] [&lt;output.json&gt;]
+</pre>
+where <code>--threads</code> gives the numbers of threads to use (by default
+one per hardware thread, which is also the maximum), <code>--orders</code> the
+number of scattering orders to precompute (4 by default),
+<code>--label</code> an arbitrary string (e.g. a commit ID) which is copied in
+the JSON output, and <code>--trace</code> a file where the timeline of all the
+runs is saved, in <a href="../trace.h.html">Chrome trace</a> format (e.g. to
+see the load balance between threads). Note that the texture sizes are compile
+time constants (see <a href="../constants.h.html">constants.h</a>), which are
+also saved in the JSON output.
+
+<p>Each run also prints the checksum of the precomputed textures (see
+<code>GetTexturesChecksum</code>), which is saved in the JSON output too. With
+<code>--check_determinism</code>, the program exits with an error if these
+checksums are not all equal, i.e. if the precomputed textures depend on the
+number of threads or on the job scheduling order. In this mode the default
+numbers of threads are 1 and N, where N is the number of hardware threads, and
+a last run is added with the last number of threads, but with the texture
+slices of each phase executed in reverse order (see
+<code>SetReverseJobOrder</code>). Note that more threads than hardware threads
+would not change the schedule, since N is also the effective maximum.
+*/
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "atmosphere/constants.h"
+#include "atmosphere/reference/benchmark.h"
+#include "atmosphere/reference/model.h"
+#include "atmosphere/trace.h"
+
+namespace atmosphere {
+namespace reference {
+
+namespace {
+
+constexpr unsigned int kDefaultScatteringOrders = 4;
+
+/*
+<h3>Measurements</h3>
+
+<p>The measurements of each phase are done with the following
+<code>InitListener</code>, using the CPU time and peak RSS functions of
+<a href="benchmark.h.html">benchmark.h</a>. It stores them in a list of
+<code>Measurement</code> (the same structure is also used for the sums per
+scattering order, and for the whole precomputation):
+*/
+
+struct Measurement {
+  std::string phase;
+  unsigned int scattering_order;
+  unsigned int num_texels;
+  double wall_time;  // seconds
+  double cpu_time;  // seconds
+  long peak_rss;  // kB  NOLINT
+};
+
+class PhaseTimer : public InitListener {
+ public:
+  void BeginPhase(const std::string& phase, unsigned int scattering_order,
+      unsigned int num_texels) override {
+    ResetPeakRss();
+    start_cpu_time_ = GetCpuTime();
+    start_time_ = std::chrono::steady_clock::now();
+  }
+
+  void EndPhase(const std::string& phase, unsigned int scattering_order,
+      unsigned int num_texels) override {
+    auto end_time = std::chrono::steady_clock::now();
+    Measurement measurement;
+    measurement.phase = phase;
+    measurement.scattering_order = scattering_order;
+    measurement.num_texels = num_texels;
+    measurement.wall_time =
+        std::chrono::duration<double>(end_time - start_time_).count();
+    measurement.cpu_time = GetCpuTime() - start_cpu_time_;
+    measurement.peak_rss = GetPeakRss();
+    measurements_.push_back(measurement);
+    std::printf("  %-20s %u %10.3f s %10.3f s %12.0f texels/s %8ld MB\n",
+        phase.c_str(), scattering_order, measurement.wall_time,
+        measurement.cpu_time, num_texels / measurement.wall_time,
+        measurement.peak_rss / 1024);
+    std::fflush(stdout);
+  }
+
+  const std::vector<Measurement>& measurements() const {
+    return measurements_;
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_time_;
+  double start_cpu_time_;
+  std::vector<Measurement> measurements_;
+};
+
+/*
+<h3>Benchmark runner</h3>
+
+<p>Each run precomputes the textures in a new temporary cache directory (so
+that they are not loaded from a previous run), which is deleted at the end. It
+returns the measurements of each phase, followed by their sums for each
+scattering order, followed by the measurements for the whole <code>Init</code>
+call (which includes the time needed to save the textures in the cache), and
+the checksum of the precomputed textures:
+*/
+
+struct RunResult {
+  unsigned int num_threads;
+  bool reverse_job_order;
+  uint64_t checksum;
+  std::vector<Measurement> phases;
+  std::vector<Measurement> orders;
+  Measurement total;
+};
+
+RunResult Run(const AtmosphereParameters& atmosphere, unsigned int num_threads,
+    bool reverse_job_order, unsigned int num_scattering_orders) {
+  char cache_directory[] = "/tmp/atmosphere_model_bench_XXXXXX";
+  if (mkdtemp(cache_directory) == nullptr) {
+    std::fprintf(stderr, "Cannot create a temporary directory\n");
+    std::exit(1);
+  }
+  const std::string cache_prefix = std::string(cache_directory) + "/";
+
+  RunResult result;
+  result.num_threads = num_threads;
+  result.reverse_job_order = reverse_job_order;
+  PhaseTimer timer;
+  {
+    Model model(atmosphere, cache_prefix);
+    model.SetNumThreads(num_threads);
+    model.SetReverseJobOrder(reverse_job_order);
+    model.SetInitListener(&timer);
+    ResetPeakRss();
+    double start_cpu_time = GetCpuTime();
+    auto start_time = std::chrono::steady_clock::now();
+    model.Init(num_scattering_orders);
+    auto end_time = std::chrono::steady_clock::now();
+    result.total.phase = "total";
+    result.total.scattering_order = num_scattering_orders;
+    result.total.num_texels = 0;
+    result.total.wall_time =
+        std::chrono::duration<double>(end_time - start_time).count();
+    result.total.cpu_time = GetCpuTime() - start_cpu_time;
+    result.total.peak_rss = GetPeakRss();
+    result.checksum = model.GetTexturesChecksum();
+  }
+  for (const char* file : {"transmittance.dat", "scattering.dat",
+      "single_mie_scattering.dat", "irradiance.dat"}) {
+    std::remove((cache_prefix + file).c_str());
+  }
+  rmdir(cache_directory);
+
+  result.phases = timer.measurements();
+  for (unsigned int order = 0; order <= num_scattering_orders; ++order) {
+    Measurement sum;
+    sum.phase = "order";
+    sum.scattering_order = order;
+    sum.num_texels = 0;
+    sum.wall_time = 0.0;
+    sum.cpu_time = 0.0;
+    sum.peak_rss = 0;
+    for (const Measurement& phase : result.phases) {
+      if (phase.scattering_order == order) {
+        sum.num_texels += phase.num_texels;
+        sum.wall_time += phase.wall_time;
+        sum.cpu_time += phase.cpu_time;
+        sum.peak_rss = std::max(sum.peak_rss, phase.peak_rss);
+      }
+    }
+    result.orders.push_back(sum);
+    result.total.num_texels += sum.num_texels;
+  }
+  return result;
+}
+
+/*
+<p>The results are saved in the following JSON format, with one entry per run
+(times are in seconds and peak RSS values in kB):
+*/
+
+void WriteMeasurement(std::ofstream& file, const Measurement& measurement,
+    const std::string& indent, const std::string& end) {
+  file << indent << "\"phase\": \"" << measurement.phase << "\",\n";
+  file << indent << "\"scattering_order\": " << measurement.scattering_order
+       << ",\n";
+  file << indent << "\"texels\": " << measurement.num_texels << ",\n";
+  file << indent << "\"wall_time\": " << measurement.wall_time << ",\n";
+  file << indent << "\"cpu_time\": " << measurement.cpu_time << ",\n";
+  file << indent << "\"texels_per_second\": "
+       << measurement.num_texels / measurement.wall_time << ",\n";
+  file << indent << "\"peak_rss\": " << measurement.peak_rss << end;
+}
+
+void WriteMeasurements(std::ofstream& file, const std::string& name,
+    const std::vector<Measurement>& measurements) {
+  file << "      \"" << name << "\": [\n";
+  for (unsigned int i = 0; i < measurements.size(); ++i) {
+    file << "        {\n";
+    WriteMeasurement(file, measurements[i], "          ", "\n");
+    file << "        }" << (i + 1 < measurements.size() ? "," : "") << "\n";
+  }
+  file << "      ]";
+}
+
+std::string FormatChecksum(uint64_t checksum) {
+  char buffer[17];
+  std::snprintf(buffer, sizeof(buffer), "%016llx",
+      static_cast<unsigned long long>(checksum));  // NOLINT
+  return buffer;
+}
+
+void SaveResults(const std::string& filename, const std::string& label,
+    unsigned int num_scattering_orders, const std::vector<RunResult>& runs) {
+  std::ofstream file(filename);
+  file << "{\n";
+  file << "  \"context\": {\n";
+  file << "    \"date\": \"" << GetCurrentDate() << "\",\n";
+  file << "    \"label\": \"" << label << "\",\n";
+  file << "    \"build_type\": \"" << GetBuildType() << "\",\n";
+  file << "    \"hardware_threads\": " << sysconf(_SC_NPROCESSORS_ONLN)
+       << ",\n";
+  file << "    \"scattering_orders\": " << num_scattering_orders << ",\n";
+  file << "    \"transmittance_texture_size\": [" <<
+      TRANSMITTANCE_TEXTURE_WIDTH << ", " << TRANSMITTANCE_TEXTURE_HEIGHT <<
+      "],\n";
+  file << "    \"scattering_texture_size\": [" << SCATTERING_TEXTURE_WIDTH <<
+      ", " << SCATTERING_TEXTURE_HEIGHT << ", " << SCATTERING_TEXTURE_DEPTH <<
+      "],\n";
+  file << "    \"irradiance_texture_size\": [" << IRRADIANCE_TEXTURE_WIDTH <<
+      ", " << IRRADIANCE_TEXTURE_HEIGHT << "],\n";
+  file << "    \"time_unit\": \"s\",\n";
+  file << "    \"memory_unit\": \"kB\"\n";
+  file << "  },\n";
+  file << "  \"runs\": [\n";
+  for (unsigned int i = 0; i < runs.size(); ++i) {
+    const RunResult& run = runs[i];
+    file << "    {\n";
+    file << "      \"threads\": " << run.num_threads << ",\n";
+    file << "      \"reverse_job_order\": " <<
+        (run.reverse_job_order ? "true" : "false") << ",\n";
+    file << "      \"checksum\": \"" << FormatChecksum(run.checksum) <<
+        "\",\n";
+    WriteMeasurement(file, run.total, "      ", ",\n");
+    WriteMeasurements(file, "phases", run.phases);
+    file << ",\n";
+    WriteMeasurements(file, "orders", run.orders);
+    file << "\n";
+    file << "    }" << (i + 1 < runs.size() ? "," : "") << "\n";
+  }
+  file << "  ]\n";
+  file << "}\n";
+}
+
+}  // anonymous namespace
+
+}  // namespace reference
+}  // namespace atmosphere
+
+/*
+<h3>Main function</h3>
+
+<p>Finally, the main function parses the command line arguments, runs the
+benchmark for each requested number of threads, saves the results and, if
+requested, checks that all the runs produced the same textures:
+*/
+
+using atmosphere::reference::AtmosphereParameters;
+using atmosphere::reference::FormatChecksum;
+using atmosphere::reference::GetBenchmarkAtmosphereParameters;
+using atmosphere::reference::Run;
+using atmosphere::reference::RunResult;
+using atmosphere::reference::SaveResults;
+using atmosphere::reference::kDefaultScatteringOrders;
+
+int main(int argc, char** argv) {
+  std::vector<unsigned int> threads;
+  unsigned int num_scattering_orders = kDefaultScatteringOrders;
+  std::string label;
+  std::string trace_filename;
+  std::string output_filename;
+  bool check_determinism = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.compare(0, 10, "--threads=") == 0) {
+      std::istringstream values(arg.substr(10));
+      std::string value;
+      while (std::getline(values, value, ',')) {
+        threads.push_back(std::atoi(value.c_str()));
+      }
+    } else if (arg.compare(0, 9, "--orders=") == 0) {
+      num_scattering_orders = std::max(1, std::atoi(arg.substr(9).c_str()));
+    } else if (arg.compare(0, 8, "--label=") == 0) {
+      label = arg.substr(8);
+    } else if (arg.compare(0, 8, "--trace=") == 0) {
+      trace_filename = arg.substr(8);
+    } else if (arg == "--check_determinism") {
+      check_determinism = true;
+    } else if (arg.compare(0, 2, "--") != 0 && output_filename.empty()) {
+      output_filename = arg;
+    } else {
+      std::fprintf(stderr, "Usage: %s [--threads=<n1>,<n2>,...] "
+          "[--orders=<n>] [--label=<label>] [--trace=<trace.json>] "
+          "[--check_determinism] [<output.json>]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (threads.empty()) {
+    const unsigned int num_hardware_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (check_determinism) {
+      threads.push_back(1);
+    }
+    threads.push_back(num_hardware_threads);
+  }
+  std::vector<bool> reverse_job_order(threads.size(), false);
+  if (check_determinism) {
+    threads.push_back(threads.back());
+    reverse_job_order.push_back(true);
+  }
+
+  const AtmosphereParameters atmosphere = GetBenchmarkAtmosphereParameters();
+  std::vector<RunResult> runs;
+  if (!trace_filename.empty()) {
+    atmosphere::trace::Start();
+  }
+  for (unsigned int i = 0; i < threads.size(); ++i) {
+    std::printf("%u thread(s)%s, %u scattering orders:\n", threads[i],
+        reverse_job_order[i] ? " in reverse job order" : "",
+        num_scattering_orders);
+    std::printf("  %-20s %s %12s %12s %21s %11s\n", "phase", "order",
+        "wall time", "CPU time", "throughput", "peak RSS");
+    runs.push_back(Run(atmosphere, threads[i], reverse_job_order[i],
+        num_scattering_orders));
+    const RunResult& run = runs.back();
+    std::printf("  %-20s   %10.3f s %10.3f s %25ld MB\n", "total",
+        run.total.wall_time, run.total.cpu_time, run.total.peak_rss / 1024);
+    std::printf("  %-20s   %s\n", "checksum",
+        FormatChecksum(run.checksum).c_str());
+  }
+  if (!trace_filename.empty() && !atmosphere::trace::Stop(trace_filename)) {
+    std::fprintf(stderr, "Can't write %s\n", trace_filename.c_str());
+  }
+  if (!output_filename.empty()) {
+    SaveResults(output_filename, label, num_scattering_orders, runs);
+  }
+  if (check_determinism) {
+    for (const RunResult& run : runs) {
+      if (run.checksum != runs[0].checksum) {
+        std::fprintf(stderr, "The precomputed textures depend on the number "
+            "of threads or on the job order (%s with %u thread(s), %s with %u "
+            "thread(s)%s)\n", FormatChecksum(runs[0].checksum).c_str(),
+            runs[0].num_threads, FormatChecksum(run.checksum).c_str(),
+            run.num_threads,
+            run.reverse_job_order ? " in reverse job order" : "");
+        return 1;
+      }
+    }
+    std::printf("The precomputed textures are identical in all runs\n");
+  }
+  return 0;
+}
@@ -0,0 +1,400 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/model_sweep.cc</h2>
+
+<p>This file provides a tool to measure the precision and the cost of the
+precomputations done by the CPU <a href="model.h.html">model</a>, as a function
+of the texture sizes, of the number of samples used to compute the integrals,
+and of the number of scattering orders. The first two are compile time
+constants (see <a href="../constants.h.html">constants.h</a>), so this tool must
+be compiled once per configuration (this is done by the <code>sweep</code>
+target of the Makefile), while the number of scattering orders is a command
+line option. For each number of scattering orders, the tool precomputes the
+textures, renders a few views of the <a href="scene.h.html">test scene</a>, and
+compares them with the images rendered by a baseline configuration (e.g. with
+the default constants and the maximum number of scattering orders). The command
+line syntax is
+<pre>
+atmosphere_model_sweep [--orders=&lt;n1&gt;,&lt;n2&gt;,...]
+    [--threads=&lt;n&gt;] [--size=&lt;width&gt;x&lt;height&gt;]
+    [--label=&lt;label&gt;] [--save=&lt;dir&gt;] [--baseline=&lt;dir&gt;]
+    [&lt;output.json&gt;]
+</pre>
+where <code>--orders</code> gives the numbers of scattering orders to
+precompute (4 by default), <code>--threads</code> the number of threads to use
+(by default one per hardware thread), <code>--size</code> the size of the
+rendered images (smaller than in the model tests by default, to save time),
+<code>--label</code> an arbitrary string (e.g. the name of the configuration)
+which is copied in the JSON output, <code>--save</code> a directory where the
+images rendered with the largest number of scattering orders are saved, and
+<code>--baseline</code> a directory containing the images to compare with
+(saved by a previous run with <code>--save</code>). The images are compared
+with their Peak Signal to Noise Ratio (PSNR), and with their mean CIE76 color
+difference (see <a href="image.h.html">image.h</a>), which is closer to the
+perceived difference. The results are printed on the standard output and,
+optionally, saved in a JSON file.
+
+<p>Note that the precomputations are done in double precision on CPU, so this
+tool can't measure the effect of the <code>half_precision</code> option of the
+GPU <a href="../model.h.html">model</a>.
+*/
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "atmosphere/constants.h"
+#include "atmosphere/reference/benchmark.h"
+#include "atmosphere/reference/image.h"
+#include "atmosphere/reference/model.h"
+#include "atmosphere/reference/scene.h"
+
+namespace atmosphere {
+namespace reference {
+
+namespace {
+
+constexpr unsigned int kDefaultScatteringOrders = 4;
+constexpr unsigned int kDefaultWidth = 320;
+constexpr unsigned int kDefaultHeight = 180;
+
+/*
+<h3>Views</h3>
+
+<p>We render the views of the model tests with a high and with a low Sun, with
+the radiance and with the luminance outputs (the latter uses the full radiance
+spectrum, while the former only uses 3 wavelengths):
+*/
+
+struct View {
+  const char* name;
+  double sun_theta;  // degrees
+  bool use_luminance;
+};
+
+constexpr View kViews[] = {
+  {"radiance_high_sun", 65.0, false},
+  {"radiance_low_sun", 88.0, false},
+  {"luminance_high_sun", 65.0, true},
+  {"luminance_low_sun", 88.0, true}
+};
+
+/*
+<h3>Sweep runner</h3>
+
+<p>Each run precomputes the textures with a given number of scattering orders,
+in a new temporary cache directory (so that they are not loaded from a previous
+run), which is deleted at the end. It measures the wall time, the CPU time and
+the peak resident set size (RSS) of the <code>Init</code> call, then renders
+each view and compares it with the baseline image, if any, and finally saves
+the images, if requested:
+*/
+
+struct ViewResult {
+  std::string name;
+  double render_time;  // seconds
+  bool has_baseline;
+  double psnr;  // dB
+  double delta_e;
+};
+
+struct RunResult {
+  unsigned int num_scattering_orders;
+  double wall_time;  // seconds
+  double cpu_time;  // seconds
+  long peak_rss;  // kB  NOLINT
+  std::vector<ViewResult> views;
+};
+
+struct Options {
+  unsigned int num_threads;
+  unsigned int width;
+  unsigned int height;
+  std::string save_directory;
+  std::string baseline_directory;
+};
+
+RunResult Run(Scene& scene, unsigned int num_scattering_orders,
+    const Options& options, bool save) {
+  char cache_directory[] = "/tmp/atmosphere_model_sweep_XXXXXX";
+  if (mkdtemp(cache_directory) == nullptr) {
+    std::fprintf(stderr, "Cannot create a temporary directory\n");
+    std::exit(1);
+  }
+  const std::string cache_prefix = std::string(cache_directory) + "/";
+
+  RunResult result;
+  result.num_scattering_orders = num_scattering_orders;
+  Model model(scene.atmosphere_parameters(), cache_prefix);
+  model.SetNumThreads(options.num_threads);
+  ResetPeakRss();
+  double start_cpu_time = GetCpuTime();
+  auto start_time = std::chrono::steady_clock::now();
+  model.Init(num_scattering_orders);
+  auto end_time = std::chrono::steady_clock::now();
+  result.wall_time =
+      std::chrono::duration<double>(end_time - start_time).count();
+  result.cpu_time = GetCpuTime() - start_cpu_time;
+  result.peak_rss = GetPeakRss();
+  for (const char* file : {"transmittance.dat", "scattering.dat",
+      "single_mie_scattering.dat", "irradiance.dat"}) {
+    std::remove((cache_prefix + file).c_str());
+  }
+  rmdir(cache_directory);
+
+  for (const View& view : kViews) {
+    ViewResult view_result;
+    view_result.name = view.name;
+    scene.SetViewParameters(view.sun_theta * deg, 90.0 * deg,
+        view.use_luminance);
+    start_time = std::chrono::steady_clock::now();
+    Image image = scene.Render(model);
+    end_time = std::chrono::steady_clock::now();
+    view_result.render_time =
+        std::chrono::duration<double>(end_time - start_time).count();
+
+    const std::string filename = std::string(view.name) + ".ppm";
+    Image baseline(0, 0);
+    view_result.has_baseline = !options.baseline_directory.empty() &&
+        LoadImage(options.baseline_directory + "/" + filename, &baseline) &&
+        baseline.width() == image.width() &&
+        baseline.height() == image.height();
+    view_result.psnr = 0.0;
+    view_result.delta_e = 0.0;
+    if (view_result.has_baseline) {
+      view_result.psnr = ComputePsnr(image, baseline);
+      view_result.delta_e = ComputeMeanDeltaE(image, baseline);
+    } else if (!options.baseline_directory.empty()) {
+      std::fprintf(stderr, "No baseline image with the same size for %s\n",
+          view.name);
+    }
+    if (save && !SaveImage(image,
+        options.save_directory + "/" + filename)) {
+      std::fprintf(stderr, "Can't save %s in %s\n", filename.c_str(),
+          options.save_directory.c_str());
+    }
+    result.views.push_back(view_result);
+  }
+  return result;
+}
+
+/*
+<p>The results are saved in the following JSON format, with one entry per
+number of scattering orders (times are in seconds, memory sizes in kB, and
+PSNR values in dB). The memory size of the precomputed textures is computed
+from the texture sizes (the temporary textures used during the precomputations
+are not included, but they are measured by the peak RSS):
+*/
+
+long GetTextureMemory() {  // NOLINT
+  const long transmittance_size =  // NOLINT
+      TRANSMITTANCE_TEXTURE_WIDTH * TRANSMITTANCE_TEXTURE_HEIGHT *
+      sizeof(DimensionlessSpectrum);
+  const long scattering_size =  // NOLINT
+      SCATTERING_TEXTURE_WIDTH * SCATTERING_TEXTURE_HEIGHT *
+      SCATTERING_TEXTURE_DEPTH * sizeof(IrradianceSpectrum);
+  const long irradiance_size =  // NOLINT
+      IRRADIANCE_TEXTURE_WIDTH * IRRADIANCE_TEXTURE_HEIGHT *
+      sizeof(IrradianceSpectrum);
+  return (transmittance_size + 2 * scattering_size + irradiance_size) / 1024;
+}
+
+void SaveResults(const std::string& filename, const std::string& label,
+    const Options& options, const std::vector<RunResult>& runs) {
+  std::ofstream file(filename);
+  file << "{\n";
+  file << "  \"context\": {\n";
+  file << "    \"date\": \"" << GetCurrentDate() << "\",\n";
+  file << "    \"label\": \"" << label << "\",\n";
+  file << "    \"build_type\": \"" << GetBuildType() << "\",\n";
+  file << "    \"threads\": " << options.num_threads << ",\n";
+  file << "    \"image_size\": [" << options.width << ", " << options.height
+       << "],\n";
+  file << "    \"baseline\": \"" << options.baseline_directory << "\",\n";
+  file << "    \"transmittance_texture_size\": [" <<
+      TRANSMITTANCE_TEXTURE_WIDTH << ", " << TRANSMITTANCE_TEXTURE_HEIGHT <<
+      "],\n";
+  file << "    \"scattering_texture_size\": [" << SCATTERING_TEXTURE_R_SIZE <<
+      ", " << SCATTERING_TEXTURE_MU_SIZE << ", " <<
+      SCATTERING_TEXTURE_MU_S_SIZE << ", " << SCATTERING_TEXTURE_NU_SIZE <<
+      "],\n";
+  file << "    \"irradiance_texture_size\": [" << IRRADIANCE_TEXTURE_WIDTH <<
+      ", " << IRRADIANCE_TEXTURE_HEIGHT << "],\n";
+  file << "    \"transmittance_samples\": " << TRANSMITTANCE_SAMPLE_COUNT <<
+      ",\n";
+  file << "    \"single_scattering_samples\": " <<
+      SINGLE_SCATTERING_SAMPLE_COUNT << ",\n";
+  file << "    \"scattering_density_samples\": " <<
+      SCATTERING_DENSITY_SAMPLE_COUNT << ",\n";
+  file << "    \"indirect_irradiance_samples\": " <<
+      INDIRECT_IRRADIANCE_SAMPLE_COUNT << ",\n";
+  file << "    \"multiple_scattering_samples\": " <<
+      MULTIPLE_SCATTERING_SAMPLE_COUNT << ",\n";
+  file << "    \"texture_memory\": " << GetTextureMemory() << ",\n";
+  file << "    \"time_unit\": \"s\",\n";
+  file << "    \"memory_unit\": \"kB\"\n";
+  file << "  },\n";
+  file << "  \"runs\": [\n";
+  for (unsigned int i = 0; i < runs.size(); ++i) {
+    const RunResult& run = runs[i];
+    file << "    {\n";
+    file << "      \"scattering_orders\": " << run.num_scattering_orders
+         << ",\n";
+    file << "      \"wall_time\": " << run.wall_time << ",\n";
+    file << "      \"cpu_time\": " << run.cpu_time << ",\n";
+    file << "      \"peak_rss\": " << run.peak_rss << ",\n";
+    file << "      \"views\": [\n";
+    for (unsigned int j = 0; j < run.views.size(); ++j) {
+      const ViewResult& view = run.views[j];
+      file << "        {\n";
+      file << "          \"name\": \"" << view.name << "\",\n";
+      file << "          \"render_time\": " << view.render_time;
+      if (view.has_baseline) {
+        file << ",\n";
+        file << "          \"psnr\": " << view.psnr << ",\n";
+        file << "          \"delta_e\": " << view.delta_e << "\n";
+      } else {
+        file << "\n";
+      }
+      file << "        }" << (j + 1 < run.views.size() ? "," : "") << "\n";
+    }
+    file << "      ]\n";
+    file << "    }" << (i + 1 < runs.size() ? "," : "") << "\n";
+  }
+  file << "  ]\n";
+  file << "}\n";
+}
+
+}  // anonymous namespace
+
+}  // namespace reference
+}  // namespace atmosphere
+
+/*
+<h3>Main function</h3>
+
+<p>Finally, the main function parses the command line arguments, runs the
+sweep for each requested number of scattering orders, and prints and saves the
+results:
+*/
+
+using atmosphere::reference::GetTextureMemory;
+using atmosphere::reference::Options;
+using atmosphere::reference::Run;
+using atmosphere::reference::RunResult;
+using atmosphere::reference::SaveResults;
+using atmosphere::reference::Scene;
+using atmosphere::reference::ViewResult;
+using atmosphere::reference::kDefaultHeight;
+using atmosphere::reference::kDefaultScatteringOrders;
+using atmosphere::reference::kDefaultWidth;
+
+int main(int argc, char** argv) {
+  std::vector<unsigned int> orders;
+  Options options;
+  options.num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  options.width = kDefaultWidth;
+  options.height = kDefaultHeight;
+  std::string label;
+  std::string output_filename;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.compare(0, 9, "--orders=") == 0) {
+      std::istringstream values(arg.substr(9));
+      std::string value;
+      while (std::getline(values, value, ',')) {
+        orders.push_back(std::max(1, std::atoi(value.c_str())));
+      }
+    } else if (arg.compare(0, 10, "--threads=") == 0) {
+      options.num_threads = std::max(1, std::atoi(arg.substr(10).c_str()));
+    } else if (arg.compare(0, 7, "--size=") == 0) {
+      std::sscanf(arg.c_str() + 7, "%ux%u", &options.width, &options.height);
+    } else if (arg.compare(0, 8, "--label=") == 0) {
+      label = arg.substr(8);
+    } else if (arg.compare(0, 7, "--save=") == 0) {
+      options.save_directory = arg.substr(7);
+    } else if (arg.compare(0, 11, "--baseline=") == 0) {
+      options.baseline_directory = arg.substr(11);
+    } else if (arg.compare(0, 2, "--") != 0 && output_filename.empty()) {
+      output_filename = arg;
+    } else {
+      std::fprintf(stderr, "Usage: %s [--orders=<n1>,<n2>,...] "
+          "[--threads=<n>] [--size=<width>x<height>] [--label=<label>] "
+          "[--save=<dir>] [--baseline=<dir>] [<output.json>]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (orders.empty()) {
+    orders.push_back(kDefaultScatteringOrders);
+  }
+  const unsigned int max_orders =
+      *std::max_element(orders.begin(), orders.end());
+
+  Scene scene(options.width, options.height);
+  std::vector<RunResult> runs;
+  std::printf("precomputed textures: %.1f MB\n", GetTextureMemory() / 1024.0);
+  std::printf("%6s %10s %10s %9s  %-20s %10s %9s %8s\n", "orders",
+      "wall time", "CPU time", "peak RSS", "view", "render", "PSNR",
+      "delta E");
+  for (unsigned int num_scattering_orders : orders) {
+    const bool save = !options.save_directory.empty() &&
+        num_scattering_orders == max_orders;
+    runs.push_back(Run(scene, num_scattering_orders, options, save));
+    const RunResult& run = runs.back();
+    for (unsigned int i = 0; i < run.views.size(); ++i) {
+      const ViewResult& view = run.views[i];
+      if (i == 0) {
+        std::printf("%6u %8.3f s %8.3f s %6ld MB  ",
+            run.num_scattering_orders, run.wall_time, run.cpu_time,
+            run.peak_rss / 1024);
+      } else {
+        std::printf("%40s", "");
+      }
+      std::printf("%-20s %8.3f s", view.name.c_str(), view.render_time);
+      if (view.has_baseline) {
+        std::printf(" %6.2f dB %8.3f\n", view.psnr, view.delta_e);
+      } else {
+        std::printf(" %9s %8s\n", "-", "-");
+      }
+    }
+    std::fflush(stdout);
+  }
+  if (!output_filename.empty()) {
+    SaveResults(output_filename, label, options, runs);
+  }
+  return 0;
+}
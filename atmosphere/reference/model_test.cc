@@ -56,7 +56,8 @@ reduce the image quality.
 
 <p>We start by including the files we need. Since we want to render images with
 the GPU and CPU versions of our algorithm, we need to include the GPU and CPU
-model definitions:
+model definitions, as well as the test scene, which is shared with other CPU
+only tools:
 */
 
 #include "atmosphere/reference/model.h"
@@ -64,20 +65,27 @@ model definitions:
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 
-#include <array>
+#include <algorithm>
 #include <fstream>
 #include <memory>
+#include <utility>
 
 #include "atmosphere/model.h"
 #include "atmosphere/reference/definitions.h"
+#include "atmosphere/reference/golden_image_cache.h"
+#include "atmosphere/reference/image.h"
+#include "atmosphere/reference/scene.h"
 #include "minpng/minpng.h"
 #include "test/test_case.h"
-#include "util/progress_bar.h"
 
 /*
-<p>Our test scene is a sphere on a purely spherical planet. Its position and
-size are specified by the following constants (note that we use a large sphere
-so that it can produce visible light shafts, in order to test them):
+<p>Our test scene is a sphere on a purely spherical planet (see
+<a href="scene.h.html">scene.h</a>). Its position and size are specified by the
+<code>kSphereCenter</code> and <code>kSphereRadius</code> constants. Our tests
+use length values expressed in kilometers and, for the tests based on radiance
+values (as opposed to luminance values), make use of the 3 wavelengths
+<code>kLambdaR</code>, <code>kLambdaG</code> and <code>kLambdaB</code> of the
+GPU model:
 */
 
 namespace atmosphere {
@@ -85,19 +93,7 @@ namespace reference {
 
 namespace {
 
-constexpr Length kSphereRadius = 1.0 * km;
-constexpr Position kSphereCenter = Position(0.0 * km, 0.0 * km, kSphereRadius);
-
-/*
-<p>Our tests use length values expressed in kilometers and, for the tests based
-on radiance values (as opposed to luminance values), make use of the following
-3 wavelengths:
-*/
-
 constexpr Length kLengthUnit = 1.0 * km;
-constexpr Wavelength kLambdaR = atmosphere::Model::kLambdaR * nm;
-constexpr Wavelength kLambdaG = atmosphere::Model::kLambdaG * nm;
-constexpr Wavelength kLambdaB = atmosphere::Model::kLambdaB * nm;
 
 /*
 <p>The test scene is rendered on GPU by the following shaders. The vertex shader
@@ -167,6 +163,14 @@ files included below:
 #include "atmosphere/definitions.glsl.inc"
 #include "atmosphere/reference/model_test.glsl.inc"
 
+/*
+<p>The CPU model is always initialized with the default number of scattering
+orders, which is also part of the <a href="golden_image_cache.h.html">golden
+image cache</a> keys:
+*/
+
+constexpr unsigned int kNumScatteringOrders = 4;
+
 /*
 <p>Each test case produces two images, using two different methods, and checks
 that the difference between the two is small enough. These images are stored on
@@ -174,14 +178,13 @@ disk with the following function, which is a simple wrapper around the
 <a href="https://github.com/jrmuizel/minpng">minpng</a> library:
 */
 
-typedef std::unique_ptr<unsigned int[]> Image;
-
 const char kOutputDir[] = "output/Doc/atmosphere/reference/";
 constexpr unsigned int kWidth = 640;
 constexpr unsigned int kHeight = 360;
 
-void WritePngArgb(const std::string& name, void* pixels) {
-  write_png((std::string(kOutputDir) + name).c_str(), pixels, kWidth, kHeight);
+void WritePngArgb(const std::string& name, const Image& image) {
+  write_png((std::string(kOutputDir) + name).c_str(),
+      const_cast<unsigned int*>(image.data()), kWidth, kHeight);
 }
 
 }  // anonymous namespace
@@ -201,166 +204,31 @@ class ModelTest : public dimensional::TestCase {
  public:
   template<typename T>
   ModelTest(const std::string& name, T test)
-      : TestCase("ModelTest " + name, static_cast<Test>(test)), name_(name) {}
+      : TestCase("ModelTest " + name, static_cast<Test>(test)), name_(name),
+        scene_(kWidth, kHeight), golden_image_cache_("output/") {}
 
 /*
 <h4 id="setup">Setup methods</h4>
 
 <p>The <code>SetUp</code> method is called before each test case. We put here
 the initialization code which must be executed before any test case, i.e. the
-initialization of the atmosphere parameters (all our tests use the same
-atmosphere parameters) and of the constant scene parameters (earth center, sun
-size and radiance, surface albedos):
+initialization of the test scene, which contains the atmosphere parameters (all
+our tests use the same atmosphere parameters) and the constant scene parameters
+(earth center, sun size and radiance, surface albedos):
 */
 
   void SetUp() override {
-    // Values from "Reference Solar Spectral Irradiance: ASTM G-173", ETR column
-    // (see http://rredc.nrel.gov/solar/spectra/am1.5/ASTMG173/ASTMG173.html),
-    // summed and averaged in each bin (e.g. the value for 360nm is the average
-    // of the ASTM G-173 values for all wavelengths between 360 and 370nm).
-    // Values in W.m^-2.
-    constexpr int kLambdaMin = 360;
-    constexpr int kLambdaMax = 830;
-    constexpr double kSolarIrradiance[48] = {
-      1.11776, 1.14259, 1.01249, 1.14716, 1.72765, 1.73054, 1.6887, 1.61253,
-      1.91198, 2.03474, 2.02042, 2.02212, 1.93377, 1.95809, 1.91686, 1.8298,
-      1.8685, 1.8931, 1.85149, 1.8504, 1.8341, 1.8345, 1.8147, 1.78158, 1.7533,
-      1.6965, 1.68194, 1.64654, 1.6048, 1.52143, 1.55622, 1.5113, 1.474, 1.4482,
-      1.41018, 1.36775, 1.34188, 1.31429, 1.28303, 1.26758, 1.2367, 1.2082,
-      1.18737, 1.14683, 1.12362, 1.1058, 1.07124, 1.04992
-    };
-    constexpr ScatteringCoefficient kRayleigh = 1.24062e-6 / m;
-    constexpr Length kRayleighScaleHeight = 8000.0 * m;
-    constexpr Length kMieScaleHeight = 1200.0 * m;
-    constexpr double kMieAngstromAlpha = 0.0;
-    constexpr double kMieAngstromBeta = 5.328e-3;
-    constexpr double kMieSingleScatteringAlbedo = 0.9;
-    constexpr double kMiePhaseFunctionG = 0.8;
-    // Values from http://www.iup.uni-bremen.de/gruppen/molspec/databases/
-    // referencespectra/o3spectra2011/index.html for 233K, summed and averaged
-    // in each bin (e.g. the value for 360nm is the average of the original
-    // values for all wavelengths between 360 and 370nm). Values in m^2.
-    constexpr double kOzoneCrossSection[48] = {
-      1.18e-27, 2.182e-28, 2.818e-28, 6.636e-28, 1.527e-27, 2.763e-27, 5.52e-27,
-      8.451e-27, 1.582e-26, 2.316e-26, 3.669e-26, 4.924e-26, 7.752e-26,
-      9.016e-26, 1.48e-25, 1.602e-25, 2.139e-25, 2.755e-25, 3.091e-25, 3.5e-25,
-      4.266e-25, 4.672e-25, 4.398e-25, 4.701e-25, 5.019e-25, 4.305e-25,
-      3.74e-25, 3.215e-25, 2.662e-25, 2.238e-25, 1.852e-25, 1.473e-25,
-      1.209e-25, 9.423e-26, 7.455e-26, 6.566e-26, 5.105e-26, 4.15e-26,
-      4.228e-26, 3.237e-26, 2.451e-26, 2.801e-26, 2.534e-26, 1.624e-26,
-      1.465e-26, 2.078e-26, 1.383e-26, 7.105e-27
-    };
-    // From https://en.wikipedia.org/wiki/Dobson_unit, in molecules.m^-2.
-    constexpr dimensional::Scalar<-2, 0, 0, 0, 0> kDobsonUnit = 2.687e20 / m2;
-    // Maximum number density of ozone molecules, in m^-3 (computed so at to get
-    // 300 Dobson units of ozone - for this we divide 300 DU by the integral of
-    // the ozone density profile defined below, which is equal to 15km).
-    constexpr NumberDensity kMaxOzoneNumberDensity =
-        300.0 * kDobsonUnit / (15.0 * km);
-
-    std::vector<SpectralIrradiance> solar_irradiance;
-    std::vector<ScatteringCoefficient> rayleigh_scattering;
-    std::vector<ScatteringCoefficient> mie_scattering;
-    std::vector<ScatteringCoefficient> mie_extinction;
-    std::vector<ScatteringCoefficient> absorption_extinction;
-    for (int l = kLambdaMin; l <= kLambdaMax; l += 10) {
-      double lambda = static_cast<double>(l) * 1e-3;  // micro-meters
-      SpectralIrradiance solar = kSolarIrradiance[(l - kLambdaMin) / 10] *
-          watt_per_square_meter_per_nm;
-      ScatteringCoefficient rayleigh = kRayleigh * pow(lambda, -4);
-      ScatteringCoefficient mie = kMieAngstromBeta / kMieScaleHeight *
-          pow(lambda, -kMieAngstromAlpha);
-      solar_irradiance.push_back(solar);
-      rayleigh_scattering.push_back(rayleigh);
-      mie_scattering.push_back(mie * kMieSingleScatteringAlbedo);
-      mie_extinction.push_back(mie);
-      absorption_extinction.push_back(kMaxOzoneNumberDensity *
-          kOzoneCrossSection[(l - kLambdaMin) / 10] * m2);
-    }
-
-    atmosphere_parameters_.solar_irradiance = IrradianceSpectrum(
-        kLambdaMin * nm, kLambdaMax * nm, solar_irradiance);
-    atmosphere_parameters_.sun_angular_radius = 0.2678 * deg;
-    atmosphere_parameters_.bottom_radius = 6360.0 * km;
-    atmosphere_parameters_.top_radius = 6420.0 * km;
-    atmosphere_parameters_.rayleigh_density.layers[1] = DensityProfileLayer(
-        0.0 * m, 1.0, -1.0 / kRayleighScaleHeight, 0.0 / m, 0.0);
-    atmosphere_parameters_.rayleigh_scattering = ScatteringSpectrum(
-        kLambdaMin * nm, kLambdaMax * nm, rayleigh_scattering);
-    atmosphere_parameters_.mie_density.layers[1] = DensityProfileLayer(
-        0.0 * m, 1.0, -1.0 / kMieScaleHeight, 0.0 / m, 0.0);
-    atmosphere_parameters_.mie_scattering = ScatteringSpectrum(
-        kLambdaMin * nm, kLambdaMax * nm, mie_scattering);
-    atmosphere_parameters_.mie_extinction = ScatteringSpectrum(
-        kLambdaMin * nm, kLambdaMax * nm, mie_extinction);
-    atmosphere_parameters_.mie_phase_function_g = kMiePhaseFunctionG;
-    // Density profile increasing linearly from 0 to 1 between 10 and 25km, and
-    // decreasing linearly from 1 to 0 between 25 and 40km. Approximate profile
-    // from http://www.kln.ac.lk/science/Chemistry/Teaching_Resources/Documents/
-    // Introduction%20to%20atmospheric%20chemistry.pdf (page 10).
-    atmosphere_parameters_.absorption_density.layers[0] = DensityProfileLayer(
-        25.0 * km, 0.0, 0.0 / km, 1.0 / (15.0 * km), -2.0 / 3.0);
-    atmosphere_parameters_.absorption_density.layers[1] = DensityProfileLayer(
-        0.0 * km, 0.0, 0.0 / km, -1.0 / (15.0 * km), 8.0 / 3.0);
-    atmosphere_parameters_.absorption_extinction = ScatteringSpectrum(
-        kLambdaMin * nm, kLambdaMax * nm, absorption_extinction);
-    atmosphere_parameters_.ground_albedo = DimensionlessSpectrum(0.1);
-    atmosphere_parameters_.mu_s_min = cos(102.0 * deg);
-
-    earth_center_ =
-        Position(0.0 * m, 0.0 * m, -atmosphere_parameters_.bottom_radius);
-
-    sun_size_ = dimensional::vec2(
-        tan(atmosphere_parameters_.sun_angular_radius),
-        cos(atmosphere_parameters_.sun_angular_radius));
-
-    ground_albedo_ = GetGrassAlbedo();
-    sphere_albedo_ = GetSnowAlbedo();
+    scene_ = Scene(kWidth, kHeight);
     program_ = 0;
   }
 
-/*
-<p>where the ground and sphere albedos are provided by the following methods:
-*/
-
-  DimensionlessSpectrum GetGrassAlbedo() {
-    // Grass spectral albedo from Uwe Feister and Rolf Grewe, "Spectral albedo
-    // measurements in the UV and visible region over different types of
-    // surfaces", Photochemistry and Photobiology, 62, 736-744, 1995.
-    constexpr double kGrassAlbedo[45] = {
-      0.018, 0.019, 0.019, 0.020, 0.022, 0.024, 0.027, 0.029, 0.030, 0.031,
-      0.032, 0.032, 0.032, 0.033, 0.035, 0.040, 0.055, 0.073, 0.084, 0.089,
-      0.089, 0.079, 0.069, 0.063, 0.061, 0.057, 0.052, 0.051, 0.048, 0.042,
-      0.039, 0.035, 0.035, 0.043, 0.087, 0.156, 0.234, 0.334, 0.437, 0.513,
-      0.553, 0.571, 0.579, 0.581, 0.587
-    };
-    std::vector<Number> grass_albedo_samples;
-    for (int i = 0; i < 45; ++i) {
-      grass_albedo_samples.push_back(kGrassAlbedo[i]);
-    }
-    return DimensionlessSpectrum(360.0 * nm, 800.0 * nm, grass_albedo_samples);
-  }
-
-  DimensionlessSpectrum GetSnowAlbedo() {
-    // Snow 5cm spectral albedo from Uwe Feister and Rolf Grewe, "Spectral
-    // albedo measurements in the UV and visible region over different types of
-    // surfaces", Photochemistry and Photobiology, 62, 736-744, 1995.
-    constexpr double kSnowAlbedo[7] = {
-      0.796, 0.802, 0.807, 0.810, 0.818, 0.825, 0.826
-    };
-    std::vector<Number> snow_albedo_samples;
-    for (int i = 0; i < 7; ++i) {
-      snow_albedo_samples.push_back(kSnowAlbedo[i]);
-    }
-    return DimensionlessSpectrum(360.0 * nm, 420.0 * nm, snow_albedo_samples);
-  }
-
 /*
 <p>The GPU model is initialized differently depending on the test case, so we
-provide a separate method to initialize it:
+provide a separate method to create it (without precomputing its textures):
 */
 
-  void InitGpuModel(bool combine_textures, bool precomputed_luminance) {
+  void CreateGpuModel(bool combine_textures, bool precomputed_luminance,
+      bool use_compute_shaders = false) {
     if (!glutGet(GLUT_INIT_STATE)) {
       int argc = 0;
       char** argv = nullptr;
@@ -372,8 +240,10 @@ provide a separate method to initialize it:
       glewInit();
     }
 
+    const AtmosphereParameters& atmosphere_parameters =
+        scene_.atmosphere_parameters();
     std::vector<double> wavelengths;
-    const auto& spectrum = atmosphere_parameters_.solar_irradiance;
+    const auto& spectrum = atmosphere_parameters.solar_irradiance;
     for (unsigned int i = 0; i < spectrum.size(); ++i) {
       wavelengths.push_back(spectrum.GetSample(i).to(nm));
     }
@@ -384,89 +254,64 @@ provide a separate method to initialize it:
     };
     model_.reset(new atmosphere::Model(
         wavelengths,
-        atmosphere_parameters_.solar_irradiance.to(
+        atmosphere_parameters.solar_irradiance.to(
             watt_per_square_meter_per_nm),
-        atmosphere_parameters_.sun_angular_radius.to(rad),
-        atmosphere_parameters_.bottom_radius.to(m),
-        atmosphere_parameters_.top_radius.to(m),
-        {profile(atmosphere_parameters_.rayleigh_density.layers[1])},
-        atmosphere_parameters_.rayleigh_scattering.to(1.0 / m),
-        {profile(atmosphere_parameters_.mie_density.layers[1])},
-        atmosphere_parameters_.mie_scattering.to(1.0 / m),
-        atmosphere_parameters_.mie_extinction.to(1.0 / m),
-        atmosphere_parameters_.mie_phase_function_g(),
-        {profile(atmosphere_parameters_.absorption_density.layers[0]),
-         profile(atmosphere_parameters_.absorption_density.layers[1])},
-        atmosphere_parameters_.absorption_extinction.to(1.0 / m),
-        atmosphere_parameters_.ground_albedo.to(Number::Unit()),
-        acos(atmosphere_parameters_.mu_s_min()),
+        atmosphere_parameters.sun_angular_radius.to(rad),
+        atmosphere_parameters.bottom_radius.to(m),
+        atmosphere_parameters.top_radius.to(m),
+        {profile(atmosphere_parameters.rayleigh_density.layers[1])},
+        atmosphere_parameters.rayleigh_scattering.to(1.0 / m),
+        {profile(atmosphere_parameters.mie_density.layers[1])},
+        atmosphere_parameters.mie_scattering.to(1.0 / m),
+        atmosphere_parameters.mie_extinction.to(1.0 / m),
+        atmosphere_parameters.mie_phase_function_g(),
+        {profile(atmosphere_parameters.absorption_density.layers[0]),
+         profile(atmosphere_parameters.absorption_density.layers[1])},
+        atmosphere_parameters.absorption_extinction.to(1.0 / m),
+        atmosphere_parameters.ground_albedo.to(Number::Unit()),
+        acos(atmosphere_parameters.mu_s_min()),
         kLengthUnit.to(m),
         precomputed_luminance ? 15 : 3 /* num_computed_wavelengths */,
         combine_textures,
-        true /* half_precision */));
+        true /* half_precision */,
+        "" /* cache_directory */,
+        use_compute_shaders));
+  }
+
+/*
+<p>and to create and initialize it:
+*/
+
+  void InitGpuModel(bool combine_textures, bool precomputed_luminance,
+      bool use_compute_shaders = false) {
+    CreateGpuModel(combine_textures, precomputed_luminance,
+        use_compute_shaders);
     model_->Init();
     glutSwapBuffers();
   }
 
 /*
 <p>Likewise, the CPU model might not be needed by all test cases, so we provide
-a separate method to initialize it:
+a separate method to initialize it. Most test cases do not call it directly:
+the CPU model is only needed to render the reference images which are not yet
+in the golden image cache (see below):
 */
 
   void InitCpuModel() {
     reference_model_.reset(
-        new reference::Model(atmosphere_parameters_, "output/"));
-    reference_model_->Init();
+        new reference::Model(scene_.atmosphere_parameters(), "output/"));
+    reference_model_->Init(kNumScatteringOrders);
   }
 
 /*
 <p>Finally, before rendering an image with the GPU or CPU model, we must
 initialize the camera (position, transform matrix, exposure) and the sun
-direction and choose the rendering output (radiance or luminance). For this we
-provide the following method:
+direction and choose the rendering output (radiance or luminance). This is done
+by the test scene:
 */
 
   void SetViewParameters(Angle sun_theta, Angle sun_phi, bool use_luminance) {
-    // Transform matrix from camera frame to world space (i.e. the inverse of a
-    // GL_MODELVIEW matrix).
-    const float kCameraPos[3] = { 2000.0, -8000.0, 500.0 };
-    constexpr float kPitch = PI / 30.0;
-    const float model_from_view[16] = {
-      1.0, 0.0, 0.0, kCameraPos[0],
-      0.0, -sinf(kPitch), -cosf(kPitch), kCameraPos[1],
-      0.0, cosf(kPitch), -sinf(kPitch), kCameraPos[2],
-      0.0, 0.0, 0.0, 1.0
-    };
-
-    // Transform matrix from clip space to camera space (i.e. the inverse of a
-    // GL_PROJECTION matrix).
-    constexpr float kFovY = 50.0 / 180.0 * PI;
-    const float kTanFovY = std::tan(kFovY / 2.0);
-    const float view_from_clip[16] = {
-      kTanFovY * static_cast<float>(kWidth) / kHeight, 0.0, 0.0, 0.0,
-      0.0, kTanFovY, 0.0, 0.0,
-      0.0, 0.0, 0.0, -1.0,
-      0.0, 0.0, 1.0, 1.0
-    };
-
-    // Transform matrix from clip space to world space.
-    for (int row = 0; row < 3; ++row) {
-      for (int col = 0; col < 3; ++col) {
-        int col2 = col < 2 ? col : 3;
-        model_from_clip_[col + 3 * row] =
-            model_from_view[0 + 4 * row] * view_from_clip[col2 + 0] +
-            model_from_view[1 + 4 * row] * view_from_clip[col2 + 4] +
-            model_from_view[2 + 4 * row] * view_from_clip[col2 + 8];
-      }
-    }
-
-    camera_ = Position(kCameraPos[0] * m, kCameraPos[1] * m, kCameraPos[2] * m);
-    exposure_ = use_luminance ? 1e-4 : 10.0;
-    use_luminance_ = use_luminance;
-    sun_direction_ = Direction(
-        cos(sun_phi) * sin(sun_theta),
-        sin(sun_phi) * sin(sun_theta),
-        cos(sun_theta));
+    scene_.SetViewParameters(sun_theta, sun_phi, use_luminance);
   }
 
 /*
@@ -500,7 +345,7 @@ method:
 
     const std::string fragment_shader_str =
         "#version 330\n" +
-        std::string(use_luminance_ ? "#define USE_LUMINANCE\n" : "") +
+        std::string(scene_.use_luminance() ? "#define USE_LUMINANCE\n" : "") +
         std::string(kFragmentShader) + definitions_glsl +
         "const vec3 kSphereCenter = vec3(0.0, 0.0, " +
             std::to_string(kSphereRadius.to(kLengthUnit)) + ");\n" +
@@ -526,34 +371,40 @@ method:
     glDeleteShader(vertex_shader);
     glDeleteShader(fragment_shader);
 
+    const Position camera = scene_.camera();
+    const Position earth_center = scene_.earth_center();
+    const Direction sun_direction = scene_.sun_direction();
+    const dimensional::vec2 sun_size = scene_.sun_size();
+    const DimensionlessSpectrum& ground_albedo = scene_.ground_albedo();
+    const DimensionlessSpectrum& sphere_albedo = scene_.sphere_albedo();
     glUseProgram(program_);
     model_->SetProgramUniforms(program_, 0, 1, 2, 3);
     glUniformMatrix3fv(glGetUniformLocation(program_, "model_from_clip"),
-        1, true, model_from_clip_.data());
+        1, true, scene_.model_from_clip().data());
     glUniform3f(glGetUniformLocation(program_, "camera_"),
-        camera_.x.to(kLengthUnit),
-        camera_.y.to(kLengthUnit),
-        camera_.z.to(kLengthUnit));
+        camera.x.to(kLengthUnit),
+        camera.y.to(kLengthUnit),
+        camera.z.to(kLengthUnit));
     glUniform1f(glGetUniformLocation(program_, "exposure_"),
-        exposure_());
+        scene_.exposure()());
     glUniform3f(glGetUniformLocation(program_, "earth_center_"),
-        earth_center_.x.to(kLengthUnit),
-        earth_center_.y.to(kLengthUnit),
-        earth_center_.z.to(kLengthUnit));
+        earth_center.x.to(kLengthUnit),
+        earth_center.y.to(kLengthUnit),
+        earth_center.z.to(kLengthUnit));
     glUniform3f(glGetUniformLocation(program_, "sun_direction_"),
-        sun_direction_.x(),
-        sun_direction_.y(),
-        sun_direction_.z());
+        sun_direction.x(),
+        sun_direction.y(),
+        sun_direction.z());
     glUniform2f(glGetUniformLocation(program_, "sun_size_"),
-        sun_size_.x(), sun_size_.y());
+        sun_size.x(), sun_size.y());
     glUniform3f(glGetUniformLocation(program_, "ground_albedo_"),
-        ground_albedo_(kLambdaR)(),
-        ground_albedo_(kLambdaG)(),
-        ground_albedo_(kLambdaB)());
+        ground_albedo(kLambdaR)(),
+        ground_albedo(kLambdaG)(),
+        ground_albedo(kLambdaB)());
     glUniform3f(glGetUniformLocation(program_, "sphere_albedo_"),
-        sphere_albedo_(kLambdaR)(),
-        sphere_albedo_(kLambdaG)(),
-        sphere_albedo_(kLambdaB)());
+        sphere_albedo(kLambdaR)(),
+        sphere_albedo(kLambdaG)(),
+        sphere_albedo(kLambdaB)());
   }
 
 /*
@@ -579,136 +430,40 @@ with the GPU program, and then read back the framebuffer pixels.
     glReadPixels(
         0, 0, kWidth, kHeight, GL_RGBA, GL_UNSIGNED_BYTE, gl_pixels.get());
 
-    Image pixels(new unsigned int[kWidth * kHeight]);
+    Image pixels(kWidth, kHeight);
     for (unsigned int j = 0; j < kHeight; ++j) {
       for (unsigned int i = 0; i < kWidth; ++i) {
         int gl_offset = 4 * (i + (kHeight - 1 - j) * kWidth);
-        int offset = i + j * kWidth;
-        pixels[offset] = (255 << 24) |
+        pixels.Set(i, j, (255 << 24) |
             (gl_pixels[gl_offset] << 16) |
             (gl_pixels[gl_offset + 1] << 8) |
-            gl_pixels[gl_offset + 2];
+            gl_pixels[gl_offset + 2]);
       }
     }
     return pixels;
   }
 
 /*
-<p>In order to render an image with the CPU model, we must first provide its
-CPU implementation. For this, as for the unit tests of the GPU model, we simply
-view the GLSL shader <a href="model_test.glsl.html">model_test.glsl</a> as C++
-code (see the <a href="../index.html">Introduction</a>), that we include here
-directly (after the definitions of the functions and macros it requires - the
-"uniforms" are provided by the fields of the test fixture class, defined at the
-end of this file):
-*/
-
-  RadianceSpectrum GetSolarRadiance() {
-    return reference_model_->GetSolarRadiance();
-  }
-
-  RadianceSpectrum GetSkyRadiance(Position camera, Direction view_ray,
-      Length shadow_length, Direction sun_direction,
-      DimensionlessSpectrum& transmittance) {
-    return reference_model_->GetSkyRadiance(
-        camera, view_ray, shadow_length, sun_direction, &transmittance);
-  }
-
-  RadianceSpectrum GetSkyRadianceToPoint(Position camera, Position point,
-      Length shadow_length, Direction sun_direction,
-      DimensionlessSpectrum& transmittance) {
-    return reference_model_->GetSkyRadianceToPoint(
-        camera, point, shadow_length, sun_direction, &transmittance);
-  }
-
-  IrradianceSpectrum GetSunAndSkyIrradiance(Position point, Direction normal,
-      Direction sun_direction, IrradianceSpectrum& sky_irradiance) {
-    return reference_model_->GetSunAndSkyIrradiance(
-        point, normal, sun_direction, &sky_irradiance);
-  }
-
-#define OUT(x) x&
-#include "atmosphere/reference/model_test.glsl"
-
-/*
-<p>With this CPU implementation, we can render an image with a simple loop over
-all the pixels, calling <code>GetViewRayRadiance</code> for each pixel, and
-using the same tone mapping function as in the GPU version to convert the result
-to a final color. The main difference with the GPU model is the conversion from
-a radiance spectrum to an sRGB value, which must be done explicitely if a
-luminance output is desired (otherwise, for radiance outputs, we simply need to
-sample the radiance spectrum at the 3 predefined wavelengths):
+<p>The CPU implementation of the same shader is provided by the test scene,
+which renders it with the CPU model. This is very slow, but the result only
+depends on the scene and on the code of the CPU model. We thus cache the HDR
+reference images on disk, in a <a href="golden_image_cache.h.html">golden image
+cache</a>, and render them with the CPU model (which is initialized here if
+necessary) only if they are not already in this cache:
 */
 
   Image RenderCpuImage() {
-    constexpr auto kMaxLuminousEfficacy = MAX_LUMINOUS_EFFICACY * lm / watt;
-    std::vector<Wavelength> wavelengths;
-    std::vector<Number> x_values;
-    std::vector<Number> y_values;
-    std::vector<Number> z_values;
-    for (unsigned int i = 0; i < 95 * 4; i += 4) {
-      wavelengths.push_back(CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[i] * nm);
-      x_values.push_back(CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[i + 1]);
-      y_values.push_back(CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[i + 2]);
-      z_values.push_back(CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[i + 3]);
-    }
-    const auto cie_x_bar = DimensionlessSpectrum(wavelengths, x_values);
-    const auto cie_y_bar = DimensionlessSpectrum(wavelengths, y_values);
-    const auto cie_z_bar = DimensionlessSpectrum(wavelengths, z_values);
-
-    Image pixels(new unsigned int[kWidth * kHeight]);
-    ProgressBar progress_bar(kWidth * kHeight);
-    RunJobs([&](unsigned int j) {
-      double y = 1.0 - 2.0 * (j + 0.5) / kHeight;
-      double dy = -2.0 / kHeight;
-      for (unsigned int i = 0; i < kWidth; ++i) {
-        double x = 2.0 * (i + 0.5) / kWidth - 1.0;
-        double dx = 2.0 / kWidth;
-
-        Direction view_ray(
-            model_from_clip_[0] * x + model_from_clip_[1] * y +
-                model_from_clip_[2],
-            model_from_clip_[3] * x + model_from_clip_[4] * y +
-                model_from_clip_[5],
-            model_from_clip_[6] * x + model_from_clip_[7] * y +
-                model_from_clip_[8]);
-
-        Direction view_ray_diff(
-            model_from_clip_[0] * dx + model_from_clip_[1] * dy,
-            model_from_clip_[3] * dx + model_from_clip_[4] * dy,
-            model_from_clip_[6] * dx + model_from_clip_[7] * dy);
-
-        RadianceSpectrum radiance = GetViewRayRadiance(view_ray, view_ray_diff);
-
-        double r, g, b;
-        if (use_luminance_) {
-          Luminance x = kMaxLuminousEfficacy * Integral(radiance * cie_x_bar);
-          Luminance y = kMaxLuminousEfficacy * Integral(radiance * cie_y_bar);
-          Luminance z = kMaxLuminousEfficacy * Integral(radiance * cie_z_bar);
-          r = (XYZ_TO_SRGB[0] * x + XYZ_TO_SRGB[1] * y + XYZ_TO_SRGB[2] * z).to(
-              cd_per_square_meter);
-          g = (XYZ_TO_SRGB[3] * x + XYZ_TO_SRGB[4] * y + XYZ_TO_SRGB[5] * z).to(
-              cd_per_square_meter);
-          b = (XYZ_TO_SRGB[6] * x + XYZ_TO_SRGB[7] * y + XYZ_TO_SRGB[8] * z).to(
-              cd_per_square_meter);
-        } else {
-          r = radiance(kLambdaR).to(watt_per_square_meter_per_sr_per_nm);
-          g = radiance(kLambdaG).to(watt_per_square_meter_per_sr_per_nm);
-          b = radiance(kLambdaB).to(watt_per_square_meter_per_sr_per_nm);
-        }
-
-        r = std::pow(1.0 - std::exp(-r * exposure_()), 1.0 / 2.2);
-        g = std::pow(1.0 - std::exp(-g * exposure_()), 1.0 / 2.2);
-        b = std::pow(1.0 - std::exp(-b * exposure_()), 1.0 / 2.2);
-        unsigned int red = static_cast<unsigned int>(r * 255.0);
-        unsigned int green = static_cast<unsigned int>(g * 255.0);
-        unsigned int blue = static_cast<unsigned int>(b * 255.0);
-        pixels[i + j * kWidth] =
-            (255 << 24) | (red << 16) | (green << 8) | blue;
-        progress_bar.Increment(1);
+    const uint64_t key =
+        GoldenImageCache::GetKey(scene_, kNumScatteringOrders);
+    HdrImage image(kWidth, kHeight);
+    if (!golden_image_cache_.Load(key, &image)) {
+      if (!reference_model_) {
+        InitCpuModel();
       }
-    }, kHeight);
-    return pixels;
+      image = scene_.RenderHdr(*reference_model_);
+      golden_image_cache_.Save(key, image);
+    }
+    return scene_.ToneMap(image);
   }
 
 /*
@@ -716,49 +471,38 @@ sample the radiance spectrum at the 3 predefined wavelengths):
 
 <p>After some images have been rendered, we want to compare them in order to
 check whether two images of the same scene, rendered with different methods, are
-close enough or not. This is the goal of the following method, which uses the
+close enough or not. For this we use the
 <a href="https://fr.wikipedia.org/wiki/Peak_Signal_to_Noise_Ratio">Peak Signal
-to Noise Ratio</a> as the image difference measure.
-*/
-
-  double ComputePSNR(const unsigned int* image1, const unsigned int* image2) {
-    double square_error_sum = 0.0;
-    for (unsigned int j = 0; j < kHeight; ++j) {
-      for (unsigned int i = 0; i < kWidth; ++i) {
-        int argb1 = image1[i + j * kWidth];
-        int argb2 = image2[i + j * kWidth];
-        dimensional::Vector3<Number> rgb1(
-            (argb1 >> 16) & 0xFF, (argb1 >> 8) & 0xFF, argb1 & 0xFF);
-        dimensional::Vector3<Number> rgb2(
-            (argb2 >> 16) & 0xFF, (argb2 >> 8) & 0xFF, argb2 & 0xFF);
-        square_error_sum += dot(rgb1 - rgb2, rgb1 - rgb2)();
-      }
-    }
-    double mean_square_error = sqrt(square_error_sum / (kWidth * kHeight));
-    return 10.0 * log(255 * 255 / mean_square_error) / log(10.0);
-  }
-
-/*
-<p>Also, in order to visually compare the images, it is useful to have an HTML
-test report, showing for each test case its two images and their PSNR score
-difference. For this, the following method compares two images, writes them to
-disk, creates or appends a test report entry in a test report file, and finally
-returns the computed PSNR.
+to Noise Ratio</a> as the image difference measure (see
+<a href="image.h.html">image.h</a>). Also, in order to visually compare the
+images, it is useful to have an HTML test report, showing for each test case its
+two images, their PSNR, SSIM and maximum error, and a heatmap of the RMS error
+per tile, which shows where the differences are. For this, the following method
+compares two images, writes them and the heatmap to disk, creates or appends a
+test report entry in a test report file, and finally returns the computed PSNR.
 */
 
   double Compare(Image image1, Image image2, const std::string& caption,
       bool append) {
-    double psnr = ComputePSNR(image1.get(), image2.get());
-    WritePngArgb(name_ + "1.png", image1.get());
-    WritePngArgb(name_ + "2.png", image2.get());
+    const ImageComparison comparison = CompareImages(image1, image2);
+    const double max_tile_error = *std::max_element(
+        comparison.tile_rms_error.begin(), comparison.tile_rms_error.end());
+    WritePngArgb(name_ + "1.png", image1);
+    WritePngArgb(name_ + "2.png", image2);
+    WritePngArgb(name_ + "_error.png",
+        CreateHeatmap(comparison, comparison.tile_rms_error, max_tile_error));
     std::ofstream file(std::string(kOutputDir) + "test_report.html",
         append ? std::ios_base::app : std::ios_base::trunc);
-    file << "<h2>" << name_ << " (PSNR = " << psnr << "dB)</h2>" << std::endl
-         << "<p>" << caption << std::endl
+    file << "<h2>" << name_ << " (PSNR = " << comparison.psnr << "dB, SSIM = "
+         << comparison.ssim << ", max error = " << comparison.max_error
+         << ")</h2>" << std::endl
+         << "<p>" << caption << " Bottom: RMS error per tile (white = "
+         << max_tile_error << ")." << std::endl
          << "<p><img src=\"" << name_ << "1.png\">" << std::endl
-         << "<img src=\"" << name_ << "2.png\">" << std::endl;
+         << "<img src=\"" << name_ << "2.png\">" << std::endl
+         << "<br><img src=\"" << name_ << "_error.png\">" << std::endl;
     file.close();
-    return psnr;
+    return comparison.psnr;
   }
 
 /*
@@ -782,7 +526,6 @@ CPU). As a consequence, we expect the two images to be nearly identical:
         "predefined wavelengths (i.e. no conversion to sRGB via CIE XYZ).";
     InitGpuModel(false /* combine_textures */,
         false /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(65.0 * deg, 90.0 * deg, false /* use_luminance */);
     ExpectLess(
         47.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, false));
@@ -802,7 +545,6 @@ previous test case:
         "predefined wavelengths (i.e. no conversion to sRGB via CIE XYZ).";
     InitGpuModel(true /* combine_textures */,
         false /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(65.0 * deg, 90.0 * deg, false /* use_luminance */);
     ExpectLess(
         46.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
@@ -821,7 +563,6 @@ previous test, so we expect a larger difference between the GPU and CPU results
         "predefined wavelengths (i.e. no conversion to sRGB via CIE XYZ).";
     InitGpuModel(true /* combine_textures */,
         false /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(88.0 * deg, 90.0 * deg, false /* use_luminance */);
     ExpectLess(
         40.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
@@ -844,11 +585,10 @@ approximations:
         "Right: CPU model. Both images show the sRGB luminance (radiance "
         "converted to CIE XYZ and then to sRGB - with some approximations on "
         "GPU).";
-    sphere_albedo_ = DimensionlessSpectrum(0.8);
-    ground_albedo_ = DimensionlessSpectrum(0.1);
+    scene_.set_sphere_albedo(DimensionlessSpectrum(0.8));
+    scene_.set_ground_albedo(DimensionlessSpectrum(0.1));
     InitGpuModel(false /* combine_textures */,
         false /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(65.0 * deg, 90.0 * deg, true /* use_luminance */);
     ExpectLess(
         40.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
@@ -867,11 +607,10 @@ compared to the previous test case:
         "Right: CPU model. Both images show the sRGB luminance (radiance "
         "converted to CIE XYZ and then to sRGB - with some approximations on "
         "GPU).";
-    sphere_albedo_ = DimensionlessSpectrum(0.8);
-    ground_albedo_ = DimensionlessSpectrum(0.1);
+    scene_.set_sphere_albedo(DimensionlessSpectrum(0.8));
+    scene_.set_ground_albedo(DimensionlessSpectrum(0.1));
     InitGpuModel(true /* combine_textures */,
         false /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(65.0 * deg, 90.0 * deg, true /* use_luminance */);
     ExpectLess(
         40.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
@@ -889,11 +628,10 @@ previous test, so we expect a larger difference between the GPU and CPU results
         "Right: CPU model. Both images show the sRGB luminance (radiance "
         "converted to CIE XYZ and then to sRGB - with some approximations on "
         "GPU).";
-    sphere_albedo_ = DimensionlessSpectrum(0.8);
-    ground_albedo_ = DimensionlessSpectrum(0.1);
+    scene_.set_sphere_albedo(DimensionlessSpectrum(0.8));
+    scene_.set_ground_albedo(DimensionlessSpectrum(0.1));
     InitGpuModel(true /* combine_textures */,
         false /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(88.0 * deg, 90.0 * deg, true /* use_luminance */);
     ExpectLess(
         35.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
@@ -916,7 +654,6 @@ spectral way, and to convert to XYZ and then to sRGB only at the very end).
         "GPU).";
     InitGpuModel(true /* combine_textures */,
         false /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(65.0 * deg, 90.0 * deg, true /* use_luminance */);
     ExpectLess(
         38.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
@@ -936,7 +673,6 @@ dependent albedo values (see the previous test case):
         "GPU).";
     InitGpuModel(true /* combine_textures */,
         false /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(88.0 * deg, 90.0 * deg, true /* use_luminance */);
     ExpectLess(
         35.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
@@ -958,11 +694,10 @@ approximations:
         "Right: CPU model. Both images show the sRGB luminance (radiance "
         "converted to CIE XYZ and then to sRGB - using 15 wavelengths on GPU, "
         "vs 47 on CPU).";
-    sphere_albedo_ = DimensionlessSpectrum(0.8);
-    ground_albedo_ = DimensionlessSpectrum(0.1);
+    scene_.set_sphere_albedo(DimensionlessSpectrum(0.8));
+    scene_.set_ground_albedo(DimensionlessSpectrum(0.1));
     InitGpuModel(false /* combine_textures */,
         true /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(65.0 * deg, 90.0 * deg, true /* use_luminance */);
     ExpectLess(
         43.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
@@ -981,11 +716,10 @@ compared to the previous test case:
         "Right: CPU model. Both images show the sRGB luminance (radiance "
         "converted to CIE XYZ and then to sRGB - using 15 wavelengths on GPU, "
         "vs 47 on CPU).";
-    sphere_albedo_ = DimensionlessSpectrum(0.8);
-    ground_albedo_ = DimensionlessSpectrum(0.1);
+    scene_.set_sphere_albedo(DimensionlessSpectrum(0.8));
+    scene_.set_ground_albedo(DimensionlessSpectrum(0.1));
     InitGpuModel(true /* combine_textures */,
         true /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(65.0 * deg, 90.0 * deg, true /* use_luminance */);
     ExpectLess(
         43.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
@@ -1003,11 +737,10 @@ previous test, so we expect a larger difference between the GPU and CPU results
         "Right: CPU model. Both images show the sRGB luminance (radiance "
         "converted to CIE XYZ and then to sRGB - using 15 wavelengths on GPU, "
         "vs 47 on CPU).";
-    sphere_albedo_ = DimensionlessSpectrum(0.8);
-    ground_albedo_ = DimensionlessSpectrum(0.1);
+    scene_.set_sphere_albedo(DimensionlessSpectrum(0.8));
+    scene_.set_ground_albedo(DimensionlessSpectrum(0.1));
     InitGpuModel(true /* combine_textures */,
         true /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(88.0 * deg, 90.0 * deg, true /* use_luminance */);
     ExpectLess(
         40.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
@@ -1030,7 +763,6 @@ XYZ and then to sRGB only at the very end).
         "vs 47 on CPU).";
     InitGpuModel(true /* combine_textures */,
         true /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(65.0 * deg, 90.0 * deg, true /* use_luminance */);
     ExpectLess(
         39.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
@@ -1050,12 +782,149 @@ dependent albedo values (see the previous test case):
         "vs 47 on CPU).";
     InitGpuModel(true /* combine_textures */,
         true /* precomputed_luminance */);
-    InitCpuModel();
     SetViewParameters(88.0 * deg, 90.0 * deg, true /* use_luminance */);
     ExpectLess(
         40.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
   }
 
+/*
+<p>The following test case checks that the precomputed textures can be
+saved to a file and loaded back, and that loading them yields exactly the same
+image as precomputing them. It also checks that textures precomputed with
+different parameters or with a different number of scattering orders are
+rejected:
+*/
+
+  void TestPrecomputedTexturesSaveAndLoad() {
+    const std::string kCaption = "Left: GPU model, with precomputed textures. "
+        "Right: GPU model, with textures loaded from the file saved by the "
+        "left model.";
+    const std::string kFilename =
+        std::string(kOutputDir) + "precomputed_textures.dat";
+    InitGpuModel(false /* combine_textures */,
+        false /* precomputed_luminance */);
+    SetViewParameters(65.0 * deg, 90.0 * deg, false /* use_luminance */);
+    ExpectTrue(model_->SaveTextures(kFilename));
+    Image precomputed_image = RenderGpuImage();
+    glDeleteProgram(program_);
+
+    CreateGpuModel(true /* combine_textures */,
+        false /* precomputed_luminance */);
+    ExpectFalse(model_->LoadTextures(kFilename, 4));
+    CreateGpuModel(false /* combine_textures */,
+        false /* precomputed_luminance */);
+    ExpectFalse(model_->LoadTextures(kFilename, 3));
+    ExpectTrue(model_->LoadTextures(kFilename, 4));
+    ExpectLess(100.0,
+        Compare(std::move(precomputed_image), RenderGpuImage(), kCaption,
+            true));
+  }
+
+/*
+<p>The following test case checks the incremental precomputation of the
+textures. It checks that the textures of a previous initialization (here with
+fewer scattering orders) are still used until the incremental precomputation
+is complete, and that the final textures yield the same image as a blocking
+initialization:
+*/
+
+  void TestIncrementalPrecomputation() {
+    const std::string kCaption = "Left: GPU model, with textures precomputed "
+        "incrementally. Right: GPU model, with textures precomputed in a "
+        "single Init call.";
+    CreateGpuModel(false /* combine_textures */,
+        false /* precomputed_luminance */);
+    model_->Init(2);
+    SetViewParameters(65.0 * deg, 90.0 * deg, false /* use_luminance */);
+    Image initial_image = RenderGpuImage();
+    glDeleteProgram(program_);
+
+    model_->BeginInit(4);
+    ExpectFalse(model_->Step(1.0 /* ms */));
+    Image intermediate_image = RenderGpuImage();
+    glDeleteProgram(program_);
+    ExpectLess(100.0,
+        ComputePsnr(initial_image, intermediate_image));
+
+    while (!model_->Step(10.0 /* ms */)) {}
+    Image incremental_image = RenderGpuImage();
+    glDeleteProgram(program_);
+
+    InitGpuModel(false /* combine_textures */,
+        false /* precomputed_luminance */);
+    ExpectLess(100.0,
+        Compare(std::move(incremental_image), RenderGpuImage(), kCaption,
+            true));
+  }
+
+/*
+<p>The following test case checks that the textures precomputed with compute
+shaders (if supported - otherwise the test is trivial) yield the same image as
+the textures precomputed with fragment shaders, up to rounding errors:
+*/
+
+  void TestComputeShaders() {
+    const std::string kCaption = "Left: GPU model, with textures precomputed "
+        "with fragment shaders. Right: GPU model, with textures precomputed "
+        "with compute shaders.";
+    CreateGpuModel(false /* combine_textures */,
+        true /* precomputed_luminance */);
+    model_->Init();
+    SetViewParameters(65.0 * deg, 90.0 * deg, true /* use_luminance */);
+    Image fragment_shaders_image = RenderGpuImage();
+    glDeleteProgram(program_);
+
+    InitGpuModel(false /* combine_textures */,
+        true /* precomputed_luminance */, true /* use_compute_shaders */);
+    ExpectLess(60.0, Compare(std::move(fragment_shaders_image),
+        RenderGpuImage(), kCaption, true));
+  }
+
+/*
+<p>Finally, the following test cases check that the GPU textures can be
+converted from the textures precomputed by the CPU model, instead of being
+precomputed on GPU. The first one uses the same rendering options as the first
+test case, and we expect the same image differences (the GPU textures then
+contain exactly the CPU values, except for the half precision quantization):
+*/
+
+  void TestRadianceSeparateTexturesFromCpuTextures() {
+    const std::string kCaption = "Left: GPU model, combine_textures = false, "
+        "with textures converted from the CPU model. Right: CPU model. Both "
+        "images show the spectral radiance at 3 predefined wavelengths (i.e. "
+        "no conversion to sRGB via CIE XYZ).";
+    InitCpuModel();
+    CreateGpuModel(false /* combine_textures */,
+        false /* precomputed_luminance */);
+    ExpectTrue(model_->LoadReferenceTextures("output/", kNumScatteringOrders));
+    SetViewParameters(65.0 * deg, 90.0 * deg, false /* use_luminance */);
+    ExpectLess(
+        47.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
+  }
+
+/*
+<p>The second one checks the conversion to precomputed luminance values, packed
+in combined textures. The luminance values are integrated from the 47 CPU
+wavelengths instead of 15 on GPU, so we expect at least the same precision as
+in the corresponding GPU test case:
+*/
+
+  void TestPrecomputedLuminanceCombineTexturesFromCpuTextures() {
+    const std::string kCaption = "Left: GPU model, combine_textures = true, "
+        "with textures converted from the CPU model. Right: CPU model. Both "
+        "images show the sRGB luminance (radiance converted to CIE XYZ and "
+        "then to sRGB - using 47 wavelengths in both cases).";
+    scene_.set_sphere_albedo(DimensionlessSpectrum(0.8));
+    scene_.set_ground_albedo(DimensionlessSpectrum(0.1));
+    InitCpuModel();
+    CreateGpuModel(true /* combine_textures */,
+        true /* precomputed_luminance */);
+    ExpectTrue(model_->LoadReferenceTextures("output/", kNumScatteringOrders));
+    SetViewParameters(65.0 * deg, 90.0 * deg, true /* use_luminance */);
+    ExpectLess(
+        43.0, Compare(RenderGpuImage(), RenderCpuImage(), kCaption, true));
+  }
+
 /*
 <p> The rest of the code simply declares the fields of our test fixture class,
 and registers the test cases in the test framework:
@@ -1063,21 +932,12 @@ and registers the test cases in the test framework:
 
  private:
   std::string name_;
-  AtmosphereParameters atmosphere_parameters_;
-  DimensionlessSpectrum ground_albedo_;
-  DimensionlessSpectrum sphere_albedo_;
-  Position earth_center_;
-  dimensional::vec2 sun_size_;
+  Scene scene_;
+  GoldenImageCache golden_image_cache_;
 
   std::unique_ptr<atmosphere::Model> model_;
   std::unique_ptr<reference::Model> reference_model_;
   GLuint program_;
-
-  std::array<float, 9> model_from_clip_;
-  Position camera_;
-  Number exposure_;
-  bool use_luminance_;
-  Direction sun_direction_;
 };
 
 namespace {
@@ -1121,6 +981,21 @@ ModelTest precomputed_luminance4(
 ModelTest precomputed_luminance5(
     "PrecomputedLuminanceCombineTexturesSpectralAlbedoSunSet",
     &ModelTest::TestPrecomputedLuminanceCombineTexturesSpectralAlbedoSunSet);
+ModelTest precomputed_textures(
+    "PrecomputedTexturesSaveAndLoad",
+    &ModelTest::TestPrecomputedTexturesSaveAndLoad);
+ModelTest incremental_precomputation(
+    "IncrementalPrecomputation",
+    &ModelTest::TestIncrementalPrecomputation);
+ModelTest compute_shaders(
+    "ComputeShaders",
+    &ModelTest::TestComputeShaders);
+ModelTest cpu_textures1(
+    "RadianceSeparateTexturesFromCpuTextures",
+    &ModelTest::TestRadianceSeparateTexturesFromCpuTextures);
+ModelTest cpu_textures2(
+    "PrecomputedLuminanceCombineTexturesFromCpuTextures",
+    &ModelTest::TestPrecomputedLuminanceCombineTexturesFromCpuTextures);
 
 }  // anonymous namespace
 
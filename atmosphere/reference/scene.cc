@@ -0,0 +1,473 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/scene.cc</h2>
+
+<p>This file implements the <a href="scene.h.html">test scene</a>. The
+constructor initializes the atmosphere parameters (all the images of the scene
+use the same atmosphere parameters) and the constant scene parameters (earth
+center, sun size, surface albedos). The default albedos are provided by the
+following functions:
+*/
+
+#include "atmosphere/reference/scene.h"
+
+#include <cmath>
+#include <vector>
+
+#include "util/progress_bar.h"
+
+namespace atmosphere {
+namespace reference {
+
+namespace {
+
+DimensionlessSpectrum GetGrassAlbedo() {
+  // Grass spectral albedo from Uwe Feister and Rolf Grewe, "Spectral albedo
+  // measurements in the UV and visible region over different types of
+  // surfaces", Photochemistry and Photobiology, 62, 736-744, 1995.
+  constexpr double kGrassAlbedo[45] = {
+    0.018, 0.019, 0.019, 0.020, 0.022, 0.024, 0.027, 0.029, 0.030, 0.031,
+    0.032, 0.032, 0.032, 0.033, 0.035, 0.040, 0.055, 0.073, 0.084, 0.089,
+    0.089, 0.079, 0.069, 0.063, 0.061, 0.057, 0.052, 0.051, 0.048, 0.042,
+    0.039, 0.035, 0.035, 0.043, 0.087, 0.156, 0.234, 0.334, 0.437, 0.513,
+    0.553, 0.571, 0.579, 0.581, 0.587
+  };
+  std::vector<Number> grass_albedo_samples;
+  for (int i = 0; i < 45; ++i) {
+    grass_albedo_samples.push_back(kGrassAlbedo[i]);
+  }
+  return DimensionlessSpectrum(360.0 * nm, 800.0 * nm, grass_albedo_samples);
+}
+
+DimensionlessSpectrum GetSnowAlbedo() {
+  // Snow 5cm spectral albedo from Uwe Feister and Rolf Grewe, "Spectral
+  // albedo measurements in the UV and visible region over different types of
+  // surfaces", Photochemistry and Photobiology, 62, 736-744, 1995.
+  constexpr double kSnowAlbedo[7] = {
+    0.796, 0.802, 0.807, 0.810, 0.818, 0.825, 0.826
+  };
+  std::vector<Number> snow_albedo_samples;
+  for (int i = 0; i < 7; ++i) {
+    snow_albedo_samples.push_back(kSnowAlbedo[i]);
+  }
+  return DimensionlessSpectrum(360.0 * nm, 420.0 * nm, snow_albedo_samples);
+}
+
+}  // anonymous namespace
+
+Scene::Scene(unsigned int width, unsigned int height)
+    : width_(width), height_(height) {
+  // Values from "Reference Solar Spectral Irradiance: ASTM G-173", ETR column
+  // (see http://rredc.nrel.gov/solar/spectra/am1.5/ASTMG173/ASTMG173.html),
+  // summed and averaged in each bin (e.g. the value for 360nm is the average
+  // of the ASTM G-173 values for all wavelengths between 360 and 370nm).
+  // Values in W.m^-2.
+  constexpr int kLambdaMin = 360;
+  constexpr int kLambdaMax = 830;
+  constexpr double kSolarIrradiance[48] = {
+    1.11776, 1.14259, 1.01249, 1.14716, 1.72765, 1.73054, 1.6887, 1.61253,
+    1.91198, 2.03474, 2.02042, 2.02212, 1.93377, 1.95809, 1.91686, 1.8298,
+    1.8685, 1.8931, 1.85149, 1.8504, 1.8341, 1.8345, 1.8147, 1.78158, 1.7533,
+    1.6965, 1.68194, 1.64654, 1.6048, 1.52143, 1.55622, 1.5113, 1.474, 1.4482,
+    1.41018, 1.36775, 1.34188, 1.31429, 1.28303, 1.26758, 1.2367, 1.2082,
+    1.18737, 1.14683, 1.12362, 1.1058, 1.07124, 1.04992
+  };
+  constexpr ScatteringCoefficient kRayleigh = 1.24062e-6 / m;
+  constexpr Length kRayleighScaleHeight = 8000.0 * m;
+  constexpr Length kMieScaleHeight = 1200.0 * m;
+  constexpr double kMieAngstromAlpha = 0.0;
+  constexpr double kMieAngstromBeta = 5.328e-3;
+  constexpr double kMieSingleScatteringAlbedo = 0.9;
+  constexpr double kMiePhaseFunctionG = 0.8;
+  // Values from http://www.iup.uni-bremen.de/gruppen/molspec/databases/
+  // referencespectra/o3spectra2011/index.html for 233K, summed and averaged
+  // in each bin (e.g. the value for 360nm is the average of the original
+  // values for all wavelengths between 360 and 370nm). Values in m^2.
+  constexpr double kOzoneCrossSection[48] = {
+    1.18e-27, 2.182e-28, 2.818e-28, 6.636e-28, 1.527e-27, 2.763e-27, 5.52e-27,
+    8.451e-27, 1.582e-26, 2.316e-26, 3.669e-26, 4.924e-26, 7.752e-26,
+    9.016e-26, 1.48e-25, 1.602e-25, 2.139e-25, 2.755e-25, 3.091e-25, 3.5e-25,
+    4.266e-25, 4.672e-25, 4.398e-25, 4.701e-25, 5.019e-25, 4.305e-25,
+    3.74e-25, 3.215e-25, 2.662e-25, 2.238e-25, 1.852e-25, 1.473e-25,
+    1.209e-25, 9.423e-26, 7.455e-26, 6.566e-26, 5.105e-26, 4.15e-26,
+    4.228e-26, 3.237e-26, 2.451e-26, 2.801e-26, 2.534e-26, 1.624e-26,
+    1.465e-26, 2.078e-26, 1.383e-26, 7.105e-27
+  };
+  // From https://en.wikipedia.org/wiki/Dobson_unit, in molecules.m^-2.
+  constexpr dimensional::Scalar<-2, 0, 0, 0, 0> kDobsonUnit = 2.687e20 / m2;
+  // Maximum number density of ozone molecules, in m^-3 (computed so at to get
+  // 300 Dobson units of ozone - for this we divide 300 DU by the integral of
+  // the ozone density profile defined below, which is equal to 15km).
+  constexpr NumberDensity kMaxOzoneNumberDensity =
+      300.0 * kDobsonUnit / (15.0 * km);
+
+  std::vector<SpectralIrradiance> solar_irradiance;
+  std::vector<ScatteringCoefficient> rayleigh_scattering;
+  std::vector<ScatteringCoefficient> mie_scattering;
+  std::vector<ScatteringCoefficient> mie_extinction;
+  std::vector<ScatteringCoefficient> absorption_extinction;
+  for (int l = kLambdaMin; l <= kLambdaMax; l += 10) {
+    double lambda = static_cast<double>(l) * 1e-3;  // micro-meters
+    SpectralIrradiance solar = kSolarIrradiance[(l - kLambdaMin) / 10] *
+        watt_per_square_meter_per_nm;
+    ScatteringCoefficient rayleigh = kRayleigh * pow(lambda, -4);
+    ScatteringCoefficient mie = kMieAngstromBeta / kMieScaleHeight *
+        pow(lambda, -kMieAngstromAlpha);
+    solar_irradiance.push_back(solar);
+    rayleigh_scattering.push_back(rayleigh);
+    mie_scattering.push_back(mie * kMieSingleScatteringAlbedo);
+    mie_extinction.push_back(mie);
+    absorption_extinction.push_back(kMaxOzoneNumberDensity *
+        kOzoneCrossSection[(l - kLambdaMin) / 10] * m2);
+  }
+
+  atmosphere_parameters_.solar_irradiance = IrradianceSpectrum(
+      kLambdaMin * nm, kLambdaMax * nm, solar_irradiance);
+  atmosphere_parameters_.sun_angular_radius = 0.2678 * deg;
+  atmosphere_parameters_.bottom_radius = 6360.0 * km;
+  atmosphere_parameters_.top_radius = 6420.0 * km;
+  atmosphere_parameters_.rayleigh_density.layers[1] = DensityProfileLayer(
+      0.0 * m, 1.0, -1.0 / kRayleighScaleHeight, 0.0 / m, 0.0);
+  atmosphere_parameters_.rayleigh_scattering = ScatteringSpectrum(
+      kLambdaMin * nm, kLambdaMax * nm, rayleigh_scattering);
+  atmosphere_parameters_.mie_density.layers[1] = DensityProfileLayer(
+      0.0 * m, 1.0, -1.0 / kMieScaleHeight, 0.0 / m, 0.0);
+  atmosphere_parameters_.mie_scattering = ScatteringSpectrum(
+      kLambdaMin * nm, kLambdaMax * nm, mie_scattering);
+  atmosphere_parameters_.mie_extinction = ScatteringSpectrum(
+      kLambdaMin * nm, kLambdaMax * nm, mie_extinction);
+  atmosphere_parameters_.mie_phase_function_g = kMiePhaseFunctionG;
+  // Density profile increasing linearly from 0 to 1 between 10 and 25km, and
+  // decreasing linearly from 1 to 0 between 25 and 40km. Approximate profile
+  // from http://www.kln.ac.lk/science/Chemistry/Teaching_Resources/Documents/
+  // Introduction%20to%20atmospheric%20chemistry.pdf (page 10).
+  atmosphere_parameters_.absorption_density.layers[0] = DensityProfileLayer(
+      25.0 * km, 0.0, 0.0 / km, 1.0 / (15.0 * km), -2.0 / 3.0);
+  atmosphere_parameters_.absorption_density.layers[1] = DensityProfileLayer(
+      0.0 * km, 0.0, 0.0 / km, -1.0 / (15.0 * km), 8.0 / 3.0);
+  atmosphere_parameters_.absorption_extinction = ScatteringSpectrum(
+      kLambdaMin * nm, kLambdaMax * nm, absorption_extinction);
+  atmosphere_parameters_.ground_albedo = DimensionlessSpectrum(0.1);
+  atmosphere_parameters_.mu_s_min = cos(102.0 * deg);
+
+  earth_center_ =
+      Position(0.0 * m, 0.0 * m, -atmosphere_parameters_.bottom_radius);
+
+  sun_size_ = dimensional::vec2(
+      tan(atmosphere_parameters_.sun_angular_radius),
+      cos(atmosphere_parameters_.sun_angular_radius));
+
+  ground_albedo_ = GetGrassAlbedo();
+  sphere_albedo_ = GetSnowAlbedo();
+  SetViewParameters(65.0 * deg, 90.0 * deg, false /* use_luminance */);
+}
+
+/*
+<p>The view parameters are initialized as in the model tests, with a fixed
+camera position and field of view:
+*/
+
+void Scene::SetViewParameters(Angle sun_theta, Angle sun_phi,
+    bool use_luminance) {
+  // Transform matrix from camera frame to world space (i.e. the inverse of a
+  // GL_MODELVIEW matrix).
+  const float kCameraPos[3] = { 2000.0, -8000.0, 500.0 };
+  constexpr float kPitch = PI / 30.0;
+  const float model_from_view[16] = {
+    1.0, 0.0, 0.0, kCameraPos[0],
+    0.0, -sinf(kPitch), -cosf(kPitch), kCameraPos[1],
+    0.0, cosf(kPitch), -sinf(kPitch), kCameraPos[2],
+    0.0, 0.0, 0.0, 1.0
+  };
+
+  // Transform matrix from clip space to camera space (i.e. the inverse of a
+  // GL_PROJECTION matrix).
+  constexpr float kFovY = 50.0 / 180.0 * PI;
+  const float kTanFovY = std::tan(kFovY / 2.0);
+  const float view_from_clip[16] = {
+    kTanFovY * static_cast<float>(width_) / height_, 0.0, 0.0, 0.0,
+    0.0, kTanFovY, 0.0, 0.0,
+    0.0, 0.0, 0.0, -1.0,
+    0.0, 0.0, 1.0, 1.0
+  };
+
+  // Transform matrix from clip space to world space.
+  for (int row = 0; row < 3; ++row) {
+    for (int col = 0; col < 3; ++col) {
+      int col2 = col < 2 ? col : 3;
+      model_from_clip_[col + 3 * row] =
+          model_from_view[0 + 4 * row] * view_from_clip[col2 + 0] +
+          model_from_view[1 + 4 * row] * view_from_clip[col2 + 4] +
+          model_from_view[2 + 4 * row] * view_from_clip[col2 + 8];
+    }
+  }
+
+  camera_ = Position(kCameraPos[0] * m, kCameraPos[1] * m, kCameraPos[2] * m);
+  exposure_ = use_luminance ? 1e-4 : 10.0;
+  use_luminance_ = use_luminance;
+  sun_direction_ = Direction(
+      cos(sun_phi) * sin(sun_theta),
+      sin(sun_phi) * sin(sun_theta),
+      cos(sun_theta));
+}
+
+std::array<double, 9> Scene::view_ray_from_clip() const {
+  std::array<double, 9> result;
+  for (int i = 0; i < 9; ++i) {
+    result[i] = model_from_clip_[i];
+  }
+  return result;
+}
+
+/*
+<p>In order to render the scene on CPU, we view the GLSL shader <a href=
+"model_test.glsl.html">model_test.glsl</a> as C++ code (see the <a href=
+"../index.html">Introduction</a>), that we include in the following class
+(after the definitions of the functions and macros it requires - the "uniforms"
+are provided by the fields of this class, copied from the scene). This class is
+templated by the model type, in order to be usable with other models providing
+the same API as <code>Model</code>:
+*/
+
+namespace {
+
+template<class ModelType>
+class SceneRenderer {
+ public:
+  SceneRenderer(const Scene& scene, const ModelType& model)
+      : model_(model),
+        ground_albedo_(scene.ground_albedo()),
+        sphere_albedo_(scene.sphere_albedo()),
+        earth_center_(scene.earth_center()),
+        sun_size_(scene.sun_size()),
+        camera_(scene.camera()),
+        sun_direction_(scene.sun_direction()) {}
+
+  RadianceSpectrum GetSolarRadiance() {
+    return model_.GetSolarRadiance();
+  }
+
+  RadianceSpectrum GetSkyRadiance(Position camera, Direction view_ray,
+      Length shadow_length, Direction sun_direction,
+      DimensionlessSpectrum& transmittance) {
+    return model_.GetSkyRadiance(
+        camera, view_ray, shadow_length, sun_direction, &transmittance);
+  }
+
+  RadianceSpectrum GetSkyRadianceToPoint(Position camera, Position point,
+      Length shadow_length, Direction sun_direction,
+      DimensionlessSpectrum& transmittance) {
+    return model_.GetSkyRadianceToPoint(
+        camera, point, shadow_length, sun_direction, &transmittance);
+  }
+
+  IrradianceSpectrum GetSunAndSkyIrradiance(Position point, Direction normal,
+      Direction sun_direction, IrradianceSpectrum& sky_irradiance) {
+    return model_.GetSunAndSkyIrradiance(
+        point, normal, sun_direction, &sky_irradiance);
+  }
+
+  HdrImage Render(const Scene& scene);
+
+#define OUT(x) x&
+#include "atmosphere/reference/model_test.glsl"
+#undef OUT
+
+ private:
+  const ModelType& model_;
+  const DimensionlessSpectrum ground_albedo_;
+  const DimensionlessSpectrum sphere_albedo_;
+  const Position earth_center_;
+  const dimensional::vec2 sun_size_;
+  const Position camera_;
+  const Direction sun_direction_;
+};
+
+/*
+<p>With this CPU implementation, we can render an HDR image with a simple loop
+over all the pixels, calling <code>GetViewRayRadiance</code> for each pixel. The
+main difference with the GPU model is the conversion from a radiance spectrum to
+an sRGB value, which must be done explicitely if a luminance output is desired
+(otherwise, for radiance outputs, we simply need to sample the radiance spectrum
+at the 3 predefined wavelengths):
+*/
+
+template<class ModelType>
+HdrImage SceneRenderer<ModelType>::Render(const Scene& scene) {
+  constexpr auto kMaxLuminousEfficacy = MAX_LUMINOUS_EFFICACY * lm / watt;
+  std::vector<Wavelength> wavelengths;
+  std::vector<Number> x_values;
+  std::vector<Number> y_values;
+  std::vector<Number> z_values;
+  for (unsigned int i = 0; i < 95 * 4; i += 4) {
+    wavelengths.push_back(CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[i] * nm);
+    x_values.push_back(CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[i + 1]);
+    y_values.push_back(CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[i + 2]);
+    z_values.push_back(CIE_2_DEG_COLOR_MATCHING_FUNCTIONS[i + 3]);
+  }
+  const auto cie_x_bar = DimensionlessSpectrum(wavelengths, x_values);
+  const auto cie_y_bar = DimensionlessSpectrum(wavelengths, y_values);
+  const auto cie_z_bar = DimensionlessSpectrum(wavelengths, z_values);
+
+  const unsigned int width = scene.width();
+  const unsigned int height = scene.height();
+  const std::array<float, 9>& model_from_clip = scene.model_from_clip();
+  HdrImage pixels(width, height);
+  ProgressBar progress_bar(width * height);
+  RunJobs([&](unsigned int j) {
+    double y = 1.0 - 2.0 * (j + 0.5) / height;
+    double dy = -2.0 / height;
+    for (unsigned int i = 0; i < width; ++i) {
+      double x = 2.0 * (i + 0.5) / width - 1.0;
+      double dx = 2.0 / width;
+
+      Direction view_ray(
+          model_from_clip[0] * x + model_from_clip[1] * y +
+              model_from_clip[2],
+          model_from_clip[3] * x + model_from_clip[4] * y +
+              model_from_clip[5],
+          model_from_clip[6] * x + model_from_clip[7] * y +
+              model_from_clip[8]);
+
+      Direction view_ray_diff(
+          model_from_clip[0] * dx + model_from_clip[1] * dy,
+          model_from_clip[3] * dx + model_from_clip[4] * dy,
+          model_from_clip[6] * dx + model_from_clip[7] * dy);
+
+      RadianceSpectrum radiance = GetViewRayRadiance(view_ray, view_ray_diff);
+
+      double r, g, b;
+      if (scene.use_luminance()) {
+        Luminance x = kMaxLuminousEfficacy * Integral(radiance * cie_x_bar);
+        Luminance y = kMaxLuminousEfficacy * Integral(radiance * cie_y_bar);
+        Luminance z = kMaxLuminousEfficacy * Integral(radiance * cie_z_bar);
+        r = (XYZ_TO_SRGB[0] * x + XYZ_TO_SRGB[1] * y + XYZ_TO_SRGB[2] * z).to(
+            cd_per_square_meter);
+        g = (XYZ_TO_SRGB[3] * x + XYZ_TO_SRGB[4] * y + XYZ_TO_SRGB[5] * z).to(
+            cd_per_square_meter);
+        b = (XYZ_TO_SRGB[6] * x + XYZ_TO_SRGB[7] * y + XYZ_TO_SRGB[8] * z).to(
+            cd_per_square_meter);
+      } else {
+        r = radiance(kLambdaR).to(watt_per_square_meter_per_sr_per_nm);
+        g = radiance(kLambdaG).to(watt_per_square_meter_per_sr_per_nm);
+        b = radiance(kLambdaB).to(watt_per_square_meter_per_sr_per_nm);
+      }
+      pixels.Set(i, j, r, g, b);
+      progress_bar.Increment(1);
+    }
+  }, height);
+  return pixels;
+}
+
+/*
+<p>The aerial perspective volume of a <code>Model</code> is not used by its
+<code>GetSkyRadianceToPoint</code> method. In order to render the scene with
+it, we use the following adapter, providing the API expected by
+<code>SceneRenderer</code>:
+*/
+
+class AerialPerspectiveVolumeModel {
+ public:
+  explicit AerialPerspectiveVolumeModel(const Model& model) : model_(model) {}
+
+  RadianceSpectrum GetSolarRadiance() const {
+    return model_.GetSolarRadiance();
+  }
+
+  RadianceSpectrum GetSkyRadiance(Position camera, Direction view_ray,
+      Length shadow_length, Direction sun_direction,
+      DimensionlessSpectrum* transmittance) const {
+    return model_.GetSkyRadiance(
+        camera, view_ray, shadow_length, sun_direction, transmittance);
+  }
+
+  RadianceSpectrum GetSkyRadianceToPoint(Position camera, Position point,
+      Length shadow_length, Direction sun_direction,
+      DimensionlessSpectrum* transmittance) const {
+    return model_.GetSkyRadianceToPointFromVolume(
+        camera, point, sun_direction, transmittance);
+  }
+
+  IrradianceSpectrum GetSunAndSkyIrradiance(Position point, Direction normal,
+      Direction sun_direction, IrradianceSpectrum* sky_irradiance) const {
+    return model_.GetSunAndSkyIrradiance(
+        point, normal, sun_direction, sky_irradiance);
+  }
+
+ private:
+  const Model& model_;
+};
+
+}  // anonymous namespace
+
+/*
+<p>The HDR images are then converted to final colors with the same tone mapping
+function as in the GPU version:
+*/
+
+Image Scene::ToneMap(const HdrImage& image) const {
+  const double exposure = exposure_();
+  Image pixels(image.width(), image.height());
+  for (unsigned int j = 0; j < image.height(); ++j) {
+    for (unsigned int i = 0; i < image.width(); ++i) {
+      const float* rgb = image.Get(i, j);
+      double r = std::pow(1.0 - std::exp(-rgb[0] * exposure), 1.0 / 2.2);
+      double g = std::pow(1.0 - std::exp(-rgb[1] * exposure), 1.0 / 2.2);
+      double b = std::pow(1.0 - std::exp(-rgb[2] * exposure), 1.0 / 2.2);
+      unsigned int red = static_cast<unsigned int>(r * 255.0);
+      unsigned int green = static_cast<unsigned int>(g * 255.0);
+      unsigned int blue = static_cast<unsigned int>(b * 255.0);
+      pixels.Set(i, j, (255 << 24) | (red << 16) | (green << 8) | blue);
+    }
+  }
+  return pixels;
+}
+
+Image Scene::Render(const Model& model) const {
+  return ToneMap(RenderHdr(model));
+}
+
+HdrImage Scene::RenderHdr(const Model& model) const {
+  return SceneRenderer<Model>(*this, model).Render(*this);
+}
+
+Image Scene::Render(const FastModel& model) const {
+  return ToneMap(SceneRenderer<FastModel>(*this, model).Render(*this));
+}
+
+Image Scene::RenderWithAerialPerspectiveVolume(const Model& model) const {
+  const AerialPerspectiveVolumeModel volume_model(model);
+  return ToneMap(
+      SceneRenderer<AerialPerspectiveVolumeModel>(*this, volume_model)
+          .Render(*this));
+}
+
+}  // namespace reference
+}  // namespace atmosphere
@@ -0,0 +1,170 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/reference/scene.h</h2>
+
+<p>This file provides the test scene of the <a href="model_test.cc.html">model
+tests</a>, and a method to render it on CPU with a <a href="model.h.html">
+<code>Model</code></a>. The scene is a sphere on a purely spherical planet, with
+an Earth like atmosphere, seen from a fixed camera (see
+<a href="model_test.glsl.html">model_test.glsl</a>). It does not depend on
+OpenGL, so that it can also be used in CPU only tools, e.g. to compare images
+rendered with different model parameters (see
+<a href="model_sweep.cc.html">model_sweep.cc</a>). To use it:
+<ul>
+<li>create a <code>Scene</code> with the desired image size, and change its
+ground and sphere albedos if desired (grass and snow by default),</li>
+<li>create and initialize a <code>Model</code> with the atmosphere parameters
+of the scene,</li>
+<li>call <code>SetViewParameters</code> to set the Sun direction and the
+rendering output,</li>
+<li>call <code>Render</code> to render an image with the model.</li>
+</ul>
+
+<p><code>Render</code> is equivalent to <code>RenderHdr</code>, which returns
+the radiance or luminance values before tone mapping, followed by
+<code>ToneMap</code>. The HDR images do not depend on the exposure, and are
+cached by the model tests (see
+<a href="golden_image_cache.h.html">golden_image_cache.h</a>).
+
+<p>The scene can also be rendered with the CPU fast paths of the model, i.e.
+with a <code>FastModel</code>, or with the aerial perspective volume of a
+<code>Model</code> (see <a href="fast_path_test.cc.html">fast_path_test.cc</a>).
+For this, the <code>FastModel</code> or the volume must first be updated with
+the camera (relative to the Earth center), Sun direction and
+<code>view_ray_from_clip</code> matrix of the scene.
+*/
+
+#ifndef ATMOSPHERE_REFERENCE_SCENE_H_
+#define ATMOSPHERE_REFERENCE_SCENE_H_
+
+#include <array>
+
+#include "atmosphere/reference/definitions.h"
+#include "atmosphere/reference/image.h"
+#include "atmosphere/reference/model.h"
+
+namespace atmosphere {
+namespace reference {
+
+// The sphere of the test scene. We use a large sphere so that it can produce
+// visible light shafts, in order to test them.
+constexpr Length kSphereRadius = 1.0 * km;
+constexpr Position kSphereCenter = Position(0.0 * km, 0.0 * km, kSphereRadius);
+
+// The wavelengths at which the radiance is rendered when the luminance output
+// is not used. These are the same as atmosphere::Model::kLambdaR, etc.
+constexpr Wavelength kLambdaR = 680.0 * nm;
+constexpr Wavelength kLambdaG = 550.0 * nm;
+constexpr Wavelength kLambdaB = 440.0 * nm;
+
+class Scene {
+ public:
+  Scene(unsigned int width, unsigned int height);
+
+  unsigned int width() const { return width_; }
+  unsigned int height() const { return height_; }
+
+  const AtmosphereParameters& atmosphere_parameters() const {
+    return atmosphere_parameters_;
+  }
+
+  const DimensionlessSpectrum& ground_albedo() const { return ground_albedo_; }
+  void set_ground_albedo(const DimensionlessSpectrum& albedo) {
+    ground_albedo_ = albedo;
+  }
+
+  const DimensionlessSpectrum& sphere_albedo() const { return sphere_albedo_; }
+  void set_sphere_albedo(const DimensionlessSpectrum& albedo) {
+    sphere_albedo_ = albedo;
+  }
+
+  // Sets the Sun direction, with spherical coordinates in the frame whose z
+  // axis is the zenith, and the rendering output: the sRGB luminance if
+  // 'use_luminance' is true, or the radiance at kLambdaR, kLambdaG and kLambdaB
+  // otherwise (with different exposures in each case).
+  void SetViewParameters(Angle sun_theta, Angle sun_phi, bool use_luminance);
+
+  // The view parameters. 'model_from_clip' is a row major matrix giving the
+  // (unnormalized) view ray direction for the clip space coordinates (x,y,1).
+  const std::array<float, 9>& model_from_clip() const {
+    return model_from_clip_;
+  }
+  // The same matrix, in double precision, as expected by FastModel::Update and
+  // Model::UpdateAerialPerspective.
+  std::array<double, 9> view_ray_from_clip() const;
+  Position camera() const { return camera_; }
+  Number exposure() const { return exposure_; }
+  bool use_luminance() const { return use_luminance_; }
+  Direction sun_direction() const { return sun_direction_; }
+  Position earth_center() const { return earth_center_; }
+  dimensional::vec2 sun_size() const { return sun_size_; }
+
+  // Renders the scene with the given model, initialized with the atmosphere
+  // parameters of this scene, with one thread per hardware thread.
+  Image Render(const Model& model) const;
+
+  // Same as above, but returns the radiance (in W.m^-2.sr^-1.nm^-1) or the
+  // luminance (in cd.m^-2) values, before tone mapping.
+  HdrImage RenderHdr(const Model& model) const;
+
+  // Converts an HDR image of this scene to an 8 bits image, with the exposure
+  // of the current view parameters.
+  Image ToneMap(const HdrImage& image) const;
+
+  // Renders the scene with the given fast model, which must have been updated
+  // with the camera, Sun direction and view_ray_from_clip of this scene.
+  Image Render(const FastModel& model) const;
+
+  // Renders the scene with the given model, using its aerial perspective volume
+  // instead of GetSkyRadianceToPoint (and thus without light shafts). The
+  // volume must have been updated with the camera, Sun direction and
+  // view_ray_from_clip of this scene.
+  Image RenderWithAerialPerspectiveVolume(const Model& model) const;
+
+ private:
+  unsigned int width_;
+  unsigned int height_;
+  AtmosphereParameters atmosphere_parameters_;
+  DimensionlessSpectrum ground_albedo_;
+  DimensionlessSpectrum sphere_albedo_;
+  Position earth_center_;
+  dimensional::vec2 sun_size_;
+
+  std::array<float, 9> model_from_clip_;
+  Position camera_;
+  Number exposure_;
+  bool use_luminance_;
+  Direction sun_direction_;
+};
+
+}  // namespace reference
+}  // namespace atmosphere
+
+#endif  // ATMOSPHERE_REFERENCE_SCENE_H_
@@ -0,0 +1,212 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/trace.cc</h2>
+
+<p>This file implements the tracing library defined in
+<a href="trace.h.html">trace.h</a>. The events are stored in a global vector,
+protected with a spin lock (the events are short and rare enough, compared to
+the work they measure, for the lock to be uncontended most of the time):
+*/
+
+#include "atmosphere/trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace atmosphere {
+namespace trace {
+
+namespace internal {
+std::atomic<bool> enabled(false);
+}  // namespace internal
+
+namespace {
+
+struct Event {
+  std::string category;
+  std::string name;
+  int thread;
+  double begin;
+  double end;
+  const char* arg_name;
+  int arg_value;
+  const char* arg2_name;
+  int arg2_value;
+};
+
+std::atomic_flag events_lock = ATOMIC_FLAG_INIT;
+std::vector<Event> events;
+double start_time = 0.0;
+int start_thread = 0;
+int num_threads = 0;
+std::set<int> free_threads;
+
+class LockGuard {
+ public:
+  LockGuard() {
+    while (events_lock.test_and_set(std::memory_order_acquire)) {}
+  }
+  ~LockGuard() { events_lock.clear(std::memory_order_release); }
+};
+
+// The track ID of a thread. It is released when the thread exits, to be reused
+// by the next new thread (the reference model creates new threads for each
+// precomputation phase, which would otherwise each get a new track).
+class ThreadId {
+ public:
+  ThreadId() {
+    LockGuard lock;
+    if (free_threads.empty()) {
+      id = kGpuThread + 1 + num_threads++;
+    } else {
+      id = *free_threads.begin();
+      free_threads.erase(free_threads.begin());
+    }
+  }
+  ~ThreadId() {
+    LockGuard lock;
+    free_threads.insert(id);
+  }
+
+  int id;
+};
+
+// Writes the given string as a JSON string (the event names and categories
+// are identifiers, so only quotes and backslashes need to be escaped).
+void WriteString(std::ofstream& file, const std::string& value) {
+  file << '"';
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      file << '\\';
+    }
+    file << c;
+  }
+  file << '"';
+}
+
+void WriteThreadName(std::ofstream& file, int thread) {
+  file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+       << thread << ", \"args\": {\"name\": ";
+  if (thread == kGpuThread) {
+    WriteString(file, "GPU");
+  } else if (thread == start_thread) {
+    WriteString(file, "main");
+  } else {
+    WriteString(file, "thread " + std::to_string(thread));
+  }
+  file << "}}";
+}
+
+void WriteEvent(std::ofstream& file, const Event& event) {
+  file << "{\"name\": ";
+  WriteString(file, event.name);
+  file << ", \"cat\": ";
+  WriteString(file, event.category);
+  file << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+       << ", \"ts\": " << event.begin - start_time
+       << ", \"dur\": " << event.end - event.begin;
+  if (event.arg_name != nullptr) {
+    file << ", \"args\": {";
+    WriteString(file, event.arg_name);
+    file << ": " << event.arg_value;
+    if (event.arg2_name != nullptr) {
+      file << ", ";
+      WriteString(file, event.arg2_name);
+      file << ": " << event.arg2_value;
+    }
+    file << "}";
+  }
+  file << "}";
+}
+
+}  // anonymous namespace
+
+void Start() {
+  const int current_thread = CurrentThread();
+  {
+    LockGuard lock;
+    events.clear();
+    start_time = NowMicros();
+    start_thread = current_thread;
+  }
+  internal::enabled.store(true, std::memory_order_relaxed);
+}
+
+bool Stop(const std::string& filename) {
+  internal::enabled.store(false, std::memory_order_relaxed);
+  LockGuard lock;
+  std::ofstream file(filename);
+  file << std::fixed << std::setprecision(3);
+  file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  std::set<int> threads;
+  for (const Event& event : events) {
+    threads.insert(event.thread);
+  }
+  for (int thread : threads) {
+    WriteThreadName(file, thread);
+    file << ",\n";
+  }
+  for (unsigned int i = 0; i < events.size(); ++i) {
+    WriteEvent(file, events[i]);
+    file << (i + 1 < events.size() ? ",\n" : "\n");
+  }
+  file << "]}\n";
+  events.clear();
+  return file.good();
+}
+
+double NowMicros() {
+  std::chrono::duration<double, std::micro> now =
+      std::chrono::steady_clock::now().time_since_epoch();
+  return now.count();
+}
+
+int CurrentThread() {
+  thread_local ThreadId thread;
+  return thread.id;
+}
+
+void AddEvent(const char* category, const std::string& name, int thread,
+    double begin, double end, const char* arg_name, int arg_value,
+    const char* arg2_name, int arg2_value) {
+  if (!IsEnabled()) {
+    return;
+  }
+  LockGuard lock;
+  events.push_back({category, name, thread, begin, end, arg_name, arg_value,
+      arg2_name, arg2_value});
+}
+
+}  // namespace trace
+}  // namespace atmosphere
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2017 Eric Bruneton
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holders nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*<h2>atmosphere/trace.h</h2>
+
+<p>This file provides a minimal tracing library, to record the timeline of the
+precomputations and of the rendering work in the Chrome trace event JSON
+format, which can be viewed with chrome://tracing or
+<a href="https://ui.perfetto.dev">Perfetto</a>. The instrumented code creates a
+<code>Span</code> object for each unit of work (a precomputation phase, a slice
+of a texture computed by one thread, a draw call, etc), which records a
+"complete" event when it is destroyed. Events recorded on the GPU (with timer
+queries) can be added with <code>AddEvent</code> on the <code>kGpuThread</code>
+track.
+
+<p>Tracing is disabled by default, in which case a <code>Span</code> only costs
+a relaxed atomic load. It is enabled between a call to <code>Start</code> and a
+call to <code>Stop</code>, which writes the recorded events to a JSON file.
+*/
+
+#ifndef ATMOSPHERE_TRACE_H_
+#define ATMOSPHERE_TRACE_H_
+
+#include <atomic>
+#include <string>
+
+namespace atmosphere {
+namespace trace {
+
+// The track of the events recorded on the GPU. The CPU threads use the next
+// track IDs, in the order in which they record their first event (the ID of a
+// thread which has exited is reused by the next new thread).
+constexpr int kGpuThread = 0;
+
+namespace internal {
+extern std::atomic<bool> enabled;
+}  // namespace internal
+
+// Returns whether events are currently recorded.
+inline bool IsEnabled() {
+  return internal::enabled.load(std::memory_order_relaxed);
+}
+
+// Discards the previously recorded events, if any, and starts recording new
+// ones.
+void Start();
+
+// Stops recording events, and writes them to the given file. Returns false if
+// the file can't be written.
+bool Stop(const std::string& filename);
+
+// Returns the time elapsed since an arbitrary origin, in microseconds.
+double NowMicros();
+
+// Returns the track ID of the calling thread.
+int CurrentThread();
+
+// Records an event from 'begin' to 'end' (in microseconds, see NowMicros) on
+// the given track, with up to two integer arguments (ignored if their name is
+// null, and otherwise a string literal). Does nothing if tracing is disabled.
+void AddEvent(const char* category, const std::string& name, int thread,
+    double begin, double end, const char* arg_name = nullptr,
+    int arg_value = 0, const char* arg2_name = nullptr, int arg2_value = 0);
+
+// Records an event on the calling thread's track, from its construction to its
+// destruction (if tracing was enabled at construction). The category and name
+// must remain valid until then.
+class Span {
+ public:
+  Span(const char* category, const char* name,
+      const char* arg_name = nullptr, int arg_value = 0,
+      const char* arg2_name = nullptr, int arg2_value = 0)
+      : category_(category), name_(name), arg_name_(arg_name),
+        arg_value_(arg_value), arg2_name_(arg2_name), arg2_value_(arg2_value),
+        begin_(IsEnabled() ? NowMicros() : -1.0) {}
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+  ~Span() {
+    if (begin_ >= 0.0) {
+      AddEvent(category_, name_, CurrentThread(), begin_, NowMicros(),
+          arg_name_, arg_value_, arg2_name_, arg2_value_);
+    }
+  }
+
+ private:
+  const char* category_;
+  const char* name_;
+  const char* arg_name_;
+  int arg_value_;
+  const char* arg2_name_;
+  int arg2_value_;
+  double begin_;
+};
+
+}  // namespace trace
+}  // namespace atmosphere
+
+#endif  // ATMOSPHERE_TRACE_H_